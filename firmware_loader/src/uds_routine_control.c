@@ -7,13 +7,17 @@
 
 #include "iso14229.h"
 
+#include <string.h>
+
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(firmware_loader, CONFIG_APP_LOG_LEVEL);
 
+#include <zephyr/drivers/flash.h>
 #include <zephyr/init.h>
 #include <zephyr/kernel.h>
 #include <zephyr/storage/flash_map.h>
 #include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
 #include <zephyr/sys/reboot.h>
 #include <zephyr/sys/util.h>
 
@@ -56,11 +60,16 @@ static void erase_slot0_work_handler(struct k_work *work) {
   struct uds_memory_erasure_routine_status *status =
       CONTAINER_OF(dwork, struct uds_memory_erasure_routine_status, work);
 
+  int32_t result = UDS_OK;
+
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+  // The download erases the pages it writes, the routine is only kept for
+  // testers that still start it before the download
+  LOG_INF("slot0 is erased during the download, nothing to do");
+#else
   const struct flash_area *fa;
   int rc = flash_area_open(PARTITION_ID(slot0_partition), &fa);
 
-  int32_t result = UDS_OK;
-
   if (rc < 0) {
     LOG_ERR("Failed to open slot0 partition: %d", rc);
     result = UDS_NRC_GeneralProgrammingFailure;
@@ -78,6 +87,7 @@ static void erase_slot0_work_handler(struct k_work *work) {
 
     flash_area_close(fa);
   }
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
 
   k_mutex_lock(status->mutex, K_FOREVER);
   status->result = result;
@@ -180,3 +190,344 @@ UDS_REGISTER_ROUTINE_CONTROL_HANDLER(&uds_default_instance,
                                      erase_memory_routine_check,
                                      erase_memory_routine_action,
                                      &erasure_status);
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+UDSErr_t check_memory_routine_check(const struct uds_context *const context,
+                                    bool *apply_action) {
+  UDSRoutineCtrlArgs_t *args = (UDSRoutineCtrlArgs_t *)context->arg;
+
+  if (args->ctrlType != UDS_ROUTINE_CONTROL__START_ROUTINE) {
+    *apply_action = false;
+    LOG_WRN("Only starting the check memory routine is supported");
+    return UDS_NRC_SubFunctionNotSupported;
+  }
+
+  *apply_action = true;
+  return UDS_OK;
+}
+
+// Reports the digest of the last download, which was computed while it was
+// written: size (4 bytes), CRC-32 (4 bytes) and SHA-256 (32 bytes), big endian
+UDSErr_t check_memory_routine_action(struct uds_context *const context,
+                                     bool *consume_event) {
+  UDSRoutineCtrlArgs_t *args = (UDSRoutineCtrlArgs_t *)context->arg;
+
+  *consume_event = true;
+
+  struct uds_download_digest digest;
+  if (uds_download_get_digest(&digest) != 0) {
+    LOG_WRN("No completed download to check");
+    return UDS_NRC_RequestSequenceError;
+  }
+
+  uint8_t status_record[4 + 4 + sizeof(digest.sha256)];
+  sys_put_be32(digest.size, &status_record[0]);
+  sys_put_be32(digest.crc32, &status_record[4]);
+  memcpy(&status_record[8], digest.sha256, sizeof(digest.sha256));
+
+  LOG_INF("Check memory: %u bytes, CRC-32 0x%08x", digest.size, digest.crc32);
+
+  return args->copyStatusRecord(context->server, status_record,
+                                sizeof(status_record));
+}
+
+UDS_REGISTER_ROUTINE_CONTROL_HANDLER(&uds_default_instance,
+                                     0x0202,
+                                     check_memory_routine_check,
+                                     check_memory_routine_action,
+                                     NULL);
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
+/* Flash memory base address, addresses above it are normalized like the ones
+ * of RequestDownload */
+#define FLASH_BASE_ADDRESS DT_REG_ADDR(DT_CHOSEN(zephyr_flash))
+
+enum sector_hash_routine_state {
+  SECTOR_HASH_STATE__IDLE = 0,
+  SECTOR_HASH_STATE__IN_PROGRESS = 1,
+  SECTOR_HASH_STATE__COMPLETED = 2,
+};
+
+struct sector_hash_routine_status {
+  enum sector_hash_routine_state state;
+  struct k_mutex *mutex;
+  // requested range, as sent by the tester
+  uint32_t address;
+  uint32_t size;
+  // added to the flash offsets to report addresses like the tester sent them
+  uint32_t address_base;
+  int result;
+  // flash offset of the first hashed sector
+  uint32_t sector_offset;
+  uint32_t sector_size;
+  size_t sector_count;
+  uint32_t crc[CONFIG_FIRMWARE_LOADER_SECTOR_HASH_MAX_SECTORS];
+  struct k_work work;
+};
+
+K_MUTEX_DEFINE(sector_hash_routine_mutex);
+
+static void sector_hash_work_handler(struct k_work *work);
+
+static struct sector_hash_routine_status sector_hash_status = {
+  .state = SECTOR_HASH_STATE__IDLE,
+  .mutex = &sector_hash_routine_mutex,
+};
+
+static int sector_hash_routine_init(void) {
+  k_work_init(&sector_hash_status.work, sector_hash_work_handler);
+  return 0;
+}
+
+SYS_INIT(sector_hash_routine_init,
+         APPLICATION,
+         CONFIG_APPLICATION_INIT_PRIORITY);
+
+static int sector_hash_compute(struct sector_hash_routine_status *status,
+                               const struct flash_area *fa) {
+  const struct device *dev = flash_area_get_device(fa);
+  uint32_t offset = status->address - status->address_base;
+  uint32_t end = offset + status->size;
+
+  struct flash_pages_info page;
+  int rc = flash_get_page_info_by_offs(dev, offset, &page);
+  if (rc < 0) {
+    return rc;
+  }
+
+  status->sector_offset = page.start_offset;
+  status->sector_size = page.size;
+  status->sector_count = 0;
+
+  uint8_t buf[256];
+  for (uint32_t sector = page.start_offset;
+       sector < end &&
+       status->sector_count < CONFIG_FIRMWARE_LOADER_SECTOR_HASH_MAX_SECTORS;
+       sector += page.size) {
+    rc = flash_get_page_info_by_offs(dev, sector, &page);
+    if (rc < 0) {
+      return rc;
+    }
+
+    // The status record holds a single sector size, sectors of another size
+    // are left to the next request
+    if (page.size != status->sector_size) {
+      break;
+    }
+
+    uint32_t crc = 0;
+
+    for (uint32_t pos = 0; pos < page.size; pos += sizeof(buf)) {
+      size_t len = MIN(sizeof(buf), page.size - pos);
+
+      rc = flash_read(dev, sector + pos, buf, len);
+      if (rc < 0) {
+        return rc;
+      }
+      crc = crc32_ieee_update(crc, buf, len);
+    }
+
+    status->crc[status->sector_count++] = crc;
+  }
+
+  return 0;
+}
+
+static void sector_hash_work_handler(struct k_work *work) {
+  struct sector_hash_routine_status *status =
+      CONTAINER_OF(work, struct sector_hash_routine_status, work);
+
+  const struct flash_area *fa;
+  int rc = flash_area_open(PARTITION_ID(slot0_partition), &fa);
+
+  if (rc < 0) {
+    LOG_ERR("Failed to open slot0 partition: %d", rc);
+  } else {
+    rc = sector_hash_compute(status, fa);
+    if (rc < 0) {
+      LOG_ERR("Failed to hash the sectors of slot0: %d", rc);
+    }
+
+    flash_area_close(fa);
+  }
+
+  k_mutex_lock(status->mutex, K_FOREVER);
+  status->result = rc;
+  status->state = SECTOR_HASH_STATE__COMPLETED;
+  k_mutex_unlock(status->mutex);
+}
+
+// Checks that the requested range lies within slot0
+static UDSErr_t sector_hash_check_range(uint32_t offset, uint32_t size) {
+  const struct flash_area *fa;
+  int rc = flash_area_open(PARTITION_ID(slot0_partition), &fa);
+
+  if (rc < 0) {
+    LOG_ERR("Failed to open slot0 partition: %d", rc);
+    return UDS_NRC_ConditionsNotCorrect;
+  }
+
+  bool in_slot0 = size > 0 && offset >= fa->fa_off &&
+                  offset - fa->fa_off < fa->fa_size &&
+                  size <= fa->fa_size - (offset - fa->fa_off);
+
+  flash_area_close(fa);
+
+  if (!in_slot0) {
+    LOG_WRN("Sector hash range 0x%08x+0x%x is not within slot0", offset,
+            size);
+    return UDS_NRC_RequestOutOfRange;
+  }
+
+  return UDS_OK;
+}
+
+UDSErr_t sector_hash_routine_check(const struct uds_context *const context,
+                                   bool *apply_action) {
+  UDSRoutineCtrlArgs_t *args = (UDSRoutineCtrlArgs_t *)context->arg;
+
+  if (args->ctrlType != UDS_ROUTINE_CONTROL__START_ROUTINE) {
+    *apply_action = false;
+    LOG_WRN("Only starting the sector hash routine is supported");
+    return UDS_NRC_SubFunctionNotSupported;
+  }
+
+  // address (4 bytes) and size (4 bytes) of the range to hash
+  if (args->len != 8) {
+    *apply_action = false;
+    return UDS_NRC_IncorrectMessageLengthOrInvalidFormat;
+  }
+
+  *apply_action = true;
+  return UDS_OK;
+}
+
+// Hashes the sectors of a range of slot0, so a tester only has to download
+// the sectors that changed. The option record holds the address and size of
+// the range (4 bytes each). The hashes are computed in the background while
+// the request is answered with ResponsePending. The status record holds the
+// address (4 bytes) and size (4 bytes) of the first sector, followed by the
+// CRC-32 (4 bytes) of each sector. At most
+// CONFIG_FIRMWARE_LOADER_SECTOR_HASH_MAX_SECTORS sectors of the same size are
+// reported, the tester requests the rest of the range again. All values are
+// big endian.
+UDSErr_t sector_hash_routine_action(struct uds_context *const context,
+                                    bool *consume_event) {
+  UDSRoutineCtrlArgs_t *args = (UDSRoutineCtrlArgs_t *)context->arg;
+
+  struct sector_hash_routine_status *status =
+      (struct sector_hash_routine_status *)
+          context->registration->routine_control.user_context;
+
+  *consume_event = true;
+
+  uint32_t address = sys_get_be32(&args->optionRecord[0]);
+  uint32_t size = sys_get_be32(&args->optionRecord[4]);
+
+  k_mutex_lock(status->mutex, K_FOREVER);
+
+  bool same_range = status->address == address && status->size == size;
+
+  if (status->state == SECTOR_HASH_STATE__IN_PROGRESS) {
+    k_mutex_unlock(status->mutex);
+    // The request is repeated by the server until the hashes are ready
+    return same_range ? UDS_NRC_RequestCorrectlyReceived_ResponsePending
+                      : UDS_NRC_BusyRepeatRequest;
+  }
+
+  if (status->state == SECTOR_HASH_STATE__COMPLETED && same_range) {
+    status->state = SECTOR_HASH_STATE__IDLE;
+    k_mutex_unlock(status->mutex);
+
+    if (status->result < 0) {
+      return UDS_NRC_GeneralProgrammingFailure;
+    }
+
+    static uint8_t status_record[8 + sizeof(sector_hash_status.crc)];
+    sys_put_be32(status->sector_offset + status->address_base,
+                 &status_record[0]);
+    sys_put_be32(status->sector_size, &status_record[4]);
+    for (size_t i = 0; i < status->sector_count; i++) {
+      sys_put_be32(status->crc[i], &status_record[8 + 4 * i]);
+    }
+
+    LOG_INF("Sector hashes: %zu sectors of %u bytes from 0x%08x",
+            status->sector_count, status->sector_size,
+            status->sector_offset + status->address_base);
+
+    return args->copyStatusRecord(context->server, status_record,
+                                  8 + 4 * status->sector_count);
+  }
+
+  uint32_t address_base = address > FLASH_BASE_ADDRESS ? FLASH_BASE_ADDRESS : 0;
+
+  UDSErr_t ret = sector_hash_check_range(address - address_base, size);
+  if (ret != UDS_OK) {
+    k_mutex_unlock(status->mutex);
+    return ret;
+  }
+
+  status->address = address;
+  status->size = size;
+  status->address_base = address_base;
+  status->state = SECTOR_HASH_STATE__IN_PROGRESS;
+  k_mutex_unlock(status->mutex);
+
+  k_work_submit(&status->work);
+
+  LOG_INF("Sector hash routine started");
+  return UDS_NRC_RequestCorrectlyReceived_ResponsePending;
+}
+
+UDS_REGISTER_ROUTINE_CONTROL_HANDLER(&uds_default_instance,
+                                     0x0203,
+                                     sector_hash_routine_check,
+                                     sector_hash_routine_action,
+                                     &sector_hash_status);
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+UDSErr_t resume_point_routine_check(const struct uds_context *const context,
+                                    bool *apply_action) {
+  UDSRoutineCtrlArgs_t *args = (UDSRoutineCtrlArgs_t *)context->arg;
+
+  if (args->ctrlType != UDS_ROUTINE_CONTROL__START_ROUTINE) {
+    *apply_action = false;
+    LOG_WRN("Only starting the resume point routine is supported");
+    return UDS_NRC_SubFunctionNotSupported;
+  }
+
+  *apply_action = true;
+  return UDS_OK;
+}
+
+// Reports where an interrupted download can be continued: address (4 bytes)
+// and remaining size (4 bytes), big endian
+UDSErr_t resume_point_routine_action(struct uds_context *const context,
+                                     bool *consume_event) {
+  UDSRoutineCtrlArgs_t *args = (UDSRoutineCtrlArgs_t *)context->arg;
+
+  *consume_event = true;
+
+  struct uds_download_resume_point resume_point;
+  if (uds_download_get_resume_point(&resume_point) != 0) {
+    LOG_WRN("No interrupted download to resume");
+    return UDS_NRC_RequestSequenceError;
+  }
+
+  uint8_t status_record[8];
+  sys_put_be32(resume_point.address, &status_record[0]);
+  sys_put_be32(resume_point.size, &status_record[4]);
+
+  LOG_INF("Download can be resumed at 0x%08x, %u bytes left",
+          resume_point.address, resume_point.size);
+
+  return args->copyStatusRecord(context->server, status_record,
+                                sizeof(status_record));
+}
+
+UDS_REGISTER_ROUTINE_CONTROL_HANDLER(&uds_default_instance,
+                                     0x0204,
+                                     resume_point_routine_check,
+                                     resume_point_routine_action,
+                                     NULL);
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ARDEP_INCLUDE_CAN_DEMUX_H_
+#define ARDEP_INCLUDE_CAN_DEMUX_H_
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+
+#ifdef CONFIG_CAN_DEMUX
+
+/**
+ * @brief Add an RX filter through the CAN demultiplexer
+ *
+ * Works like can_add_rx_filter(), but the filters of a device are merged
+ * into at most CONFIG_CAN_DEMUX_MAX_HW_FILTERS hardware filters. Received
+ * frames are dispatched in software to the callbacks whose filter matches.
+ *
+ * @note Must be called from a thread, not from an RX callback
+ *
+ * @param dev CAN device
+ * @param callback Callback for matching frames
+ * @param user_data User data passed to @p callback
+ * @param filter Filter the frames have to match
+ *
+ * @returns Filter id (>= 0) on success
+ * @returns -ENOSPC if no more filters can be added
+ * @returns Negative error code if a hardware filter could not be added
+ */
+int can_demux_add_rx_filter(const struct device *dev,
+                            can_rx_callback_t callback,
+                            void *user_data,
+                            const struct can_filter *filter);
+
+/**
+ * @brief Remove an RX filter added with can_demux_add_rx_filter()
+ *
+ * The callback is not called anymore once this returns.
+ *
+ * @note Must be called from a thread, not from an RX callback
+ *
+ * @param dev CAN device
+ * @param filter_id Filter id returned by can_demux_add_rx_filter()
+ */
+void can_demux_remove_rx_filter(const struct device *dev, int filter_id);
+
+#else
+
+static inline int can_demux_add_rx_filter(const struct device *dev,
+                                          can_rx_callback_t callback,
+                                          void *user_data,
+                                          const struct can_filter *filter) {
+  return can_add_rx_filter(dev, callback, user_data, filter);
+}
+
+static inline void can_demux_remove_rx_filter(const struct device *dev,
+                                              int filter_id) {
+  can_remove_rx_filter(dev, filter_id);
+}
+
+#endif  // CONFIG_CAN_DEMUX
+
+#endif  // ARDEP_INCLUDE_CAN_DEMUX_H_
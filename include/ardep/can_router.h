@@ -11,10 +11,65 @@
 #include <zephyr/device.h>
 #include <zephyr/drivers/can.h>
 
+/**
+ * @brief Rewrite of the CAN ID of routed frames
+ *
+ * The bits of the ID in mask are replaced by the ones of value, then offset
+ * is added. The result is truncated to a standard or extended ID.
+ */
+struct can_router_id_rewrite {
+  uint32_t mask;
+  uint32_t value;
+  int32_t offset;
+};
+
+/**
+ * @brief Transform of a payload byte of routed frames
+ *
+ * The byte at index becomes (byte & and_mask) ^ xor_mask. Bytes beyond the
+ * length of a frame are left out.
+ */
+struct can_router_byte_transform {
+  uint8_t index;
+  uint8_t and_mask;
+  uint8_t xor_mask;
+};
+
+/**
+ * @brief Token bucket limiting the rate of routed frames
+ *
+ * A token is added every interval_us up to burst tokens, each routed frame
+ * takes one. A burst of 0 or 1 enforces a minimum interval between frames.
+ * An interval of 0 disables the limit.
+ *
+ * The time is taken from the 64-bit cycle counter if there is one, otherwise
+ * from the system tick. Without the cycle counter, intervals shorter than a
+ * tick need a burst of at least a tick's worth of tokens.
+ */
+struct can_router_rate_limit {
+  uint32_t interval_us;
+  uint16_t burst;
+};
+
+/**
+ * @brief Actions applied to the frames of a route, in the RX path
+ */
+struct can_router_action_t {
+  struct can_router_id_rewrite id_rewrite;
+  const struct can_router_byte_transform *transforms;
+  uint8_t transform_count;
+  struct can_router_rate_limit rate_limit;
+  /** @brief Further destinations, on top of the route's destination */
+  const struct device **const *fan_out;
+  uint8_t fan_out_count;
+};
+
 struct can_router_entry_t {
   const struct device **from;
   const struct device **to;
-  const struct can_filter filter;
+  struct can_filter filter;
+  /** @brief Optional actions, frames are routed unchanged without them */
+  const struct can_router_action_t *action;
 };
 
 struct can_router_table_t {
@@ -22,9 +77,126 @@ struct can_router_table_t {
   int entry_count;
 };
 
+/**
+ * @brief Add entries to the active routing table
+ *
+ * @param entries Entries to route, must stay valid while they are installed
+ * @param entry_count Number of entries
+ *
+ * @returns 0 on success
+ * @returns -EINVAL, -ENODEV or -ENOMEM if the entries are not valid
+ * @returns Negative error code if a hardware filter could not be added
+ */
 int can_router_register(const struct can_router_entry_t *entries,
                         int entry_count);
 
+/**
+ * @brief Check if entries can replace the active routing table
+ *
+ * @param entries Entries to route
+ * @param entry_count Number of entries
+ *
+ * @returns 0 if the entries are valid
+ * @returns -EINVAL if an entry is malformed
+ * @returns -ENODEV if a device of an entry is not ready
+ * @returns -ENOMEM if the entries exceed the configured limits
+ */
+int can_router_validate(const struct can_router_entry_t *entries,
+                        int entry_count);
+
+/**
+ * @brief Replace the active routing table
+ *
+ * The entries are validated and their filters are installed next to the
+ * active table, which is then swapped out at once. Each received frame is
+ * routed either by the old or the new table, never by both or a mix of them.
+ * The call waits until no frame is routed by the old table anymore, so its
+ * entries can be released once it returns. This also replaces the entries
+ * registered with CAN_ROUTER_REGISTER().
+ *
+ * @note Must be called from a thread
+ *
+ * @param entries Entries to route, must stay valid until they are replaced
+ * @param entry_count Number of entries, 0 removes all routes
+ *
+ * @returns 0 on success
+ * @returns -EINVAL, -ENODEV or -ENOMEM if the entries are not valid
+ * @returns Negative error code if a hardware filter could not be added, the
+ *          active table is kept then
+ */
+int can_router_replace(const struct can_router_entry_t *entries,
+                       int entry_count);
+
+/**
+ * @brief Statistics of the transmit queue of a destination
+ */
+struct can_router_stats {
+  /** @brief Number of frames sent to the destination */
+  uint32_t sent;
+  /** @brief Number of frames dropped because the queue was full */
+  uint32_t dropped;
+  /** @brief Number of frames the CAN driver failed to send */
+  uint32_t errors;
+  /** @brief Highest number of frames that were queued at once */
+  uint32_t high_water;
+  /** @brief Average time from routing a frame until it was sent */
+  uint32_t latency_avg_us;
+  /** @brief Longest time from routing a frame until it was sent */
+  uint32_t latency_max_us;
+};
+
+/**
+ * @brief Get the statistics of the transmit queue of a destination
+ *
+ * @param to Destination CAN device
+ * @param stats Statistics of the destination
+ *
+ * @returns 0 on success
+ * @returns -ENOENT if no frames are routed to the device
+ */
+int can_router_get_stats(const struct device *to,
+                         struct can_router_stats *stats);
+
+/**
+ * @brief Statistics of a route
+ */
+struct can_router_route_stats {
+  /** @brief Number of frames that matched the filter of the route */
+  uint32_t matched;
+  /** @brief Number of frames passed on to the destinations */
+  uint32_t routed;
+  /** @brief Number of frames whose ID or payload was changed */
+  uint32_t translated;
+  /** @brief Number of frames dropped by the rate limit */
+  uint32_t throttled;
+};
+
+/**
+ * @brief Get the statistics of a route of the active routing table
+ *
+ * Routes are numbered in the order their entries were registered, starting
+ * at 0. After can_router_replace(), or writing the table over UDS, the index
+ * of a route is the index of its entry.
+ *
+ * @param index Index of the route
+ * @param stats Statistics of the route
+ *
+ * @returns 0 on success
+ * @returns -ENOENT if there is no route with the index
+ */
+int can_router_get_route_stats(int index,
+                               struct can_router_route_stats *stats);
+
+/**
+ * @brief Data identifier of the routing table written over UDS
+ *
+ * Requires CONFIG_CAN_ROUTER_UDS. Each route is a record of 11 bytes:
+ * source bus, destination bus, filter flags, filter ID (4 bytes) and filter
+ * mask (4 bytes), multi-byte values in big endian. Buses are the indices of
+ * the `can-router-bus<N>` devicetree aliases.
+ */
+#define CAN_ROUTER_UDS_ROUTE_TABLE_DATA_ID 0xFD10
+
 #define CAN_ROUTER_REGISTER(entry_array)                       \
   const STRUCT_SECTION_ITERABLE(can_router_table_t,            \
                                 router_table##__COUNTER__) = { \
@@ -0,0 +1,157 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ARDEP_INCLUDE_CAN_STATS_H_
+#define ARDEP_INCLUDE_CAN_STATS_H_
+
+#include <stdint.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/sys/util.h>
+
+/**
+ * @brief Statistics of a monitored CAN bus
+ */
+struct can_stats_bus {
+  /** @brief Number of received frames */
+  uint32_t rx_frames;
+  /** @brief Number of sent frames */
+  uint32_t tx_frames;
+  /** @brief Bus load of the last window in permille */
+  uint16_t load_permille;
+  /** @brief Highest bus load of a window in permille */
+  uint16_t load_peak_permille;
+  /** @brief Frames of IDs that did not fit into the ID table */
+  uint32_t untracked_frames;
+  /** @brief State of the CAN controller at the end of the last window */
+  enum can_state state;
+  /** @brief Transmit error counter at the end of the last window */
+  uint8_t tx_err_cnt;
+  /** @brief Receive error counter at the end of the last window */
+  uint8_t rx_err_cnt;
+  /** @brief Change of the transmit error counter over the last window */
+  int16_t tx_err_trend;
+  /** @brief Change of the receive error counter over the last window */
+  int16_t rx_err_trend;
+  /** @brief Number of times the controller became error passive */
+  uint32_t error_passive_count;
+  /** @brief Number of times the controller went bus off */
+  uint32_t bus_off_count;
+};
+
+/**
+ * @brief Statistics of a CAN ID on a monitored bus
+ */
+struct can_stats_id {
+  uint32_t id;
+  bool extended;
+  uint32_t rx_count;
+  uint32_t tx_count;
+  /** @brief Moving average of the time between two frames */
+  uint32_t interval_avg_us;
+  uint32_t interval_min_us;
+  uint32_t interval_max_us;
+  /** @brief Moving average of the deviation from the average interval */
+  uint32_t jitter_us;
+};
+
+typedef void (*can_stats_id_cb_t)(const struct can_stats_id *stats,
+                                  void *user_data);
+
+#ifdef CONFIG_CAN_STATS
+
+/**
+ * @brief Start monitoring a CAN bus
+ *
+ * Adds RX filters for all frames through the CAN demultiplexer. The bus load
+ * is estimated from the frame lengths including the worst case number of
+ * stuff bits. Calling it again for a monitored bus updates the bitrates, e.g.
+ * after a link control.
+ *
+ * @param dev CAN device
+ * @param bitrate Nominal bitrate in bit/s
+ * @param bitrate_data Data phase bitrate of CAN FD frames in bit/s, 0 if the
+ *                     bus only uses the nominal bitrate
+ *
+ * @returns 0 on success
+ * @returns -EINVAL if the bitrate is 0
+ * @returns -ENOSPC if CONFIG_CAN_STATS_MAX_DEVICES buses are monitored
+ * @returns Negative error code if the RX filters could not be added
+ */
+int can_stats_enable(const struct device *dev,
+                     uint32_t bitrate,
+                     uint32_t bitrate_data);
+
+/**
+ * @brief Count a frame sent on a monitored bus
+ *
+ * Called by the ARDEP libraries for each frame they hand to the CAN driver,
+ * does nothing if the bus is not monitored.
+ */
+void can_stats_record_tx(const struct device *dev,
+                         const struct can_frame *frame);
+
+/**
+ * @brief Get the statistics of a monitored bus
+ *
+ * @returns 0 on success
+ * @returns -ENOENT if the bus is not monitored
+ */
+int can_stats_get_bus(const struct device *dev, struct can_stats_bus *stats);
+
+/**
+ * @brief Call @p cb with the statistics of each CAN ID seen on a bus
+ *
+ * @returns 0 on success
+ * @returns -ENOENT if the bus is not monitored
+ */
+int can_stats_foreach_id(const struct device *dev,
+                         can_stats_id_cb_t cb,
+                         void *user_data);
+
+/**
+ * @brief Clear the statistics of a monitored bus
+ *
+ * @returns 0 on success
+ * @returns -ENOENT if the bus is not monitored
+ */
+int can_stats_reset(const struct device *dev);
+
+/**
+ * @brief Get the bus monitored first
+ *
+ * @returns The CAN device, NULL if no bus is monitored
+ */
+const struct device *can_stats_default_device(void);
+
+/**
+ * @brief Data identifier of the bus statistics read over UDS
+ *
+ * Requires CONFIG_CAN_STATS_UDS, reports the bus monitored first. The record
+ * starts with the load, peak load (2 bytes each, permille), received and
+ * sent frames, untracked frames (4 bytes each), state, transmit and receive
+ * error counter (1 byte each), their trends (2 bytes each, signed), the
+ * error passive and bus off counts (4 bytes each) and the number of CAN IDs
+ * (1 byte). For each of the CAN IDs with the most frames follow the ID (4
+ * bytes, bit 31 set for extended IDs), received and sent frames, average
+ * interval and jitter in microseconds (4 bytes each). Multi-byte values are
+ * in big endian.
+ */
+#define CAN_STATS_UDS_DATA_ID 0xFD11
+
+#else
+
+static inline void can_stats_record_tx(const struct device *dev,
+                                       const struct can_frame *frame) {
+  ARG_UNUSED(dev);
+  ARG_UNUSED(frame);
+}
+
+#endif  // CONFIG_CAN_STATS
+
+#endif  // ARDEP_INCLUDE_CAN_STATS_H_
@@ -30,6 +30,156 @@ typedef UDSErr_t (*uds_callback)(struct iso14229_zephyr_instance* inst,
                                  void* arg,
                                  void* user_context);
 
+/**
+ * @brief Callback for requests that are handled outside of the UDS server
+ *
+ * Called from the event loop with every complete request received by the
+ * transport, before it is passed to the server. Used for services the
+ * iso14229 library does not implement. Responses are sent with
+ * @ref iso14229_zephyr_send_response().
+ *
+ * @param inst Pointer to the iso-14229 instance the request was received on
+ * @param data Request, starting with the service identifier
+ * @param len Length of the request in bytes, at least 1
+ * @param functional true if the request was received on the functional
+ *                   address
+ * @returns true if the request was handled and must not reach the server
+ */
+typedef bool (*iso14229_request_hook)(struct iso14229_zephyr_instance* inst,
+                                      const uint8_t* data,
+                                      uint16_t len,
+                                      bool functional);
+
+/**
+ * @brief Transport between the UDS server and ISO-TP that passes received
+ *        requests to the request hook of the instance
+ */
+struct iso14229_zephyr_request_tp {
+  /**
+   * @brief Transport handle passed to the UDS server
+   */
+  UDSTp_t hdl;
+  /**
+   * @brief ISO-TP transport the requests are received on
+   */
+  UDSTp_t* inner;
+};
+
+/**
+ * @brief Transmit queue of an ISO-14229 instance
+ *
+ * Frames are handed to the CAN driver one at a time in order. The next frame
+ * is submitted from the transmit completion callback.
+ */
+struct iso14229_zephyr_tx {
+  /**
+   * @brief CAN device the frames are sent on
+   */
+  const struct device* can_dev;
+
+  struct k_spinlock lock;
+  struct can_frame frames[CONFIG_ISO14229_TX_QUEUE_SIZE];
+  uint16_t tail;
+  uint16_t count;
+  bool in_flight;
+  bool kicking;
+  bool space_wanted;
+
+  /**
+   * @brief Number of frames rejected because the queue was full
+   */
+  uint32_t overflows;
+  /**
+   * @brief Number of frames the CAN driver failed to send
+   */
+  uint32_t errors;
+};
+
+/**
+ * @brief Receive ring of an ISO-14229 instance
+ *
+ * Single producer, single consumer ring of CAN frames. The CAN RX callback
+ * copies received frames directly into a free slot, the event loop processes
+ * them in place and releases the slot afterwards. Neither side takes a lock.
+ */
+struct iso14229_zephyr_rx_ring {
+  struct iso14229_zephyr_instance* inst;
+  struct can_frame* slots;
+  /**
+   * @brief Number of slots, one more than the capacity of the ring
+   */
+  uint16_t num_slots;
+  /**
+   * @brief Next slot to fill, only written by the producer
+   */
+  atomic_t head;
+  /**
+   * @brief Next slot to process, only written by the consumer
+   */
+  atomic_t tail;
+
+  /**
+   * @brief Highest number of frames that were buffered at the same time
+   */
+  uint16_t high_water;
+  /**
+   * @brief Number of frames dropped because the ring was full
+   */
+  uint32_t dropped;
+};
+
+#ifdef CONFIG_ISO14229_CAN_FD
+/**
+ * @brief Receive state of one ISO-TP over CAN FD link
+ */
+struct iso14229_zephyr_isotp_fd_rx {
+  uint8_t* buf;
+  uint32_t buf_size;
+  uint32_t size;
+  uint32_t offset;
+  uint32_t timer_cr;
+  uint8_t status;
+  uint8_t sn;
+  uint8_t bs_remain;
+};
+
+/**
+ * @brief ISO-TP transport over CAN FD (ISO 15765-2:2016)
+ *
+ * Replaces the classic CAN isotp-c transport of the iso14229 library when
+ * CONFIG_ISO14229_CAN_FD is enabled.
+ */
+struct iso14229_zephyr_isotp_fd {
+  /**
+   * @brief Transport handle passed to the UDS server
+   */
+  UDSTp_t hdl;
+  struct iso14229_zephyr_tx* tx;
+
+  UDSSDU_t phys_info;
+  UDSSDU_t func_info;
+  uint32_t phys_tx_id;
+  uint32_t func_tx_id;
+
+  struct iso14229_zephyr_isotp_fd_rx phys_rx;
+  struct iso14229_zephyr_isotp_fd_rx func_rx;
+
+  uint32_t send_size;
+  uint32_t send_offset;
+  uint32_t send_st_min_us;
+  uint32_t send_timer_st;
+  uint32_t send_timer_bs;
+  uint16_t send_bs_remain;
+  uint8_t send_status;
+  uint8_t send_sn;
+  bool send_wait_fc;
+
+  uint8_t phys_rx_buf[CONFIG_ISO14229_CAN_FD_MTU];
+  uint8_t func_rx_buf[CAN_MAX_DLEN];
+  uint8_t send_buf[CONFIG_ISO14229_CAN_FD_MTU];
+};
+#endif  // CONFIG_ISO14229_CAN_FD
+
 /**
  * @brief A Zephyr-specific ISO-14229 instance
  */
@@ -42,25 +192,89 @@ struct iso14229_zephyr_instance {
    * @brief Underlying isotp instance
    */
   UDSISOTpC_t tp;
+  /**
+   * @brief Queue for outgoing CAN frames
+   */
+  struct iso14229_zephyr_tx tx;
+#ifdef CONFIG_ISO14229_CAN_FD
+  /**
+   * @brief CAN FD transport, used instead of @ref tp for sending and
+   *        receiving. @ref tp still holds the addresses.
+   */
+  struct iso14229_zephyr_isotp_fd tp_fd;
+#endif  // CONFIG_ISO14229_CAN_FD
 
-  struct k_msgq can_phys_msgq;
-  struct k_msgq can_func_msgq;
+  /**
+   * @brief Frames received on the physical address
+   */
+  struct iso14229_zephyr_rx_ring can_phys_rx;
+  /**
+   * @brief Frames received on the functional address
+   */
+  struct iso14229_zephyr_rx_ring can_func_rx;
 
-  char can_phys_buffer[sizeof(struct can_frame) * 25];
-  char can_func_buffer[sizeof(struct can_frame) * 25];
+  struct can_frame can_phys_slots[CONFIG_ISO14229_PHYS_RX_RING_SIZE + 1];
+  struct can_frame can_func_slots[CONFIG_ISO14229_FUNC_RX_RING_SIZE + 1];
 
   struct k_mutex event_callback_mutex;
   uds_callback event_callback;
 
+  /**
+   * @brief Optional hook for requests the server does not handle, set before
+   *        the thread is started
+   */
+  iso14229_request_hook request_hook;
+  struct iso14229_zephyr_request_tp request_tp;
+
   void* user_context;
 
 #ifdef CONFIG_ISO14229_THREAD
+  bool thread_running;
+  struct k_mutex thread_mutex;
+  /**
+   * @brief Number of times the thread woke up to run the event loop
+   */
+  atomic_t thread_wakeups;
+#ifdef CONFIG_ISO14229_EXECUTOR
+  /**
+   * @brief Node in the list of instances served by the executor
+   */
+  sys_snode_t executor_node;
+  /**
+   * @brief Set when the instance was woken up and has to be run
+   */
+  atomic_t executor_pending;
+  /**
+   * @brief Time (as returned by isotp_user_get_us()) the instance has to be
+   *        run again at the latest
+   */
+  uint32_t executor_deadline_us;
+  /**
+   * @brief Set while an executor thread runs the instance
+   */
+  bool executor_busy;
+  /**
+   * @brief Set while the instance is removed from the executor and waits
+   *        for executor_idle
+   */
+  bool executor_stopping;
+  /**
+   * @brief Given by the executor thread that ran a stopping instance last
+   */
+  struct k_sem executor_idle;
+#else
   k_tid_t thread_id;
   struct k_thread thread_data;
   K_KERNEL_STACK_MEMBER(thread_stack, CONFIG_ISO14229_THREAD_STACK_SIZE);
-  bool thread_running;
   atomic_t thread_stop_requested;
-  struct k_mutex thread_mutex;
+#ifdef CONFIG_ISO14229_THREAD_WAIT_EVENT
+  /**
+   * @brief Signal used to wake the thread, raised on CAN reception, transmit
+   *        queue space and stop requests
+   */
+  struct k_poll_signal thread_signal;
+#endif  // CONFIG_ISO14229_THREAD_WAIT_EVENT
+#endif  // CONFIG_ISO14229_EXECUTOR
 #endif  // CONFIG_ISO14229_THREAD
 
   /**
@@ -81,6 +295,9 @@ struct iso14229_zephyr_instance {
 #ifdef CONFIG_ISO14229_THREAD
   /**
    * @brief Start the UDS server thread
+   *
+   * With CONFIG_ISO14229_EXECUTOR, the instance is handed to the shared
+   * executor instead.
    */
   int (*thread_start)(struct iso14229_zephyr_instance* inst);
   /**
@@ -107,6 +324,36 @@ int iso14229_zephyr_init(struct iso14229_zephyr_instance* inst,
                          const struct device* can_dev,
                          void* user_context);
 
+/**
+ * @brief Queue a CAN frame for transmission without blocking
+ *
+ * @param tx Transmit queue of the instance
+ * @param frame Frame to send, copied into the queue
+ *
+ * @returns 0 on success
+ * @returns -ENOBUFS if the queue is full
+ */
+int iso14229_zephyr_tx_enqueue(struct iso14229_zephyr_tx* tx,
+                               const struct can_frame* frame);
+
+/**
+ * @brief Send a response to the physical target address
+ *
+ * Used to answer requests handled by a @ref iso14229_request_hook. The
+ * message is sent through ISO-TP and may span several frames, so only call
+ * this from the request hook while the transport is idle.
+ *
+ * @param inst Pointer to the iso-14229 instance
+ * @param data Message to send
+ * @param len Length of the message
+ *
+ * @returns 0 on success
+ * @returns -EIO if the transport did not accept the message
+ */
+int iso14229_zephyr_send_response(struct iso14229_zephyr_instance* inst,
+                                  const uint8_t* data,
+                                  uint16_t len);
+
 /**
  * @brief Inject a received CAN frame into the UDS server instance. Overwrites
  * the frame ID with the actual source address of the instance, either physical
@@ -13,6 +13,9 @@
 
 #include <wchar.h>
 
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/dlist.h>
 #include <zephyr/sys/slist.h>
 
 struct uds_instance_t;
@@ -124,6 +127,30 @@ enum uds_link_control_modifier {
   UDS_LINK_CONTROL_MODIFIER__PROGRAMMING_SETUP = 0x20,
 };
 
+enum uds_periodic_transmission_mode {
+  UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_SLOW_RATE = 0x01,
+  UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_MEDIUM_RATE = 0x02,
+  UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_FAST_RATE = 0x03,
+  UDS_PERIODIC_TRANSMISSION_MODE__STOP_SENDING = 0x04,
+};
+
+enum uds_response_on_event_type {
+  UDS_RESPONSE_ON_EVENT_TYPE__STOP = 0x00,
+  UDS_RESPONSE_ON_EVENT_TYPE__ON_DTC_STATUS_CHANGE = 0x01,
+  UDS_RESPONSE_ON_EVENT_TYPE__ON_CHANGE_OF_DATA_IDENTIFIER = 0x03,
+  UDS_RESPONSE_ON_EVENT_TYPE__REPORT_ACTIVATED_EVENTS = 0x04,
+  UDS_RESPONSE_ON_EVENT_TYPE__START = 0x05,
+  UDS_RESPONSE_ON_EVENT_TYPE__CLEAR = 0x06,
+  UDS_RESPONSE_ON_EVENT_TYPE__ON_COMPARISON_OF_VALUES = 0x07,
+};
+
+enum uds_response_on_event_window {
+  UDS_RESPONSE_ON_EVENT_WINDOW__INFINITE = 0x02,
+  UDS_RESPONSE_ON_EVENT_WINDOW__SHORT = 0x03,
+  UDS_RESPONSE_ON_EVENT_WINDOW__MEDIUM = 0x04,
+  UDS_RESPONSE_ON_EVENT_WINDOW__LONG = 0x05,
+};
+
 /**
  * @brief Get the baudrate associated with the `enum uds_link_control_modifier`
  * entry
@@ -225,8 +252,215 @@ struct uds_actor {
   uds_action_fn action;
 };
 
+/**
+ * @brief Response cache of a data identifier
+ *
+ * Define with UDS_DATA_IDENTIFIER_CACHE_DEFINE() and register the data
+ * identifier with UDS_REGISTER_CACHED_DATA_BY_IDENTIFIER_HANDLER(). The bytes
+ * copied by the read action are served to later reads without running the
+ * action again until they are older than @ref max_age_ms or the data
+ * identifier is written or I/O controlled.
+ *
+ * @note Only used with CONFIG_UDS_DATA_IDENTIFIER_CACHE
+ */
+struct uds_data_identifier_cache {
+  /**
+   * @brief Two buffers of @ref size bytes, one is served while the other one
+   * is filled
+   */
+  uint8_t *buffers[2];
+  /**
+   * @brief Maximum number of bytes the read action copies
+   */
+  uint16_t size;
+  /**
+   * @brief Maximum age of the cached bytes, 0 to keep them until invalidated
+   */
+  uint32_t max_age_ms;
+  /**
+   * @brief Interval to refresh the cached bytes on the system work queue
+   * while the data identifier is read, 0 to refresh on demand only
+   */
+  uint32_t refresh_ms;
+
+  // Internal state
+  struct k_spinlock lock;
+  uint8_t active;
+  uint16_t len;
+  bool valid;
+  uint32_t generation;
+  int64_t updated_at;
+  atomic_t read_since_refresh;
+  atomic_t refresh_running;
+  bool refresh_ready;
+  struct uds_instance_t *instance;
+  struct uds_registration_t *registration;
+  struct k_work_delayable refresh_work;
+};
+
+/**
+ * @brief Drop the cached bytes of a data identifier
+ *
+ * The next read runs the read action again. Writes and I/O control of the
+ * data identifier invalidate the cache automatically, call this when the
+ * data changes otherwise.
+ *
+ * @param cache Cache to invalidate
+ */
+void uds_data_identifier_cache_invalidate(
+    struct uds_data_identifier_cache *cache);
+
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+
+/**
+ * @brief A data identifier scheduled by ReadDataByPeriodicIdentifier (0x2A)
+ */
+struct uds_periodic_data_id {
+  /**
+   * @brief Periodic data identifier, the low byte of 0xF2XX
+   */
+  uint8_t periodic_id;
+  /**
+   * @brief Transmission period, 0 if the slot is unused
+   */
+  uint32_t period_ms;
+  /**
+   * @brief Uptime the next message is due at. Advanced by the period, so
+   *        messages do not drift.
+   */
+  int64_t due_ms;
+};
+
+/**
+ * @brief Scheduler for ReadDataByPeriodicIdentifier (0x2A)
+ *
+ * Protected by the event callback mutex of the iso14229 instance.
+ */
+struct uds_periodic_scheduler {
+  /**
+   * @brief CAN ID the periodic messages are sent on
+   */
+  uint32_t can_id;
+  struct uds_periodic_data_id data_ids[CONFIG_UDS_PERIODIC_DATA_IDS_MAX];
+  struct k_work_delayable work;
+  /**
+   * @brief Number of messages that were skipped because the scheduler ran
+   *        late by more than a period
+   */
+  uint32_t overruns;
+
+  // Data of the message being read, the periodic data identifier takes the
+  // first of the 8 bytes of the frame
+  uint8_t read_buf[7];
+  uint8_t read_len;
+  bool read_overflow;
+};
+
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
+
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+
+/**
+ * @brief Longest eventTypeRecord, the one of onComparisonOfValues
+ */
+#define UDS_RESPONSE_ON_EVENT_RECORD_MAX 10
+
+/**
+ * @brief Longest serviceToRespondToRecord, a single frame request
+ */
+#define UDS_RESPONSE_ON_EVENT_SERVICE_MAX 7
+
+/**
+ * @brief An event set up by ResponseOnEvent (0x86)
+ */
+struct uds_response_on_event_entry {
+  /**
+   * @brief Type of the event, 0 if the slot is unused
+   */
+  uint8_t event_type;
+  uint8_t window;
+  uint8_t record[UDS_RESPONSE_ON_EVENT_RECORD_MAX];
+  uint8_t record_len;
+  /**
+   * @brief Request executed whenever the event is identified
+   */
+  uint8_t service[UDS_RESPONSE_ON_EVENT_SERVICE_MAX];
+  uint8_t service_len;
+
+  bool active;
+  /**
+   * @brief Uptime the event window ends at, INT64_MAX for infinite windows
+   */
+  int64_t window_end_ms;
+  /**
+   * @brief Number of times the event was identified since it was started
+   */
+  uint8_t identified;
+  /**
+   * @brief The event window ended and the final response is not sent yet
+   */
+  bool window_ended;
+
+  /**
+   * @brief Whether the first value was sampled after the start
+   */
+  bool sampled;
+  /**
+   * @brief Hash of the last sampled data identifier or DTC statuses
+   */
+  uint32_t hash;
+  /**
+   * @brief onComparisonOfValues fires again once the comparison was false
+   *        beyond the hysteresis
+   */
+  bool armed;
+};
+
+/**
+ * @brief Change detection for ResponseOnEvent (0x86)
+ *
+ * Protected by the event callback mutex of the iso14229 instance.
+ */
+struct uds_response_on_event {
+  struct uds_response_on_event_entry events[CONFIG_UDS_RESPONSE_ON_EVENT_MAX];
+  struct k_work_delayable work;
+  /**
+   * @brief Event checked first by the next pass, so no event is starved
+   */
+  uint8_t next;
+  /**
+   * @brief A final response marker is injected and not taken yet
+   */
+  bool final_injected;
+
+  // State of the data identifier or DTC read being sampled
+  uint8_t read_type;
+  uint32_t read_pos;
+  uint32_t read_hash;
+  uint8_t read_dtc_mask;
+  uint16_t read_bit_offset;
+  uint8_t read_bit_len;
+  uint8_t read_bits;
+  uint32_t read_value;
+};
+
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
+
 #ifdef CONFIG_UDS_USE_DYNAMIC_REGISTRATION
 
+/**
+ * @brief Destination of a source data identifier read for a dynamically
+ *        defined data identifier
+ */
+struct uds_dynamic_read_capture {
+  uint8_t *buf;
+  uint16_t size;
+  /**
+   * @brief Number of bytes the source returned, may exceed the size
+   */
+  uint32_t len;
+};
+
 /**
  * @brief Function to dynamically register a new event handler at runtime
  *
@@ -238,8 +472,8 @@ struct uds_actor {
  * registration object. Can be NULL if not needed.
  *
  * @returns 0 on success
- * @returns -ENOSPC if no free ID is available (all IDs from 1 to UINT32_MAX are
- * taken)
+ * @returns -ENOMEM if all CONFIG_UDS_DYNAMIC_REGISTRATION_POOL_SIZE
+ * registrations are in use
  * @returns <0 on other failures
  *
  */
@@ -280,12 +514,31 @@ struct uds_instance_t {
 
 #ifdef CONFIG_UDS_USE_DYNAMIC_REGISTRATION
   /**
-   * @brief Singly linked list of dynamic registrations
+   * @brief Doubly linked list of dynamic registrations in registration order
    */
-  sys_slist_t dynamic_registrations;
+  sys_dlist_t dynamic_registrations;
   register_event_handler_fn register_event_handler;
   unregister_event_handler_fn unregister_event_handler;
+  /**
+   * @brief Buffer the source data identifier currently read for a
+   *        dynamically defined data identifier is copied to
+   */
+  struct uds_dynamic_read_capture dynamic_read_capture;
 #endif  // CONFIG_UDS_USE_DYNAMIC_REGISTRATION
+
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+  /**
+   * @brief Data identifiers sent periodically
+   */
+  struct uds_periodic_scheduler periodic;
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
+
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+  /**
+   * @brief Events set up by ResponseOnEvent
+   */
+  struct uds_response_on_event response_on_event;
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
 };
 
 int uds_init(struct uds_instance_t *inst,
@@ -303,6 +556,43 @@ int uds_init(struct uds_instance_t *inst,
 int uds_get_isotp_config(struct uds_instance_t *inst,
                          UDSISOTpCConfig_t *iso_tp_config);
 
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+
+/**
+ * @brief Set the CAN ID periodic data identifiers are sent on
+ *
+ * ReadDataByPeriodicIdentifier (0x2A) requests are rejected until a CAN ID
+ * is set. Every periodic message is a single unsegmented CAN frame with the
+ * periodic data identifier in the first byte followed by the data.
+ *
+ * @param inst UDS Instance pointer
+ * @param can_id CAN ID for the periodic messages, UDS_TP_NOOP_ADDR to disable
+ *               the service
+ * @returns 0 on success
+ * @returns -EINVAL if the instance is null
+ */
+int uds_set_periodic_can_id(struct uds_instance_t *inst, uint32_t can_id);
+
+/**
+ * @brief Stop sending all periodic data identifiers of the instance
+ *
+ * @param inst UDS Instance pointer
+ */
+void uds_periodic_data_ids_stop(struct uds_instance_t *inst);
+
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
+
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+
+/**
+ * @brief Stop and clear all ResponseOnEvent events of the instance
+ *
+ * @param inst UDS Instance pointer
+ */
+void uds_response_on_event_clear(struct uds_instance_t *inst);
+
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
+
 /**
  * @brief type identifier for `struct uds_registration_t`
  */
@@ -336,6 +626,10 @@ struct uds_dynamically_defined_data {
       uint16_t id;
       uint8_t position;
       uint8_t size;
+      /**
+       * @brief Index of the source data identifier in the read plan
+       */
+      uint8_t source;
     } id;
     struct {
       void *memAddr;
@@ -437,6 +731,10 @@ struct uds_registration_t {
        * @brief Actor for *UDS_EVT_IOControl* events
        */
       struct uds_actor io_control;
+      /**
+       * @brief Optional response cache for *UDS_EVT_ReadDataByIdent* events
+       */
+      struct uds_data_identifier_cache *cache;
     } data_identifier;
     /**
      * @brief Data for the Read/Write Memory by Address event handler
@@ -622,12 +920,12 @@ struct uds_registration_t {
 #ifdef CONFIG_UDS_USE_DYNAMIC_REGISTRATION
 
   /**
-   * @brief Singly linked list of `struct uds_registration_t` using zephyr's
-   * sys_slist_t
+   * @brief Doubly linked list of `struct uds_registration_t` using zephyr's
+   * sys_dlist_t
    *
    * @note: Only used for dynamic registration
    */
-  sys_snode_t node;
+  sys_dnode_t node;
 
   /**
    * @brief Unique ID of this dynamic registration
@@ -768,6 +1066,73 @@ UDSErr_t uds_check_default_link_control_change_diag_session(
 UDSErr_t uds_action_default_link_control_change_diag_session(
     struct uds_context *const context, bool *consume_event);
 
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+/**
+ * @brief Digest of the data written by a download (RequestDownload)
+ */
+struct uds_download_digest {
+  /** @brief number of bytes written */
+  uint32_t size;
+  /** @brief CRC-32 (IEEE 802.3, as used by zlib) of the written bytes */
+  uint32_t crc32;
+  /** @brief SHA-256 of the written bytes */
+  uint8_t sha256[32];
+};
+
+/**
+ * @brief Get the digest of the last download
+ *
+ * The digest is computed while the data is written, so it is available right
+ * after RequestTransferExit without reading back the flash.
+ *
+ * @param digest the digest of the last download
+ * @retval 0 on success
+ * @retval -ENODATA if no download was exited successfully since the last
+ * RequestDownload
+ */
+int uds_download_get_digest(struct uds_download_digest *digest);
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
+#ifdef CONFIG_UDS_DOWNLOAD_PIPELINE
+/**
+ * @brief Wait until the writer thread programmed all downloaded blocks
+ *
+ * TransferData only queues a block for the writer thread. A routine that
+ * checks the written data before RequestTransferExit waits for it first.
+ *
+ * @param timeout how long to wait at most
+ * @retval 0 if all blocks are written
+ * @retval -EAGAIN if blocks are still pending after @p timeout
+ */
+int uds_download_wait_drained(k_timeout_t timeout);
+#endif  // CONFIG_UDS_DOWNLOAD_PIPELINE
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+/**
+ * @brief Where an interrupted download can be continued
+ */
+struct uds_download_resume_point {
+  /** @brief address of the first byte that was not written yet */
+  uint32_t address;
+  /** @brief number of bytes that are left, 0 if only the exit is missing */
+  uint32_t size;
+};
+
+/**
+ * @brief Get the point an interrupted download can be continued at
+ *
+ * A RequestDownload of exactly the remaining range continues the interrupted
+ * download without erasing the data that was written already. The journal is
+ * kept in retention, so it survives resets but not a loss of power.
+ *
+ * @param resume_point where to continue the download
+ * @retval 0 on success
+ * @retval -ENODATA if there is no interrupted download
+ */
+int uds_download_get_resume_point(
+    struct uds_download_resume_point *resume_point);
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+
 #if DT_HAS_CHOSEN(zephyr_firmware_loader_args) && CONFIG_RETENTION_BOOT_MODE
 /**
  * @brief Switch into the firmware loader with an active programming session.
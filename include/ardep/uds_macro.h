@@ -459,8 +459,74 @@
   _io_control,                                                        \
   _user_context                                                       \
 )                                                                     \
-  STRUCT_SECTION_ITERABLE(uds_registration_t,                         \
-        _UDS_CAT_EXPAND(__uds_registration_id, _data_id)) = {         \
+  UDS_REGISTER_CACHED_DATA_BY_IDENTIFIER_HANDLER(                     \
+    _instance,                                                        \
+    _data_id,                                                         \
+    _data_ptr,                                                        \
+    NULL,                                                             \
+    _read_check,                                                      \
+    _read,                                                            \
+    _write_check,                                                     \
+    _write,                                                           \
+    _io_control_check,                                                \
+    _io_control,                                                      \
+    _user_context                                                     \
+  )
+
+/**
+ * @brief Define a response cache for a data identifier
+ * 
+ * @param _name Name of the cache
+ * @param _size Maximum number of bytes the read action copies
+ * @param _max_age_ms Maximum age of the cached bytes in milliseconds, 0 to
+ *                    keep them until the cache is invalidated
+ * @param _refresh_ms Interval in milliseconds to refresh the cached bytes in
+ *                    the background while the data identifier is read, 0 to
+ *                    only refresh on demand
+ */
+#define UDS_DATA_IDENTIFIER_CACHE_DEFINE(                             \
+  _name,                                                              \
+  _size,                                                              \
+  _max_age_ms,                                                        \
+  _refresh_ms                                                         \
+)                                                                     \
+  static uint8_t _name##_buffers[2][_size];                           \
+  static struct uds_data_identifier_cache _name = {                   \
+    .buffers = { _name##_buffers[0], _name##_buffers[1] },            \
+    .size = _size,                                                    \
+    .max_age_ms = _max_age_ms,                                        \
+    .refresh_ms = _refresh_ms,                                        \
+  };
+
+/**
+ * @brief Register a new static data identifier with a response cache
+ * 
+ * Same as UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(), but reads are served
+ * from @p _cache while the cached bytes are valid. The read check still runs
+ * for every request.
+ * 
+ * @param _cache Pointer to a cache defined with
+ *               UDS_DATA_IDENTIFIER_CACHE_DEFINE() or NULL
+ * 
+ * @note: Requires CONFIG_UDS_DATA_IDENTIFIER_CACHE, @p _cache is ignored
+ *        otherwise
+ */
+#define UDS_REGISTER_CACHED_DATA_BY_IDENTIFIER_HANDLER(               \
+  _instance,                                                          \
+  _data_id,                                                           \
+  _data_ptr,                                                          \
+  _cache,                                                             \
+  _read_check,                                                        \
+  _read,                                                              \
+  _write_check,                                                       \
+  _write,                                                             \
+  _io_control_check,                                                  \
+  _io_control,                                                        \
+  _user_context                                                       \
+)                                                                     \
+  STRUCT_SECTION_ITERABLE_ALTERNATE(                                  \
+        uds_data_identifier_registration, uds_registration_t,         \
+        _UDS_UNIQUE_REGISTRATION_NAME(data_identifier)) = {           \
     .instance = _instance,                                            \
     .type = UDS_REGISTRATION_TYPE__DATA_IDENTIFIER,                   \
     .data_identifier = {                                              \
@@ -479,6 +545,7 @@
         .check = _io_control_check,                                   \
         .action = _io_control,                                        \
       },                                                              \
+      .cache = _cache,                                                \
     },                                                                \
   };
 
@@ -574,6 +641,7 @@
  * @brief Register a new routine control event handler
  * 
  * @param _instance Pointer to associated the UDS server instance
+ * @param _routine_id The routine identifier to register the handler for
  * @param _check Check if the action should be executed
  * @param _act Execute the handler for the event
  * @param _user_context Optional context provided by the user
@@ -586,7 +654,8 @@
   _act,                                                                        \
   _user_context                                                                \
 )                                                                              \
-  STRUCT_SECTION_ITERABLE(uds_registration_t,                                  \
+  STRUCT_SECTION_ITERABLE_ALTERNATE(                                           \
+        uds_routine_control_registration, uds_registration_t,                  \
         _UDS_UNIQUE_REGISTRATION_NAME(routine_control)) = {                    \
     .instance = _instance,                                                     \
     .type = UDS_REGISTRATION_TYPE__ROUTINE_CONTROL,                            \
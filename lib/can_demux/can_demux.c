@@ -0,0 +1,537 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include <ardep/can_demux.h>
+
+LOG_MODULE_REGISTER(can_demux, CONFIG_CAN_DEMUX_LOG_LEVEL);
+
+// Old and new hardware filters coexist while the filters are rebuilt
+#define CAN_DEMUX_HW_FILTER_SLOTS (2 * CONFIG_CAN_DEMUX_MAX_HW_FILTERS)
+
+// Set in the lookup key of extended IDs, which only use 29 bits
+#define CAN_DEMUX_KEY_IDE BIT(31)
+
+struct can_demux_device;
+
+struct can_demux_subscriber {
+  // NULL if the subscriber is unused
+  struct can_demux_device *ctx;
+  struct can_filter filter;
+  can_rx_callback_t callback;
+  void *user_data;
+};
+
+struct can_demux_hw_filter {
+  struct can_demux_device *ctx;
+  struct can_filter filter;
+  int filter_id;
+  bool installed;
+};
+
+struct can_demux_entry {
+  uint32_t key;
+  uint8_t subscriber;
+  // Hardware filter slot the subscriber receives its frames through
+  uint8_t hw_filter;
+};
+
+/*
+ * Dispatch table of a device. Subscribers with an exact ID come first,
+ * sorted by their key for a binary search, followed by the ones with a mask.
+ */
+struct can_demux_table {
+  struct can_demux_entry entries[CONFIG_CAN_DEMUX_MAX_SUBSCRIBERS];
+  uint8_t exact_count;
+  uint8_t count;
+  atomic_t readers;
+};
+
+/*
+ * Filters of a device. A new dispatch table is built in the inactive one of
+ * two tables and swapped in with a single pointer store, so the RX callbacks
+ * need no lock. They count themselves as readers of the table they use, the
+ * old table is reused once it has no readers anymore. The last reader of an
+ * inactive table gives can_demux_released.
+ */
+struct can_demux_device {
+  const struct device *dev;
+  struct can_demux_hw_filter hw_filters[CAN_DEMUX_HW_FILTER_SLOTS];
+  struct can_demux_table tables[2];
+  atomic_ptr_t active;
+};
+
+static struct can_demux_subscriber
+    can_demux_subscribers[CONFIG_CAN_DEMUX_MAX_SUBSCRIBERS];
+static struct can_demux_device can_demux_devices[CONFIG_CAN_DEMUX_MAX_DEVICES];
+
+// Serializes changes of the filters
+K_MUTEX_DEFINE(can_demux_mutex);
+static K_SEM_DEFINE(can_demux_released, 0, 1);
+
+static uint32_t can_demux_id_mask(const struct can_filter *filter) {
+  return (filter->flags & CAN_FILTER_IDE) != 0 ? CAN_EXT_ID_MASK
+                                               : CAN_STD_ID_MASK;
+}
+
+static bool can_demux_is_exact(const struct can_filter *filter) {
+  return filter->mask == can_demux_id_mask(filter);
+}
+
+static uint32_t can_demux_frame_key(const struct can_frame *frame) {
+  return (frame->flags & CAN_FRAME_IDE) != 0 ? frame->id | CAN_DEMUX_KEY_IDE
+                                             : frame->id;
+}
+
+static uint32_t can_demux_filter_key(const struct can_filter *filter) {
+  return (filter->flags & CAN_FILTER_IDE) != 0
+             ? filter->id | CAN_DEMUX_KEY_IDE
+             : filter->id;
+}
+
+static bool can_demux_filter_equal(const struct can_filter *a,
+                                   const struct can_filter *b) {
+  return a->flags == b->flags && a->id == b->id && a->mask == b->mask;
+}
+
+// Returns the filter accepting the frames of both filters
+static struct can_filter can_demux_filter_merge(const struct can_filter *a,
+                                                const struct can_filter *b) {
+  const uint32_t mask = a->mask & b->mask & ~(a->id ^ b->id);
+
+  return (struct can_filter){
+    .flags = a->flags,
+    .id = a->id & mask,
+    .mask = mask,
+  };
+}
+
+static void can_demux_rx_cb(const struct device *dev,
+                            struct can_frame *frame,
+                            void *user_data) {
+  struct can_demux_hw_filter *hw_filter = user_data;
+  struct can_demux_device *ctx = hw_filter->ctx;
+  const uint8_t slot = hw_filter - ctx->hw_filters;
+
+  // Counting as reader before checking the table keeps it from being
+  // reused while the frame is dispatched
+  struct can_demux_table *table;
+  while (true) {
+    table = atomic_ptr_get(&ctx->active);
+    atomic_inc(&table->readers);
+    if (atomic_ptr_get(&ctx->active) == table) {
+      break;
+    }
+    atomic_dec(&table->readers);
+  }
+
+  const uint32_t key = can_demux_frame_key(frame);
+  size_t low = 0;
+  size_t high = table->exact_count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (table->entries[mid].key < key) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  for (size_t i = low; i < table->exact_count && table->entries[i].key == key;
+       i++) {
+    const struct can_demux_entry *entry = &table->entries[i];
+    if (entry->hw_filter == slot) {
+      const struct can_demux_subscriber *sub =
+          &can_demux_subscribers[entry->subscriber];
+      sub->callback(dev, frame, sub->user_data);
+    }
+  }
+
+  for (size_t i = table->exact_count; i < table->count; i++) {
+    const struct can_demux_entry *entry = &table->entries[i];
+    const struct can_demux_subscriber *sub =
+        &can_demux_subscribers[entry->subscriber];
+    if (entry->hw_filter == slot &&
+        can_frame_matches_filter(frame, &sub->filter)) {
+      sub->callback(dev, frame, sub->user_data);
+    }
+  }
+
+  if (atomic_dec(&table->readers) == 1 &&
+      atomic_ptr_get(&ctx->active) != table) {
+    k_sem_give(&can_demux_released);
+  }
+}
+
+/*
+ * Merges filters into at most CONFIG_CAN_DEMUX_MAX_HW_FILTERS groups. A
+ * filter covered by another one is always merged into it. While there are
+ * too many groups, the pair whose merged filter keeps the most mask bits is
+ * merged, which lets the fewest unwanted frames through.
+ */
+static int can_demux_group_filters(const struct can_filter *filters,
+                                   size_t count,
+                                   struct can_filter *groups,
+                                   uint8_t *group_of,
+                                   size_t *group_count) {
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    groups[n] = filters[i];
+    group_of[i] = n++;
+  }
+
+  while (true) {
+    const bool over_budget = n > CONFIG_CAN_DEMUX_MAX_HW_FILTERS;
+    int best_score = -1;
+    size_t best_a = 0;
+    size_t best_b = 0;
+    struct can_filter best;
+
+    for (size_t a = 0; a < n; a++) {
+      for (size_t b = a + 1; b < n; b++) {
+        if (groups[a].flags != groups[b].flags) {
+          continue;
+        }
+
+        struct can_filter merged = can_demux_filter_merge(&groups[a],
+                                                          &groups[b]);
+        const bool covered = can_demux_filter_equal(&merged, &groups[a]) ||
+                             can_demux_filter_equal(&merged, &groups[b]);
+        if (!covered && !over_budget) {
+          continue;
+        }
+
+        // Covering merges first, then by the number of kept mask bits
+        const int score = (covered ? 64 : 0) + POPCOUNT(merged.mask);
+        if (score > best_score) {
+          best_score = score;
+          best_a = a;
+          best_b = b;
+          best = merged;
+        }
+      }
+    }
+
+    if (best_score < 0) {
+      break;
+    }
+
+    groups[best_a] = best;
+    groups[best_b] = groups[n - 1];
+    for (size_t i = 0; i < count; i++) {
+      if (group_of[i] == best_b) {
+        group_of[i] = best_a;
+      } else if (group_of[i] == n - 1) {
+        group_of[i] = best_b;
+      }
+    }
+    n--;
+  }
+
+  if (n > CONFIG_CAN_DEMUX_MAX_HW_FILTERS) {
+    return -ENOSPC;
+  }
+
+  *group_count = n;
+  return 0;
+}
+
+// Swaps in a new dispatch table and waits until the old one has no readers
+static void can_demux_table_swap(struct can_demux_device *ctx,
+                                 struct can_demux_table *next) {
+  struct can_demux_table *active = atomic_ptr_get(&ctx->active);
+
+  atomic_ptr_set(&ctx->active, next);
+
+  // Gives left over from earlier swaps are dropped, a reader that leaves
+  // after the check below wakes it up again
+  k_sem_reset(&can_demux_released);
+  while (atomic_get(&active->readers) != 0) {
+    k_sem_take(&can_demux_released, K_FOREVER);
+  }
+}
+
+static struct can_demux_table *can_demux_table_inactive(
+    struct can_demux_device *ctx) {
+  return atomic_ptr_get(&ctx->active) == &ctx->tables[0] ? &ctx->tables[1]
+                                                        : &ctx->tables[0];
+}
+
+// Removes a subscriber from the dispatch table of a device, must be called
+// with the mutex held
+static void can_demux_table_drop(struct can_demux_device *ctx,
+                                 uint8_t subscriber) {
+  const struct can_demux_table *active = atomic_ptr_get(&ctx->active);
+  struct can_demux_table *next = can_demux_table_inactive(ctx);
+
+  next->exact_count = 0;
+  next->count = 0;
+  for (size_t i = 0; i < active->count; i++) {
+    if (active->entries[i].subscriber == subscriber) {
+      continue;
+    }
+
+    if (i < active->exact_count) {
+      next->exact_count++;
+    }
+    next->entries[next->count++] = active->entries[i];
+  }
+
+  can_demux_table_swap(ctx, next);
+}
+
+// Removes the hardware filters that no group claimed
+static void can_demux_release_hw_filters(struct can_demux_device *ctx,
+                                         const bool *claimed) {
+  for (size_t i = 0; i < ARRAY_SIZE(ctx->hw_filters); i++) {
+    struct can_demux_hw_filter *hw_filter = &ctx->hw_filters[i];
+    if (hw_filter->installed && !claimed[i]) {
+      can_remove_rx_filter(ctx->dev, hw_filter->filter_id);
+      hw_filter->installed = false;
+    }
+  }
+}
+
+/*
+ * Rebuilds the hardware filters and the dispatch table of a device from its
+ * subscribers, must be called with the mutex held. Hardware filters that do
+ * not change are kept, the active table is only replaced on success.
+ */
+static int can_demux_rebuild(struct can_demux_device *ctx) {
+  struct can_filter filters[CONFIG_CAN_DEMUX_MAX_SUBSCRIBERS];
+  uint8_t subscribers[CONFIG_CAN_DEMUX_MAX_SUBSCRIBERS];
+  size_t count = 0;
+
+  for (size_t i = 0; i < ARRAY_SIZE(can_demux_subscribers); i++) {
+    const struct can_demux_subscriber *sub = &can_demux_subscribers[i];
+    if (sub->ctx == ctx) {
+      filters[count] = sub->filter;
+      subscribers[count] = i;
+      count++;
+    }
+  }
+
+  struct can_filter groups[CONFIG_CAN_DEMUX_MAX_SUBSCRIBERS];
+  uint8_t group_of[CONFIG_CAN_DEMUX_MAX_SUBSCRIBERS];
+  size_t group_count;
+  int err =
+      can_demux_group_filters(filters, count, groups, group_of, &group_count);
+  if (err) {
+    LOG_ERR("Filters of %s do not fit into %d hardware filters",
+            ctx->dev->name, CONFIG_CAN_DEMUX_MAX_HW_FILTERS);
+    return err;
+  }
+
+  // Assign each group to an installed hardware filter with the same filter,
+  // or install a new one
+  bool claimed[CAN_DEMUX_HW_FILTER_SLOTS] = {0};
+  bool added[CAN_DEMUX_HW_FILTER_SLOTS] = {0};
+  uint8_t slot_of[CONFIG_CAN_DEMUX_MAX_SUBSCRIBERS];
+
+  for (size_t g = 0; g < group_count; g++) {
+    size_t slot = ARRAY_SIZE(ctx->hw_filters);
+    for (size_t i = 0; i < ARRAY_SIZE(ctx->hw_filters); i++) {
+      const struct can_demux_hw_filter *hw_filter = &ctx->hw_filters[i];
+      if (hw_filter->installed && !claimed[i] &&
+          can_demux_filter_equal(&hw_filter->filter, &groups[g])) {
+        slot = i;
+        break;
+      }
+    }
+
+    if (slot == ARRAY_SIZE(ctx->hw_filters)) {
+      for (size_t i = 0; i < ARRAY_SIZE(ctx->hw_filters); i++) {
+        if (!ctx->hw_filters[i].installed) {
+          slot = i;
+          break;
+        }
+      }
+
+      struct can_demux_hw_filter *hw_filter = &ctx->hw_filters[slot];
+      hw_filter->filter = groups[g];
+      hw_filter->filter_id = can_add_rx_filter(ctx->dev, can_demux_rx_cb,
+                                               hw_filter, &hw_filter->filter);
+      if (hw_filter->filter_id < 0) {
+        err = hw_filter->filter_id;
+        LOG_ERR("Could not add hardware filter on %s (%d)", ctx->dev->name,
+                err);
+
+        // Keep the filters of the active table only
+        for (size_t i = 0; i < ARRAY_SIZE(claimed); i++) {
+          claimed[i] = ctx->hw_filters[i].installed && !added[i];
+        }
+        can_demux_release_hw_filters(ctx, claimed);
+        return err;
+      }
+      hw_filter->installed = true;
+      added[slot] = true;
+    }
+
+    claimed[slot] = true;
+    slot_of[g] = slot;
+  }
+
+  struct can_demux_table *next = can_demux_table_inactive(ctx);
+
+  // Exact IDs are inserted sorted, masks are appended behind them
+  next->exact_count = 0;
+  next->count = 0;
+  for (size_t i = 0; i < count; i++) {
+    const struct can_demux_entry entry = {
+      .key = can_demux_filter_key(&filters[i]),
+      .subscriber = subscribers[i],
+      .hw_filter = slot_of[group_of[i]],
+    };
+
+    if (!can_demux_is_exact(&filters[i])) {
+      continue;
+    }
+
+    size_t pos = next->exact_count;
+    while (pos > 0 && next->entries[pos - 1].key > entry.key) {
+      next->entries[pos] = next->entries[pos - 1];
+      pos--;
+    }
+    next->entries[pos] = entry;
+    next->exact_count++;
+  }
+  next->count = next->exact_count;
+  for (size_t i = 0; i < count; i++) {
+    if (can_demux_is_exact(&filters[i])) {
+      continue;
+    }
+
+    next->entries[next->count++] = (struct can_demux_entry){
+      .subscriber = subscribers[i],
+      .hw_filter = slot_of[group_of[i]],
+    };
+  }
+
+  can_demux_table_swap(ctx, next);
+  can_demux_release_hw_filters(ctx, claimed);
+
+  LOG_DBG("%s dispatches %zu filters through %zu hardware filters",
+          ctx->dev->name, count, group_count);
+
+  return 0;
+}
+
+// Returns the context of a device, optionally creating it
+static struct can_demux_device *can_demux_device_get(const struct device *dev,
+                                                     bool create) {
+  for (size_t i = 0; i < ARRAY_SIZE(can_demux_devices); i++) {
+    struct can_demux_device *ctx = &can_demux_devices[i];
+
+    if (ctx->dev == dev) {
+      return ctx;
+    }
+
+    if (ctx->dev == NULL) {
+      if (!create) {
+        return NULL;
+      }
+
+      ctx->dev = dev;
+      for (size_t j = 0; j < ARRAY_SIZE(ctx->hw_filters); j++) {
+        ctx->hw_filters[j].ctx = ctx;
+      }
+      atomic_ptr_set(&ctx->active, &ctx->tables[0]);
+      return ctx;
+    }
+  }
+
+  return NULL;
+}
+
+int can_demux_add_rx_filter(const struct device *dev,
+                            can_rx_callback_t callback,
+                            void *user_data,
+                            const struct can_filter *filter) {
+  if (callback == NULL || filter == NULL) {
+    return -EINVAL;
+  }
+
+  k_mutex_lock(&can_demux_mutex, K_FOREVER);
+
+  struct can_demux_device *ctx = can_demux_device_get(dev, true);
+  if (ctx == NULL) {
+    k_mutex_unlock(&can_demux_mutex);
+    LOG_ERR("Too many devices, increase CONFIG_CAN_DEMUX_MAX_DEVICES");
+    return -ENOSPC;
+  }
+
+  int filter_id = -ENOSPC;
+  for (size_t i = 0; i < ARRAY_SIZE(can_demux_subscribers); i++) {
+    if (can_demux_subscribers[i].ctx == NULL) {
+      filter_id = i;
+      break;
+    }
+  }
+  if (filter_id < 0) {
+    k_mutex_unlock(&can_demux_mutex);
+    LOG_ERR("Too many filters, increase CONFIG_CAN_DEMUX_MAX_SUBSCRIBERS");
+    return filter_id;
+  }
+
+  // Bits outside of the ID and below the mask do not take part in matching
+  const uint32_t mask = filter->mask & can_demux_id_mask(filter);
+  can_demux_subscribers[filter_id] = (struct can_demux_subscriber){
+    .ctx = ctx,
+    .filter =
+        {
+          .flags = filter->flags,
+          .id = filter->id & mask,
+          .mask = mask,
+        },
+    .callback = callback,
+    .user_data = user_data,
+  };
+
+  int err = can_demux_rebuild(ctx);
+  if (err) {
+    can_demux_subscribers[filter_id].ctx = NULL;
+    filter_id = err;
+  }
+
+  k_mutex_unlock(&can_demux_mutex);
+
+  return filter_id;
+}
+
+void can_demux_remove_rx_filter(const struct device *dev, int filter_id) {
+  if (filter_id < 0 || filter_id >= (int)ARRAY_SIZE(can_demux_subscribers)) {
+    return;
+  }
+
+  k_mutex_lock(&can_demux_mutex, K_FOREVER);
+
+  struct can_demux_subscriber *sub = &can_demux_subscribers[filter_id];
+  struct can_demux_device *ctx = can_demux_device_get(dev, false);
+  if (ctx == NULL || sub->ctx != ctx) {
+    k_mutex_unlock(&can_demux_mutex);
+    return;
+  }
+
+  // The subscriber is released once no RX callback can dispatch to it, the
+  // hardware filters it used are merged again afterwards
+  can_demux_table_drop(ctx, filter_id);
+  *sub = (struct can_demux_subscriber){0};
+
+  if (can_demux_rebuild(ctx)) {
+    LOG_WRN("Could not merge the filters of %s, keeping the old ones",
+            dev->name);
+  }
+
+  k_mutex_unlock(&can_demux_mutex);
+}
@@ -12,6 +12,7 @@
 #include <zephyr/logging/log_backend_std.h>
 
 #include <ardep/can_log.h>
+#include <ardep/can_stats.h>
 
 struct k_sem can_tx_sem;  // semaphore for CAN TX completion
 
@@ -64,12 +65,17 @@ static int can_log_line_out(uint8_t *data, size_t length, void *output_ctx) {
   if (synchronous) {
     // in synchronous mode we don't wait for completion, just throw it on the
     // bus
-    can_send(can_dev, &frame, K_NO_WAIT, can_log_tx_cb_no_wait, NULL);
+    if (can_send(can_dev, &frame, K_NO_WAIT, can_log_tx_cb_no_wait, NULL) ==
+        0) {
+      can_stats_record_tx(can_dev, &frame);
+    }
   } else {
     k_sem_take(&can_tx_sem, K_NO_WAIT);  // Reset semaphore
 
-    can_send(can_dev, &frame, K_MSEC(CONFIG_CAN_LOG_SEND_TIMEOUT_MS),
-             can_log_tx_cb, &can_tx_sem);
+    if (can_send(can_dev, &frame, K_MSEC(CONFIG_CAN_LOG_SEND_TIMEOUT_MS),
+                 can_log_tx_cb, &can_tx_sem) == 0) {
+      can_stats_record_tx(can_dev, &frame);
+    }
 
     // wait for transmission to complete
     k_sem_take(&can_tx_sem, K_MSEC(CONFIG_CAN_LOG_SEND_TIMEOUT_MS));
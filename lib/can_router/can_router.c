@@ -5,50 +5,671 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <errno.h>
+
 #include <zephyr/drivers/can.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
 
+#include <ardep/can_demux.h>
 #include <ardep/can_router.h>
+#include <ardep/can_stats.h>
 
 LOG_MODULE_REGISTER(can_router, CONFIG_CAN_ROUTER_LOG_LEVEL);
 
+struct can_router_queued_frame {
+  struct can_frame frame;
+  // cycle count when the frame was routed
+  uint32_t routed_at;
+};
+
+/*
+ * Transmit queue of a destination. Routed frames are queued from the RX
+ * callbacks of all sources and handed to the CAN driver one at a time, so
+ * their order is kept. The next frame is submitted from the transmit
+ * completion callback, or from a timer if all mailboxes were busy.
+ */
+struct can_router_queue {
+  const struct device *dev;
+
+  struct k_spinlock lock;
+  struct can_router_queued_frame frames[CONFIG_CAN_ROUTER_TX_QUEUE_SIZE];
+  uint16_t tail;
+  uint16_t count;
+  bool in_flight;
+  bool kicking;
+  uint32_t in_flight_routed_at;
+  struct k_timer retry;
+
+  uint32_t sent;
+  uint32_t dropped;
+  uint32_t errors;
+  uint32_t high_water;
+  uint64_t latency_total_us;
+  uint32_t latency_max_us;
+};
+
+static struct can_router_queue
+    can_router_queues[CONFIG_CAN_ROUTER_MAX_DESTINATIONS];
+
+struct can_router_route_table;
+
+/*
+ * Runtime state of a registered entry. Its frames are only handled by the RX
+ * callback of the source, so the state needs no lock.
+ */
+struct can_router_route {
+  struct can_router_route_table *table;
+  const struct can_router_entry_t *entry;
+  // The queue of the destination, followed by the ones of the fan-out
+  struct can_router_queue *queues[1 + CONFIG_CAN_ROUTER_MAX_FAN_OUT];
+  uint8_t queue_count;
+
+  // Token bucket of the rate limit
+  int64_t refilled_at_us;
+  uint16_t tokens;
+
+  uint32_t matched;
+  uint32_t routed;
+  uint32_t translated;
+  uint32_t throttled;
+};
+
+/*
+ * Set of routes with their hardware filters. A new table is built in the
+ * inactive one of two tables and swapped in with a single pointer store.
+ * The RX callbacks of a table only route frames while it is the active one,
+ * and count themselves as readers, so the old table is released once no
+ * callback uses it anymore. The last reader of an inactive table gives
+ * can_router_released.
+ */
+struct can_router_route_table {
+  struct can_router_route routes[CONFIG_CAN_ROUTER_MAX_ROUTES];
+  int filter_ids[CONFIG_CAN_ROUTER_MAX_ROUTES];
+  size_t count;
+  atomic_t readers;
+};
+
+static struct can_router_route_table can_router_tables[2];
+static atomic_ptr_t can_router_active = ATOMIC_PTR_INIT(&can_router_tables[0]);
+
+// Serializes changes of the tables
+K_MUTEX_DEFINE(can_router_mutex);
+static K_SEM_DEFINE(can_router_released, 0, 1);
+
+static void can_router_kick(struct can_router_queue *queue);
+
 static void can_router_tx_cb(const struct device *dev,
                              int error,
-                             void *user_data) {}
+                             void *user_data) {
+  struct can_router_queue *queue = user_data;
+
+  uint32_t latency_us =
+      k_cyc_to_us_floor32(k_cycle_get_32() - queue->in_flight_routed_at);
+
+  k_spinlock_key_t key = k_spin_lock(&queue->lock);
+  queue->in_flight = false;
+  if (error != 0) {
+    queue->errors++;
+  } else {
+    queue->sent++;
+    queue->latency_total_us += latency_us;
+    queue->latency_max_us = MAX(queue->latency_max_us, latency_us);
+  }
+  k_spin_unlock(&queue->lock, key);
+
+  if (error != 0) {
+    LOG_WRN("Can send to %s failed (%d)", dev->name, error);
+  }
+
+  can_router_kick(queue);
+}
+
+static void can_router_retry_cb(struct k_timer *timer) {
+  can_router_kick(CONTAINER_OF(timer, struct can_router_queue, retry));
+}
+
+// Removes the frame at position index (0 is the oldest), must be called with
+// the lock held
+static void can_router_queue_remove(struct can_router_queue *queue,
+                                    uint16_t index) {
+  const uint16_t size = ARRAY_SIZE(queue->frames);
+
+  for (uint16_t i = index; i + 1 < queue->count; i++) {
+    queue->frames[(queue->tail + i) % size] =
+        queue->frames[(queue->tail + i + 1) % size];
+  }
+  queue->count--;
+}
+
+#ifdef CONFIG_CAN_ROUTER_OVERFLOW_PRIORITY
+// Arbitration order of a frame, lower values win. A standard frame wins
+// against an extended frame with the same base ID.
+static uint32_t can_router_frame_priority(const struct can_frame *frame) {
+  if ((frame->flags & CAN_FRAME_IDE) == 0) {
+    return frame->id << 19;
+  }
+  return ((frame->id >> 18) << 19) | BIT(18) | (frame->id & BIT_MASK(18));
+}
+#endif  // CONFIG_CAN_ROUTER_OVERFLOW_PRIORITY
+
+// Makes room for a routed frame in a full queue according to the overflow
+// policy. Returns false if the routed frame is dropped instead.
+static bool can_router_queue_evict(struct can_router_queue *queue,
+                                   const struct can_frame *frame) {
+#if defined(CONFIG_CAN_ROUTER_OVERFLOW_DROP_NEWEST)
+  ARG_UNUSED(queue);
+  ARG_UNUSED(frame);
+  return false;
+#elif defined(CONFIG_CAN_ROUTER_OVERFLOW_PRIORITY)
+  uint16_t lowest = 0;
+  uint32_t lowest_priority = 0;
+  for (uint16_t i = 0; i < queue->count; i++) {
+    uint32_t priority = can_router_frame_priority(
+        &queue->frames[(queue->tail + i) % ARRAY_SIZE(queue->frames)].frame);
+    if (priority >= lowest_priority) {
+      lowest = i;
+      lowest_priority = priority;
+    }
+  }
+
+  if (can_router_frame_priority(frame) >= lowest_priority) {
+    return false;
+  }
+
+  can_router_queue_remove(queue, lowest);
+  return true;
+#else
+  ARG_UNUSED(frame);
+  can_router_queue_remove(queue, 0);
+  return true;
+#endif
+}
+
+// Hands the oldest queued frame to the CAN driver if none is in flight. The
+// completion callback may run synchronously from within can_send(), so it
+// only re-enters this function, which then returns right away and the loop
+// below picks up the next frame.
+static void can_router_kick(struct can_router_queue *queue) {
+  k_spinlock_key_t key = k_spin_lock(&queue->lock);
+  if (queue->kicking) {
+    k_spin_unlock(&queue->lock, key);
+    return;
+  }
+  queue->kicking = true;
+
+  while (!queue->in_flight && queue->count > 0) {
+    // The driver copies the frame, so it leaves the queue right away
+    struct can_router_queued_frame entry = queue->frames[queue->tail];
+    queue->tail = (queue->tail + 1) % ARRAY_SIZE(queue->frames);
+    queue->count--;
+    queue->in_flight = true;
+    queue->in_flight_routed_at = entry.routed_at;
+    k_spin_unlock(&queue->lock, key);
+
+    int err = can_send(queue->dev, &entry.frame, K_NO_WAIT, can_router_tx_cb,
+                       queue);
+
+    key = k_spin_lock(&queue->lock);
+    if (err == -EAGAIN) {
+      // All mailboxes are busy with frames of other senders, put the frame
+      // back and try again on the next tick
+      queue->in_flight = false;
+      if (queue->count < ARRAY_SIZE(queue->frames)) {
+        queue->tail = (queue->tail + ARRAY_SIZE(queue->frames) - 1) %
+                      ARRAY_SIZE(queue->frames);
+        queue->frames[queue->tail] = entry;
+        queue->count++;
+      } else {
+        queue->dropped++;
+      }
+      k_timer_start(&queue->retry, K_TICKS(1), K_NO_WAIT);
+      break;
+    }
+    if (err != 0) {
+      queue->in_flight = false;
+      queue->errors++;
+      LOG_WRN("Can send to %s failed (%d)", queue->dev->name, err);
+    } else {
+      can_stats_record_tx(queue->dev, &entry.frame);
+    }
+  }
+
+  queue->kicking = false;
+  k_spin_unlock(&queue->lock, key);
+}
+
+static void can_router_enqueue(struct can_router_queue *queue,
+                               const struct can_frame *frame) {
+  k_spinlock_key_t key = k_spin_lock(&queue->lock);
+  if (queue->count == ARRAY_SIZE(queue->frames)) {
+    queue->dropped++;
+    if (!can_router_queue_evict(queue, frame)) {
+      k_spin_unlock(&queue->lock, key);
+      LOG_DBG("Dropped frame to %s, queue full", queue->dev->name);
+      return;
+    }
+  }
+
+  struct can_router_queued_frame *entry =
+      &queue->frames[(queue->tail + queue->count) % ARRAY_SIZE(queue->frames)];
+  entry->frame = *frame;
+  entry->routed_at = k_cycle_get_32();
+  queue->count++;
+  queue->high_water = MAX(queue->high_water, queue->count);
+  k_spin_unlock(&queue->lock, key);
+
+  can_router_kick(queue);
+}
+
+// Time of the rate limits. The cycle counter resolves intervals shorter
+// than a tick, rounding them to ticks would slow down fast routes.
+static int64_t can_router_now_us(void) {
+#ifdef CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+  return (int64_t)k_cyc_to_us_floor64(k_cycle_get_64());
+#else
+  return (int64_t)k_ticks_to_us_floor64(k_uptime_ticks());
+#endif
+}
+
+// Takes a token of the rate limit, returns false if the frame is throttled
+static bool can_router_rate_limit_take(struct can_router_route *route,
+                                       const struct can_router_rate_limit *rl) {
+  if (rl->interval_us == 0) {
+    return true;
+  }
+
+  const uint16_t burst = MAX(rl->burst, 1);
+  const int64_t now_us = can_router_now_us();
+
+  int64_t refills = (now_us - route->refilled_at_us) / rl->interval_us;
+  if (refills > 0) {
+    if (route->tokens + refills >= burst) {
+      route->tokens = burst;
+      route->refilled_at_us = now_us;
+    } else {
+      route->tokens += refills;
+      route->refilled_at_us += refills * rl->interval_us;
+    }
+  }
+
+  if (route->tokens == 0) {
+    return false;
+  }
+
+  route->tokens--;
+  return true;
+}
+
+// Applies the ID rewrite and the byte transforms, returns true if the frame
+// was changed
+static bool can_router_translate(const struct can_router_action_t *action,
+                                 struct can_frame *frame) {
+  const struct can_router_id_rewrite *rewrite = &action->id_rewrite;
+  bool translated = false;
+
+  if (rewrite->mask != 0 || rewrite->offset != 0) {
+    const uint32_t id_mask = (frame->flags & CAN_FRAME_IDE) != 0
+                                 ? CAN_EXT_ID_MASK
+                                 : CAN_STD_ID_MASK;
+    uint32_t id =
+        (frame->id & ~rewrite->mask) | (rewrite->value & rewrite->mask);
+    id = (id + (uint32_t)rewrite->offset) & id_mask;
+
+    translated = id != frame->id;
+    frame->id = id;
+  }
+
+  const uint8_t len = can_dlc_to_bytes(frame->dlc);
+  for (uint8_t i = 0; i < action->transform_count; i++) {
+    const struct can_router_byte_transform *transform = &action->transforms[i];
+    if (transform->index >= len) {
+      continue;
+    }
+
+    uint8_t byte = frame->data[transform->index];
+    byte = (byte & transform->and_mask) ^ transform->xor_mask;
+
+    translated |= byte != frame->data[transform->index];
+    frame->data[transform->index] = byte;
+  }
+
+  return translated;
+}
+
+static void can_router_route_frame(const struct device *dev,
+                                   struct can_router_route *route,
+                                   const struct can_frame *frame) {
+  const struct can_router_action_t *action = route->entry->action;
+
+  route->matched++;
+
+  if (action == NULL) {
+    can_router_enqueue(route->queues[0], frame);
+    route->routed++;
+    LOG_DBG("Routed frame from %s to %s", dev->name,
+            route->queues[0]->dev->name);
+    return;
+  }
+
+  if (!can_router_rate_limit_take(route, &action->rate_limit)) {
+    route->throttled++;
+    return;
+  }
+
+  struct can_frame translated = *frame;
+  if (can_router_translate(action, &translated)) {
+    route->translated++;
+  }
+
+  for (uint8_t i = 0; i < route->queue_count; i++) {
+    can_router_enqueue(route->queues[i], &translated);
+  }
+  route->routed++;
+
+  LOG_DBG("Routed frame %x from %s as %x to %u destinations", frame->id,
+          dev->name, translated.id, route->queue_count);
+}
 
 static void can_router_frame_cb(const struct device *dev,
                                 struct can_frame *frame,
                                 void *user_data) {
-  const struct device *to = user_data;
+  struct can_router_route *route = user_data;
+  struct can_router_route_table *table = route->table;
 
-  // Note: we use a tx callback to make use can_send non-blocking
-  const int err = can_send(to, frame, K_NO_WAIT, can_router_tx_cb, NULL);
-  if (err) {
-    LOG_WRN("Can send failed (%d)", err);
-    return;
+  // Counting as reader before checking the table keeps it from being
+  // released while the frame is routed
+  atomic_inc(&table->readers);
+  if (atomic_ptr_get(&can_router_active) == table) {
+    can_router_route_frame(dev, route, frame);
+  }
+  if (atomic_dec(&table->readers) == 1 &&
+      atomic_ptr_get(&can_router_active) != table) {
+    k_sem_give(&can_router_released);
+  }
+}
+
+// Returns the transmit queue of a destination, optionally creating it
+static struct can_router_queue *can_router_queue_get(const struct device *to,
+                                                     bool create) {
+  for (size_t i = 0; i < ARRAY_SIZE(can_router_queues); i++) {
+    struct can_router_queue *queue = &can_router_queues[i];
+
+    if (queue->dev == to) {
+      return queue;
+    }
+
+    if (queue->dev == NULL) {
+      if (!create) {
+        return NULL;
+      }
+
+      queue->dev = to;
+      k_timer_init(&queue->retry, can_router_retry_cb, NULL);
+      return queue;
+    }
+  }
+
+  return NULL;
+}
+
+// Checks that the queue pool has room for the destinations of entries
+static bool can_router_destinations_fit(
+    const struct can_router_entry_t *entries, int entry_count) {
+  const struct device *added[CONFIG_CAN_ROUTER_MAX_DESTINATIONS];
+  size_t added_count = 0;
+
+  size_t free_count = 0;
+  for (size_t i = 0; i < ARRAY_SIZE(can_router_queues); i++) {
+    if (can_router_queues[i].dev == NULL) {
+      free_count++;
+    }
+  }
+
+  for (int i = 0; i < entry_count; i++) {
+    const struct can_router_action_t *action = entries[i].action;
+    const uint8_t fan_out_count = action != NULL ? action->fan_out_count : 0;
+
+    for (uint8_t j = 0; j <= fan_out_count; j++) {
+      const struct device *to =
+          j == 0 ? *entries[i].to : *action->fan_out[j - 1];
+
+      bool known = can_router_queue_get(to, false) != NULL;
+      for (size_t k = 0; k < added_count && !known; k++) {
+        known = added[k] == to;
+      }
+      if (known) {
+        continue;
+      }
+
+      if (added_count == free_count) {
+        return false;
+      }
+      added[added_count++] = to;
+    }
+  }
+
+  return true;
+}
+
+// Checks that entries fit into a table next to the given number of routes,
+// must be called with the mutex held
+static int can_router_validate_locked(const struct can_router_entry_t *entries,
+                                      int entry_count,
+                                      size_t route_count) {
+  if (entry_count < 0 || (entry_count > 0 && entries == NULL)) {
+    return -EINVAL;
+  }
+
+  if (route_count + entry_count > CONFIG_CAN_ROUTER_MAX_ROUTES) {
+    LOG_ERR("Too many routes, increase CONFIG_CAN_ROUTER_MAX_ROUTES");
+    return -ENOMEM;
+  }
+
+  for (int i = 0; i < entry_count; i++) {
+    const struct can_router_entry_t *entry = &entries[i];
+    const struct can_router_action_t *action = entry->action;
+
+    if (entry->from == NULL || entry->to == NULL) {
+      return -EINVAL;
+    }
+    if (!device_is_ready(*entry->from) || !device_is_ready(*entry->to)) {
+      LOG_ERR("Route %d uses a device that is not ready", i);
+      return -ENODEV;
+    }
+
+    if (action == NULL) {
+      continue;
+    }
+
+    if ((action->transform_count > 0 && action->transforms == NULL) ||
+        (action->fan_out_count > 0 && action->fan_out == NULL)) {
+      return -EINVAL;
+    }
+    if (action->fan_out_count > CONFIG_CAN_ROUTER_MAX_FAN_OUT) {
+      LOG_ERR("Route %d fans out to %u destinations, increase "
+              "CONFIG_CAN_ROUTER_MAX_FAN_OUT",
+              i, action->fan_out_count);
+      return -ENOMEM;
+    }
+    for (uint8_t j = 0; j < action->fan_out_count; j++) {
+      if (!device_is_ready(*action->fan_out[j])) {
+        LOG_ERR("Route %d fans out to a device that is not ready", i);
+        return -ENODEV;
+      }
+    }
+  }
+
+  if (!can_router_destinations_fit(entries, entry_count)) {
+    LOG_ERR("Too many destinations, increase "
+            "CONFIG_CAN_ROUTER_MAX_DESTINATIONS");
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+// Sets up the route of a validated entry and installs its hardware filter,
+// must be called with the mutex held
+static int can_router_table_add(struct can_router_route_table *table,
+                                const struct can_router_entry_t *entry) {
+  const struct can_router_action_t *action = entry->action;
+  const uint8_t fan_out_count = action != NULL ? action->fan_out_count : 0;
+
+  struct can_router_route *route = &table->routes[table->count];
+  *route = (struct can_router_route){
+    .table = table,
+    .entry = entry,
+    .refilled_at_us = can_router_now_us(),
+    .tokens = action != NULL ? MAX(action->rate_limit.burst, 1) : 0,
+  };
+
+  for (uint8_t i = 0; i <= fan_out_count; i++) {
+    const struct device *to = i == 0 ? *entry->to : *action->fan_out[i - 1];
+    route->queues[i] = can_router_queue_get(to, true);
+  }
+  route->queue_count = 1 + fan_out_count;
+
+  const int filter_id = can_demux_add_rx_filter(
+      *entry->from, can_router_frame_cb, route, &entry->filter);
+  if (filter_id < 0) {
+    LOG_ERR("Could not add filter on %s (%d)", (*entry->from)->name,
+            filter_id);
+    return filter_id;
+  }
+
+  table->filter_ids[table->count] = filter_id;
+  table->count++;
+  return 0;
+}
+
+// Removes the hardware filters of a table and waits until no RX callback
+// uses it anymore, must be called with the mutex held
+static void can_router_table_release(struct can_router_route_table *table) {
+  for (size_t i = 0; i < table->count; i++) {
+    can_demux_remove_rx_filter(*table->routes[i].entry->from,
+                               table->filter_ids[i]);
+  }
+
+  // Gives left over from earlier releases are dropped, a reader that leaves
+  // after the check below wakes it up again
+  k_sem_reset(&can_router_released);
+  while (atomic_get(&table->readers) != 0) {
+    k_sem_take(&can_router_released, K_FOREVER);
   }
 
-  LOG_DBG("Routed frame from %s to %s", dev->name, to->name);
+  table->count = 0;
+}
+
+int can_router_validate(const struct can_router_entry_t *entries,
+                        int entry_count) {
+  k_mutex_lock(&can_router_mutex, K_FOREVER);
+  int err = can_router_validate_locked(entries, entry_count, 0);
+  k_mutex_unlock(&can_router_mutex);
+
+  return err;
 }
 
 int can_router_register(const struct can_router_entry_t *entries,
                         int entry_count) {
   LOG_DBG("Registering %d can router entries", entry_count);
+
+  k_mutex_lock(&can_router_mutex, K_FOREVER);
+  struct can_router_route_table *table = atomic_ptr_get(&can_router_active);
+
+  int err = can_router_validate_locked(entries, entry_count, table->count);
+  for (int i = 0; i < entry_count && err == 0; i++) {
+    err = can_router_table_add(table, &entries[i]);
+  }
+  k_mutex_unlock(&can_router_mutex);
+
+  if (err) {
+    return err;
+  }
+
+  LOG_DBG("Registered %d can router entries", entry_count);
+
+  return 0;
+}
+
+int can_router_replace(const struct can_router_entry_t *entries,
+                       int entry_count) {
+  k_mutex_lock(&can_router_mutex, K_FOREVER);
+
+  int err = can_router_validate_locked(entries, entry_count, 0);
+  if (err) {
+    k_mutex_unlock(&can_router_mutex);
+    return err;
+  }
+
+  struct can_router_route_table *active = atomic_ptr_get(&can_router_active);
+  struct can_router_route_table *next = active == &can_router_tables[0]
+                                            ? &can_router_tables[1]
+                                            : &can_router_tables[0];
+
+  // The new filters are installed while the old table is still active, so
+  // their callbacks leave the frames to the old routes until the swap
   for (int i = 0; i < entry_count; i++) {
-    const int err =
-        can_add_rx_filter(*entries[i].from, can_router_frame_cb,
-                          (void *)*entries[i].to, &entries[i].filter);
+    err = can_router_table_add(next, &entries[i]);
     if (err) {
+      can_router_table_release(next);
+      k_mutex_unlock(&can_router_mutex);
       return err;
     }
   }
 
-  LOG_DBG("Registered %d can router entries", entry_count);
+  atomic_ptr_set(&can_router_active, next);
+  can_router_table_release(active);
+
+  k_mutex_unlock(&can_router_mutex);
+
+  LOG_INF("Replaced routing table with %d entries", entry_count);
 
   return 0;
 }
 
+int can_router_get_stats(const struct device *to,
+                         struct can_router_stats *stats) {
+  struct can_router_queue *queue = can_router_queue_get(to, false);
+  if (queue == NULL) {
+    return -ENOENT;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&queue->lock);
+  stats->sent = queue->sent;
+  stats->dropped = queue->dropped;
+  stats->errors = queue->errors;
+  stats->high_water = queue->high_water;
+  stats->latency_avg_us =
+      queue->sent > 0 ? (uint32_t)(queue->latency_total_us / queue->sent) : 0;
+  stats->latency_max_us = queue->latency_max_us;
+  k_spin_unlock(&queue->lock, key);
+
+  return 0;
+}
+
+int can_router_get_route_stats(int index,
+                               struct can_router_route_stats *stats) {
+  int err = -ENOENT;
+
+  k_mutex_lock(&can_router_mutex, K_FOREVER);
+  const struct can_router_route_table *table =
+      atomic_ptr_get(&can_router_active);
+  if (index >= 0 && (size_t)index < table->count) {
+    const struct can_router_route *route = &table->routes[index];
+
+    stats->matched = route->matched;
+    stats->routed = route->routed;
+    stats->translated = route->translated;
+    stats->throttled = route->throttled;
+    err = 0;
+  }
+  k_mutex_unlock(&can_router_mutex);
+
+  return err;
+}
+
 static int can_router_sysinit() {
   LOG_DBG("Initializing can router");
 
@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+
+#include <zephyr/devicetree.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include <ardep/can_router.h>
+#include <ardep/uds.h>
+
+LOG_MODULE_DECLARE(can_router, CONFIG_CAN_ROUTER_LOG_LEVEL);
+
+// Note that this file is only compiled if CONFIG_CAN_ROUTER_UDS is set
+
+#define CAN_ROUTER_UDS_RECORD_SIZE 11
+#define CAN_ROUTER_UDS_MAX_BUSES 8
+
+#define CAN_ROUTER_UDS_BUS(i, _)                                       \
+  COND_CODE_1(DT_HAS_ALIAS(can_router_bus##i),                         \
+              (DEVICE_DT_GET(DT_ALIAS(can_router_bus##i))), (NULL))
+
+static const struct device *can_router_uds_buses[] = {
+  LISTIFY(CAN_ROUTER_UDS_MAX_BUSES, CAN_ROUTER_UDS_BUS, (, )),
+};
+
+// The table written last is installed while the next one is parsed, the
+// router is done with it once can_router_replace() returns
+static struct can_router_entry_t
+    can_router_uds_entries[2][CONFIG_CAN_ROUTER_MAX_ROUTES];
+static uint8_t can_router_uds_next;
+
+static UDSErr_t can_router_uds_write_check(
+    const struct uds_context *const context, bool *apply_action) {
+  if (context->server->sessionType == UDS_DIAG_SESSION__DEFAULT) {
+    LOG_WRN("Cannot write the routing table in the default session");
+    return UDS_NRC_ConditionsNotCorrect;
+  }
+
+  *apply_action = true;
+  return UDS_OK;
+}
+
+static UDSErr_t can_router_uds_write(struct uds_context *const context,
+                                     bool *consume_event) {
+  UDSWDBIArgs_t *args = context->arg;
+
+  *consume_event = true;
+
+  if (args->len % CAN_ROUTER_UDS_RECORD_SIZE != 0) {
+    return UDS_NRC_IncorrectMessageLengthOrInvalidFormat;
+  }
+
+  const size_t entry_count = args->len / CAN_ROUTER_UDS_RECORD_SIZE;
+  if (entry_count > CONFIG_CAN_ROUTER_MAX_ROUTES) {
+    return UDS_NRC_RequestOutOfRange;
+  }
+
+  struct can_router_entry_t *entries =
+      can_router_uds_entries[can_router_uds_next];
+
+  for (size_t i = 0; i < entry_count; i++) {
+    const uint8_t *record = &args->data[i * CAN_ROUTER_UDS_RECORD_SIZE];
+    const uint8_t from = record[0];
+    const uint8_t to = record[1];
+
+    if (from >= ARRAY_SIZE(can_router_uds_buses) ||
+        to >= ARRAY_SIZE(can_router_uds_buses) ||
+        can_router_uds_buses[from] == NULL ||
+        can_router_uds_buses[to] == NULL) {
+      LOG_WRN("Route %zu uses an unknown bus", i);
+      return UDS_NRC_RequestOutOfRange;
+    }
+
+    entries[i] = (struct can_router_entry_t){
+      .from = &can_router_uds_buses[from],
+      .to = &can_router_uds_buses[to],
+      .filter =
+          {
+            .flags = record[2],
+            .id = sys_get_be32(&record[3]),
+            .mask = sys_get_be32(&record[7]),
+          },
+    };
+  }
+
+  int err = can_router_replace(entries, entry_count);
+  if (err == -EINVAL || err == -ENODEV || err == -ENOMEM) {
+    LOG_WRN("Rejected routing table (%d)", err);
+    return UDS_NRC_RequestOutOfRange;
+  }
+  if (err) {
+    LOG_ERR("Could not install routing table (%d)", err);
+    return UDS_NRC_ConditionsNotCorrect;
+  }
+
+  can_router_uds_next ^= 1;
+
+  return UDS_PositiveResponse;
+}
+
+UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(&uds_default_instance,
+                                        CAN_ROUTER_UDS_ROUTE_TABLE_DATA_ID,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        can_router_uds_write_check,
+                                        can_router_uds_write,
+                                        NULL,
+                                        NULL,
+                                        NULL);
@@ -0,0 +1,441 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include <ardep/can_demux.h>
+#include <ardep/can_stats.h>
+
+LOG_MODULE_REGISTER(can_stats, CONFIG_CAN_STATS_LOG_LEVEL);
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_CAN_STATS_ID_TABLE_SIZE),
+             "CONFIG_CAN_STATS_ID_TABLE_SIZE must be a power of two");
+
+#define CAN_STATS_KEY_EMPTY UINT32_MAX
+// Set in the key of extended IDs, which only use 29 bits
+#define CAN_STATS_KEY_IDE BIT(31)
+
+// IDs are only added while the table is at most three quarters full, which
+// keeps the probe sequences short
+#define CAN_STATS_MAX_IDS (CONFIG_CAN_STATS_ID_TABLE_SIZE * 3 / 4)
+
+struct can_stats_id_entry {
+  uint32_t key;
+  uint32_t rx_count;
+  uint32_t tx_count;
+  // Cycle count and uptime when the ID was last seen, the uptime covers
+  // intervals the cycle counter wraps in
+  uint32_t last_cycles;
+  uint32_t last_ms;
+  uint32_t interval_avg_us;
+  uint32_t interval_min_us;
+  uint32_t interval_max_us;
+  uint32_t jitter_us;
+};
+
+struct can_stats_device {
+  const struct device *dev;
+
+  struct k_spinlock lock;
+  uint32_t ns_per_bit;
+  uint32_t ns_per_data_bit;
+  // Bus time of the frames in the current window
+  uint64_t busy_ns;
+  struct can_stats_bus bus;
+  struct can_stats_id_entry ids[CONFIG_CAN_STATS_ID_TABLE_SIZE];
+  uint16_t id_count;
+
+  struct k_work_delayable window;
+  int filter_ids[2];
+};
+
+static struct can_stats_device can_stats_devices[CONFIG_CAN_STATS_MAX_DEVICES];
+
+// Serializes enabling buses
+K_MUTEX_DEFINE(can_stats_mutex);
+
+// Intervals longer than this are taken from the uptime
+static uint32_t can_stats_cycles_wrap_ms;
+
+static uint32_t can_stats_frame_key(const struct can_frame *frame) {
+  return (frame->flags & CAN_FRAME_IDE) != 0 ? frame->id | CAN_STATS_KEY_IDE
+                                             : frame->id;
+}
+
+static uint32_t can_stats_hash(uint32_t key) {
+  key ^= key >> 16;
+  key *= 0x45d9f3bU;
+  key ^= key >> 16;
+  return key & (CONFIG_CAN_STATS_ID_TABLE_SIZE - 1);
+}
+
+// Returns the entry of a key, adding it if there is room, must be called
+// with the lock held
+static struct can_stats_id_entry *can_stats_id_get(
+    struct can_stats_device *ctx, uint32_t key) {
+  uint32_t index = can_stats_hash(key);
+
+  while (true) {
+    struct can_stats_id_entry *entry = &ctx->ids[index];
+    if (entry->key == key) {
+      return entry;
+    }
+
+    if (entry->key == CAN_STATS_KEY_EMPTY) {
+      if (ctx->id_count >= CAN_STATS_MAX_IDS) {
+        return NULL;
+      }
+
+      *entry = (struct can_stats_id_entry){
+        .key = key,
+        .interval_min_us = UINT32_MAX,
+      };
+      ctx->id_count++;
+      return entry;
+    }
+
+    index = (index + 1) & (CONFIG_CAN_STATS_ID_TABLE_SIZE - 1);
+  }
+}
+
+/*
+ * Bus time of a frame. Bit stuffing is assumed to add the worst case number
+ * of stuff bits, so the bus load is rather over- than underestimated. The
+ * data phase of CAN FD frames with bit rate switching uses the data bitrate.
+ */
+static uint32_t can_stats_frame_ns(const struct can_stats_device *ctx,
+                                   const struct can_frame *frame) {
+  const bool ext = (frame->flags & CAN_FRAME_IDE) != 0;
+  const uint32_t len =
+      (frame->flags & CAN_FRAME_RTR) != 0 ? 0 : can_dlc_to_bytes(frame->dlc);
+  // CRC delimiter, ACK slot and delimiter, end of frame and interframe space
+  const uint32_t trailer = 13;
+
+  if ((frame->flags & CAN_FRAME_FDF) == 0) {
+    // Start of frame up to the CRC is subject to bit stuffing
+    const uint32_t stuffed = (ext ? 54 : 34) + 8 * len;
+    return (stuffed + (stuffed - 1) / 4 + trailer) * ctx->ns_per_bit;
+  }
+
+  // Start of frame up to the bit rate switch
+  const uint32_t header = ext ? 36 : 17;
+  // Error state indicator, DLC and data
+  const uint32_t payload = 5 + 8 * len;
+  const uint32_t crc = len <= 16 ? 17 : 21;
+  // Stuff count and CRC with their fixed stuff bits
+  const uint32_t checksum = 4 + crc + (4 + crc + 3) / 4;
+  const uint32_t data =
+      payload + (header + payload - 1) / 4 + checksum;
+
+  const uint32_t ns_per_data_bit = (frame->flags & CAN_FRAME_BRS) != 0
+                                       ? ctx->ns_per_data_bit
+                                       : ctx->ns_per_bit;
+  return (header + trailer) * ctx->ns_per_bit + data * ns_per_data_bit;
+}
+
+static void can_stats_record(struct can_stats_device *ctx,
+                             const struct can_frame *frame,
+                             bool tx) {
+  const uint32_t now_cycles = k_cycle_get_32();
+  const uint32_t now_ms = k_uptime_get_32();
+  const uint32_t frame_ns = can_stats_frame_ns(ctx, frame);
+
+  k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+
+  ctx->busy_ns += frame_ns;
+  if (tx) {
+    ctx->bus.tx_frames++;
+  } else {
+    ctx->bus.rx_frames++;
+  }
+
+  struct can_stats_id_entry *entry =
+      can_stats_id_get(ctx, can_stats_frame_key(frame));
+  if (entry == NULL) {
+    ctx->bus.untracked_frames++;
+    k_spin_unlock(&ctx->lock, key);
+    return;
+  }
+
+  if (entry->rx_count + entry->tx_count > 0) {
+    const uint32_t elapsed_ms = now_ms - entry->last_ms;
+    const uint32_t interval_us =
+        elapsed_ms < can_stats_cycles_wrap_ms
+            ? k_cyc_to_us_floor32(now_cycles - entry->last_cycles)
+            : elapsed_ms * USEC_PER_MSEC;
+
+    if (entry->interval_min_us == UINT32_MAX) {
+      entry->interval_avg_us = interval_us;
+    } else {
+      // Jitter as in RFC 3550, relative to the average interval
+      const int32_t deviation =
+          (int32_t)(interval_us - entry->interval_avg_us);
+      entry->jitter_us += ((int32_t)abs(deviation) -
+                           (int32_t)entry->jitter_us) / 16;
+      entry->interval_avg_us += deviation / 8;
+    }
+    entry->interval_min_us = MIN(entry->interval_min_us, interval_us);
+    entry->interval_max_us = MAX(entry->interval_max_us, interval_us);
+  }
+  entry->last_cycles = now_cycles;
+  entry->last_ms = now_ms;
+  if (tx) {
+    entry->tx_count++;
+  } else {
+    entry->rx_count++;
+  }
+
+  k_spin_unlock(&ctx->lock, key);
+}
+
+static void can_stats_rx_cb(const struct device *dev,
+                            struct can_frame *frame,
+                            void *user_data) {
+  ARG_UNUSED(dev);
+  can_stats_record(user_data, frame, false);
+}
+
+// Closes a window: computes the bus load and samples the error counters
+static void can_stats_window_work(struct k_work *work) {
+  struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+  struct can_stats_device *ctx =
+      CONTAINER_OF(dwork, struct can_stats_device, window);
+
+  enum can_state state;
+  struct can_bus_err_cnt err_cnt;
+  int err = can_get_state(ctx->dev, &state, &err_cnt);
+
+  k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+
+  const uint64_t window_ns =
+      (uint64_t)CONFIG_CAN_STATS_WINDOW_MS * NSEC_PER_MSEC;
+  const uint16_t load = MIN(ctx->busy_ns * 1000 / window_ns, 1000);
+  ctx->busy_ns = 0;
+  ctx->bus.load_permille = load;
+  ctx->bus.load_peak_permille = MAX(ctx->bus.load_peak_permille, load);
+
+  if (err == 0) {
+    if (state == CAN_STATE_ERROR_PASSIVE &&
+        ctx->bus.state != CAN_STATE_ERROR_PASSIVE) {
+      ctx->bus.error_passive_count++;
+    }
+    if (state == CAN_STATE_BUS_OFF && ctx->bus.state != CAN_STATE_BUS_OFF) {
+      ctx->bus.bus_off_count++;
+    }
+
+    ctx->bus.tx_err_trend = err_cnt.tx_err_cnt - ctx->bus.tx_err_cnt;
+    ctx->bus.rx_err_trend = err_cnt.rx_err_cnt - ctx->bus.rx_err_cnt;
+    ctx->bus.tx_err_cnt = err_cnt.tx_err_cnt;
+    ctx->bus.rx_err_cnt = err_cnt.rx_err_cnt;
+    ctx->bus.state = state;
+  }
+
+  k_spin_unlock(&ctx->lock, key);
+
+  if (err != 0) {
+    LOG_WRN("Could not get the state of %s (%d)", ctx->dev->name, err);
+  }
+
+  k_work_reschedule(dwork, K_MSEC(CONFIG_CAN_STATS_WINDOW_MS));
+}
+
+static struct can_stats_device *can_stats_device_get(
+    const struct device *dev) {
+  for (size_t i = 0; i < ARRAY_SIZE(can_stats_devices); i++) {
+    if (can_stats_devices[i].dev == dev && dev != NULL) {
+      return &can_stats_devices[i];
+    }
+  }
+
+  return NULL;
+}
+
+// Clears the statistics, must be called with the lock held
+static void can_stats_clear(struct can_stats_device *ctx) {
+  ctx->busy_ns = 0;
+  ctx->bus = (struct can_stats_bus){
+    .state = ctx->bus.state,
+    .tx_err_cnt = ctx->bus.tx_err_cnt,
+    .rx_err_cnt = ctx->bus.rx_err_cnt,
+  };
+  for (size_t i = 0; i < ARRAY_SIZE(ctx->ids); i++) {
+    ctx->ids[i].key = CAN_STATS_KEY_EMPTY;
+  }
+  ctx->id_count = 0;
+}
+
+int can_stats_enable(const struct device *dev,
+                     uint32_t bitrate,
+                     uint32_t bitrate_data) {
+  if (bitrate == 0) {
+    return -EINVAL;
+  }
+  if (bitrate_data == 0) {
+    bitrate_data = bitrate;
+  }
+
+  k_mutex_lock(&can_stats_mutex, K_FOREVER);
+
+  if (can_stats_cycles_wrap_ms == 0) {
+    can_stats_cycles_wrap_ms = (uint32_t)((uint64_t)UINT32_MAX *
+                                          MSEC_PER_SEC /
+                                          sys_clock_hw_cycles_per_sec() / 2);
+  }
+
+  struct can_stats_device *ctx = can_stats_device_get(dev);
+  if (ctx != NULL) {
+    k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+    ctx->ns_per_bit = NSEC_PER_SEC / bitrate;
+    ctx->ns_per_data_bit = NSEC_PER_SEC / bitrate_data;
+    k_spin_unlock(&ctx->lock, key);
+
+    k_mutex_unlock(&can_stats_mutex);
+    return 0;
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(can_stats_devices) && ctx == NULL; i++) {
+    if (can_stats_devices[i].dev == NULL) {
+      ctx = &can_stats_devices[i];
+    }
+  }
+  if (ctx == NULL) {
+    k_mutex_unlock(&can_stats_mutex);
+    LOG_ERR("Too many buses, increase CONFIG_CAN_STATS_MAX_DEVICES");
+    return -ENOSPC;
+  }
+
+  ctx->ns_per_bit = NSEC_PER_SEC / bitrate;
+  ctx->ns_per_data_bit = NSEC_PER_SEC / bitrate_data;
+  can_stats_clear(ctx);
+
+  const struct can_filter filters[] = {
+    {.id = 0, .mask = 0, .flags = 0},
+    {.id = 0, .mask = 0, .flags = CAN_FILTER_IDE},
+  };
+  for (size_t i = 0; i < ARRAY_SIZE(filters); i++) {
+    ctx->filter_ids[i] =
+        can_demux_add_rx_filter(dev, can_stats_rx_cb, ctx, &filters[i]);
+    if (ctx->filter_ids[i] < 0) {
+      int err = ctx->filter_ids[i];
+      LOG_ERR("Could not add RX filter on %s (%d)", dev->name, err);
+      if (i > 0) {
+        can_demux_remove_rx_filter(dev, ctx->filter_ids[0]);
+      }
+      k_mutex_unlock(&can_stats_mutex);
+      return err;
+    }
+  }
+
+  // Published last, frames sent before are not counted
+  ctx->dev = dev;
+
+  k_work_init_delayable(&ctx->window, can_stats_window_work);
+  k_work_reschedule(&ctx->window, K_MSEC(CONFIG_CAN_STATS_WINDOW_MS));
+
+  k_mutex_unlock(&can_stats_mutex);
+
+  LOG_INF("Monitoring %s", dev->name);
+
+  return 0;
+}
+
+void can_stats_record_tx(const struct device *dev,
+                         const struct can_frame *frame) {
+  struct can_stats_device *ctx = can_stats_device_get(dev);
+  if (ctx != NULL) {
+    can_stats_record(ctx, frame, true);
+  }
+}
+
+int can_stats_get_bus(const struct device *dev, struct can_stats_bus *stats) {
+  struct can_stats_device *ctx = can_stats_device_get(dev);
+  if (ctx == NULL) {
+    return -ENOENT;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+  *stats = ctx->bus;
+  k_spin_unlock(&ctx->lock, key);
+
+  return 0;
+}
+
+int can_stats_foreach_id(const struct device *dev,
+                         can_stats_id_cb_t cb,
+                         void *user_data) {
+  struct can_stats_device *ctx = can_stats_device_get(dev);
+  if (ctx == NULL) {
+    return -ENOENT;
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(ctx->ids); i++) {
+    k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+    const struct can_stats_id_entry entry = ctx->ids[i];
+    k_spin_unlock(&ctx->lock, key);
+
+    if (entry.key == CAN_STATS_KEY_EMPTY) {
+      continue;
+    }
+
+    const struct can_stats_id stats = {
+      .id = entry.key & ~CAN_STATS_KEY_IDE,
+      .extended = (entry.key & CAN_STATS_KEY_IDE) != 0,
+      .rx_count = entry.rx_count,
+      .tx_count = entry.tx_count,
+      .interval_avg_us = entry.interval_avg_us,
+      .interval_min_us =
+          entry.interval_min_us == UINT32_MAX ? 0 : entry.interval_min_us,
+      .interval_max_us = entry.interval_max_us,
+      .jitter_us = entry.jitter_us,
+    };
+    cb(&stats, user_data);
+  }
+
+  return 0;
+}
+
+int can_stats_reset(const struct device *dev) {
+  struct can_stats_device *ctx = can_stats_device_get(dev);
+  if (ctx == NULL) {
+    return -ENOENT;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&ctx->lock);
+  can_stats_clear(ctx);
+  k_spin_unlock(&ctx->lock, key);
+
+  return 0;
+}
+
+const struct device *can_stats_default_device(void) {
+  return can_stats_devices[0].dev;
+}
+
+#ifdef CONFIG_CAN_STATS_AUTOSTART
+#define CAN_STATS_BUS DT_CHOSEN(zephyr_canbus)
+
+static int can_stats_sysinit(void) {
+  const struct device *dev = DEVICE_DT_GET(CAN_STATS_BUS);
+
+  if (!device_is_ready(dev)) {
+    LOG_ERR("CAN device %s is not ready", dev->name);
+    return -ENODEV;
+  }
+
+  return can_stats_enable(dev, DT_PROP_OR(CAN_STATS_BUS, bitrate, 500000),
+                          DT_PROP_OR(CAN_STATS_BUS, bitrate_data, 0));
+}
+
+SYS_INIT(can_stats_sysinit, APPLICATION, CONFIG_CAN_STATS_INIT_PRIORITY);
+#endif  // CONFIG_CAN_STATS_AUTOSTART
@@ -0,0 +1,117 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+
+#include <zephyr/device.h>
+#include <zephyr/shell/shell.h>
+
+#include <ardep/can_stats.h>
+
+// Note that this file is only compiled if CONFIG_CAN_STATS_SHELL is set
+
+static const struct device *can_stats_shell_device(const struct shell *sh,
+                                                   size_t argc,
+                                                   char **argv) {
+  const struct device *dev =
+      argc > 1 ? device_get_binding(argv[1]) : can_stats_default_device();
+
+  if (dev == NULL) {
+    shell_error(sh, "No monitored CAN device");
+  }
+
+  return dev;
+}
+
+static int can_stats_cmd_bus(const struct shell *sh,
+                             size_t argc,
+                             char **argv) {
+  const struct device *dev = can_stats_shell_device(sh, argc, argv);
+  struct can_stats_bus bus;
+
+  if (dev == NULL) {
+    return -ENODEV;
+  }
+
+  int err = can_stats_get_bus(dev, &bus);
+  if (err) {
+    shell_error(sh, "%s is not monitored", dev->name);
+    return err;
+  }
+
+  shell_print(sh, "load: %u.%u%% (peak %u.%u%%)", bus.load_permille / 10,
+              bus.load_permille % 10, bus.load_peak_permille / 10,
+              bus.load_peak_permille % 10);
+  shell_print(sh, "frames: rx %u, tx %u, untracked %u", bus.rx_frames,
+              bus.tx_frames, bus.untracked_frames);
+  shell_print(sh, "state: %d, tec %u (%+d), rec %u (%+d)", bus.state,
+              bus.tx_err_cnt, bus.tx_err_trend, bus.rx_err_cnt,
+              bus.rx_err_trend);
+  shell_print(sh, "error passive: %u, bus off: %u", bus.error_passive_count,
+              bus.bus_off_count);
+
+  return 0;
+}
+
+static void can_stats_print_id(const struct can_stats_id *stats,
+                               void *user_data) {
+  const struct shell *sh = user_data;
+
+  shell_print(sh, "%8x%c %10u %10u %10u %10u %10u %10u", stats->id,
+              stats->extended ? 'x' : ' ', stats->rx_count, stats->tx_count,
+              stats->interval_avg_us, stats->interval_min_us,
+              stats->interval_max_us, stats->jitter_us);
+}
+
+static int can_stats_cmd_ids(const struct shell *sh,
+                             size_t argc,
+                             char **argv) {
+  const struct device *dev = can_stats_shell_device(sh, argc, argv);
+
+  if (dev == NULL) {
+    return -ENODEV;
+  }
+
+  shell_print(sh, "%9s %10s %10s %10s %10s %10s %10s", "id", "rx", "tx",
+              "avg [us]", "min [us]", "max [us]", "jitter");
+
+  int err = can_stats_foreach_id(dev, can_stats_print_id, (void *)sh);
+  if (err) {
+    shell_error(sh, "%s is not monitored", dev->name);
+  }
+
+  return err;
+}
+
+static int can_stats_cmd_reset(const struct shell *sh,
+                               size_t argc,
+                               char **argv) {
+  const struct device *dev = can_stats_shell_device(sh, argc, argv);
+
+  if (dev == NULL) {
+    return -ENODEV;
+  }
+
+  int err = can_stats_reset(dev);
+  if (err) {
+    shell_error(sh, "%s is not monitored", dev->name);
+  }
+
+  return err;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    can_stats_cmds,
+    SHELL_CMD_ARG(bus, NULL, "Bus load and error counters [device]",
+                  can_stats_cmd_bus, 1, 1),
+    SHELL_CMD_ARG(ids, NULL, "Statistics per CAN ID [device]",
+                  can_stats_cmd_ids, 1, 1),
+    SHELL_CMD_ARG(reset, NULL, "Clear the statistics [device]",
+                  can_stats_cmd_reset, 1, 1),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(can_stats, &can_stats_cmds, "CAN bus statistics", NULL);
@@ -0,0 +1,136 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include <ardep/can_stats.h>
+#include <ardep/uds.h>
+
+// Note that this file is only compiled if CONFIG_CAN_STATS_UDS is set
+
+#define CAN_STATS_UDS_BUS_RECORD_SIZE 32
+#define CAN_STATS_UDS_ID_RECORD_SIZE 20
+
+struct can_stats_uds_top {
+  struct can_stats_id ids[CONFIG_CAN_STATS_UDS_MAX_IDS];
+  size_t count;
+};
+
+// Only one read is answered at a time
+K_MUTEX_DEFINE(can_stats_uds_mutex);
+static struct can_stats_uds_top can_stats_uds_top;
+static uint8_t can_stats_uds_buffer[CAN_STATS_UDS_BUS_RECORD_SIZE +
+                                    CONFIG_CAN_STATS_UDS_MAX_IDS *
+                                        CAN_STATS_UDS_ID_RECORD_SIZE];
+
+static uint32_t can_stats_uds_frames(const struct can_stats_id *stats) {
+  return stats->rx_count + stats->tx_count;
+}
+
+// Keeps the IDs with the most frames, sorted in descending order
+static void can_stats_uds_collect(const struct can_stats_id *stats,
+                                  void *user_data) {
+  struct can_stats_uds_top *top = user_data;
+  const uint32_t frames = can_stats_uds_frames(stats);
+
+  size_t index = top->count;
+  while (index > 0 && can_stats_uds_frames(&top->ids[index - 1]) < frames) {
+    index--;
+  }
+  if (index >= ARRAY_SIZE(top->ids)) {
+    return;
+  }
+
+  const size_t moved = MIN(top->count, ARRAY_SIZE(top->ids) - 1) - index;
+  memmove(&top->ids[index + 1], &top->ids[index],
+          moved * sizeof(top->ids[0]));
+  top->ids[index] = *stats;
+  top->count = MIN(top->count + 1, ARRAY_SIZE(top->ids));
+}
+
+static UDSErr_t can_stats_uds_read_check(
+    const struct uds_context *const context, bool *apply_action) {
+  ARG_UNUSED(context);
+
+  if (can_stats_default_device() == NULL) {
+    return UDS_NRC_ConditionsNotCorrect;
+  }
+
+  *apply_action = true;
+  return UDS_OK;
+}
+
+static UDSErr_t can_stats_uds_read(struct uds_context *const context,
+                                   bool *consume_event) {
+  UDSRDBIArgs_t *args = context->arg;
+  const struct device *dev = can_stats_default_device();
+  struct can_stats_bus bus;
+
+  *consume_event = true;
+
+  k_mutex_lock(&can_stats_uds_mutex, K_FOREVER);
+
+  can_stats_uds_top.count = 0;
+  if (can_stats_get_bus(dev, &bus) != 0 ||
+      can_stats_foreach_id(dev, can_stats_uds_collect, &can_stats_uds_top) !=
+          0) {
+    k_mutex_unlock(&can_stats_uds_mutex);
+    return UDS_NRC_ConditionsNotCorrect;
+  }
+
+  uint8_t *record = can_stats_uds_buffer;
+  sys_put_be16(bus.load_permille, &record[0]);
+  sys_put_be16(bus.load_peak_permille, &record[2]);
+  sys_put_be32(bus.rx_frames, &record[4]);
+  sys_put_be32(bus.tx_frames, &record[8]);
+  sys_put_be32(bus.untracked_frames, &record[12]);
+  record[16] = bus.state;
+  record[17] = bus.tx_err_cnt;
+  record[18] = bus.rx_err_cnt;
+  sys_put_be16((uint16_t)bus.tx_err_trend, &record[19]);
+  sys_put_be16((uint16_t)bus.rx_err_trend, &record[21]);
+  sys_put_be32(bus.error_passive_count, &record[23]);
+  sys_put_be32(bus.bus_off_count, &record[27]);
+  record[CAN_STATS_UDS_BUS_RECORD_SIZE - 1] = can_stats_uds_top.count;
+
+  for (size_t i = 0; i < can_stats_uds_top.count; i++) {
+    const struct can_stats_id *stats = &can_stats_uds_top.ids[i];
+    record = &can_stats_uds_buffer[CAN_STATS_UDS_BUS_RECORD_SIZE +
+                                   i * CAN_STATS_UDS_ID_RECORD_SIZE];
+
+    sys_put_be32(stats->extended ? stats->id | BIT(31) : stats->id,
+                 &record[0]);
+    sys_put_be32(stats->rx_count, &record[4]);
+    sys_put_be32(stats->tx_count, &record[8]);
+    sys_put_be32(stats->interval_avg_us, &record[12]);
+    sys_put_be32(stats->jitter_us, &record[16]);
+  }
+
+  UDSErr_t ret = args->copy(
+      context->server, can_stats_uds_buffer,
+      CAN_STATS_UDS_BUS_RECORD_SIZE +
+          can_stats_uds_top.count * CAN_STATS_UDS_ID_RECORD_SIZE);
+
+  k_mutex_unlock(&can_stats_uds_mutex);
+
+  return ret;
+}
+
+UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(&uds_default_instance,
+                                        CAN_STATS_UDS_DATA_ID,
+                                        NULL,
+                                        can_stats_uds_read_check,
+                                        can_stats_uds_read,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL);
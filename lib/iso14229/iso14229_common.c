@@ -7,8 +7,19 @@
 
 #include "ardep/iso14229.h"
 
+#ifdef CONFIG_ISO14229_CAN_FD
+#include "iso14229_isotp_fd.h"
+#endif  // CONFIG_ISO14229_CAN_FD
+#ifdef CONFIG_ISO14229_THREAD_WAIT_EVENT
+#include "iso14229_executor.h"
+#endif  // CONFIG_ISO14229_THREAD_WAIT_EVENT
+
+#include <string.h>
+
 #include <zephyr/logging/log.h>
 
+#include <ardep/can_demux.h>
+#include <ardep/can_stats.h>
 #include <iso14229.h>
 
 LOG_MODULE_REGISTER(iso14229, CONFIG_ISO14229_LOG_LEVEL);
@@ -27,25 +38,210 @@ UDSErr_t uds_cb(struct UDSServer *srv, UDSEvent_t event, void *arg) {
   return ret;
 }
 
+// Number of queue slots kept free for flow control frames of the receive
+// path. The server is not polled (and thus sends no further consecutive
+// frames) while less space is available.
+#define ISO14229_TX_RESERVED_SLOTS 2
+
+static void iso14229_zephyr_tx_kick(struct iso14229_zephyr_tx *tx);
+
+static void iso14229_zephyr_wake(struct iso14229_zephyr_instance *inst) {
+#if defined(CONFIG_ISO14229_EXECUTOR)
+  iso14229_zephyr_executor_wake(inst);
+#elif defined(CONFIG_ISO14229_THREAD_WAIT_EVENT)
+  k_poll_signal_raise(&inst->thread_signal, 0);
+#else
+  ARG_UNUSED(inst);
+#endif
+}
+
+static void can_tx_done_cb(const struct device *dev, int error, void *user_data) {
+  struct iso14229_zephyr_tx *tx = user_data;
+
+  // The frame stays at the tail until it is released below
+  if (error == 0) {
+    can_stats_record_tx(dev, &tx->frames[tx->tail]);
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&tx->lock);
+  tx->tail = (tx->tail + 1) % ARRAY_SIZE(tx->frames);
+  tx->count--;
+  tx->in_flight = false;
+  if (error != 0) {
+    tx->errors++;
+  }
+  bool wake = tx->space_wanted;
+  tx->space_wanted = false;
+  k_spin_unlock(&tx->lock, key);
+
+  if (error != 0) {
+    LOG_WRN("CAN TX failed: %d", error);
+  }
+
+  if (wake) {
+    iso14229_zephyr_wake(CONTAINER_OF(tx, struct iso14229_zephyr_instance, tx));
+  }
+
+  iso14229_zephyr_tx_kick(tx);
+}
+
+// Hands the oldest queued frame to the CAN driver if none is in flight. The
+// completion callback may run synchronously from within can_send(), so it
+// only re-enters this function, which then returns right away and the loop
+// below picks up the next frame.
+static void iso14229_zephyr_tx_kick(struct iso14229_zephyr_tx *tx) {
+  k_spinlock_key_t key = k_spin_lock(&tx->lock);
+  if (tx->kicking) {
+    k_spin_unlock(&tx->lock, key);
+    return;
+  }
+  tx->kicking = true;
+
+  while (!tx->in_flight && tx->count > 0) {
+    const struct can_frame *frame = &tx->frames[tx->tail];
+    tx->in_flight = true;
+    k_spin_unlock(&tx->lock, key);
+
+    int err = can_send(tx->can_dev, frame, K_NO_WAIT, can_tx_done_cb, tx);
+
+    key = k_spin_lock(&tx->lock);
+    if (err == -EAGAIN) {
+      // All mailboxes busy, retried on the next event loop iteration
+      tx->in_flight = false;
+      break;
+    }
+    if (err != 0) {
+      LOG_WRN("Dropped CAN TX frame, error: %d", err);
+      tx->tail = (tx->tail + 1) % ARRAY_SIZE(tx->frames);
+      tx->count--;
+      tx->in_flight = false;
+      tx->errors++;
+    }
+  }
+
+  tx->kicking = false;
+  k_spin_unlock(&tx->lock, key);
+}
+
+int iso14229_zephyr_tx_enqueue(struct iso14229_zephyr_tx *tx,
+                               const struct can_frame *frame) {
+  k_spinlock_key_t key = k_spin_lock(&tx->lock);
+  if (tx->count == ARRAY_SIZE(tx->frames)) {
+    tx->overflows++;
+    k_spin_unlock(&tx->lock, key);
+    LOG_ERR("CAN TX queue overflow");
+    return -ENOBUFS;
+  }
+
+  tx->frames[(tx->tail + tx->count) % ARRAY_SIZE(tx->frames)] = *frame;
+  tx->count++;
+  k_spin_unlock(&tx->lock, key);
+
+  iso14229_zephyr_tx_kick(tx);
+  return 0;
+}
+
+// Returns true if the server may be polled. Otherwise the caller gets woken
+// up once a queued frame completed.
+static bool iso14229_zephyr_tx_has_space(struct iso14229_zephyr_tx *tx) {
+  k_spinlock_key_t key = k_spin_lock(&tx->lock);
+  bool has_space =
+      ARRAY_SIZE(tx->frames) - tx->count > ISO14229_TX_RESERVED_SLOTS;
+  if (!has_space) {
+    tx->space_wanted = true;
+  }
+  k_spin_unlock(&tx->lock, key);
+  return has_space;
+}
+
+static bool iso14229_zephyr_tx_needs_retry(struct iso14229_zephyr_tx *tx) {
+  k_spinlock_key_t key = k_spin_lock(&tx->lock);
+  bool retry = !tx->in_flight && tx->count > 0;
+  k_spin_unlock(&tx->lock, key);
+  return retry;
+}
+
+// The ISO-TP block size must leave room for the frames that are still
+// buffered when the flow control frame for the next block is sent
+BUILD_ASSERT(ISO_TP_DEFAULT_BLOCK_SIZE > 0 &&
+                 ISO_TP_DEFAULT_BLOCK_SIZE < CONFIG_ISO14229_PHYS_RX_RING_SIZE,
+             "ISO-TP block size does not fit into the receive ring");
+
+static void iso14229_zephyr_rx_ring_init(struct iso14229_zephyr_rx_ring *ring,
+                                         struct iso14229_zephyr_instance *inst,
+                                         struct can_frame *slots,
+                                         uint16_t num_slots) {
+  ring->inst = inst;
+  ring->slots = slots;
+  ring->num_slots = num_slots;
+  atomic_set(&ring->head, 0);
+  atomic_set(&ring->tail, 0);
+  ring->high_water = 0;
+  ring->dropped = 0;
+}
+
+// Producer side, called from the CAN RX callback. One slot always stays
+// empty to tell a full from an empty ring.
 static void can_rx_cb(const struct device *dev,
                       struct can_frame *frame,
                       void *user_data) {
+  struct iso14229_zephyr_rx_ring *ring = user_data;
+
   LOG_DBG("CAN RX: %03x [%u] %x ...", frame->id, frame->dlc, frame->data[0]);
-  int ret = k_msgq_put((struct k_msgq *)user_data, frame, K_NO_WAIT);
-  if (ret != 0) {
-    LOG_ERR("Dropped CAN frame, error: %d", ret);
+
+  uint32_t head = (uint32_t)atomic_get(&ring->head);
+  uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+  uint32_t used = (head + ring->num_slots - tail) % ring->num_slots;
+
+  if (used == ring->num_slots - 1U) {
+    ring->dropped++;
+    LOG_ERR("Dropped CAN frame, receive ring full");
+    return;
+  }
+
+  ring->slots[head] = *frame;
+  atomic_set(&ring->head, (head + 1) % ring->num_slots);
+
+  if (used + 1 > ring->high_water) {
+    ring->high_water = used + 1;
+  }
+
+  // The event loop drains the ring completely before it waits again, so only
+  // the first frame needs to wake it up
+  if (used == 0) {
+    iso14229_zephyr_wake(ring->inst);
   }
 }
 
+// Consumer side, returns the oldest frame without removing it from the ring
+static const struct can_frame *iso14229_zephyr_rx_ring_peek(
+    struct iso14229_zephyr_rx_ring *ring) {
+  uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+
+  if (tail == (uint32_t)atomic_get(&ring->head)) {
+    return NULL;
+  }
+
+  return &ring->slots[tail];
+}
+
+static void iso14229_zephyr_rx_ring_release(
+    struct iso14229_zephyr_rx_ring *ring) {
+  uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+
+  atomic_set(&ring->tail, (tail + 1) % ring->num_slots);
+}
+
 void iso14229_inject_can_frame_rx(struct iso14229_zephyr_instance *inst,
                                   struct can_frame *frame,
                                   bool functional_address) {
   frame->id = functional_address ? inst->tp.func_sa : inst->tp.phys_sa;
 
-  LOG_INF("Injecting CAN Frame: %03x [%u] %x ...", frame->id, frame->dlc,
-          frame->data[0]);
-  can_rx_cb((const struct device *)inst->tp.phys_link.user_send_can_arg, frame,
-            &inst->can_phys_msgq);
+  // The ring has a single producer, keep the CAN RX callback from
+  // interrupting the injection
+  unsigned int key = irq_lock();
+  can_rx_cb(inst->tx.can_dev, frame, &inst->can_phys_rx);
+  irq_unlock(key);
 }
 
 int iso14229_zephyr_set_callback(struct iso14229_zephyr_instance *inst,
@@ -57,17 +253,107 @@ int iso14229_zephyr_set_callback(struct iso14229_zephyr_instance *inst,
   return 0;
 }
 
-static void iso14229_zephyr_event_loop_tick(
-    struct iso14229_zephyr_instance *inst) {
-  struct can_frame frame_phys;
-  struct can_frame frame_func;
+static UDSTpStatus_t request_tp_poll(UDSTp_t *hdl) {
+  struct iso14229_zephyr_request_tp *tp =
+      CONTAINER_OF(hdl, struct iso14229_zephyr_request_tp, hdl);
+
+  return tp->inner->poll(tp->inner);
+}
+
+static ssize_t request_tp_send(UDSTp_t *hdl,
+                               uint8_t *buf,
+                               size_t len,
+                               UDSSDU_t *info) {
+  struct iso14229_zephyr_request_tp *tp =
+      CONTAINER_OF(hdl, struct iso14229_zephyr_request_tp, hdl);
+
+  return tp->inner->send(tp->inner, buf, len, info);
+}
+
+// Hands every received request to the request hook first and only returns
+// the requests the hook did not handle to the server
+static ssize_t request_tp_recv(UDSTp_t *hdl,
+                               uint8_t *buf,
+                               size_t bufsize,
+                               UDSSDU_t *info) {
+  struct iso14229_zephyr_request_tp *tp =
+      CONTAINER_OF(hdl, struct iso14229_zephyr_request_tp, hdl);
+  struct iso14229_zephyr_instance *inst =
+      CONTAINER_OF(tp, struct iso14229_zephyr_instance, request_tp);
+  UDSSDU_t local_info;
+
+  if (info == NULL) {
+    info = &local_info;
+  }
+
+  while (true) {
+    ssize_t len = tp->inner->recv(tp->inner, buf, bufsize, info);
+    if (len <= 0 || inst->request_hook == NULL) {
+      return len;
+    }
 
-  while (k_msgq_get(&inst->can_phys_msgq, &frame_phys, K_NO_WAIT) == 0) {
-    isotp_on_can_message(&inst->tp.phys_link, frame_phys.data, frame_phys.dlc);
+    const bool functional = info->A_TA_Type == UDS_A_TA_TYPE_FUNCTIONAL;
+    if (!inst->request_hook(inst, buf, len, functional)) {
+      return len;
+    }
   }
+}
 
-  while (k_msgq_get(&inst->can_func_msgq, &frame_func, K_NO_WAIT) == 0) {
-    isotp_on_can_message(&inst->tp.func_link, frame_func.data, frame_func.dlc);
+int iso14229_zephyr_send_response(struct iso14229_zephyr_instance *inst,
+                                  const uint8_t *data,
+                                  uint16_t len) {
+  UDSSDU_t info = {
+    .A_Mtype = UDS_A_MTYPE_DIAG,
+    .A_SA = inst->tp.phys_sa,
+    .A_TA = inst->tp.phys_ta,
+    .A_TA_Type = UDS_A_TA_TYPE_PHYSICAL,
+  };
+
+  UDSTp_t *tp = inst->request_tp.inner;
+  if (tp->send(tp, (uint8_t *)data, len, &info) != len) {
+    return -EIO;
+  }
+
+  return 0;
+}
+
+static void iso14229_zephyr_on_can_frame(struct iso14229_zephyr_instance *inst,
+                                         const struct can_frame *frame,
+                                         bool functional) {
+#ifdef CONFIG_ISO14229_CAN_FD
+  iso14229_zephyr_isotp_fd_on_can_frame(&inst->tp_fd, frame, functional);
+#else
+  // isotp-c only handles classic CAN frame lengths
+  uint8_t len = can_dlc_to_bytes(frame->dlc);
+  if (len > 8) {
+    LOG_WRN("Ignoring CAN FD frame with %u bytes", len);
+    return;
+  }
+
+  isotp_on_can_message(functional ? &inst->tp.func_link : &inst->tp.phys_link,
+                       frame->data, len);
+#endif  // CONFIG_ISO14229_CAN_FD
+}
+
+static void iso14229_zephyr_rx_drain(struct iso14229_zephyr_instance *inst,
+                                     struct iso14229_zephyr_rx_ring *ring,
+                                     bool functional) {
+  const struct can_frame *frame;
+
+  while ((frame = iso14229_zephyr_rx_ring_peek(ring)) != NULL) {
+    iso14229_zephyr_on_can_frame(inst, frame, functional);
+    iso14229_zephyr_rx_ring_release(ring);
+  }
+}
+
+static void iso14229_zephyr_event_loop_tick(
+    struct iso14229_zephyr_instance *inst) {
+  iso14229_zephyr_rx_drain(inst, &inst->can_phys_rx, false);
+  iso14229_zephyr_rx_drain(inst, &inst->can_func_rx, true);
+
+  iso14229_zephyr_tx_kick(&inst->tx);
+  if (!iso14229_zephyr_tx_has_space(&inst->tx)) {
+    return;
   }
 
   UDSServerPoll(&inst->server);
@@ -75,12 +361,153 @@ static void iso14229_zephyr_event_loop_tick(
 
 #ifdef CONFIG_ISO14229_THREAD
 
+#ifdef CONFIG_ISO14229_THREAD_WAIT_EVENT
+
+// Remaining time until a deadline in the wrapping time base of the iso14229
+// library. Timers expire once the current time is strictly after the
+// deadline, deadlines in the past are clamped to zero.
+static uint32_t time_until(uint32_t deadline, uint32_t now) {
+  int32_t diff = (int32_t)(deadline - now);
+  return diff >= 0 ? (uint32_t)diff + 1 : 0;
+}
+
+#ifndef CONFIG_ISO14229_CAN_FD
+static uint32_t isotp_link_next_deadline_us(const IsoTpLink *link,
+                                            uint32_t now_us,
+                                            uint32_t wait_us) {
+  if (link->send_status == ISOTP_SEND_STATUS_INPROGRESS) {
+    // Consecutive frames are only sent while the block is not exhausted,
+    // otherwise the link waits for the next flow control frame (N_Bs)
+    if (link->send_bs_remain > 0) {
+      uint32_t st_us = link->send_st_min_us == 0
+                           ? 0
+                           : time_until(link->send_timer_st, now_us);
+      wait_us = MIN(wait_us, st_us);
+    }
+    wait_us = MIN(wait_us, time_until(link->send_timer_bs, now_us));
+  }
+
+  if (link->receive_status == ISOTP_RECEIVE_STATUS_INPROGRESS) {
+    wait_us = MIN(wait_us, time_until(link->receive_timer_cr, now_us));
+  }
+
+  return wait_us;
+}
+#endif  // !CONFIG_ISO14229_CAN_FD
+
+// Computes how long (in microseconds) the event loop may sleep until the next
+// protocol timer of the server or the transport layer needs to be serviced.
+static uint32_t iso14229_zephyr_next_wait_us(
+    struct iso14229_zephyr_instance *inst) {
+  const UDSServer_t *srv = &inst->server;
+
+  // A frame rejected with -EAGAIN is not in flight, so no completion
+  // callback wakes the thread up for it
+  if (iso14229_zephyr_tx_needs_retry(&inst->tx)) {
+    return k_ticks_to_us_ceil32(1);
+  }
+  if (inst->tx.space_wanted) {
+    // Woken up by the transmit completion callback
+    return CONFIG_ISO14229_THREAD_MAX_WAIT_MS * USEC_PER_MSEC;
+  }
+
+  if (srv->requestInProgress) {
+    if (!srv->RCRRP) {
+      // The response is sent on the next iteration
+      return 0;
+    }
+    // The handler is re-evaluated until it stops answering with 0x78
+    return CONFIG_ISO14229_THREAD_PENDING_POLL_US;
+  }
+
+  uint32_t wait_us = CONFIG_ISO14229_THREAD_MAX_WAIT_MS * USEC_PER_MSEC;
+
+  const uint32_t now_ms = UDSMillis();
+  if (srv->sessionType != UDS_LEV_DS_DS) {
+    wait_us = MIN(wait_us, time_until(srv->s3_session_timeout_timer, now_ms) *
+                               USEC_PER_MSEC);
+  }
+  if (srv->ecuResetScheduled) {
+    wait_us =
+        MIN(wait_us, time_until(srv->ecuResetTimer, now_ms) * USEC_PER_MSEC);
+  }
+
+  const uint32_t now_us = isotp_user_get_us();
+#ifdef CONFIG_ISO14229_CAN_FD
+  wait_us =
+      iso14229_zephyr_isotp_fd_next_deadline_us(&inst->tp_fd, now_us, wait_us);
+#else
+  wait_us = isotp_link_next_deadline_us(&inst->tp.phys_link, now_us, wait_us);
+  wait_us = isotp_link_next_deadline_us(&inst->tp.func_link, now_us, wait_us);
+#endif  // CONFIG_ISO14229_CAN_FD
+
+  return wait_us;
+}
+
+#ifdef CONFIG_ISO14229_EXECUTOR
+
+uint32_t iso14229_zephyr_run_once(struct iso14229_zephyr_instance *inst) {
+  iso14229_zephyr_event_loop_tick(inst);
+  return iso14229_zephyr_next_wait_us(inst);
+}
+
+#else
+
+// Waits for the thread signal (raised on CAN reception among others) or until
+// wait_us elapsed. Sleeps are rounded down to whole ticks, see
+// iso14229_zephyr_sub_tick_wait() for the remainder below one tick.
+static void iso14229_zephyr_wait(struct iso14229_zephyr_instance *inst,
+                                 struct k_poll_event *events,
+                                 size_t num_events,
+                                 uint32_t wait_us) {
+  if (wait_us == 0) {
+    return;
+  }
+
+  uint32_t wait_ticks = k_us_to_ticks_floor32(wait_us);
+  if (wait_ticks == 0 && iso14229_zephyr_sub_tick_wait(wait_us)) {
+    return;
+  }
+  wait_ticks = MAX(wait_ticks, 1);
+
+  for (size_t i = 0; i < num_events; i++) {
+    events[i].state = K_POLL_STATE_NOT_READY;
+  }
+  k_poll(events, num_events, K_TICKS(wait_ticks));
+  k_poll_signal_reset(&inst->thread_signal);
+}
+
+static void iso14229_thread_entry(void *p1, void *p2, void *p3) {
+  struct iso14229_zephyr_instance *inst = (struct iso14229_zephyr_instance *)p1;
+
+  struct k_poll_event events[] = {
+    K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL, K_POLL_MODE_NOTIFY_ONLY,
+                             &inst->thread_signal),
+  };
+
+  while (atomic_get(&inst->thread_stop_requested) == 0) {
+    iso14229_zephyr_event_loop_tick(inst);
+    iso14229_zephyr_wait(inst, events, ARRAY_SIZE(events),
+                         iso14229_zephyr_next_wait_us(inst));
+    atomic_inc(&inst->thread_wakeups);
+  }
+
+  k_mutex_lock(&inst->thread_mutex, K_FOREVER);
+  inst->thread_running = false;
+  k_mutex_unlock(&inst->thread_mutex);
+}
+
+#endif  // CONFIG_ISO14229_EXECUTOR
+
+#else  // CONFIG_ISO14229_THREAD_WAIT_POLLING
+
 static void iso14229_thread_entry(void *p1, void *p2, void *p3) {
   struct iso14229_zephyr_instance *inst = (struct iso14229_zephyr_instance *)p1;
 
   while (atomic_get(&inst->thread_stop_requested) == 0) {
     iso14229_zephyr_event_loop_tick(inst);
     k_usleep(CONFIG_ISO14229_THREAD_SLEEP_US);
+    atomic_inc(&inst->thread_wakeups);
   }
 
   k_mutex_lock(&inst->thread_mutex, K_FOREVER);
@@ -88,6 +515,10 @@ static void iso14229_thread_entry(void *p1, void *p2, void *p3) {
   k_mutex_unlock(&inst->thread_mutex);
 }
 
+#endif  // CONFIG_ISO14229_THREAD_WAIT_EVENT
+
+#ifndef CONFIG_ISO14229_EXECUTOR
+
 int iso14229_zephyr_thread_start(struct iso14229_zephyr_instance *inst) {
   LOG_DBG("Starting UDS thread");
 
@@ -100,6 +531,9 @@ int iso14229_zephyr_thread_start(struct iso14229_zephyr_instance *inst) {
   }
 
   atomic_set(&inst->thread_stop_requested, 0);
+#ifdef CONFIG_ISO14229_THREAD_WAIT_EVENT
+  k_poll_signal_reset(&inst->thread_signal);
+#endif  // CONFIG_ISO14229_THREAD_WAIT_EVENT
   inst->thread_id = k_thread_create(&inst->thread_data, inst->thread_stack,
                                     K_KERNEL_STACK_SIZEOF(inst->thread_stack),
                                     iso14229_thread_entry, inst, NULL, NULL,
@@ -128,6 +562,9 @@ int iso14229_zephyr_thread_stop(struct iso14229_zephyr_instance *inst) {
   }
 
   atomic_set(&inst->thread_stop_requested, 1);
+#ifdef CONFIG_ISO14229_THREAD_WAIT_EVENT
+  k_poll_signal_raise(&inst->thread_signal, 0);
+#endif  // CONFIG_ISO14229_THREAD_WAIT_EVENT
   k_mutex_unlock(&inst->thread_mutex);
 
   // Wait for thread to finish
@@ -137,6 +574,8 @@ int iso14229_zephyr_thread_stop(struct iso14229_zephyr_instance *inst) {
   return 0;
 }
 
+#endif  // !CONFIG_ISO14229_EXECUTOR
+
 #endif  // CONFIG_ISO14229_THREAD
 
 int iso14229_zephyr_init(struct iso14229_zephyr_instance *inst,
@@ -145,6 +584,7 @@ int iso14229_zephyr_init(struct iso14229_zephyr_instance *inst,
                          void *user_context) {
   inst->user_context = user_context;
   inst->set_callback = iso14229_zephyr_set_callback;
+  inst->request_hook = NULL;
 
   int ret = k_mutex_init(&inst->event_callback_mutex);
   if (ret != 0) {
@@ -152,22 +592,50 @@ int iso14229_zephyr_init(struct iso14229_zephyr_instance *inst,
     return ret;
   }
 
-  k_msgq_init(&inst->can_phys_msgq, inst->can_phys_buffer,
-              sizeof(struct can_frame),
-              ARRAY_SIZE(inst->can_phys_buffer) / sizeof(struct can_frame));
-
-  k_msgq_init(&inst->can_func_msgq, inst->can_func_buffer,
-              sizeof(struct can_frame),
-              ARRAY_SIZE(inst->can_func_buffer) / sizeof(struct can_frame));
+  iso14229_zephyr_rx_ring_init(&inst->can_phys_rx, inst, inst->can_phys_slots,
+                               ARRAY_SIZE(inst->can_phys_slots));
+  iso14229_zephyr_rx_ring_init(&inst->can_func_rx, inst, inst->can_func_slots,
+                               ARRAY_SIZE(inst->can_func_slots));
+#if defined(CONFIG_ISO14229_EXECUTOR)
+  // Set by the CAN RX callback as soon as the filters are installed
+  atomic_set(&inst->executor_pending, 0);
+  inst->executor_busy = false;
+  inst->executor_stopping = false;
+  k_sem_init(&inst->executor_idle, 0, 1);
+#elif defined(CONFIG_ISO14229_THREAD_WAIT_EVENT)
+  // Raised by the CAN RX callback as soon as the filters are installed
+  k_poll_signal_init(&inst->thread_signal);
+#endif
 
   UDSServerInit(&inst->server);
   UDSISOTpCInit(&inst->tp, iso_tp_config);
 
   inst->server.fn = uds_cb;
   inst->server.fn_data = inst;
-  inst->server.tp = &inst->tp.hdl;
-  inst->tp.phys_link.user_send_can_arg = (void *)can_dev;
-  inst->tp.func_link.user_send_can_arg = (void *)can_dev;
+
+  memset(&inst->tx, 0, sizeof(inst->tx));
+  inst->tx.can_dev = can_dev;
+  inst->tp.phys_link.user_send_can_arg = &inst->tx;
+  inst->tp.func_link.user_send_can_arg = &inst->tx;
+
+#ifdef CONFIG_ISO14229_CAN_FD
+  can_mode_t capabilities;
+  ret = can_get_capabilities(can_dev, &capabilities);
+  if (ret != 0 || (capabilities & CAN_MODE_FD) == 0) {
+    LOG_ERR("CAN device does not support CAN FD");
+    return -ENOTSUP;
+  }
+
+  iso14229_zephyr_isotp_fd_init(&inst->tp_fd, &inst->tx, &inst->tp);
+  inst->request_tp.inner = &inst->tp_fd.hdl;
+#else
+  inst->request_tp.inner = &inst->tp.hdl;
+#endif  // CONFIG_ISO14229_CAN_FD
+
+  inst->request_tp.hdl.poll = request_tp_poll;
+  inst->request_tp.hdl.send = request_tp_send;
+  inst->request_tp.hdl.recv = request_tp_recv;
+  inst->server.tp = &inst->request_tp.hdl;
 
   const struct can_filter phys_filter = {
     .id = inst->tp.phys_sa,
@@ -179,16 +647,16 @@ int iso14229_zephyr_init(struct iso14229_zephyr_instance *inst,
     .mask = CAN_STD_ID_MASK,
   };
 
-  int err =
-      can_add_rx_filter(can_dev, can_rx_cb, &inst->can_phys_msgq, &phys_filter);
+  int err = can_demux_add_rx_filter(can_dev, can_rx_cb, &inst->can_phys_rx,
+                                    &phys_filter);
   if (err < 0) {
     printk("Failed to add RX filter for physical address: %d\n", err);
     return err;
   }
 
   if (inst->tp.func_sa != UDS_TP_NOOP_ADDR) {
-    err = can_add_rx_filter(can_dev, can_rx_cb, &inst->can_func_msgq,
-                            &func_filter);
+    err = can_demux_add_rx_filter(can_dev, can_rx_cb, &inst->can_func_rx,
+                                  &func_filter);
     if (err < 0) {
       printk("Failed to add RX filter for functional address: %d\n", err);
       return err;
@@ -198,8 +666,13 @@ int iso14229_zephyr_init(struct iso14229_zephyr_instance *inst,
   inst->event_loop_tick = iso14229_zephyr_event_loop_tick;
 
 #ifdef CONFIG_ISO14229_THREAD
+#ifdef CONFIG_ISO14229_EXECUTOR
+  inst->thread_start = iso14229_zephyr_executor_start;
+  inst->thread_stop = iso14229_zephyr_executor_stop;
+#else
   inst->thread_start = iso14229_zephyr_thread_start;
   inst->thread_stop = iso14229_zephyr_thread_stop;
+#endif  // CONFIG_ISO14229_EXECUTOR
 
   ret = k_mutex_init(&inst->thread_mutex);
   if (ret != 0) {
@@ -208,7 +681,10 @@ int iso14229_zephyr_init(struct iso14229_zephyr_instance *inst,
   }
 
   inst->thread_running = false;
+  atomic_set(&inst->thread_wakeups, 0);
+#ifndef CONFIG_ISO14229_EXECUTOR
   atomic_set(&inst->thread_stop_requested, 0);
+#endif  // !CONFIG_ISO14229_EXECUTOR
 #endif  // CONFIG_ISO14229_THREAD
 
   return 0;
@@ -0,0 +1,175 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "iso14229_executor.h"
+
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/slist.h>
+
+#include <iso14229.h>
+
+LOG_MODULE_DECLARE(iso14229, CONFIG_ISO14229_LOG_LEVEL);
+
+static K_KERNEL_STACK_ARRAY_DEFINE(executor_stacks,
+                                   CONFIG_ISO14229_EXECUTOR_THREADS,
+                                   CONFIG_ISO14229_THREAD_STACK_SIZE);
+static struct k_thread executor_threads[CONFIG_ISO14229_EXECUTOR_THREADS];
+
+// Given on every wake up, every executor thread then scans the instances once
+static K_SEM_DEFINE(executor_sem, 0, CONFIG_ISO14229_EXECUTOR_THREADS);
+
+// Protects the instance list and the executor state of the instances
+static struct k_spinlock executor_lock;
+static sys_slist_t executor_instances =
+    SYS_SLIST_STATIC_INIT(&executor_instances);
+
+// Picks the next instance that is due, either because it was woken up or its
+// deadline passed, and marks it busy. Otherwise returns NULL and the time
+// until the earliest deadline in wait_us.
+static struct iso14229_zephyr_instance *executor_next(uint32_t *wait_us) {
+  struct iso14229_zephyr_instance *inst;
+  struct iso14229_zephyr_instance *due = NULL;
+  uint32_t wait = CONFIG_ISO14229_THREAD_MAX_WAIT_MS * USEC_PER_MSEC;
+
+  k_spinlock_key_t key = k_spin_lock(&executor_lock);
+  const uint32_t now_us = isotp_user_get_us();
+
+  SYS_SLIST_FOR_EACH_CONTAINER (&executor_instances, inst, executor_node) {
+    if (inst->executor_busy) {
+      continue;
+    }
+
+    int32_t remaining = (int32_t)(inst->executor_deadline_us - now_us);
+    if (atomic_cas(&inst->executor_pending, 1, 0) || remaining <= 0) {
+      due = inst;
+      break;
+    }
+
+    wait = MIN(wait, (uint32_t)remaining);
+  }
+
+  if (due != NULL) {
+    due->executor_busy = true;
+    // Round robin between instances that are due at the same time
+    sys_slist_find_and_remove(&executor_instances, &due->executor_node);
+    sys_slist_append(&executor_instances, &due->executor_node);
+  }
+
+  k_spin_unlock(&executor_lock, key);
+
+  *wait_us = wait;
+  return due;
+}
+
+static void executor_thread_entry(void *p1, void *p2, void *p3) {
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  while (true) {
+    uint32_t wait_us;
+    struct iso14229_zephyr_instance *inst = executor_next(&wait_us);
+
+    if (inst != NULL) {
+      uint32_t next_us = iso14229_zephyr_run_once(inst);
+      atomic_inc(&inst->thread_wakeups);
+
+      k_spinlock_key_t key = k_spin_lock(&executor_lock);
+      inst->executor_deadline_us = isotp_user_get_us() + next_us;
+      inst->executor_busy = false;
+      const bool stopping = inst->executor_stopping;
+      k_spin_unlock(&executor_lock, key);
+
+      // The instance is not touched anymore once this is given
+      if (stopping) {
+        k_sem_give(&inst->executor_idle);
+      }
+      continue;
+    }
+
+    // Same as the per instance thread: sleep whole ticks, the remainder
+    // below one tick is only busy waited if configured
+    uint32_t wait_ticks = k_us_to_ticks_floor32(wait_us);
+    if (wait_ticks > 0 || !iso14229_zephyr_sub_tick_wait(wait_us)) {
+      k_sem_take(&executor_sem, K_TICKS(MAX(wait_ticks, 1)));
+    }
+  }
+}
+
+void iso14229_zephyr_executor_wake(struct iso14229_zephyr_instance *inst) {
+  atomic_set(&inst->executor_pending, 1);
+  k_sem_give(&executor_sem);
+}
+
+int iso14229_zephyr_executor_start(struct iso14229_zephyr_instance *inst) {
+  LOG_DBG("Adding instance to the UDS executor");
+
+  k_mutex_lock(&inst->thread_mutex, K_FOREVER);
+
+  if (inst->thread_running) {
+    LOG_WRN("Instance is already running");
+    k_mutex_unlock(&inst->thread_mutex);
+    return -EALREADY;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&executor_lock);
+  inst->executor_busy = false;
+  inst->executor_stopping = false;
+  inst->executor_deadline_us = isotp_user_get_us();
+  sys_slist_append(&executor_instances, &inst->executor_node);
+  k_spin_unlock(&executor_lock, key);
+
+  inst->thread_running = true;
+  k_mutex_unlock(&inst->thread_mutex);
+
+  iso14229_zephyr_executor_wake(inst);
+  return 0;
+}
+
+int iso14229_zephyr_executor_stop(struct iso14229_zephyr_instance *inst) {
+  LOG_DBG("Removing instance from the UDS executor");
+
+  k_mutex_lock(&inst->thread_mutex, K_FOREVER);
+
+  if (!inst->thread_running) {
+    LOG_WRN("Instance is not running");
+    k_mutex_unlock(&inst->thread_mutex);
+    return -EALREADY;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&executor_lock);
+  sys_slist_find_and_remove(&executor_instances, &inst->executor_node);
+  const bool busy = inst->executor_busy;
+  inst->executor_stopping = busy;
+  k_spin_unlock(&executor_lock, key);
+
+  // Wait for an executor thread that is still running the instance
+  if (busy) {
+    k_sem_take(&inst->executor_idle, K_FOREVER);
+  }
+
+  inst->thread_running = false;
+  k_mutex_unlock(&inst->thread_mutex);
+
+  LOG_DBG("Instance removed from the UDS executor");
+  return 0;
+}
+
+static int iso14229_zephyr_executor_init(void) {
+  for (int i = 0; i < CONFIG_ISO14229_EXECUTOR_THREADS; i++) {
+    k_tid_t tid = k_thread_create(
+        &executor_threads[i], executor_stacks[i],
+        K_KERNEL_STACK_SIZEOF(executor_stacks[i]), executor_thread_entry, NULL,
+        NULL, NULL, K_PRIO_COOP(7), 0, K_NO_WAIT);
+    k_thread_name_set(tid, "iso14229_executor");
+  }
+
+  return 0;
+}
+
+SYS_INIT(iso14229_zephyr_executor_init, POST_KERNEL, 0);
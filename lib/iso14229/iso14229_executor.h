@@ -0,0 +1,72 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ARDEP_LIB_ISO14229_EXECUTOR_H
+#define ARDEP_LIB_ISO14229_EXECUTOR_H
+
+#include <ardep/iso14229.h>
+
+/**
+ * @brief Busy wait for less than one tick if CONFIG_ISO14229_BUSY_WAIT_MAX_US
+ *        allows it
+ *
+ * @param wait_us Time to wait, shorter than one tick
+ *
+ * @returns true if the time was busy waited
+ * @returns false if the caller should sleep for one tick instead
+ */
+static inline bool iso14229_zephyr_sub_tick_wait(uint32_t wait_us) {
+  if (wait_us > CONFIG_ISO14229_BUSY_WAIT_MAX_US) {
+    return false;
+  }
+
+  k_busy_wait(wait_us);
+  return true;
+}
+
+/**
+ * @brief Run one iteration of the event loop of an instance
+ *
+ * @param inst Instance to run
+ *
+ * @returns Microseconds until the instance needs to be run again, unless it
+ *          is woken up earlier
+ */
+uint32_t iso14229_zephyr_run_once(struct iso14229_zephyr_instance* inst);
+
+/**
+ * @brief Mark an instance as pending and wake up an executor thread
+ *
+ * @note May be called from ISR context
+ *
+ * @param inst Instance to run
+ */
+void iso14229_zephyr_executor_wake(struct iso14229_zephyr_instance* inst);
+
+/**
+ * @brief Hand an instance to the executor
+ *
+ * @param inst Instance to serve
+ *
+ * @returns 0 on success
+ * @returns -EALREADY if the instance is already served
+ */
+int iso14229_zephyr_executor_start(struct iso14229_zephyr_instance* inst);
+
+/**
+ * @brief Remove an instance from the executor
+ *
+ * Waits until a running iteration of the event loop of the instance finished.
+ *
+ * @param inst Instance to remove
+ *
+ * @returns 0 on success
+ * @returns -EALREADY if the instance is not served
+ */
+int iso14229_zephyr_executor_stop(struct iso14229_zephyr_instance* inst);
+
+#endif  // ARDEP_LIB_ISO14229_EXECUTOR_H
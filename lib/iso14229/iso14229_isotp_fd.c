@@ -0,0 +1,495 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "iso14229_isotp_fd.h"
+
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+
+#include <iso14229.h>
+
+LOG_MODULE_DECLARE(iso14229, CONFIG_ISO14229_LOG_LEVEL);
+
+BUILD_ASSERT(CONFIG_ISO14229_CAN_FD_TX_DL == 8 ||
+                 CONFIG_ISO14229_CAN_FD_TX_DL == 12 ||
+                 CONFIG_ISO14229_CAN_FD_TX_DL == 16 ||
+                 CONFIG_ISO14229_CAN_FD_TX_DL == 20 ||
+                 CONFIG_ISO14229_CAN_FD_TX_DL == 24 ||
+                 CONFIG_ISO14229_CAN_FD_TX_DL == 32 ||
+                 CONFIG_ISO14229_CAN_FD_TX_DL == 48 ||
+                 CONFIG_ISO14229_CAN_FD_TX_DL == 64,
+             "CONFIG_ISO14229_CAN_FD_TX_DL is not a valid CAN FD frame length");
+
+#define ISOTP_FD_PCI_SF 0x0
+#define ISOTP_FD_PCI_FF 0x1
+#define ISOTP_FD_PCI_CF 0x2
+#define ISOTP_FD_PCI_FC 0x3
+
+#define ISOTP_FD_FS_CTS 0x0
+#define ISOTP_FD_FS_WAIT 0x1
+#define ISOTP_FD_FS_OVFLW 0x2
+
+// Largest message length that fits the 12 bit FF_DL of a first frame
+#define ISOTP_FD_FF_DL_MAX_SHORT 4095
+
+BUILD_ASSERT(CONFIG_ISO14229_CAN_FD_MTU <= ISOTP_FD_FF_DL_MAX_SHORT,
+             "Sending first frames with the escape sequence is not supported");
+
+// N_Bs and N_Cr timeouts, ISO 15765-2 table 16
+#define ISOTP_FD_TIMEOUT_US (1000 * USEC_PER_MSEC)
+
+// Frames up to this length use the classic single frame layout
+#define ISOTP_FD_CLASSIC_DL 8
+
+#define ISOTP_FD_PADDING 0xCC
+
+enum isotp_fd_status {
+  ISOTP_FD_STATUS_IDLE,
+  ISOTP_FD_STATUS_IN_PROGRESS,
+  ISOTP_FD_STATUS_FULL,
+  ISOTP_FD_STATUS_ERROR,
+};
+
+static bool time_after(uint32_t now, uint32_t deadline) {
+  return (int32_t)(deadline - now) < 0;
+}
+
+// Same semantics as in iso14229_common.c: time until time_after() is true
+static uint32_t time_until(uint32_t deadline, uint32_t now) {
+  int32_t diff = (int32_t)(deadline - now);
+  return diff >= 0 ? (uint32_t)diff + 1 : 0;
+}
+
+// Sends ISO-TP frame bytes as CAN FD frame. Frames longer than 8 bytes are
+// padded up to the next valid CAN FD data length.
+static int isotp_fd_send_frame(struct iso14229_zephyr_isotp_fd *fd,
+                               uint32_t id,
+                               struct can_frame *frame,
+                               uint8_t len) {
+  frame->id = id;
+  frame->flags = CAN_FRAME_FDF;
+  if (IS_ENABLED(CONFIG_ISO14229_CAN_FD_BRS)) {
+    frame->flags |= CAN_FRAME_BRS;
+  }
+  frame->dlc = can_bytes_to_dlc(len);
+  memset(&frame->data[len], ISOTP_FD_PADDING,
+         can_dlc_to_bytes(frame->dlc) - len);
+
+  return iso14229_zephyr_tx_enqueue(fd->tx, frame);
+}
+
+static void isotp_fd_send_flow_control(struct iso14229_zephyr_isotp_fd *fd,
+                                       uint8_t flow_status) {
+  struct can_frame frame;
+  frame.data[0] = (ISOTP_FD_PCI_FC << 4) | flow_status;
+  frame.data[1] = ISO_TP_DEFAULT_BLOCK_SIZE;
+  frame.data[2] = 0;  // STmin
+
+  isotp_fd_send_frame(fd, fd->phys_tx_id, &frame, 3);
+}
+
+static void isotp_fd_on_single_frame(struct iso14229_zephyr_isotp_fd_rx *rx,
+                                     const uint8_t *data,
+                                     uint8_t len) {
+  uint32_t sf_dl;
+  const uint8_t *payload;
+
+  if (len <= ISOTP_FD_CLASSIC_DL) {
+    sf_dl = data[0] & 0x0F;
+    payload = &data[1];
+  } else {
+    // Escape sequence: SF_DL is stored in the second byte
+    if ((data[0] & 0x0F) != 0) {
+      return;
+    }
+    sf_dl = data[1];
+    payload = &data[2];
+  }
+
+  if (sf_dl == 0 || payload + sf_dl > data + len || sf_dl > rx->buf_size) {
+    LOG_DBG("Ignoring malformed single frame");
+    return;
+  }
+
+  if (rx->status == ISOTP_FD_STATUS_FULL) {
+    LOG_WRN("Dropped single frame, previous message not yet processed");
+    return;
+  }
+
+  memcpy(rx->buf, payload, sf_dl);
+  rx->size = sf_dl;
+  rx->status = ISOTP_FD_STATUS_FULL;
+}
+
+static void isotp_fd_on_first_frame(struct iso14229_zephyr_isotp_fd *fd,
+                                    struct iso14229_zephyr_isotp_fd_rx *rx,
+                                    const uint8_t *data,
+                                    uint8_t len) {
+  if (len < ISOTP_FD_CLASSIC_DL) {
+    return;
+  }
+
+  uint32_t ff_dl = ((data[0] & 0x0F) << 8) | data[1];
+  uint8_t header_len = 2;
+  if (ff_dl == 0) {
+    // Escape sequence: FF_DL is stored as 32 bit value
+    ff_dl = sys_get_be32(&data[2]);
+    header_len = 6;
+  }
+
+  if (ff_dl <= len - header_len) {
+    LOG_DBG("Ignoring first frame of a single frame message");
+    return;
+  }
+
+  if (ff_dl > rx->buf_size || rx->status == ISOTP_FD_STATUS_FULL) {
+    isotp_fd_send_flow_control(fd, ISOTP_FD_FS_OVFLW);
+    return;
+  }
+
+  rx->size = ff_dl;
+  rx->offset = len - header_len;
+  memcpy(rx->buf, &data[header_len], rx->offset);
+  rx->sn = 1;
+  rx->bs_remain = ISO_TP_DEFAULT_BLOCK_SIZE;
+  rx->timer_cr = isotp_user_get_us() + ISOTP_FD_TIMEOUT_US;
+  rx->status = ISOTP_FD_STATUS_IN_PROGRESS;
+
+  isotp_fd_send_flow_control(fd, ISOTP_FD_FS_CTS);
+}
+
+static void isotp_fd_on_consecutive_frame(
+    struct iso14229_zephyr_isotp_fd *fd,
+    struct iso14229_zephyr_isotp_fd_rx *rx,
+    const uint8_t *data,
+    uint8_t len) {
+  if (rx->status != ISOTP_FD_STATUS_IN_PROGRESS) {
+    return;
+  }
+
+  if ((data[0] & 0x0F) != rx->sn) {
+    LOG_WRN("Wrong consecutive frame sequence number, aborting reception");
+    rx->status = ISOTP_FD_STATUS_IDLE;
+    return;
+  }
+
+  uint32_t remaining = rx->size - rx->offset;
+  uint32_t copy_len = MIN((uint32_t)len - 1, remaining);
+  memcpy(&rx->buf[rx->offset], &data[1], copy_len);
+  rx->offset += copy_len;
+  rx->sn = (rx->sn + 1) & 0x0F;
+
+  if (rx->offset >= rx->size) {
+    rx->status = ISOTP_FD_STATUS_FULL;
+    return;
+  }
+
+  rx->timer_cr = isotp_user_get_us() + ISOTP_FD_TIMEOUT_US;
+  if (ISO_TP_DEFAULT_BLOCK_SIZE > 0 && --rx->bs_remain == 0) {
+    rx->bs_remain = ISO_TP_DEFAULT_BLOCK_SIZE;
+    isotp_fd_send_flow_control(fd, ISOTP_FD_FS_CTS);
+  }
+}
+
+static uint32_t isotp_fd_st_min_to_us(uint8_t st_min) {
+  if (st_min <= 0x7F) {
+    return st_min * USEC_PER_MSEC;
+  }
+  if (st_min >= 0xF1 && st_min <= 0xF9) {
+    return (st_min - 0xF0) * 100;
+  }
+  // Reserved values are interpreted as the maximum of 127 ms
+  return 0x7F * USEC_PER_MSEC;
+}
+
+static void isotp_fd_on_flow_control(struct iso14229_zephyr_isotp_fd *fd,
+                                     const uint8_t *data,
+                                     uint8_t len) {
+  if (fd->send_status != ISOTP_FD_STATUS_IN_PROGRESS || !fd->send_wait_fc ||
+      len < 3) {
+    return;
+  }
+
+  switch (data[0] & 0x0F) {
+    case ISOTP_FD_FS_CTS:
+      fd->send_bs_remain = data[1] == 0 ? UINT16_MAX : data[1];
+      fd->send_st_min_us = isotp_fd_st_min_to_us(data[2]);
+      fd->send_timer_st = isotp_user_get_us();
+      fd->send_wait_fc = false;
+      break;
+    case ISOTP_FD_FS_WAIT:
+      fd->send_timer_bs = isotp_user_get_us() + ISOTP_FD_TIMEOUT_US;
+      break;
+    case ISOTP_FD_FS_OVFLW:
+    default:
+      LOG_WRN("Receiver rejected message (flow status %u)", data[0] & 0x0F);
+      fd->send_status = ISOTP_FD_STATUS_ERROR;
+      break;
+  }
+}
+
+void iso14229_zephyr_isotp_fd_on_can_frame(struct iso14229_zephyr_isotp_fd *fd,
+                                           const struct can_frame *frame,
+                                           bool functional) {
+  uint8_t len = can_dlc_to_bytes(frame->dlc);
+  if (len == 0) {
+    return;
+  }
+
+  struct iso14229_zephyr_isotp_fd_rx *rx =
+      functional ? &fd->func_rx : &fd->phys_rx;
+
+  switch (frame->data[0] >> 4) {
+    case ISOTP_FD_PCI_SF:
+      isotp_fd_on_single_frame(rx, frame->data, len);
+      break;
+    case ISOTP_FD_PCI_FF:
+      // Functional requests are limited to single frames
+      if (!functional) {
+        isotp_fd_on_first_frame(fd, rx, frame->data, len);
+      }
+      break;
+    case ISOTP_FD_PCI_CF:
+      if (!functional) {
+        isotp_fd_on_consecutive_frame(fd, rx, frame->data, len);
+      }
+      break;
+    case ISOTP_FD_PCI_FC:
+      if (!functional) {
+        isotp_fd_on_flow_control(fd, frame->data, len);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void isotp_fd_send_consecutive_frame(
+    struct iso14229_zephyr_isotp_fd *fd) {
+  struct can_frame frame;
+  uint32_t copy_len =
+      MIN(fd->send_size - fd->send_offset, CONFIG_ISO14229_CAN_FD_TX_DL - 1);
+
+  frame.data[0] = (ISOTP_FD_PCI_CF << 4) | fd->send_sn;
+  memcpy(&frame.data[1], &fd->send_buf[fd->send_offset], copy_len);
+
+  if (isotp_fd_send_frame(fd, fd->phys_tx_id, &frame, copy_len + 1) != 0) {
+    // Queue full, retried on the next poll
+    return;
+  }
+
+  uint32_t now_us = isotp_user_get_us();
+  fd->send_offset += copy_len;
+  fd->send_sn = (fd->send_sn + 1) & 0x0F;
+  fd->send_timer_st = now_us + fd->send_st_min_us;
+
+  if (fd->send_offset >= fd->send_size) {
+    fd->send_status = ISOTP_FD_STATUS_IDLE;
+    return;
+  }
+
+  if (fd->send_bs_remain != UINT16_MAX && --fd->send_bs_remain == 0) {
+    fd->send_wait_fc = true;
+    fd->send_timer_bs = now_us + ISOTP_FD_TIMEOUT_US;
+  }
+}
+
+static UDSTpStatus_t isotp_fd_poll(UDSTp_t *hdl) {
+  struct iso14229_zephyr_isotp_fd *fd =
+      CONTAINER_OF(hdl, struct iso14229_zephyr_isotp_fd, hdl);
+  uint32_t now_us = isotp_user_get_us();
+  UDSTpStatus_t status = UDS_TP_IDLE;
+
+  if (fd->send_status == ISOTP_FD_STATUS_IN_PROGRESS) {
+    if (fd->send_wait_fc) {
+      if (time_after(now_us, fd->send_timer_bs)) {
+        LOG_WRN("Timeout waiting for flow control (N_Bs)");
+        fd->send_status = ISOTP_FD_STATUS_ERROR;
+      }
+    } else if (fd->send_st_min_us == 0 ||
+               time_after(now_us, fd->send_timer_st)) {
+      isotp_fd_send_consecutive_frame(fd);
+    }
+  }
+
+  struct iso14229_zephyr_isotp_fd_rx *rx = &fd->phys_rx;
+  if (rx->status == ISOTP_FD_STATUS_IN_PROGRESS &&
+      time_after(now_us, rx->timer_cr)) {
+    LOG_WRN("Timeout waiting for consecutive frame (N_Cr)");
+    rx->status = ISOTP_FD_STATUS_IDLE;
+  }
+
+  if (fd->send_status == ISOTP_FD_STATUS_IN_PROGRESS) {
+    status |= UDS_TP_SEND_IN_PROGRESS;
+  } else if (fd->send_status == ISOTP_FD_STATUS_ERROR) {
+    status |= UDS_TP_ERR;
+    fd->send_status = ISOTP_FD_STATUS_IDLE;
+  }
+
+  return status;
+}
+
+static ssize_t isotp_fd_send(UDSTp_t *hdl,
+                             uint8_t *buf,
+                             size_t len,
+                             UDSSDU_t *info) {
+  struct iso14229_zephyr_isotp_fd *fd =
+      CONTAINER_OF(hdl, struct iso14229_zephyr_isotp_fd, hdl);
+  const bool functional =
+      info != NULL && info->A_TA_Type == UDS_A_TA_TYPE_FUNCTIONAL;
+  const uint32_t id = functional ? fd->func_tx_id : fd->phys_tx_id;
+  // Single frames longer than 7 bytes need the escape sequence
+  const size_t sf_max_len = CONFIG_ISO14229_CAN_FD_TX_DL > ISOTP_FD_CLASSIC_DL
+                                ? CONFIG_ISO14229_CAN_FD_TX_DL - 2
+                                : ISOTP_FD_CLASSIC_DL - 1;
+  struct can_frame frame;
+
+  if (len == 0) {
+    return -1;
+  }
+
+  if (len <= ISOTP_FD_CLASSIC_DL - 1) {
+    frame.data[0] = (ISOTP_FD_PCI_SF << 4) | len;
+    memcpy(&frame.data[1], buf, len);
+    return isotp_fd_send_frame(fd, id, &frame, len + 1) == 0 ? len : -1;
+  }
+
+  if (len <= sf_max_len) {
+    frame.data[0] = ISOTP_FD_PCI_SF << 4;
+    frame.data[1] = len;
+    memcpy(&frame.data[2], buf, len);
+    return isotp_fd_send_frame(fd, id, &frame, len + 2) == 0 ? len : -1;
+  }
+
+  if (functional || len > sizeof(fd->send_buf)) {
+    LOG_ERR("Message of %zu bytes too long to send", len);
+    return -1;
+  }
+
+  if (fd->send_status == ISOTP_FD_STATUS_IN_PROGRESS) {
+    LOG_WRN("Send already in progress");
+    return -1;
+  }
+
+  // The send buffer is never longer than the 12 bit FF_DL
+  const uint8_t header_len = 2;
+  frame.data[0] = (ISOTP_FD_PCI_FF << 4) | (len >> 8);
+  frame.data[1] = len & 0xFF;
+
+  const uint8_t copy_len = CONFIG_ISO14229_CAN_FD_TX_DL - header_len;
+  memcpy(&frame.data[header_len], buf, copy_len);
+  memcpy(fd->send_buf, buf, len);
+
+  if (isotp_fd_send_frame(fd, id, &frame, CONFIG_ISO14229_CAN_FD_TX_DL) != 0) {
+    return -1;
+  }
+
+  fd->send_size = len;
+  fd->send_offset = copy_len;
+  fd->send_sn = 1;
+  fd->send_wait_fc = true;
+  fd->send_timer_bs = isotp_user_get_us() + ISOTP_FD_TIMEOUT_US;
+  fd->send_status = ISOTP_FD_STATUS_IN_PROGRESS;
+
+  return len;
+}
+
+static ssize_t isotp_fd_recv(UDSTp_t *hdl,
+                             uint8_t *buf,
+                             size_t bufsize,
+                             UDSSDU_t *info) {
+  struct iso14229_zephyr_isotp_fd *fd =
+      CONTAINER_OF(hdl, struct iso14229_zephyr_isotp_fd, hdl);
+  struct {
+    struct iso14229_zephyr_isotp_fd_rx *rx;
+    const UDSSDU_t *info;
+  } links[] = {
+    {&fd->phys_rx, &fd->phys_info},
+    {&fd->func_rx, &fd->func_info},
+  };
+
+  for (size_t i = 0; i < ARRAY_SIZE(links); i++) {
+    struct iso14229_zephyr_isotp_fd_rx *rx = links[i].rx;
+    if (rx->status != ISOTP_FD_STATUS_FULL) {
+      continue;
+    }
+
+    rx->status = ISOTP_FD_STATUS_IDLE;
+    if (rx->size > bufsize) {
+      LOG_ERR("Received message of %u bytes does not fit", rx->size);
+      return -1;
+    }
+
+    memcpy(buf, rx->buf, rx->size);
+    if (info) {
+      *info = *links[i].info;
+    }
+    return rx->size;
+  }
+
+  return 0;
+}
+
+uint32_t iso14229_zephyr_isotp_fd_next_deadline_us(
+    const struct iso14229_zephyr_isotp_fd *fd,
+    uint32_t now_us,
+    uint32_t wait_us) {
+  if (fd->send_status == ISOTP_FD_STATUS_IN_PROGRESS) {
+    if (fd->send_wait_fc) {
+      wait_us = MIN(wait_us, time_until(fd->send_timer_bs, now_us));
+    } else if (fd->send_st_min_us == 0) {
+      wait_us = 0;
+    } else {
+      wait_us = MIN(wait_us, time_until(fd->send_timer_st, now_us));
+    }
+  } else if (fd->send_status == ISOTP_FD_STATUS_ERROR) {
+    wait_us = 0;
+  }
+
+  if (fd->phys_rx.status == ISOTP_FD_STATUS_IN_PROGRESS) {
+    wait_us = MIN(wait_us, time_until(fd->phys_rx.timer_cr, now_us));
+  }
+
+  return wait_us;
+}
+
+void iso14229_zephyr_isotp_fd_init(struct iso14229_zephyr_isotp_fd *fd,
+                                   struct iso14229_zephyr_tx *tx,
+                                   const UDSISOTpC_t *addr) {
+  memset(fd, 0, sizeof(*fd));
+
+  fd->hdl.send = isotp_fd_send;
+  fd->hdl.recv = isotp_fd_recv;
+  fd->hdl.poll = isotp_fd_poll;
+  fd->tx = tx;
+
+  fd->phys_tx_id = addr->phys_ta;
+  fd->func_tx_id = addr->func_ta;
+
+  fd->phys_info = (UDSSDU_t){
+    .A_Mtype = UDS_A_MTYPE_DIAG,
+    .A_SA = addr->phys_sa,
+    .A_TA = addr->phys_ta,
+    .A_TA_Type = UDS_A_TA_TYPE_PHYSICAL,
+  };
+  fd->func_info = (UDSSDU_t){
+    .A_Mtype = UDS_A_MTYPE_DIAG,
+    .A_SA = addr->func_sa,
+    .A_TA = addr->func_ta,
+    .A_TA_Type = UDS_A_TA_TYPE_FUNCTIONAL,
+  };
+
+  // Messages the UDS server cannot take are rejected with an overflow flow
+  // control right away instead of after their transfer
+  fd->phys_rx.buf = fd->phys_rx_buf;
+  fd->phys_rx.buf_size =
+      MIN(sizeof(fd->phys_rx_buf), UDS_SERVER_RECV_BUF_SIZE);
+  fd->func_rx.buf = fd->func_rx_buf;
+  fd->func_rx.buf_size = sizeof(fd->func_rx_buf);
+}
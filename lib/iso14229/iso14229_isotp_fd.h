@@ -0,0 +1,50 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ARDEP_LIB_ISO14229_ISOTP_FD_H
+#define ARDEP_LIB_ISO14229_ISOTP_FD_H
+
+#include <ardep/iso14229.h>
+
+/**
+ * @brief Initialize the CAN FD transport
+ *
+ * @param fd Transport to initialize
+ * @param tx Transmit queue used for outgoing frames
+ * @param addr Classic transport holding the configured CAN IDs
+ */
+void iso14229_zephyr_isotp_fd_init(struct iso14229_zephyr_isotp_fd* fd,
+                                   struct iso14229_zephyr_tx* tx,
+                                   const UDSISOTpC_t* addr);
+
+/**
+ * @brief Process a received CAN frame
+ *
+ * @param fd Transport the frame was received on
+ * @param frame Received frame
+ * @param functional Whether the frame was received on the functional address
+ */
+void iso14229_zephyr_isotp_fd_on_can_frame(struct iso14229_zephyr_isotp_fd* fd,
+                                           const struct can_frame* frame,
+                                           bool functional);
+
+/**
+ * @brief Earliest pending transport deadline
+ *
+ * @param fd Transport
+ * @param now_us Current time as returned by isotp_user_get_us()
+ * @param wait_us Upper bound for the result
+ *
+ * @returns Microseconds until the transport needs to be polled, at most
+ *          @p wait_us
+ */
+uint32_t iso14229_zephyr_isotp_fd_next_deadline_us(
+    const struct iso14229_zephyr_isotp_fd* fd,
+    uint32_t now_us,
+    uint32_t wait_us);
+
+#endif  // ARDEP_LIB_ISO14229_ISOTP_FD_H
@@ -12,6 +12,24 @@
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(uds, CONFIG_UDS_LOG_LEVEL);
 
+static uint32_t uds_get_registration_key_for_data_identifier(
+    const struct uds_registration_t* const reg) {
+  return reg->data_identifier.data_id;
+}
+
+static uint32_t uds_get_event_key_for_read_data_by_identifier(const void* arg) {
+  return ((const UDSRDBIArgs_t*)arg)->dataId;
+}
+
+static uint32_t uds_get_event_key_for_write_data_by_identifier(
+    const void* arg) {
+  return ((const UDSWDBIArgs_t*)arg)->dataId;
+}
+
+static uint32_t uds_get_event_key_for_io_control(const void* arg) {
+  return ((const UDSIOCtrlArgs_t*)arg)->dataId;
+}
+
 static UDSErr_t uds_check_read_with_data_id(
     const struct uds_context* const context, bool* apply_action) {
   const struct uds_registration_t* const reg = context->registration;
@@ -36,6 +54,12 @@ uds_check_fn uds_get_check_for_read_data_by_identifier(
 }
 uds_action_fn uds_get_action_for_read_data_by_identifier(
     const struct uds_registration_t* const reg) {
+#ifdef CONFIG_UDS_DATA_IDENTIFIER_CACHE
+  if (reg->data_identifier.cache && reg->data_identifier.read.action) {
+    return uds_data_identifier_cache_read;
+  }
+#endif  // CONFIG_UDS_DATA_IDENTIFIER_CACHE
+
   return reg->data_identifier.read.action;
 }
 
@@ -46,6 +70,8 @@ STRUCT_SECTION_ITERABLE(uds_event_handler_data,
   .get_action = uds_get_action_for_read_data_by_identifier,
   .default_nrc = UDS_NRC_RequestOutOfRange,
   .registration_type = UDS_REGISTRATION_TYPE__DATA_IDENTIFIER,
+  .get_registration_key = uds_get_registration_key_for_data_identifier,
+  .get_event_key = uds_get_event_key_for_read_data_by_identifier,
 };
 
 static UDSErr_t uds_check_write_with_data_id(
@@ -68,6 +94,12 @@ uds_check_fn uds_get_check_for_write_data_by_identifier(
 }
 uds_action_fn uds_get_action_for_write_data_by_identifier(
     const struct uds_registration_t* const reg) {
+#ifdef CONFIG_UDS_DATA_IDENTIFIER_CACHE
+  if (reg->data_identifier.cache && reg->data_identifier.write.action) {
+    return uds_data_identifier_cache_write;
+  }
+#endif  // CONFIG_UDS_DATA_IDENTIFIER_CACHE
+
   return reg->data_identifier.write.action;
 }
 
@@ -78,6 +110,8 @@ STRUCT_SECTION_ITERABLE(uds_event_handler_data,
   .get_action = uds_get_action_for_write_data_by_identifier,
   .default_nrc = UDS_NRC_RequestOutOfRange,
   .registration_type = UDS_REGISTRATION_TYPE__DATA_IDENTIFIER,
+  .get_registration_key = uds_get_registration_key_for_data_identifier,
+  .get_event_key = uds_get_event_key_for_write_data_by_identifier,
 };
 
 static UDSErr_t uds_check_io_control_with_data_id(
@@ -100,6 +134,12 @@ uds_check_fn uds_get_check_for_io_control_by_identifier(
 }
 uds_action_fn uds_get_action_for_io_control_by_identifier(
     const struct uds_registration_t* const reg) {
+#ifdef CONFIG_UDS_DATA_IDENTIFIER_CACHE
+  if (reg->data_identifier.cache && reg->data_identifier.io_control.action) {
+    return uds_data_identifier_cache_io_control;
+  }
+#endif  // CONFIG_UDS_DATA_IDENTIFIER_CACHE
+
   return reg->data_identifier.io_control.action;
 }
 
@@ -110,4 +150,6 @@ STRUCT_SECTION_ITERABLE(uds_event_handler_data,
   .get_action = uds_get_action_for_io_control_by_identifier,
   .default_nrc = UDS_NRC_RequestOutOfRange,
   .registration_type = UDS_REGISTRATION_TYPE__DATA_IDENTIFIER,
+  .get_registration_key = uds_get_registration_key_for_data_identifier,
+  .get_event_key = uds_get_event_key_for_io_control,
 };
@@ -0,0 +1,248 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ardep/uds.h"
+#include "iso14229.h"
+#include "uds.h"
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(uds, CONFIG_UDS_LOG_LEVEL);
+
+typedef uint8_t (*uds_copy_fn)(UDSServer_t* srv,
+                               const void* src,
+                               uint16_t count);
+
+/*
+ * The read action copies its response with args->copy, which only gets the
+ * server. While a read action fills a cache, args->copy is replaced with
+ * uds_data_identifier_cache_capture() and the cache to fill is kept here.
+ * Filling caches is serialized by the mutex, serving cached bytes is not.
+ * The event callback mutex of the instance is always taken before it.
+ */
+static K_MUTEX_DEFINE(uds_cache_capture_mutex);
+static struct {
+  uint8_t* buffer;
+  uint16_t size;
+  uint16_t len;
+  bool overflow;
+  // Original copy function of the request, NULL for background refreshes
+  uds_copy_fn forward;
+} uds_cache_capture;
+
+static uint8_t uds_data_identifier_cache_capture(UDSServer_t* srv,
+                                                 const void* src,
+                                                 uint16_t count) {
+  if (count > uds_cache_capture.size - uds_cache_capture.len) {
+    uds_cache_capture.overflow = true;
+  } else {
+    memcpy(&uds_cache_capture.buffer[uds_cache_capture.len], src, count);
+    uds_cache_capture.len += count;
+  }
+
+  if (uds_cache_capture.forward) {
+    return uds_cache_capture.forward(srv, src, count);
+  }
+
+  return UDS_PositiveResponse;
+}
+
+static bool uds_data_identifier_cache_fresh(
+    const struct uds_data_identifier_cache* cache) {
+  return cache->valid && (cache->max_age_ms == 0 ||
+                          k_uptime_get() - cache->updated_at <
+                              (int64_t)cache->max_age_ms);
+}
+
+static void uds_data_identifier_cache_refresh(struct k_work* work);
+
+// Runs the read action and stores the copied bytes in the buffer that is not
+// served. Must be called with the capture mutex held.
+static UDSErr_t uds_data_identifier_cache_fill(
+    struct uds_context* const context, bool* consume_event) {
+  struct uds_data_identifier_cache* cache =
+      context->registration->data_identifier.cache;
+  UDSRDBIArgs_t* args = context->arg;
+
+  k_spinlock_key_t key = k_spin_lock(&cache->lock);
+  const uint32_t generation = cache->generation;
+  const uint8_t fill = !cache->active;
+  k_spin_unlock(&cache->lock, key);
+
+  uds_cache_capture.buffer = cache->buffers[fill];
+  uds_cache_capture.size = cache->size;
+  uds_cache_capture.len = 0;
+  uds_cache_capture.overflow = false;
+  uds_cache_capture.forward = args->copy;
+
+  args->copy = uds_data_identifier_cache_capture;
+  UDSErr_t ret =
+      context->registration->data_identifier.read.action(context, consume_event);
+  args->copy = uds_cache_capture.forward;
+
+  if (ret != UDS_OK) {
+    return ret;
+  }
+
+  if (uds_cache_capture.overflow) {
+    LOG_WRN("Response of data identifier 0x%04X exceeds its cache of %u bytes",
+            context->registration->data_identifier.data_id, cache->size);
+    return ret;
+  }
+
+  key = k_spin_lock(&cache->lock);
+  // Drop the bytes if the cache was invalidated in the meantime
+  if (generation == cache->generation) {
+    cache->active = fill;
+    cache->len = uds_cache_capture.len;
+    cache->valid = true;
+    cache->updated_at = k_uptime_get();
+  }
+  k_spin_unlock(&cache->lock, key);
+
+  return ret;
+}
+
+static void uds_data_identifier_cache_start_refresh(
+    struct uds_context* const context) {
+  struct uds_data_identifier_cache* cache =
+      context->registration->data_identifier.cache;
+
+  if (cache->refresh_ms == 0) {
+    return;
+  }
+
+  if (!cache->refresh_ready) {
+    k_work_init_delayable(&cache->refresh_work,
+                          uds_data_identifier_cache_refresh);
+    cache->refresh_ready = true;
+  }
+
+  if (atomic_cas(&cache->refresh_running, 0, 1)) {
+    cache->instance = context->instance;
+    cache->registration = context->registration;
+    k_work_schedule(&cache->refresh_work, K_MSEC(cache->refresh_ms));
+  }
+}
+
+// Refreshes the cache as long as it was read since the last refresh, so
+// only hot data identifiers are kept up to date
+static void uds_data_identifier_cache_refresh(struct k_work* work) {
+  struct k_work_delayable* dwork = k_work_delayable_from_work(work);
+  struct uds_data_identifier_cache* cache =
+      CONTAINER_OF(dwork, struct uds_data_identifier_cache, refresh_work);
+
+  struct k_mutex* event_callback_mutex =
+      &cache->instance->iso14229.event_callback_mutex;
+
+  // The read action runs under the event callback mutex like for a request.
+  // It is not waited for, as uds_data_identifier_cache_stop() can hold it
+  // while it waits for this work item. A busy server defers the refresh.
+  if (k_mutex_lock(event_callback_mutex, K_NO_WAIT) != 0) {
+    k_work_schedule(dwork, K_MSEC(cache->refresh_ms));
+    return;
+  }
+
+  if (!atomic_cas(&cache->read_since_refresh, 1, 0)) {
+    atomic_set(&cache->refresh_running, 0);
+    k_mutex_unlock(event_callback_mutex);
+    return;
+  }
+
+  UDSRDBIArgs_t args = {
+    .dataId = cache->registration->data_identifier.data_id,
+    .copy = NULL,
+  };
+
+  struct uds_context context = {
+    .instance = cache->instance,
+    .registration = cache->registration,
+    .server = &cache->instance->iso14229.server,
+    .event = UDS_EVT_ReadDataByIdent,
+    .arg = &args,
+  };
+
+  bool consume_event = false;
+
+  k_mutex_lock(&uds_cache_capture_mutex, K_FOREVER);
+  UDSErr_t ret = uds_data_identifier_cache_fill(&context, &consume_event);
+  k_mutex_unlock(&uds_cache_capture_mutex);
+  k_mutex_unlock(event_callback_mutex);
+
+  if (ret != UDS_OK) {
+    LOG_WRN("Failed to refresh data identifier 0x%04X. Err: %d", args.dataId,
+            ret);
+  }
+
+  k_work_schedule(dwork, K_MSEC(cache->refresh_ms));
+}
+
+UDSErr_t uds_data_identifier_cache_read(struct uds_context* const context,
+                                        bool* consume_event) {
+  struct uds_data_identifier_cache* cache =
+      context->registration->data_identifier.cache;
+  UDSRDBIArgs_t* args = context->arg;
+
+  atomic_set(&cache->read_since_refresh, 1);
+
+  k_spinlock_key_t key = k_spin_lock(&cache->lock);
+  if (uds_data_identifier_cache_fresh(cache)) {
+    UDSErr_t ret = args->copy(context->server, cache->buffers[cache->active],
+                              cache->len);
+    k_spin_unlock(&cache->lock, key);
+
+    *consume_event = true;
+    return ret;
+  }
+  k_spin_unlock(&cache->lock, key);
+
+  k_mutex_lock(&uds_cache_capture_mutex, K_FOREVER);
+  UDSErr_t ret = uds_data_identifier_cache_fill(context, consume_event);
+  if (ret == UDS_OK) {
+    uds_data_identifier_cache_start_refresh(context);
+  }
+  k_mutex_unlock(&uds_cache_capture_mutex);
+
+  return ret;
+}
+
+UDSErr_t uds_data_identifier_cache_write(struct uds_context* const context,
+                                         bool* consume_event) {
+  UDSErr_t ret =
+      context->registration->data_identifier.write.action(context, consume_event);
+  uds_data_identifier_cache_invalidate(
+      context->registration->data_identifier.cache);
+  return ret;
+}
+
+UDSErr_t uds_data_identifier_cache_io_control(
+    struct uds_context* const context, bool* consume_event) {
+  UDSErr_t ret = context->registration->data_identifier.io_control.action(
+      context, consume_event);
+  uds_data_identifier_cache_invalidate(
+      context->registration->data_identifier.cache);
+  return ret;
+}
+
+void uds_data_identifier_cache_stop(struct uds_data_identifier_cache* cache) {
+  struct k_work_sync sync;
+
+  if (cache->refresh_ready) {
+    k_work_cancel_delayable_sync(&cache->refresh_work, &sync);
+    atomic_set(&cache->refresh_running, 0);
+  }
+}
+
+void uds_data_identifier_cache_invalidate(
+    struct uds_data_identifier_cache* cache) {
+  k_spinlock_key_t key = k_spin_lock(&cache->lock);
+  cache->valid = false;
+  cache->generation++;
+  k_spin_unlock(&cache->lock, key);
+}
@@ -93,12 +93,20 @@ static int uds_default_instance_init() {
 
   uds_init(&uds_default_instance, &cfg, can_dev, user_context);
 
+#if defined(CONFIG_UDS_PERIODIC_DATA_IDS) && \
+    !defined(CONFIG_UDS_DEFAULT_INSTANCE_EXTERNAL_ADDRESS_PROVIDER)
+  uds_set_periodic_can_id(&uds_default_instance,
+                          CONFIG_UDS_DEFAULT_INSTANCE_PERIODIC_ADDRESS);
+#endif
+
   if (!device_is_ready(can_dev)) {
     LOG_INF("CAN device not ready");
     return -ENODEV;
   }
 
-  int err = can_set_mode(can_dev, CAN_MODE_NORMAL);
+  int err = can_set_mode(can_dev, IS_ENABLED(CONFIG_ISO14229_CAN_FD)
+                                      ? CAN_MODE_FD
+                                      : CAN_MODE_NORMAL);
   if (err) {
     LOG_ERR("Failed to set CAN mode: %d", err);
     return err;
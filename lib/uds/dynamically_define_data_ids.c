@@ -61,73 +61,253 @@ static UDSErr_t uds_dynamic_data_by_id_read_data_by_id_check(
   return UDS_OK;
 }
 
-static uint8_t temp_buffer[256];
-static size_t temp_buffer_len = 0;
+/*
+ * A dynamically defined data identifier is compiled into a read plan when it
+ * is defined. The plan reads every source data identifier once per request,
+ * no matter how many slices are taken from it, and keeps the bytes the slices
+ * need in a scratch buffer of the plan. The slices are then copied from the
+ * scratch buffer into the response in the order they were defined.
+ *
+ * The source being read is captured through the instance, so reads of
+ * different instances and nested dynamically defined data identifiers do not
+ * share any state.
+ */
+struct uds_dynamic_read_source {
+  uint16_t data_id;
+  // Bytes of the source needed by its slices
+  uint16_t len;
+  // Offset of the bytes in the scratch buffer
+  uint16_t offset;
+};
 
-uint8_t uds_copy(UDSServer_t* srv, const void* src, uint16_t count) {
+struct uds_dynamic_read_plan {
+  /**
+   * @brief list of `struct uds_dynamically_defined_data` in the order of
+   * their definition
+   */
+  sys_slist_t definitions;
+  const struct uds_event_handler_data* read_data_by_id_handler;
+  const struct uds_event_handler_data* read_memory_handler;
+  struct uds_dynamic_read_source* sources;
+  uint8_t num_sources;
+  uint8_t* scratch;
+};
+
+static uint8_t uds_dynamic_read_copy(UDSServer_t* srv,
+                                     const void* src,
+                                     uint16_t count) {
   if (srv == NULL) {
     return UDS_NRC_GeneralReject;
   }
   if (src == NULL) {
     return UDS_NRC_GeneralReject;
   }
-  if (count <= sizeof(temp_buffer) - temp_buffer_len) {
-    memmove(temp_buffer + temp_buffer_len, src, count);
-    temp_buffer_len += count;
-    return UDS_PositiveResponse;
-  }
-  return UDS_NRC_ResponseTooLong;
-}
 
-static UDSErr_t uds_dynamic_data_by_id_read_data_by_id_action(
-    struct uds_context* context, bool* consume_event) {
-  UDSRDBIArgs_t* parent_read_args = context->arg;
+  struct iso14229_zephyr_instance* iso14229 = srv->fn_data;
+  struct uds_instance_t* instance =
+      CONTAINER_OF(iso14229, struct uds_instance_t, iso14229);
+  struct uds_dynamic_read_capture* capture = &instance->dynamic_read_capture;
+
+  // Only the bytes needed by the slices are kept
+  if (capture->len < capture->size) {
+    memcpy(capture->buf + capture->len, src,
+           MIN(count, capture->size - capture->len));
+  }
+  capture->len += count;
 
-  sys_slist_t* list = context->registration->data_identifier.data;
+  return UDS_PositiveResponse;
+}
 
-  // Here we simulate an event for every data ID that makes up the dynamic
-  // identifier. This ensures it will be handled exactly the same as if it was
-  // read by the UDS service.
+static void uds_dynamic_read_plan_free(struct uds_dynamic_read_plan* plan) {
   sys_snode_t* node;
-  SYS_SLIST_FOR_EACH_NODE (list, node) {
+  sys_snode_t* next_node;
+  SYS_SLIST_FOR_EACH_NODE_SAFE (&plan->definitions, node, next_node) {
     struct uds_dynamically_defined_data* data =
         CONTAINER_OF(node, struct uds_dynamically_defined_data, node);
+    // Free data list item to hold sub-item [DATA_ITEM]
+    k_free(data);  // FREE: [DATA_ITEM]
+  }
 
+  k_free(plan->sources);  // FREE: [PLAN_SOURCES]
+  k_free(plan->scratch);  // FREE: [PLAN_SCRATCH]
+  k_free(plan);           // FREE: [READ_PLAN]
+}
+
+static struct uds_dynamic_read_source* uds_dynamic_read_plan_find_source(
+    struct uds_dynamic_read_source* sources,
+    uint8_t num_sources,
+    uint16_t data_id) {
+  for (uint8_t i = 0; i < num_sources; i++) {
+    if (sources[i].data_id == data_id) {
+      return &sources[i];
+    }
+  }
+
+  return NULL;
+}
+
+// Groups the slices by their source data identifier and sizes the scratch
+// buffer. The previous plan is kept if this fails.
+static UDSErr_t uds_dynamic_read_plan_compile(
+    struct uds_dynamic_read_plan* plan) {
+  size_t num_slices = 0;
+  struct uds_dynamically_defined_data* data;
+
+  SYS_SLIST_FOR_EACH_CONTAINER (&plan->definitions, data, node) {
     if (data->type == UDS_DYNAMICALLY_DEFINED_DATA_TYPE__ID) {
-      UDSRDBIArgs_t child_args = {.dataId = data->id.id, .copy = uds_copy};
+      num_slices++;
+    }
+  }
 
-      temp_buffer_len = 0;
+  if (num_slices > UINT8_MAX) {
+    LOG_ERR("Too many source data identifiers in dynamic data identifier");
+    return UDS_NRC_RequestOutOfRange;
+  }
 
-      int ret = uds_event_callback(&context->instance->iso14229,
-                                   UDS_EVT_ReadDataByIdent, &child_args,
-                                   context->instance);
-      if (ret != UDS_PositiveResponse) {
-        return ret;
-      }
+  // Allocate the sources of the plan [PLAN_SOURCES]
+  // FREED: [PLAN_SOURCES] when the plan is compiled again or freed
+  struct uds_dynamic_read_source* sources =
+      k_malloc(MAX(num_slices, 1) * sizeof(*sources));
+  if (sources == NULL) {
+    LOG_ERR("Failed to allocate memory for dynamic data identifier sources");
+    return UDS_NRC_GeneralReject;
+  }
 
-      if (data->id.position + data->id.size > temp_buffer_len) {
-        LOG_WRN(
-            "Not enough data returned for data ID 0x%04X to satisfy configured "
-            "dynamic data identifier 0x%04X",
-            data->id.id, parent_read_args->dataId);
-        return UDS_NRC_GeneralReject;
-      }
+  uint8_t num_sources = 0;
+  SYS_SLIST_FOR_EACH_CONTAINER (&plan->definitions, data, node) {
+    if (data->type != UDS_DYNAMICALLY_DEFINED_DATA_TYPE__ID) {
+      continue;
+    }
+
+    struct uds_dynamic_read_source* source =
+        uds_dynamic_read_plan_find_source(sources, num_sources, data->id.id);
+    if (source == NULL) {
+      source = &sources[num_sources++];
+      source->data_id = data->id.id;
+      source->len = 0;
+    }
+
+    source->len = MAX(source->len, data->id.position + data->id.size);
+    data->id.source = source - sources;
+  }
+
+  size_t scratch_size = 0;
+  for (uint8_t i = 0; i < num_sources; i++) {
+    sources[i].offset = scratch_size;
+    scratch_size += sources[i].len;
+  }
+
+  // Allocate the scratch buffer of the plan [PLAN_SCRATCH]
+  // FREED: [PLAN_SCRATCH] when the plan is compiled again or freed
+  uint8_t* scratch = k_malloc(MAX(scratch_size, 1));
+  if (scratch == NULL) {
+    LOG_ERR("Failed to allocate %zu bytes for dynamic data identifier",
+            scratch_size);
+    k_free(sources);  // FREE: [PLAN_SOURCES] - error cleanup in compile
+    return UDS_NRC_GeneralReject;
+  }
+
+  k_free(plan->sources);  // FREE: [PLAN_SOURCES] - replaced by new plan
+  k_free(plan->scratch);  // FREE: [PLAN_SCRATCH] - replaced by new plan
+  plan->sources = sources;
+  plan->num_sources = num_sources;
+  plan->scratch = scratch;
+
+  plan->read_data_by_id_handler =
+      uds_find_event_handler(UDS_EVT_ReadDataByIdent);
+  plan->read_memory_handler = uds_find_event_handler(UDS_EVT_ReadMemByAddr);
+
+  return UDS_OK;
+}
+
+// Reads every source data identifier of the plan into the scratch buffer
+static UDSErr_t uds_dynamic_read_plan_read_sources(
+    struct uds_context* context,
+    const struct uds_dynamic_read_plan* plan) {
+  UDSRDBIArgs_t* parent_read_args = context->arg;
+  struct uds_dynamic_read_capture* capture =
+      &context->instance->dynamic_read_capture;
+
+  if (plan->num_sources > 0 && plan->read_data_by_id_handler == NULL) {
+    return UDS_NRC_ServiceNotSupported;
+  }
+
+  for (uint8_t i = 0; i < plan->num_sources; i++) {
+    const struct uds_dynamic_read_source* source = &plan->sources[i];
+    UDSRDBIArgs_t child_args = {
+      .dataId = source->data_id,
+      .copy = uds_dynamic_read_copy,
+    };
+
+    *capture = (struct uds_dynamic_read_capture){
+      .buf = plan->scratch + source->offset,
+      .size = source->len,
+      .len = 0,
+    };
+
+    // This is handled exactly the same as if the source was read by the UDS
+    // service
+    UDSErr_t ret =
+        uds_handle_event(context->instance, UDS_EVT_ReadDataByIdent,
+                         &child_args, plan->read_data_by_id_handler);
+    if (ret != UDS_PositiveResponse) {
+      return ret;
+    }
+
+    if (capture->len < source->len) {
+      LOG_WRN(
+          "Not enough data returned for data ID 0x%04X to satisfy configured "
+          "dynamic data identifier 0x%04X",
+          source->data_id, parent_read_args->dataId);
+      return UDS_NRC_GeneralReject;
+    }
+  }
+
+  return UDS_PositiveResponse;
+}
+
+static UDSErr_t uds_dynamic_data_by_id_read_data_by_id_action(
+    struct uds_context* context, bool* consume_event) {
+  UDSRDBIArgs_t* parent_read_args = context->arg;
+  const struct uds_dynamic_read_plan* plan =
+      context->registration->data_identifier.data;
+
+  // A source may be a dynamically defined data identifier itself, so the
+  // capture of the caller is restored afterwards
+  struct uds_dynamic_read_capture caller_capture =
+      context->instance->dynamic_read_capture;
+  UDSErr_t ret = uds_dynamic_read_plan_read_sources(context, plan);
+  context->instance->dynamic_read_capture = caller_capture;
+
+  if (ret != UDS_PositiveResponse) {
+    return ret;
+  }
+
+  struct uds_dynamically_defined_data* data;
+  SYS_SLIST_FOR_EACH_CONTAINER (&plan->definitions, data, node) {
+    if (data->type == UDS_DYNAMICALLY_DEFINED_DATA_TYPE__ID) {
+      const struct uds_dynamic_read_source* source =
+          &plan->sources[data->id.source];
 
       ret = parent_read_args->copy(
-          context->server, temp_buffer + data->id.position, data->id.size);
+          context->server,
+          plan->scratch + source->offset + data->id.position, data->id.size);
       if (ret != UDS_OK) {
         return ret;
       }
     }
 
     if (data->type == UDS_DYNAMICALLY_DEFINED_DATA_TYPE__MEMORY) {
+      if (plan->read_memory_handler == NULL) {
+        return UDS_NRC_ServiceNotSupported;
+      }
+
       UDSReadMemByAddrArgs_t child_args = {.memAddr = data->memory.memAddr,
                                            .memSize = data->memory.memSize,
                                            .copy = parent_read_args->copy};
 
-      int ret = uds_event_callback(&context->instance->iso14229,
-                                   UDS_EVT_ReadMemByAddr, &child_args,
-                                   context->instance);
+      ret = uds_handle_event(context->instance, UDS_EVT_ReadMemByAddr,
+                             &child_args, plan->read_memory_handler);
       if (ret != UDS_PositiveResponse) {
         return ret;
       }
@@ -139,18 +319,8 @@ static UDSErr_t uds_dynamic_data_by_id_read_data_by_id_action(
 }
 
 static int uds_unregister_dynamic_identifier(struct uds_registration_t* this) {
-  sys_slist_t* list = this->data_identifier.data;
-
-  sys_snode_t* node;
-  sys_snode_t* next_node;
-  SYS_SLIST_FOR_EACH_NODE_SAFE (list, node, next_node) {
-    struct uds_dynamically_defined_data* data =
-        CONTAINER_OF(node, struct uds_dynamically_defined_data, node);
-    // Free data list item to hold sub-item [3]
-    k_free(data);  // FREE: [DATA_ITEM] - normal cleanup via unregister
-  }
-  // Free data list for sub-items to be read [1]
-  k_free(list);  // FREE: [DATA_LIST] - normal cleanup via unregister
+  // Free the read plan with its sub-items [READ_PLAN]
+  uds_dynamic_read_plan_free(this->data_identifier.data);
 
   return 0;
 }
@@ -230,7 +400,7 @@ static int uds_find_existing_registration_by_data_id(
     uint16_t data_id,
     struct uds_registration_t** read_data_by_id_reg) {
   struct uds_registration_t* temp_reg;
-  SYS_SLIST_FOR_EACH_CONTAINER (&context->instance->dynamic_registrations,
+  SYS_DLIST_FOR_EACH_CONTAINER (&context->instance->dynamic_registrations,
                                 temp_reg, node) {
     if (temp_reg->type == UDS_REGISTRATION_TYPE__DATA_IDENTIFIER) {
       if (temp_reg->data_identifier.data_id == data_id) {
@@ -256,20 +426,21 @@ static int uds_create_new_data_identifier_by_id(
     struct uds_context* const context,
     uint16_t data_id,
     struct uds_registration_t** read_data_by_id_reg_ptr) {
-  // Allocating data list for sub-items to be read [DATA_LIST]
-  // FREED: [DATA_LIST] via uds_unregister_dynamic_identifier or error cleanup
-  sys_slist_t* data_list = k_malloc(sizeof(sys_slist_t));
-  if (!data_list) {
+  // Allocating read plan for sub-items to be read [READ_PLAN]
+  // FREED: [READ_PLAN] via uds_unregister_dynamic_identifier or error cleanup
+  struct uds_dynamic_read_plan* plan = k_malloc(sizeof(*plan));
+  if (!plan) {
     return -1;
   }
-  sys_slist_init(data_list);
+  memset(plan, 0, sizeof(*plan));
+  sys_slist_init(&plan->definitions);
 
   // Allocate new temporary registration item [TEMP_REG]
   // FREED: [TEMP_REG] after successful registration or via error cleanup
   *read_data_by_id_reg_ptr = k_malloc(sizeof(struct uds_registration_t));
   if (*read_data_by_id_reg_ptr == NULL) {
-    // Free [DATA_LIST]
-    k_free(data_list);  // FREE: [DATA_LIST] - error cleanup in create function
+    // Free [READ_PLAN]
+    k_free(plan);  // FREE: [READ_PLAN] - error cleanup in create function
     return -2;
   }
 
@@ -280,7 +451,7 @@ static int uds_create_new_data_identifier_by_id(
   read_data_by_id_reg->instance = context->instance;
   read_data_by_id_reg->unregister_registration_fn =
       uds_unregister_dynamic_identifier;
-  read_data_by_id_reg->data_identifier.data = data_list;
+  read_data_by_id_reg->data_identifier.data = plan;
   read_data_by_id_reg->data_identifier.data_id = data_id;
   read_data_by_id_reg->data_identifier.read.check =
       uds_dynamic_data_by_id_read_data_by_id_check;
@@ -328,8 +499,13 @@ static UDSErr_t uds_register_new_data_by_id_item(
   return UDS_OK;
 }
 
-static UDSErr_t uds_dynamicallY_define_data_by_id_add_new_id(
-    struct uds_context* const context, bool* consume_event) {
+typedef UDSErr_t (*uds_append_dynamic_data_fn)(UDSDDDIArgs_t* args,
+                                               sys_slist_t* data_list);
+
+static UDSErr_t uds_dynamically_define_data_add(
+    struct uds_context* const context,
+    bool* consume_event,
+    uds_append_dynamic_data_fn append) {
   UDSDDDIArgs_t* args = context->arg;
 
   struct uds_registration_t* read_data_by_id_reg = NULL;
@@ -348,72 +524,34 @@ static UDSErr_t uds_dynamicallY_define_data_by_id_add_new_id(
     }
   }
 
-  sys_slist_t* data_list = read_data_by_id_reg->data_identifier.data;
+  struct uds_dynamic_read_plan* plan =
+      read_data_by_id_reg->data_identifier.data;
 
-  ret = uds_append_dynamic_data_identifiers_to_registration(args, data_list);
+  ret = append(args, &plan->definitions);
   if (ret != UDS_OK) {
-    if (!is_existing_registration) {
+    if (is_existing_registration) {
+      // The definitions were dropped, so the plan must not refer to them
+      uds_dynamic_read_plan_compile(plan);
+    } else {
       // If we created a new registration but failed to add data, clean it up
-      k_free(read_data_by_id_reg->data_identifier
-                 .data);  // FREE: [DATA_LIST] - error cleanup in caller
+      uds_dynamic_read_plan_free(plan);  // FREE: [READ_PLAN] - error cleanup
       k_free(
           read_data_by_id_reg);  // FREE: [TEMP_REG] - error cleanup in caller
     }
     return ret;
   }
 
-  if (!is_existing_registration) {
-    ret = uds_register_new_data_by_id_item(context, read_data_by_id_reg);
-    if (ret != UDS_OK) {
-      // Clean up the data list and registration we created
-      sys_snode_t* node;
-      sys_snode_t* next_node;
-      SYS_SLIST_FOR_EACH_NODE_SAFE (data_list, node, next_node) {
-        struct uds_dynamically_defined_data* cleanup_data =
-            CONTAINER_OF(node, struct uds_dynamically_defined_data, node);
-        sys_slist_remove(data_list, NULL, &cleanup_data->node);
-        k_free(cleanup_data);  // FREE: [DATA_ITEM] - error cleanup in caller
-      }
-      k_free(read_data_by_id_reg->data_identifier
-                 .data);  // FREE: [DATA_LIST] - error cleanup in caller
-      k_free(
-          read_data_by_id_reg);  // FREE: [TEMP_REG] - error cleanup in caller
-      return ret;
-    }
-  }
-
-  *consume_event = true;
-  return UDS_OK;
-}
-
-static UDSErr_t uds_dynamicallY_define_data_by_memory_address_add_new_id(
-    struct uds_context* const context, bool* consume_event) {
-  UDSDDDIArgs_t* args = context->arg;
-
-  struct uds_registration_t* read_data_by_id_reg = NULL;
-  int ret = uds_find_existing_registration_by_data_id(
-      context, args->dynamicDataId, &read_data_by_id_reg);
-
-  bool is_existing_registration = ret == 0;
-
-  if (!is_existing_registration) {
-    ret = uds_create_new_data_identifier_by_id(context, args->dynamicDataId,
-                                               &read_data_by_id_reg);
-    if (ret < 0) {
-      LOG_ERR("Failed to create new data identifier registration. ERR: %d",
-              ret);
-      return UDS_NRC_GeneralReject;
-    }
-  }
-
-  sys_slist_t* data_list = read_data_by_id_reg->data_identifier.data;
-
-  ret = uds_append_dynamic_memory_addresses_to_registration(args, data_list);
+  ret = uds_dynamic_read_plan_compile(plan);
   if (ret != UDS_OK) {
+    // Drop the definition that was just appended
+    struct uds_dynamically_defined_data* data = CONTAINER_OF(
+        sys_slist_peek_tail(&plan->definitions),
+        struct uds_dynamically_defined_data, node);
+    sys_slist_find_and_remove(&plan->definitions, &data->node);
+    k_free(data);  // FREE: [DATA_ITEM] - error cleanup in caller
+
     if (!is_existing_registration) {
-      // If we created a new registration but failed to add data, clean it up
-      k_free(read_data_by_id_reg->data_identifier
-                 .data);  // FREE: [DATA_LIST] - error cleanup in caller
+      uds_dynamic_read_plan_free(plan);  // FREE: [READ_PLAN] - error cleanup
       k_free(
           read_data_by_id_reg);  // FREE: [TEMP_REG] - error cleanup in caller
     }
@@ -423,17 +561,8 @@ static UDSErr_t uds_dynamicallY_define_data_by_memory_address_add_new_id(
   if (!is_existing_registration) {
     ret = uds_register_new_data_by_id_item(context, read_data_by_id_reg);
     if (ret != UDS_OK) {
-      // Clean up the data list and registration we created
-      sys_snode_t* node;
-      sys_snode_t* next_node;
-      SYS_SLIST_FOR_EACH_NODE_SAFE (data_list, node, next_node) {
-        struct uds_dynamically_defined_data* cleanup_data =
-            CONTAINER_OF(node, struct uds_dynamically_defined_data, node);
-        sys_slist_remove(data_list, NULL, &cleanup_data->node);
-        k_free(cleanup_data);  // FREE: [DATA_ITEM] - error cleanup in caller
-      }
-      k_free(read_data_by_id_reg->data_identifier
-                 .data);  // FREE: [DATA_LIST] - error cleanup in caller
+      // Clean up the read plan and registration we created
+      uds_dynamic_read_plan_free(plan);  // FREE: [READ_PLAN] - error cleanup
       k_free(
           read_data_by_id_reg);  // FREE: [TEMP_REG] - error cleanup in caller
       return ret;
@@ -444,6 +573,20 @@ static UDSErr_t uds_dynamicallY_define_data_by_memory_address_add_new_id(
   return UDS_OK;
 }
 
+static UDSErr_t uds_dynamicallY_define_data_by_id_add_new_id(
+    struct uds_context* const context, bool* consume_event) {
+  return uds_dynamically_define_data_add(
+      context, consume_event,
+      uds_append_dynamic_data_identifiers_to_registration);
+}
+
+static UDSErr_t uds_dynamicallY_define_data_by_memory_address_add_new_id(
+    struct uds_context* const context, bool* consume_event) {
+  return uds_dynamically_define_data_add(
+      context, consume_event,
+      uds_append_dynamic_memory_addresses_to_registration);
+}
+
 static void uds_dynamicallY_define_data_by_id_remove_single_id(
     struct uds_instance_t* instance, uint16_t data_id) {
   uint32_t dynamic_id_to_remove = 0;
@@ -451,7 +594,7 @@ static void uds_dynamicallY_define_data_by_id_remove_single_id(
   // Remove the data ID from the dynamic registrations
   {
     struct uds_registration_t* dynamic_reg;
-    SYS_SLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, dynamic_reg,
+    SYS_DLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, dynamic_reg,
                                   node) {
       LOG_INF("dynamic registration with dynamic id: 0x%04X",
               dynamic_reg->dynamic_registration_id);
@@ -498,7 +641,7 @@ static void uds_dynamicallY_define_data_by_id_remove_single_id(
     }
 
     struct uds_registration_t* dynamic_reg;
-    SYS_SLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, dynamic_reg,
+    SYS_DLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, dynamic_reg,
                                   node) {
       if (dynamic_reg->type == UDS_REGISTRATION_TYPE__DYNAMIC_DEFINE_DATA_IDS) {
         struct dynamic_registration_id_sll_item* item;
@@ -549,7 +692,7 @@ static void uds_dynamicallY_define_data_by_id_remove_all_ids(
 
   // Remove all dynamic registrations referenced by dynamic registrations
   struct uds_registration_t* dynamic_reg;
-  SYS_SLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, dynamic_reg,
+  SYS_DLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, dynamic_reg,
                                 node) {
     if (dynamic_reg->type == UDS_REGISTRATION_TYPE__DYNAMIC_DEFINE_DATA_IDS) {
       struct dynamic_registration_id_sll_item* item;
@@ -594,7 +737,7 @@ static void uds_dynamicallY_define_data_by_id_remove_all_ids(
 
   // Clean up dynamic_registration_id_list entries from all dynamic event
   // handlers
-  SYS_SLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, dynamic_reg,
+  SYS_DLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, dynamic_reg,
                                 node) {
     if (dynamic_reg->type == UDS_REGISTRATION_TYPE__DYNAMIC_DEFINE_DATA_IDS) {
       struct dynamic_registration_id_sll_item* item;
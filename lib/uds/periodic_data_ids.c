@@ -0,0 +1,384 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ardep/uds.h"
+#include "iso14229.h"
+#include "uds.h"
+
+#include <string.h>
+
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+LOG_MODULE_DECLARE(uds, CONFIG_UDS_LOG_LEVEL);
+
+/*
+ * ReadDataByPeriodicIdentifier (0x2A) is not implemented by the iso14229
+ * server, the requests are taken from the request hook of the instance.
+ * Periodic data identifiers are read with the registered data identifier
+ * read actions and sent as single unacknowledged CAN frames (transmission
+ * type 2) on the periodic CAN ID of the instance.
+ *
+ * The scheduler state is protected by the event callback mutex of the
+ * iso14229 instance, which also serializes the read actions with the
+ * server.
+ */
+
+// Periodic data identifiers are the data identifiers 0xF200 to 0xF2FF
+#define UDS_PERIODIC_DATA_ID_BASE 0xF200
+
+#define UDS_NEGATIVE_RESPONSE_SID 0x7F
+#define UDS_POSITIVE_RESPONSE_OFFSET 0x40
+
+static uint32_t uds_periodic_rate_ms(uint8_t mode) {
+  switch (mode) {
+    case UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_SLOW_RATE:
+      return CONFIG_UDS_PERIODIC_SLOW_RATE_MS;
+    case UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_MEDIUM_RATE:
+      return CONFIG_UDS_PERIODIC_MEDIUM_RATE_MS;
+    case UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_FAST_RATE:
+      return CONFIG_UDS_PERIODIC_FAST_RATE_MS;
+    default:
+      return 0;
+  }
+}
+
+static uint8_t uds_periodic_copy(UDSServer_t* srv,
+                                 const void* src,
+                                 uint16_t count) {
+  struct iso14229_zephyr_instance* iso14229 = srv->fn_data;
+  struct uds_instance_t* inst =
+      CONTAINER_OF(iso14229, struct uds_instance_t, iso14229);
+  struct uds_periodic_scheduler* sched = &inst->periodic;
+
+  if (count > sizeof(sched->read_buf) - sched->read_len) {
+    sched->read_overflow = true;
+    return UDS_NRC_ResponseTooLong;
+  }
+
+  memcpy(&sched->read_buf[sched->read_len], src, count);
+  sched->read_len += count;
+  return UDS_PositiveResponse;
+}
+
+// Reads a periodic data identifier into the read buffer of the scheduler
+// with the read actions registered for the instance
+static UDSErr_t uds_periodic_read(struct uds_instance_t* inst,
+                                  uint8_t periodic_id) {
+  struct uds_periodic_scheduler* sched = &inst->periodic;
+
+  sched->read_len = 0;
+  sched->read_overflow = false;
+
+  UDSRDBIArgs_t args = {
+    .dataId = UDS_PERIODIC_DATA_ID_BASE | periodic_id,
+    .copy = uds_periodic_copy,
+  };
+
+  UDSErr_t ret =
+      inst->iso14229.event_callback(&inst->iso14229, UDS_EVT_ReadDataByIdent,
+                                    &args, inst->iso14229.user_context);
+  if (ret == UDS_PositiveResponse && sched->read_overflow) {
+    return UDS_NRC_ResponseTooLong;
+  }
+
+  return ret;
+}
+
+static void uds_periodic_send(struct uds_instance_t* inst,
+                              const struct uds_periodic_data_id* data_id) {
+  struct uds_periodic_scheduler* sched = &inst->periodic;
+
+  UDSErr_t ret = uds_periodic_read(inst, data_id->periodic_id);
+  if (ret != UDS_PositiveResponse) {
+    LOG_WRN("Failed to read periodic data identifier 0x%04X. Err: %d",
+            UDS_PERIODIC_DATA_ID_BASE | data_id->periodic_id, ret);
+    return;
+  }
+
+  struct can_frame frame = {
+    .id = sched->can_id,
+    .flags = sched->can_id > CAN_STD_ID_MASK ? CAN_FRAME_IDE : 0,
+    .dlc = 1 + sched->read_len,
+  };
+  frame.data[0] = data_id->periodic_id;
+  memcpy(&frame.data[1], sched->read_buf, sched->read_len);
+
+  iso14229_zephyr_tx_enqueue(&inst->iso14229.tx, &frame);
+}
+
+static void uds_periodic_stop_all(struct uds_periodic_scheduler* sched) {
+  ARRAY_FOR_EACH_PTR(sched->data_ids, data_id) {
+    data_id->period_ms = 0;
+  }
+
+  // A running handler waits for the mutex and finds nothing to send
+  k_work_cancel_delayable(&sched->work);
+}
+
+static void uds_periodic_work_handler(struct k_work* work) {
+  struct k_work_delayable* dwork = k_work_delayable_from_work(work);
+  struct uds_periodic_scheduler* sched =
+      CONTAINER_OF(dwork, struct uds_periodic_scheduler, work);
+  struct uds_instance_t* inst =
+      CONTAINER_OF(sched, struct uds_instance_t, periodic);
+
+  k_mutex_lock(&inst->iso14229.event_callback_mutex, K_FOREVER);
+
+  // Periodic transmission is not allowed in the default session
+  if (inst->iso14229.server.sessionType == UDS_DIAG_SESSION__DEFAULT) {
+    uds_periodic_stop_all(sched);
+    k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+    return;
+  }
+
+  const int64_t now = k_uptime_get();
+  int64_t next = INT64_MAX;
+
+  ARRAY_FOR_EACH_PTR(sched->data_ids, data_id) {
+    if (data_id->period_ms == 0) {
+      continue;
+    }
+
+    if (data_id->due_ms <= now) {
+      uds_periodic_send(inst, data_id);
+
+      // Advance from the deadline instead of the current time, so the
+      // messages do not drift. When running late by more than a period,
+      // skip the missed messages instead of sending them in a burst.
+      data_id->due_ms += data_id->period_ms;
+      if (data_id->due_ms <= now) {
+        int64_t missed = (now - data_id->due_ms) / data_id->period_ms + 1;
+        data_id->due_ms += missed * data_id->period_ms;
+        sched->overruns += missed;
+      }
+    }
+
+    next = MIN(next, data_id->due_ms);
+  }
+
+  if (next != INT64_MAX) {
+    k_work_schedule(dwork, K_TIMEOUT_ABS_MS(next));
+  }
+
+  k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+}
+
+static struct uds_periodic_data_id* uds_periodic_find(
+    struct uds_periodic_scheduler* sched, uint8_t periodic_id) {
+  ARRAY_FOR_EACH_PTR(sched->data_ids, data_id) {
+    if (data_id->period_ms != 0 && data_id->periodic_id == periodic_id) {
+      return data_id;
+    }
+  }
+
+  return NULL;
+}
+
+static struct uds_periodic_data_id* uds_periodic_find_free(
+    struct uds_periodic_scheduler* sched) {
+  ARRAY_FOR_EACH_PTR(sched->data_ids, data_id) {
+    if (data_id->period_ms == 0) {
+      return data_id;
+    }
+  }
+
+  return NULL;
+}
+
+static UDSErr_t uds_periodic_stop_sending(struct uds_periodic_scheduler* sched,
+                                          const uint8_t* ids,
+                                          uint16_t num_ids) {
+  if (num_ids == 0) {
+    uds_periodic_stop_all(sched);
+    return UDS_PositiveResponse;
+  }
+
+  for (uint16_t i = 0; i < num_ids; i++) {
+    struct uds_periodic_data_id* data_id = uds_periodic_find(sched, ids[i]);
+    if (data_id != NULL) {
+      data_id->period_ms = 0;
+    }
+  }
+
+  return UDS_PositiveResponse;
+}
+
+static UDSErr_t uds_periodic_start_sending(struct uds_instance_t* inst,
+                                           uint32_t period_ms,
+                                           const uint8_t* ids,
+                                           uint16_t num_ids) {
+  struct uds_periodic_scheduler* sched = &inst->periodic;
+  size_t free_slots = 0;
+  size_t needed_slots = 0;
+
+  if (num_ids == 0) {
+    return UDS_NRC_IncorrectMessageLengthOrInvalidFormat;
+  }
+
+  ARRAY_FOR_EACH_PTR(sched->data_ids, data_id) {
+    if (data_id->period_ms == 0) {
+      free_slots++;
+    }
+  }
+
+  // Check all data identifiers before scheduling any of them
+  for (uint16_t i = 0; i < num_ids; i++) {
+    if (uds_periodic_read(inst, ids[i]) != UDS_PositiveResponse) {
+      LOG_WRN("Periodic data identifier 0x%04X can not be read",
+              UDS_PERIODIC_DATA_ID_BASE | ids[i]);
+      return UDS_NRC_RequestOutOfRange;
+    }
+
+    bool requested_before = memchr(ids, ids[i], i) != NULL;
+    if (!requested_before && uds_periodic_find(sched, ids[i]) == NULL) {
+      needed_slots++;
+    }
+  }
+
+  if (needed_slots > free_slots) {
+    LOG_WRN("Not enough slots for %zu periodic data identifiers",
+            needed_slots);
+    return UDS_NRC_RequestOutOfRange;
+  }
+
+  // Scheduled data identifiers take the new rate
+  const int64_t now = k_uptime_get();
+  for (uint16_t i = 0; i < num_ids; i++) {
+    struct uds_periodic_data_id* data_id = uds_periodic_find(sched, ids[i]);
+    if (data_id == NULL) {
+      data_id = uds_periodic_find_free(sched);
+    }
+
+    data_id->periodic_id = ids[i];
+    data_id->period_ms = period_ms;
+    data_id->due_ms = now;
+  }
+
+  k_work_reschedule(&sched->work, K_NO_WAIT);
+  return UDS_PositiveResponse;
+}
+
+static UDSErr_t uds_periodic_handle_request(struct uds_instance_t* inst,
+                                            const uint8_t* data,
+                                            uint16_t len) {
+  UDSServer_t* srv = &inst->iso14229.server;
+
+  if (len < 2) {
+    return UDS_NRC_IncorrectMessageLengthOrInvalidFormat;
+  }
+
+  if (inst->periodic.can_id == UDS_TP_NOOP_ADDR) {
+    return UDS_NRC_ServiceNotSupported;
+  }
+
+  if (srv->requestInProgress) {
+    return UDS_NRC_BusyRepeatRequest;
+  }
+
+  if (srv->sessionType == UDS_DIAG_SESSION__DEFAULT) {
+    return UDS_NRC_ServiceNotSupportedInActiveSession;
+  }
+
+  // The request bypasses the server, keep the session alive like any other
+  // request does
+  srv->s3_session_timeout_timer = UDSMillis() + srv->s3_ms;
+
+  const uint8_t mode = data[1];
+  if (mode == UDS_PERIODIC_TRANSMISSION_MODE__STOP_SENDING) {
+    return uds_periodic_stop_sending(&inst->periodic, &data[2], len - 2);
+  }
+
+  uint32_t period_ms = uds_periodic_rate_ms(mode);
+  if (period_ms == 0) {
+    return UDS_NRC_RequestOutOfRange;
+  }
+
+  return uds_periodic_start_sending(inst, period_ms, &data[2], len - 2);
+}
+
+static void uds_periodic_respond(struct uds_instance_t* inst,
+                                 UDSErr_t nrc,
+                                 bool functional) {
+  uint8_t response[3];
+  uint8_t len;
+
+  if (nrc == UDS_PositiveResponse) {
+    response[0] =
+        UDS_SID_READ_DATA_BY_PERIODIC_IDENTIFIER + UDS_POSITIVE_RESPONSE_OFFSET;
+    len = 1;
+  } else {
+    // Same as the server: these negative responses are suppressed for
+    // functionally addressed requests
+    if (functional && (nrc == UDS_NRC_ServiceNotSupported ||
+                       nrc == UDS_NRC_SubFunctionNotSupported ||
+                       nrc == UDS_NRC_RequestOutOfRange)) {
+      return;
+    }
+
+    response[0] = UDS_NEGATIVE_RESPONSE_SID;
+    response[1] = UDS_SID_READ_DATA_BY_PERIODIC_IDENTIFIER;
+    response[2] = nrc;
+    len = 3;
+  }
+
+  int ret = iso14229_zephyr_send_response(&inst->iso14229, response, len);
+  if (ret < 0) {
+    LOG_WRN("Failed to send ReadDataByPeriodicIdentifier response: %d", ret);
+  }
+}
+
+void uds_periodic_data_ids_request(struct uds_instance_t* inst,
+                                   const uint8_t* data,
+                                   uint16_t len,
+                                   bool functional) {
+  k_mutex_lock(&inst->iso14229.event_callback_mutex, K_FOREVER);
+
+  UDSErr_t nrc = uds_periodic_handle_request(inst, data, len);
+  // Queued before the handler can send the first periodic message
+  uds_periodic_respond(inst, nrc, functional);
+
+  k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+}
+
+void uds_periodic_data_ids_on_session_change(struct uds_instance_t* inst) {
+  uds_periodic_stop_all(&inst->periodic);
+}
+
+void uds_periodic_data_ids_init(struct uds_instance_t* inst) {
+  struct uds_periodic_scheduler* sched = &inst->periodic;
+
+  memset(sched, 0, sizeof(*sched));
+  sched->can_id = UDS_TP_NOOP_ADDR;
+  k_work_init_delayable(&sched->work, uds_periodic_work_handler);
+}
+
+int uds_set_periodic_can_id(struct uds_instance_t* inst, uint32_t can_id) {
+  if (inst == NULL) {
+    return -EINVAL;
+  }
+
+  k_mutex_lock(&inst->iso14229.event_callback_mutex, K_FOREVER);
+  inst->periodic.can_id = can_id;
+  if (can_id == UDS_TP_NOOP_ADDR) {
+    uds_periodic_stop_all(&inst->periodic);
+  }
+  k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+
+  return 0;
+}
+
+void uds_periodic_data_ids_stop(struct uds_instance_t* inst) {
+  struct k_work_sync sync;
+
+  k_mutex_lock(&inst->iso14229.event_callback_mutex, K_FOREVER);
+  uds_periodic_stop_all(&inst->periodic);
+  k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+
+  k_work_cancel_delayable_sync(&inst->periodic.work, &sync);
+}
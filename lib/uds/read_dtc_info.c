@@ -17,6 +17,15 @@ LOG_MODULE_DECLARE(uds, CONFIG_UDS_LOG_LEVEL);
 #include <ardep/uds.h>
 #include <iso14229.h>
 
+static uint32_t uds_get_registration_key_for_read_dtc_info(
+    const struct uds_registration_t* const reg) {
+  return reg->read_dtc.sub_function;
+}
+
+static uint32_t uds_get_event_key_for_read_dtc_info(const void* arg) {
+  return ((const UDSRDTCIArgs_t*)arg)->type;
+}
+
 static UDSErr_t uds_check_with_subfunc_fn(
     const struct uds_context* const context, bool* apply_action) {
   const struct uds_registration_t* const reg = context->registration;
@@ -51,4 +60,6 @@ STRUCT_SECTION_ITERABLE(uds_event_handler_data,
   .get_action = uds_get_action_for_read_dtc_info,
   .default_nrc = UDS_NRC_SubFunctionNotSupported,
   .registration_type = UDS_REGISTRATION_TYPE__READ_DTC_INFO,
+  .get_registration_key = uds_get_registration_key_for_read_dtc_info,
+  .get_event_key = uds_get_event_key_for_read_dtc_info,
 };
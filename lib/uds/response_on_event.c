@@ -0,0 +1,795 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ardep/uds.h"
+#include "iso14229.h"
+#include "uds.h"
+
+#include <string.h>
+
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+LOG_MODULE_DECLARE(uds, CONFIG_UDS_LOG_LEVEL);
+
+/*
+ * ResponseOnEvent (0x86) is not implemented by the iso14229 server, the
+ * requests are taken from the request hook of the instance.
+ *
+ * Active events are sampled by a change detection pass on the system work
+ * queue. Data identifiers are read with their registered read actions and
+ * DTC statuses with the registered ReadDTCInformation (reportDTCByStatusMask)
+ * action. The bytes are hashed while they are copied, so a pass needs no
+ * buffer and only an identified event costs more than the read itself.
+ * When an event is identified, its serviceToRespondTo request is injected
+ * into the instance and answered by the server like a request of the
+ * tester. When the window of an event ends, a marker request is injected
+ * the same way and its final response is sent from the request hook, so
+ * responses are only sent by the thread of the server.
+ *
+ * The state is protected by the event callback mutex of the iso14229
+ * instance, which also serializes the read actions with the server.
+ */
+
+#define UDS_NEGATIVE_RESPONSE_SID 0x7F
+#define UDS_POSITIVE_RESPONSE_OFFSET 0x40
+
+#define UDS_SUPPRESS_POS_RSP_MSG_INDICATION_BIT 0x80
+// Events are not stored in non-volatile memory, so the bit is ignored
+#define UDS_RESPONSE_ON_EVENT_STORE_EVENT_BIT 0x40
+#define UDS_RESPONSE_ON_EVENT_TYPE_MASK               \
+  (0xFF & ~(UDS_SUPPRESS_POS_RSP_MSG_INDICATION_BIT | \
+            UDS_RESPONSE_ON_EVENT_STORE_EVENT_BIT))
+
+#define UDS_RESPONSE_ON_EVENT_DTC_RECORD_LEN 1
+#define UDS_RESPONSE_ON_EVENT_DATA_ID_RECORD_LEN 2
+#define UDS_RESPONSE_ON_EVENT_COMPARISON_RECORD_LEN 10
+
+enum uds_response_on_event_comparison {
+  UDS_RESPONSE_ON_EVENT_COMPARISON__LESS = 0x01,
+  UDS_RESPONSE_ON_EVENT_COMPARISON__GREATER = 0x02,
+  UDS_RESPONSE_ON_EVENT_COMPARISON__EQUAL = 0x03,
+  UDS_RESPONSE_ON_EVENT_COMPARISON__NOT_EQUAL = 0x04,
+};
+
+// Layout of the localization of onComparisonOfValues
+#define UDS_RESPONSE_ON_EVENT_LOCALIZATION_SIGNED BIT(15)
+#define UDS_RESPONSE_ON_EVENT_LOCALIZATION_LENGTH(localization) \
+  (((localization) >> 10) & 0x1F)
+#define UDS_RESPONSE_ON_EVENT_LOCALIZATION_OFFSET(localization) \
+  ((localization) & 0x3FF)
+
+#define UDS_FNV1A_OFFSET_BASIS 0x811C9DC5U
+#define UDS_FNV1A_PRIME 0x01000193U
+
+struct uds_response_on_event_comparison_record {
+  uint16_t data_id;
+  uint8_t logic;
+  uint32_t value;
+  uint8_t hysteresis;
+  bool is_signed;
+  uint8_t bit_len;
+  uint16_t bit_offset;
+};
+
+static void uds_response_on_event_parse_comparison(
+    const struct uds_response_on_event_entry* event,
+    struct uds_response_on_event_comparison_record* comparison) {
+  const uint16_t localization = sys_get_be16(&event->record[8]);
+  const uint8_t bit_len =
+      UDS_RESPONSE_ON_EVENT_LOCALIZATION_LENGTH(localization);
+
+  comparison->data_id = sys_get_be16(&event->record[0]);
+  comparison->logic = event->record[2];
+  comparison->value = sys_get_be32(&event->record[3]);
+  comparison->hysteresis = event->record[7];
+  comparison->is_signed =
+      (localization & UDS_RESPONSE_ON_EVENT_LOCALIZATION_SIGNED) != 0;
+  // A length of 0 compares all 32 bits
+  comparison->bit_len = bit_len == 0 ? 32 : bit_len;
+  comparison->bit_offset =
+      UDS_RESPONSE_ON_EVENT_LOCALIZATION_OFFSET(localization);
+}
+
+static uint32_t uds_response_on_event_window_ms(uint8_t window) {
+  switch (window) {
+    case UDS_RESPONSE_ON_EVENT_WINDOW__SHORT:
+      return CONFIG_UDS_RESPONSE_ON_EVENT_SHORT_WINDOW_MS;
+    case UDS_RESPONSE_ON_EVENT_WINDOW__MEDIUM:
+      return CONFIG_UDS_RESPONSE_ON_EVENT_MEDIUM_WINDOW_MS;
+    case UDS_RESPONSE_ON_EVENT_WINDOW__LONG:
+      return CONFIG_UDS_RESPONSE_ON_EVENT_LONG_WINDOW_MS;
+    default:
+      return 0;
+  }
+}
+
+static bool uds_response_on_event_window_valid(uint8_t window) {
+  return window == UDS_RESPONSE_ON_EVENT_WINDOW__INFINITE ||
+         uds_response_on_event_window_ms(window) != 0;
+}
+
+static void uds_response_on_event_hash_byte(struct uds_response_on_event* roe,
+                                            uint8_t byte) {
+  roe->read_hash = (roe->read_hash ^ byte) * UDS_FNV1A_PRIME;
+}
+
+// Appends the bits of a byte that fall into the compared value
+static void uds_response_on_event_extract_bits(
+    struct uds_response_on_event* roe, uint32_t pos, uint8_t byte) {
+  const uint32_t first_bit = pos * 8;
+  const uint32_t start = roe->read_bit_offset;
+  const uint32_t end = start + roe->read_bit_len;
+
+  if (first_bit + 8 <= start || first_bit >= end) {
+    return;
+  }
+
+  // Bits are counted from the most significant bit of the first byte
+  for (uint32_t bit = MAX(first_bit, start); bit < MIN(first_bit + 8, end);
+       bit++) {
+    roe->read_value = (roe->read_value << 1) | ((byte >> (7 - (bit % 8))) & 1);
+    roe->read_bits++;
+  }
+}
+
+static uint8_t uds_response_on_event_copy(UDSServer_t* srv,
+                                          const void* src,
+                                          uint16_t count) {
+  struct iso14229_zephyr_instance* iso14229 = srv->fn_data;
+  struct uds_instance_t* inst =
+      CONTAINER_OF(iso14229, struct uds_instance_t, iso14229);
+  struct uds_response_on_event* roe = &inst->response_on_event;
+  const uint8_t* bytes = src;
+
+  for (uint16_t i = 0; i < count; i++, roe->read_pos++) {
+    uint8_t byte = bytes[i];
+
+    switch (roe->read_type) {
+      case UDS_RESPONSE_ON_EVENT_TYPE__ON_DTC_STATUS_CHANGE:
+        // The DTCStatusAvailabilityMask is followed by records of a 3 byte
+        // DTC and its status byte. Only status bits in the mask count.
+        if (roe->read_pos > 0 && (roe->read_pos - 1) % 4 == 3) {
+          byte &= roe->read_dtc_mask;
+        }
+        uds_response_on_event_hash_byte(roe, byte);
+        break;
+      case UDS_RESPONSE_ON_EVENT_TYPE__ON_CHANGE_OF_DATA_IDENTIFIER:
+        uds_response_on_event_hash_byte(roe, byte);
+        break;
+      case UDS_RESPONSE_ON_EVENT_TYPE__ON_COMPARISON_OF_VALUES:
+        uds_response_on_event_extract_bits(roe, roe->read_pos, byte);
+        break;
+      default:
+        break;
+    }
+  }
+
+  return UDS_PositiveResponse;
+}
+
+static void uds_response_on_event_read_begin(struct uds_response_on_event* roe,
+                                             uint8_t event_type) {
+  roe->read_type = event_type;
+  roe->read_pos = 0;
+  roe->read_hash = UDS_FNV1A_OFFSET_BASIS;
+  roe->read_bits = 0;
+  roe->read_value = 0;
+}
+
+static UDSErr_t uds_response_on_event_read_data_id(struct uds_instance_t* inst,
+                                                   uint16_t data_id) {
+  UDSRDBIArgs_t args = {
+    .dataId = data_id,
+    .copy = uds_response_on_event_copy,
+  };
+
+  return inst->iso14229.event_callback(&inst->iso14229, UDS_EVT_ReadDataByIdent,
+                                       &args, inst->iso14229.user_context);
+}
+
+static UDSErr_t uds_response_on_event_read_dtc_status(
+    struct uds_instance_t* inst, uint8_t mask) {
+  UDSRDTCIArgs_t args = {
+    .type = UDS_READ_DTC_INFO_SUBFUNC__DTC_BY_STATUS_MASK,
+    .copy = uds_response_on_event_copy,
+    .subFuncArgs.numOfDTCByStatusMaskArgs.mask = mask,
+  };
+
+  inst->response_on_event.read_dtc_mask = mask;
+  return inst->iso14229.event_callback(&inst->iso14229,
+                                       UDS_EVT_ReadDTCInformation, &args,
+                                       inst->iso14229.user_context);
+}
+
+static bool uds_response_on_event_compare(
+    const struct uds_response_on_event_comparison_record* comparison,
+    int64_t measured,
+    int64_t reference) {
+  switch (comparison->logic) {
+    case UDS_RESPONSE_ON_EVENT_COMPARISON__LESS:
+      return measured < reference;
+    case UDS_RESPONSE_ON_EVENT_COMPARISON__GREATER:
+      return measured > reference;
+    case UDS_RESPONSE_ON_EVENT_COMPARISON__EQUAL:
+      return measured == reference;
+    case UDS_RESPONSE_ON_EVENT_COMPARISON__NOT_EQUAL:
+      return measured != reference;
+    default:
+      return false;
+  }
+}
+
+// The comparison fires again once it was false and the value left the
+// hysteresis band, a percentage of the comparison value, on the other side
+static bool uds_response_on_event_rearm(
+    const struct uds_response_on_event_comparison_record* comparison,
+    int64_t measured,
+    int64_t reference) {
+  const int64_t band =
+      (reference < 0 ? -reference : reference) * comparison->hysteresis / 100;
+
+  switch (comparison->logic) {
+    case UDS_RESPONSE_ON_EVENT_COMPARISON__LESS:
+      return measured >= reference + band;
+    case UDS_RESPONSE_ON_EVENT_COMPARISON__GREATER:
+      return measured <= reference - band;
+    default:
+      return !uds_response_on_event_compare(comparison, measured, reference);
+  }
+}
+
+static int64_t uds_response_on_event_to_signed(uint32_t value,
+                                               uint8_t bit_len,
+                                               bool is_signed) {
+  if (!is_signed) {
+    return value;
+  }
+
+  if (bit_len < 32 && (value & BIT(bit_len - 1))) {
+    value |= ~(uint32_t)BIT_MASK(bit_len);
+  }
+
+  return (int32_t)value;
+}
+
+static bool uds_response_on_event_sample_comparison(
+    struct uds_instance_t* inst, struct uds_response_on_event_entry* event) {
+  struct uds_response_on_event* roe = &inst->response_on_event;
+  struct uds_response_on_event_comparison_record comparison;
+
+  uds_response_on_event_parse_comparison(event, &comparison);
+
+  uds_response_on_event_read_begin(roe, event->event_type);
+  roe->read_bit_offset = comparison.bit_offset;
+  roe->read_bit_len = comparison.bit_len;
+
+  UDSErr_t ret = uds_response_on_event_read_data_id(inst, comparison.data_id);
+  if (ret != UDS_PositiveResponse || roe->read_bits != comparison.bit_len) {
+    LOG_WRN("Failed to compare data identifier 0x%04X. Err: %d",
+            comparison.data_id, ret);
+    return false;
+  }
+
+  const int64_t measured = uds_response_on_event_to_signed(
+      roe->read_value, comparison.bit_len, comparison.is_signed);
+  const int64_t reference = uds_response_on_event_to_signed(
+      comparison.value, 32, comparison.is_signed);
+  const bool matches =
+      uds_response_on_event_compare(&comparison, measured, reference);
+
+  // Only a comparison that becomes true is an event, not one that is true
+  // when the event starts
+  if (!event->sampled) {
+    event->sampled = true;
+    event->armed = !matches;
+    return false;
+  }
+
+  if (event->armed && matches) {
+    event->armed = false;
+    return true;
+  }
+
+  if (!event->armed &&
+      uds_response_on_event_rearm(&comparison, measured, reference)) {
+    event->armed = true;
+  }
+
+  return false;
+}
+
+static bool uds_response_on_event_sample_hash(
+    struct uds_instance_t* inst, struct uds_response_on_event_entry* event) {
+  struct uds_response_on_event* roe = &inst->response_on_event;
+  UDSErr_t ret;
+
+  uds_response_on_event_read_begin(roe, event->event_type);
+
+  if (event->event_type == UDS_RESPONSE_ON_EVENT_TYPE__ON_DTC_STATUS_CHANGE) {
+    ret = uds_response_on_event_read_dtc_status(inst, event->record[0]);
+  } else {
+    ret = uds_response_on_event_read_data_id(inst,
+                                             sys_get_be16(&event->record[0]));
+  }
+
+  if (ret != UDS_PositiveResponse) {
+    LOG_WRN("Failed to sample event 0x%02X. Err: %d", event->event_type, ret);
+    return false;
+  }
+
+  // The first sample after the start is the reference for changes
+  const bool changed = event->sampled && roe->read_hash != event->hash;
+  event->sampled = true;
+  event->hash = roe->read_hash;
+  return changed;
+}
+
+static bool uds_response_on_event_sample(
+    struct uds_instance_t* inst, struct uds_response_on_event_entry* event) {
+  switch (event->event_type) {
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_DTC_STATUS_CHANGE:
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_CHANGE_OF_DATA_IDENTIFIER:
+      return uds_response_on_event_sample_hash(inst, event);
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_COMPARISON_OF_VALUES:
+      return uds_response_on_event_sample_comparison(inst, event);
+    default:
+      return false;
+  }
+}
+
+// Passes the serviceToRespondTo request to the server as if the tester sent
+// it, so the server answers it on the physical target address
+static void uds_response_on_event_respond_to(
+    struct uds_instance_t* inst,
+    const struct uds_response_on_event_entry* event) {
+  struct can_frame frame = {
+    .dlc = 1 + event->service_len,
+  };
+
+  frame.data[0] = event->service_len;
+  memcpy(&frame.data[1], event->service, event->service_len);
+
+  iso14229_inject_can_frame_rx(&inst->iso14229, &frame, false);
+}
+
+static void uds_response_on_event_inject_final_response(
+    struct uds_instance_t* inst) {
+  struct can_frame frame = {
+    .dlc = 2,
+    .data = {1, UDS_RESPONSE_ON_EVENT_FINAL_RESPONSE_MARKER},
+  };
+
+  inst->response_on_event.final_injected = true;
+  iso14229_inject_can_frame_rx(&inst->iso14229, &frame, false);
+}
+
+static void uds_response_on_event_work_handler(struct k_work* work) {
+  struct k_work_delayable* dwork = k_work_delayable_from_work(work);
+  struct uds_response_on_event* roe =
+      CONTAINER_OF(dwork, struct uds_response_on_event, work);
+  struct uds_instance_t* inst =
+      CONTAINER_OF(roe, struct uds_instance_t, response_on_event);
+  bool active = false;
+
+  k_mutex_lock(&inst->iso14229.event_callback_mutex, K_FOREVER);
+
+  const int64_t now = k_uptime_get();
+  // Injected requests are received as a whole before the server takes the
+  // next one, so at most one event is identified per pass. The other events
+  // are sampled again by the next pass and the changes are not lost.
+  const bool busy = inst->iso14229.server.requestInProgress;
+  bool responded = busy;
+
+  for (size_t i = 0; i < ARRAY_SIZE(roe->events); i++) {
+    const size_t index = (roe->next + i) % ARRAY_SIZE(roe->events);
+    struct uds_response_on_event_entry* event = &roe->events[index];
+
+    if (event->active && now >= event->window_end_ms) {
+      LOG_DBG("Window of event 0x%02X ended, identified %u times",
+              event->event_type, event->identified);
+      event->active = false;
+      event->window_ended = true;
+    }
+
+    if (event->window_ended) {
+      // The final responses are sent one by one, the pass is repeated
+      // until all are sent
+      active = true;
+      if (!responded && !roe->final_injected) {
+        uds_response_on_event_inject_final_response(inst);
+        responded = true;
+      }
+      continue;
+    }
+
+    if (!event->active) {
+      continue;
+    }
+
+    active = true;
+    if (responded) {
+      continue;
+    }
+
+    if (uds_response_on_event_sample(inst, event)) {
+      uds_response_on_event_respond_to(inst, event);
+      if (event->identified < UINT8_MAX) {
+        event->identified++;
+      }
+
+      responded = true;
+      roe->next = (index + 1) % ARRAY_SIZE(roe->events);
+    }
+  }
+
+  if (active) {
+    k_work_schedule(dwork, K_MSEC(CONFIG_UDS_RESPONSE_ON_EVENT_INTERVAL_MS));
+  }
+
+  k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+}
+
+static void uds_response_on_event_stop_all(struct uds_response_on_event* roe) {
+  // Stopped events end without a final response
+  ARRAY_FOR_EACH_PTR(roe->events, event) {
+    event->active = false;
+    event->window_ended = false;
+  }
+
+  // A running handler waits for the mutex and finds nothing to sample
+  k_work_cancel_delayable(&roe->work);
+}
+
+static void uds_response_on_event_clear_all(struct uds_response_on_event* roe) {
+  uds_response_on_event_stop_all(roe);
+
+  ARRAY_FOR_EACH_PTR(roe->events, event) {
+    memset(event, 0, sizeof(*event));
+  }
+}
+
+static UDSErr_t uds_response_on_event_start(struct uds_response_on_event* roe) {
+  const int64_t now = k_uptime_get();
+  bool set_up = false;
+
+  ARRAY_FOR_EACH_PTR(roe->events, event) {
+    if (event->event_type == 0) {
+      continue;
+    }
+
+    const uint32_t window_ms = uds_response_on_event_window_ms(event->window);
+
+    event->active = true;
+    event->window_ended = false;
+    event->window_end_ms = window_ms == 0 ? INT64_MAX : now + window_ms;
+    event->identified = 0;
+    event->sampled = false;
+    set_up = true;
+  }
+
+  if (!set_up) {
+    return UDS_NRC_RequestSequenceError;
+  }
+
+  k_work_reschedule(&roe->work, K_NO_WAIT);
+  return UDS_PositiveResponse;
+}
+
+static uint8_t uds_response_on_event_record_len(uint8_t event_type) {
+  switch (event_type) {
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_DTC_STATUS_CHANGE:
+      return UDS_RESPONSE_ON_EVENT_DTC_RECORD_LEN;
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_CHANGE_OF_DATA_IDENTIFIER:
+      return UDS_RESPONSE_ON_EVENT_DATA_ID_RECORD_LEN;
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_COMPARISON_OF_VALUES:
+      return UDS_RESPONSE_ON_EVENT_COMPARISON_RECORD_LEN;
+    default:
+      return 0;
+  }
+}
+
+static UDSErr_t uds_response_on_event_check_record(
+    struct uds_instance_t* inst,
+    uint8_t event_type,
+    const uint8_t* record) {
+  struct uds_response_on_event* roe = &inst->response_on_event;
+
+  if (event_type == UDS_RESPONSE_ON_EVENT_TYPE__ON_DTC_STATUS_CHANGE) {
+    return UDS_PositiveResponse;
+  }
+
+  if (event_type == UDS_RESPONSE_ON_EVENT_TYPE__ON_COMPARISON_OF_VALUES) {
+    const uint8_t logic = record[2];
+    if (logic < UDS_RESPONSE_ON_EVENT_COMPARISON__LESS ||
+        logic > UDS_RESPONSE_ON_EVENT_COMPARISON__NOT_EQUAL ||
+        record[7] > 100) {
+      return UDS_NRC_RequestOutOfRange;
+    }
+  }
+
+  // The data identifier has to be readable when the event is set up
+  uds_response_on_event_read_begin(roe, 0);
+  if (uds_response_on_event_read_data_id(inst, sys_get_be16(record)) !=
+      UDS_PositiveResponse) {
+    LOG_WRN("Data identifier 0x%04X of event can not be read",
+            sys_get_be16(record));
+    return UDS_NRC_RequestOutOfRange;
+  }
+
+  return UDS_PositiveResponse;
+}
+
+static UDSErr_t uds_response_on_event_set_up(struct uds_instance_t* inst,
+                                             uint8_t event_type,
+                                             const uint8_t* data,
+                                             uint16_t len) {
+  struct uds_response_on_event* roe = &inst->response_on_event;
+  const uint8_t record_len = uds_response_on_event_record_len(event_type);
+
+  // SID, sub-function, eventWindowTime, eventTypeRecord and at least the
+  // service identifier to respond to
+  if (len < 3 + record_len + 1) {
+    return UDS_NRC_IncorrectMessageLengthOrInvalidFormat;
+  }
+
+  const uint8_t window = data[2];
+  const uint8_t* record = &data[3];
+  const uint8_t* service = &data[3 + record_len];
+  const uint16_t service_len = len - 3 - record_len;
+
+  if (!uds_response_on_event_window_valid(window) ||
+      service_len > UDS_RESPONSE_ON_EVENT_SERVICE_MAX ||
+      service[0] == UDS_SID_RESPONSE_ON_EVENT) {
+    return UDS_NRC_RequestOutOfRange;
+  }
+
+  UDSErr_t ret = uds_response_on_event_check_record(inst, event_type, record);
+  if (ret != UDS_PositiveResponse) {
+    return ret;
+  }
+
+  // Setting up the same event again replaces it
+  struct uds_response_on_event_entry* slot = NULL;
+  ARRAY_FOR_EACH_PTR(roe->events, event) {
+    if (event->event_type == event_type &&
+        memcmp(event->record, record, record_len) == 0) {
+      slot = event;
+      break;
+    }
+
+    if (slot == NULL && event->event_type == 0) {
+      slot = event;
+    }
+  }
+
+  if (slot == NULL) {
+    LOG_WRN("No slot for event 0x%02X", event_type);
+    return UDS_NRC_ConditionsNotCorrect;
+  }
+
+  memset(slot, 0, sizeof(*slot));
+  slot->event_type = event_type;
+  slot->window = window;
+  memcpy(slot->record, record, record_len);
+  slot->record_len = record_len;
+  memcpy(slot->service, service, service_len);
+  slot->service_len = service_len;
+
+  return UDS_PositiveResponse;
+}
+
+// Appends the description of an event as in the response to its setup
+static uint16_t uds_response_on_event_describe(
+    const struct uds_response_on_event_entry* event, uint8_t* buf) {
+  uint16_t len = 0;
+
+  buf[len++] = event->window;
+  memcpy(&buf[len], event->record, event->record_len);
+  len += event->record_len;
+  memcpy(&buf[len], event->service, event->service_len);
+  len += event->service_len;
+
+  return len;
+}
+
+#define UDS_RESPONSE_ON_EVENT_DESCRIPTION_MAX \
+  (2 + UDS_RESPONSE_ON_EVENT_RECORD_MAX + UDS_RESPONSE_ON_EVENT_SERVICE_MAX)
+
+static void uds_response_on_event_respond(struct uds_instance_t* inst,
+                                          const uint8_t* data,
+                                          uint16_t len,
+                                          UDSErr_t nrc,
+                                          bool functional) {
+  struct uds_response_on_event* roe = &inst->response_on_event;
+  uint8_t response[3 + CONFIG_UDS_RESPONSE_ON_EVENT_MAX *
+                           UDS_RESPONSE_ON_EVENT_DESCRIPTION_MAX];
+  uint16_t response_len = 0;
+
+  if (nrc == UDS_PositiveResponse) {
+    const uint8_t event_type = data[1] & UDS_RESPONSE_ON_EVENT_TYPE_MASK;
+
+    if (data[1] & UDS_SUPPRESS_POS_RSP_MSG_INDICATION_BIT) {
+      return;
+    }
+
+    response[response_len++] =
+        UDS_SID_RESPONSE_ON_EVENT + UDS_POSITIVE_RESPONSE_OFFSET;
+    response[response_len++] = event_type;
+
+    if (event_type == UDS_RESPONSE_ON_EVENT_TYPE__REPORT_ACTIVATED_EVENTS) {
+      uint8_t* num_active = &response[response_len++];
+
+      *num_active = 0;
+      ARRAY_FOR_EACH_PTR(roe->events, event) {
+        if (!event->active) {
+          continue;
+        }
+
+        (*num_active)++;
+        response[response_len++] = event->event_type;
+        response_len +=
+            uds_response_on_event_describe(event, &response[response_len]);
+      }
+    } else {
+      // numberOfIdentifiedEvents, always 0 in responses to requests
+      response[response_len++] = 0;
+      // The eventWindowTime and records are echoed
+      memcpy(&response[response_len], &data[2], len - 2);
+      response_len += len - 2;
+    }
+  } else {
+    // Same as the server: these negative responses are suppressed for
+    // functionally addressed requests
+    if (functional && (nrc == UDS_NRC_ServiceNotSupported ||
+                       nrc == UDS_NRC_SubFunctionNotSupported ||
+                       nrc == UDS_NRC_RequestOutOfRange)) {
+      return;
+    }
+
+    response[response_len++] = UDS_NEGATIVE_RESPONSE_SID;
+    response[response_len++] = UDS_SID_RESPONSE_ON_EVENT;
+    response[response_len++] = nrc;
+  }
+
+  int ret = iso14229_zephyr_send_response(&inst->iso14229, response,
+                                          response_len);
+  if (ret < 0) {
+    LOG_WRN("Failed to send ResponseOnEvent response: %d", ret);
+  }
+}
+
+static UDSErr_t uds_response_on_event_handle_request(
+    struct uds_instance_t* inst, const uint8_t* data, uint16_t len) {
+  struct uds_response_on_event* roe = &inst->response_on_event;
+  UDSServer_t* srv = &inst->iso14229.server;
+
+  if (len < 2) {
+    return UDS_NRC_IncorrectMessageLengthOrInvalidFormat;
+  }
+
+  if (srv->requestInProgress) {
+    return UDS_NRC_BusyRepeatRequest;
+  }
+
+  // The request bypasses the server, keep the session alive like any other
+  // request does
+  srv->s3_session_timeout_timer = UDSMillis() + srv->s3_ms;
+
+  const uint8_t event_type = data[1] & UDS_RESPONSE_ON_EVENT_TYPE_MASK;
+  switch (event_type) {
+    case UDS_RESPONSE_ON_EVENT_TYPE__STOP:
+    case UDS_RESPONSE_ON_EVENT_TYPE__START:
+    case UDS_RESPONSE_ON_EVENT_TYPE__CLEAR:
+      // The eventWindowTime is optional and not evaluated
+      if (len > 3) {
+        return UDS_NRC_IncorrectMessageLengthOrInvalidFormat;
+      }
+
+      if (event_type == UDS_RESPONSE_ON_EVENT_TYPE__START) {
+        return uds_response_on_event_start(roe);
+      }
+
+      if (event_type == UDS_RESPONSE_ON_EVENT_TYPE__STOP) {
+        uds_response_on_event_stop_all(roe);
+      } else {
+        uds_response_on_event_clear_all(roe);
+      }
+      return UDS_PositiveResponse;
+    case UDS_RESPONSE_ON_EVENT_TYPE__REPORT_ACTIVATED_EVENTS:
+      if (len != 2) {
+        return UDS_NRC_IncorrectMessageLengthOrInvalidFormat;
+      }
+      return UDS_PositiveResponse;
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_DTC_STATUS_CHANGE:
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_CHANGE_OF_DATA_IDENTIFIER:
+    case UDS_RESPONSE_ON_EVENT_TYPE__ON_COMPARISON_OF_VALUES:
+      return uds_response_on_event_set_up(inst, event_type, data, len);
+    default:
+      return UDS_NRC_SubFunctionNotSupported;
+  }
+}
+
+void uds_response_on_event_request(struct uds_instance_t* inst,
+                                   const uint8_t* data,
+                                   uint16_t len,
+                                   bool functional) {
+  k_mutex_lock(&inst->iso14229.event_callback_mutex, K_FOREVER);
+
+  UDSErr_t nrc = uds_response_on_event_handle_request(inst, data, len);
+  // Sent before the first identified event is answered
+  uds_response_on_event_respond(inst, data, len, nrc, functional);
+
+  k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+}
+
+bool uds_response_on_event_final_response(struct uds_instance_t* inst) {
+  struct uds_response_on_event* roe = &inst->response_on_event;
+  uint8_t response[3 + UDS_RESPONSE_ON_EVENT_DESCRIPTION_MAX];
+  uint16_t response_len = 0;
+
+  k_mutex_lock(&inst->iso14229.event_callback_mutex, K_FOREVER);
+
+  if (!roe->final_injected) {
+    k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+    return false;
+  }
+
+  roe->final_injected = false;
+
+  // The events may have been stopped since the marker was injected
+  ARRAY_FOR_EACH_PTR(roe->events, event) {
+    if (!event->window_ended) {
+      continue;
+    }
+
+    event->window_ended = false;
+
+    response[response_len++] =
+        UDS_SID_RESPONSE_ON_EVENT + UDS_POSITIVE_RESPONSE_OFFSET;
+    response[response_len++] = event->event_type;
+    response[response_len++] = event->identified;
+    response_len +=
+        uds_response_on_event_describe(event, &response[response_len]);
+    break;
+  }
+
+  if (response_len > 0) {
+    int ret = iso14229_zephyr_send_response(&inst->iso14229, response,
+                                            response_len);
+    if (ret < 0) {
+      LOG_WRN("Failed to send ResponseOnEvent final response: %d", ret);
+    }
+  }
+
+  k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+  return true;
+}
+
+void uds_response_on_event_on_session_change(struct uds_instance_t* inst) {
+  uds_response_on_event_stop_all(&inst->response_on_event);
+}
+
+void uds_response_on_event_init(struct uds_instance_t* inst) {
+  struct uds_response_on_event* roe = &inst->response_on_event;
+
+  memset(roe, 0, sizeof(*roe));
+  k_work_init_delayable(&roe->work, uds_response_on_event_work_handler);
+}
+
+void uds_response_on_event_clear(struct uds_instance_t* inst) {
+  struct k_work_sync sync;
+
+  k_mutex_lock(&inst->iso14229.event_callback_mutex, K_FOREVER);
+  uds_response_on_event_clear_all(&inst->response_on_event);
+  inst->response_on_event.final_injected = false;
+  k_mutex_unlock(&inst->iso14229.event_callback_mutex);
+
+  k_work_cancel_delayable_sync(&inst->response_on_event.work, &sync);
+}
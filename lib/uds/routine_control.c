@@ -12,6 +12,15 @@ LOG_MODULE_DECLARE(uds, CONFIG_UDS_LOG_LEVEL);
 #include "iso14229.h"
 #include "uds.h"
 
+static uint32_t uds_get_registration_key_for_routine_control(
+    const struct uds_registration_t* const reg) {
+  return reg->routine_control.routine_id;
+}
+
+static uint32_t uds_get_event_key_for_routine_control(const void* arg) {
+  return ((const UDSRoutineCtrlArgs_t*)arg)->id;
+}
+
 static UDSErr_t uds_check_with_routine_id_fn(
     const struct uds_context* const context, bool* apply_action) {
   const struct uds_registration_t* const reg = context->registration;
@@ -46,4 +55,6 @@ STRUCT_SECTION_ITERABLE(uds_event_handler_data,
   .get_action = uds_get_action_for_routine_control,
   .default_nrc = UDS_NRC_SubFunctionNotSupported,
   .registration_type = UDS_REGISTRATION_TYPE__ROUTINE_CONTROL,
+  .get_registration_key = uds_get_registration_key_for_routine_control,
+  .get_event_key = uds_get_event_key_for_routine_control,
 };
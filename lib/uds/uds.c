@@ -6,8 +6,10 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/iterable_sections.h>
 #include <zephyr/sys/util.h>
 LOG_MODULE_REGISTER(uds, CONFIG_UDS_LOG_LEVEL);
 
@@ -60,49 +62,414 @@ static UDSErr_t uds_check_and_act_on_event(
   return UDS_OK;
 }
 
-// Iterates over event handlers to apply the actions for the event
+// Registrations apply to the instance they were registered for, static
+// registrations without an instance apply to all instances
+static bool uds_registration_matches(
+    const struct uds_registration_t* reg,
+    const struct uds_instance_t* instance,
+    const struct uds_event_handler_data* handler,
+    uint32_t key) {
+  if (reg->type != handler->registration_type) {
+    return false;
+  }
+
+  if (reg->instance != NULL && reg->instance != instance) {
+    return false;
+  }
+
+  return handler->get_registration_key == NULL ||
+         handler->get_registration_key(reg) == key;
+}
+
+// Checks and acts on a single registration. Returns true if the event was
+// handled and no further registrations must be checked.
+static bool uds_apply_registration(struct uds_instance_t* instance,
+                                   struct uds_registration_t* reg,
+                                   UDSEvent_t event,
+                                   void* arg,
+                                   const struct uds_event_handler_data* handler,
+                                   bool* found_at_least_one_match,
+                                   bool consume_event_default,
+                                   UDSErr_t* ret) {
+  bool consume_event = consume_event_default;
+
+  struct uds_context context = {
+    .instance = instance,
+    .registration = reg,
+    .server = &instance->iso14229.server,
+    .event = event,
+    .arg = arg,
+  };
+
+  *ret = uds_check_and_act_on_event(&context, handler, found_at_least_one_match,
+                                    &consume_event);
+  return consume_event || *ret != UDS_OK;
+}
+
+/*
+ * Static registrations live in iterable sections in ROM. Data identifiers and
+ * routines have a section each. If such a table happens to be in key order,
+ * e.g. with a single registration, it is looked up in place with a binary
+ * search, otherwise through the index built by uds_init().
+ */
+struct uds_registration_table {
+  struct uds_registration_t* start;
+  struct uds_registration_t* end;
+  // All registrations have a key of the same kind
+  bool keyed;
+  // Keys are in ascending order, checked during uds_init()
+  bool sorted;
+};
+
+TYPE_SECTION_START_EXTERN(struct uds_registration_t, uds_registration_t);
+TYPE_SECTION_END_EXTERN(struct uds_registration_t, uds_registration_t);
+TYPE_SECTION_START_EXTERN(struct uds_registration_t,
+                          uds_data_identifier_registration);
+TYPE_SECTION_END_EXTERN(struct uds_registration_t,
+                        uds_data_identifier_registration);
+TYPE_SECTION_START_EXTERN(struct uds_registration_t,
+                          uds_routine_control_registration);
+TYPE_SECTION_END_EXTERN(struct uds_registration_t,
+                        uds_routine_control_registration);
+
+static struct uds_registration_table uds_data_identifier_table = {
+  .start = TYPE_SECTION_START(uds_data_identifier_registration),
+  .end = TYPE_SECTION_END(uds_data_identifier_registration),
+  .keyed = true,
+};
+
+static struct uds_registration_table uds_routine_control_table = {
+  .start = TYPE_SECTION_START(uds_routine_control_registration),
+  .end = TYPE_SECTION_END(uds_routine_control_registration),
+  .keyed = true,
+};
+
+static struct uds_registration_table uds_common_table = {
+  .start = TYPE_SECTION_START(uds_registration_t),
+  .end = TYPE_SECTION_END(uds_registration_t),
+};
+
+static struct uds_registration_table* const uds_registration_tables[] = {
+  &uds_data_identifier_table,
+  &uds_routine_control_table,
+  &uds_common_table,
+};
+
+static struct uds_registration_table* uds_registration_table_for(
+    enum uds_registration_type_t type) {
+  switch (type) {
+    case UDS_REGISTRATION_TYPE__DATA_IDENTIFIER:
+      return &uds_data_identifier_table;
+    case UDS_REGISTRATION_TYPE__ROUTINE_CONTROL:
+      return &uds_routine_control_table;
+    default:
+      return &uds_common_table;
+  }
+}
+
+static size_t uds_registration_table_len(
+    const struct uds_registration_table* table) {
+  return table->end - table->start;
+}
+
+/*
+ * Init time index of the static registrations in tables that are not sorted,
+ * sorted by registration type, key (e.g. data identifier) and position in the
+ * table. An event resolves to the matching range with a binary search, so the
+ * dispatch cost does not grow with the number of registrations. The position
+ * keeps the order of registrations sharing a key.
+ */
+struct uds_registration_index_entry {
+  uint32_t key;
+  uint16_t type;
+  uint16_t position;
+};
+
+static struct uds_registration_index_entry
+    uds_registration_index[CONFIG_UDS_REGISTRATION_INDEX_SIZE];
+static size_t uds_registration_index_len;
+static bool uds_registration_index_valid;
+
+// Open addressing hash table from events to their handler data
+#define UDS_EVENT_INDEX_SIZE 64
+static const struct uds_event_handler_data*
+    uds_event_index[UDS_EVENT_INDEX_SIZE];
+static bool uds_event_index_valid;
+
+static bool uds_index_built;
+
+static uint32_t uds_event_index_slot(UDSEvent_t event) {
+  // Fibonacci hashing, UDS_EVENT_INDEX_SIZE is 2^6
+  return ((uint32_t)event * 2654435769U) >> (32 - 6);
+}
+
+BUILD_ASSERT(UDS_EVENT_INDEX_SIZE == 1 << 6);
+
+static int uds_registration_index_compare(const void* a, const void* b) {
+  const struct uds_registration_index_entry* lhs = a;
+  const struct uds_registration_index_entry* rhs = b;
+
+  if (lhs->type != rhs->type) {
+    return lhs->type < rhs->type ? -1 : 1;
+  }
+  if (lhs->key != rhs->key) {
+    return lhs->key < rhs->key ? -1 : 1;
+  }
+  return (int)lhs->position - (int)rhs->position;
+}
+
+static uds_get_registration_key_fn uds_registration_key_fn(
+    enum uds_registration_type_t type) {
+  STRUCT_SECTION_FOREACH (uds_event_handler_data, handler) {
+    if (handler->registration_type == type && handler->get_registration_key) {
+      return handler->get_registration_key;
+    }
+  }
+
+  return NULL;
+}
+
+static void uds_build_event_index(void) {
+  size_t count = 0;
+
+  STRUCT_SECTION_FOREACH (uds_event_handler_data, handler) {
+    if (++count > UDS_EVENT_INDEX_SIZE / 2) {
+      LOG_WRN("Too many UDS event handlers, falling back to linear lookup");
+      return;
+    }
+
+    uint32_t slot = uds_event_index_slot(handler->event);
+    while (uds_event_index[slot] != NULL) {
+      if (uds_event_index[slot]->event == handler->event) {
+        // The first handler for an event wins, as with the linear lookup
+        break;
+      }
+      slot = (slot + 1) % UDS_EVENT_INDEX_SIZE;
+    }
+    if (uds_event_index[slot] == NULL) {
+      uds_event_index[slot] = handler;
+    }
+  }
+
+  uds_event_index_valid = true;
+}
+
+// Checks whether the table is in key order
+static bool uds_registration_table_check_sorted(
+    const struct uds_registration_table* table) {
+  if (!table->keyed || table->start == table->end) {
+    return table->keyed;
+  }
+
+  uds_get_registration_key_fn get_key =
+      uds_registration_key_fn(table->start->type);
+  if (get_key == NULL) {
+    return false;
+  }
+
+  for (struct uds_registration_t* reg = table->start + 1; reg < table->end;
+       reg++) {
+    if (get_key(reg) < get_key(reg - 1)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void uds_build_registration_index(void) {
+  size_t count = 0;
+
+  ARRAY_FOR_EACH (uds_registration_tables, i) {
+    struct uds_registration_table* table = uds_registration_tables[i];
+
+    table->sorted = uds_registration_table_check_sorted(table);
+    if (!table->sorted) {
+      count += uds_registration_table_len(table);
+    }
+  }
+
+  if (count > ARRAY_SIZE(uds_registration_index) || count > UINT16_MAX) {
+    LOG_WRN(
+        "%zu unsorted static UDS registrations exceed "
+        "CONFIG_UDS_REGISTRATION_INDEX_SIZE, falling back to linear lookup",
+        count);
+    return;
+  }
+
+  size_t len = 0;
+  ARRAY_FOR_EACH (uds_registration_tables, i) {
+    const struct uds_registration_table* table = uds_registration_tables[i];
+
+    if (table->sorted) {
+      continue;
+    }
+
+    for (size_t position = 0; position < uds_registration_table_len(table);
+         position++) {
+      struct uds_registration_t* reg = &table->start[position];
+      uds_get_registration_key_fn get_key = uds_registration_key_fn(reg->type);
+
+      uds_registration_index[len++] = (struct uds_registration_index_entry){
+        .key = get_key ? get_key(reg) : 0,
+        .type = reg->type,
+        .position = position,
+      };
+    }
+  }
+
+  qsort(uds_registration_index, len, sizeof(uds_registration_index[0]),
+        uds_registration_index_compare);
+
+  uds_registration_index_len = len;
+  uds_registration_index_valid = true;
+}
+
+static void uds_build_index(void) {
+  if (uds_index_built) {
+    return;
+  }
+
+  uds_build_event_index();
+  uds_build_registration_index();
+  uds_index_built = true;
+}
+
+const struct uds_event_handler_data* uds_find_event_handler(
+    UDSEvent_t event) {
+  if (uds_event_index_valid) {
+    uint32_t slot = uds_event_index_slot(event);
+    while (uds_event_index[slot] != NULL) {
+      if (uds_event_index[slot]->event == event) {
+        return uds_event_index[slot];
+      }
+      slot = (slot + 1) % UDS_EVENT_INDEX_SIZE;
+    }
+    return NULL;
+  }
+
+  STRUCT_SECTION_FOREACH (uds_event_handler_data, handler) {
+    if (handler->event == event) {
+      return handler;
+    }
+  }
+
+  return NULL;
+}
+
+// First index entry that is not ordered before (type, key)
+static size_t uds_registration_index_lower_bound(uint16_t type, uint32_t key) {
+  size_t low = 0;
+  size_t high = uds_registration_index_len;
+
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    const struct uds_registration_index_entry* entry =
+        &uds_registration_index[mid];
+
+    if (entry->type < type || (entry->type == type && entry->key < key)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+// First registration of a sorted table with a key not less than key. The
+// loop only narrows the range, so the number of iterations does not depend
+// on the key.
+static struct uds_registration_t* uds_registration_table_lower_bound(
+    const struct uds_registration_table* table,
+    uds_get_registration_key_fn get_key,
+    uint32_t key) {
+  struct uds_registration_t* base = table->start;
+  size_t len = uds_registration_table_len(table);
+
+  if (len == 0) {
+    return base;
+  }
+
+  while (len > 1) {
+    size_t half = len / 2;
+    base = get_key(&base[half]) < key ? &base[half] : base;
+    len -= half;
+  }
+
+  return get_key(base) < key ? base + 1 : base;
+}
+
+// Applies the actions of all matching registrations for the event
 UDSErr_t uds_handle_event(struct uds_instance_t* instance,
                           UDSEvent_t event,
                           void* arg,
                           const struct uds_event_handler_data* handler) {
   bool found_at_least_one_match = false;
+  UDSErr_t ret;
+
+  const uint32_t key = handler->get_event_key ? handler->get_event_key(arg) : 0;
+  const struct uds_registration_table* table =
+      uds_registration_table_for(handler->registration_type);
 
   // We start with static registrations
-  STRUCT_SECTION_FOREACH (uds_registration_t, reg) {
-    bool consume_event = true;
-
-    struct uds_context context = {
-      .instance = instance,
-      .registration = reg,
-      .server = &instance->iso14229.server,
-      .event = event,
-      .arg = arg,
-    };
-
-    int ret = uds_check_and_act_on_event(
-        &context, handler, &found_at_least_one_match, &consume_event);
-    if (consume_event || ret != UDS_OK) {
-      return ret;
+  if (table->sorted && handler->get_registration_key) {
+    for (struct uds_registration_t* reg = uds_registration_table_lower_bound(
+             table, handler->get_registration_key, key);
+         reg < table->end && handler->get_registration_key(reg) == key; reg++) {
+      if (reg->instance != NULL && reg->instance != instance) {
+        continue;
+      }
+
+      if (uds_apply_registration(instance, reg, event, arg, handler,
+                                 &found_at_least_one_match, true, &ret)) {
+        return ret;
+      }
+    }
+  } else if (uds_registration_index_valid) {
+    for (size_t i =
+             uds_registration_index_lower_bound(handler->registration_type, key);
+         i < uds_registration_index_len; i++) {
+      const struct uds_registration_index_entry* entry =
+          &uds_registration_index[i];
+      if (entry->type != handler->registration_type || entry->key != key) {
+        break;
+      }
+
+      struct uds_registration_t* reg = &table->start[entry->position];
+      if (reg->instance != NULL && reg->instance != instance) {
+        continue;
+      }
+
+      if (uds_apply_registration(instance, reg, event, arg, handler,
+                                 &found_at_least_one_match, true, &ret)) {
+        return ret;
+      }
+    }
+  } else {
+    for (struct uds_registration_t* reg = table->start; reg < table->end;
+         reg++) {
+      if (!uds_registration_matches(reg, instance, handler, key)) {
+        continue;
+      }
+
+      if (uds_apply_registration(instance, reg, event, arg, handler,
+                                 &found_at_least_one_match, true, &ret)) {
+        return ret;
+      }
     }
   }
 
   // Optional dynamic registrations
 #ifdef CONFIG_UDS_USE_DYNAMIC_REGISTRATION
   struct uds_registration_t* reg;
-  SYS_SLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, reg, node) {
-    bool consume_event = false;
-
-    struct uds_context context = {
-      .instance = instance,
-      .registration = reg,
-      .server = &instance->iso14229.server,
-      .event = event,
-      .arg = arg,
-    };
-
-    int ret = uds_check_and_act_on_event(
-        &context, handler, &found_at_least_one_match, &consume_event);
-    if (consume_event || ret != UDS_OK) {
+  SYS_DLIST_FOR_EACH_CONTAINER (&instance->dynamic_registrations, reg, node) {
+    if (!uds_registration_matches(reg, instance, handler, key)) {
+      continue;
+    }
+
+    if (uds_apply_registration(instance, reg, event, arg, handler,
+                               &found_at_least_one_match, false, &ret)) {
       return ret;
     }
   }
@@ -122,91 +489,150 @@ UDSErr_t uds_event_callback(struct iso14229_zephyr_instance* inst,
                             void* user_context) {
   struct uds_instance_t* instance = user_context;
 
-  // Look up the event in the handler mapping section
-  STRUCT_SECTION_FOREACH (uds_event_handler_data, handler) {
-    if (handler->event == event) {
-      return uds_handle_event(instance, event, arg, handler);
-    }
+  const struct uds_event_handler_data* handler = uds_find_event_handler(event);
+  if (handler == NULL) {
+    // Event not supported
+    return UDS_NRC_ServiceNotSupported;
+  }
+
+  UDSErr_t ret = uds_handle_event(instance, event, arg, handler);
+
+#if defined(CONFIG_UDS_PERIODIC_DATA_IDS) || \
+    defined(CONFIG_UDS_RESPONSE_ON_EVENT)
+  if ((event == UDS_EVT_DiagSessCtrl && ret == UDS_PositiveResponse) ||
+      event == UDS_EVT_SessionTimeout) {
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+    uds_periodic_data_ids_on_session_change(instance);
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+    uds_response_on_event_on_session_change(instance);
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
   }
+#endif
 
-  // Event not supported
-  return UDS_NRC_ServiceNotSupported;
+  return ret;
 }
 
+#if defined(CONFIG_UDS_PERIODIC_DATA_IDS) || \
+    defined(CONFIG_UDS_RESPONSE_ON_EVENT)
+// Takes requests for services the iso14229 server does not implement
+static bool uds_request_hook(struct iso14229_zephyr_instance* inst,
+                             const uint8_t* data,
+                             uint16_t len,
+                             bool functional) {
+  struct uds_instance_t* instance = inst->user_context;
+
+  switch (data[0]) {
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+    case UDS_SID_READ_DATA_BY_PERIODIC_IDENTIFIER:
+      uds_periodic_data_ids_request(instance, data, len, functional);
+      return true;
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+    case UDS_SID_RESPONSE_ON_EVENT:
+      uds_response_on_event_request(instance, data, len, functional);
+      return true;
+    case UDS_RESPONSE_ON_EVENT_FINAL_RESPONSE_MARKER:
+      return len == 1 && !functional &&
+             uds_response_on_event_final_response(instance);
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
+    default:
+      return false;
+  }
+}
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS || CONFIG_UDS_RESPONSE_ON_EVENT
+
 #ifdef CONFIG_UDS_USE_DYNAMIC_REGISTRATION
 
-// Find next available dynamic ID, starting from 1
-// Returns 0 if no ID is available
-// TODO: This is inefficient for large numbers of registrations
-static uint32_t find_next_dynamic_id(struct uds_instance_t* inst) {
-  // Find the next available ID starting from 1
-  uint32_t candidate_id = 1;
-  bool id_found = false;
-
-  while (candidate_id != 0) {  // Check for overflow (UINT32_MAX + 1 = 0)
-    bool id_in_use = false;
-
-    // Check if this ID is already in use
-    struct uds_registration_t* reg;
-    SYS_SLIST_FOR_EACH_CONTAINER (&inst->dynamic_registrations, reg, node) {
-      if (reg->dynamic_registration_id == candidate_id) {
-        id_in_use = true;
-        break;
-      }
-    }
+/*
+ * Dynamic registrations are allocated from a memory slab shared by all
+ * instances. The ID of a registration encodes its slot in the pool and the
+ * generation of the slot, which is incremented whenever the slot is freed.
+ * An ID therefore resolves to its registration in constant time and IDs of
+ * unregistered handlers are not valid anymore, even if the slot is reused.
+ */
+#define UDS_DYNAMIC_POOL_SIZE CONFIG_UDS_DYNAMIC_REGISTRATION_POOL_SIZE
+#define UDS_DYNAMIC_MAX_GENERATION \
+  ((UINT32_MAX - UDS_DYNAMIC_POOL_SIZE) / UDS_DYNAMIC_POOL_SIZE)
+
+static struct uds_registration_t
+    uds_dynamic_registration_pool[UDS_DYNAMIC_POOL_SIZE];
+static uint32_t uds_dynamic_registration_generation[UDS_DYNAMIC_POOL_SIZE];
+static struct k_mem_slab uds_dynamic_registration_slab;
+static bool uds_dynamic_registration_slab_ready;
+
+static void uds_dynamic_registration_pool_init(void) {
+  if (uds_dynamic_registration_slab_ready) {
+    return;
+  }
 
-    if (!id_in_use) {
-      id_found = true;
-      break;
-    }
+  int ret = k_mem_slab_init(
+      &uds_dynamic_registration_slab, uds_dynamic_registration_pool,
+      sizeof(uds_dynamic_registration_pool[0]), UDS_DYNAMIC_POOL_SIZE);
+  __ASSERT(ret == 0, "Failed to initialize dynamic registration pool: %d",
+           ret);
+  ARG_UNUSED(ret);
 
-    if (candidate_id == UINT32_MAX) {
-      id_found = false;
-      candidate_id = 0;
-    } else {
-      candidate_id++;
-    }
+  uds_dynamic_registration_slab_ready = true;
+}
+
+static size_t uds_dynamic_registration_slot(
+    const struct uds_registration_t* reg) {
+  return reg - uds_dynamic_registration_pool;
+}
+
+static uint32_t uds_dynamic_registration_id(size_t slot) {
+  return uds_dynamic_registration_generation[slot] * UDS_DYNAMIC_POOL_SIZE +
+         slot + 1;
+}
+
+// Returns the registration of the instance with the ID or NULL
+static struct uds_registration_t* uds_dynamic_registration_lookup(
+    struct uds_instance_t* inst, uint32_t dynamic_id) {
+  if (dynamic_id == 0) {
+    return NULL;
   }
 
-  if (!id_found) {
-    return 0;  // No free ID available
+  size_t slot = (dynamic_id - 1) % UDS_DYNAMIC_POOL_SIZE;
+  struct uds_registration_t* reg = &uds_dynamic_registration_pool[slot];
+
+  // A freed slot has a newer generation than the IDs handed out for it
+  if (uds_dynamic_registration_id(slot) != dynamic_id ||
+      reg->dynamic_registration_id != dynamic_id || reg->instance != inst) {
+    return NULL;
   }
 
-  return candidate_id;
+  return reg;
 }
 
 // Registration function to dynamically register new handlers at runtime
-// (Heap allocated)
+// (Allocated from the dynamic registration pool)
 int uds_register_event_handler(struct uds_instance_t* inst,
                                struct uds_registration_t registration,
                                uint32_t* dynamic_id,
                                struct uds_registration_t** registration_out) {
   registration.instance = inst;
 
-  uint32_t next_id = find_next_dynamic_id(inst);
-  if (next_id == 0) {
-    return -ENOSPC;  // No free ID available
-  }
-
-  struct uds_registration_t* heap_registration =
-      k_malloc(sizeof(struct uds_registration_t));
-  if (heap_registration == NULL) {
+  struct uds_registration_t* pool_registration;
+  if (k_mem_slab_alloc(&uds_dynamic_registration_slab,
+                       (void**)&pool_registration, K_NO_WAIT) != 0) {
     return -ENOMEM;
   }
 
-  *heap_registration = registration;
+  *pool_registration = registration;
 
   // Never append a node that might contain garbage pointers
-  heap_registration->node = (sys_snode_t){0};
-  heap_registration->dynamic_registration_id = next_id;
+  sys_dnode_init(&pool_registration->node);
+  pool_registration->dynamic_registration_id = uds_dynamic_registration_id(
+      uds_dynamic_registration_slot(pool_registration));
 
-  sys_slist_append(&inst->dynamic_registrations, &heap_registration->node);
+  sys_dlist_append(&inst->dynamic_registrations, &pool_registration->node);
 
   // Return the assigned ID to the caller
-  *dynamic_id = next_id;
+  *dynamic_id = pool_registration->dynamic_registration_id;
 
   if (registration_out) {
-    *registration_out = heap_registration;
+    *registration_out = pool_registration;
   }
 
   return 0;
@@ -214,33 +640,39 @@ int uds_register_event_handler(struct uds_instance_t* inst,
 
 int uds_unregister_event_handler(struct uds_instance_t* inst,
                                  uint32_t dynamic_id) {
-  struct uds_registration_t* reg;
-  struct uds_registration_t* tmp;
-
-  SYS_SLIST_FOR_EACH_CONTAINER_SAFE (&inst->dynamic_registrations, reg, tmp,
-                                     node) {
-    if (reg->dynamic_registration_id == dynamic_id) {
-      /* Call custom unregister function if provided */
-      if (reg->unregister_registration_fn) {
-        int ret = reg->unregister_registration_fn(reg);
-        if (ret < 0) {
-          LOG_ERR(
-              "Custom unregister function failed for registration ID %u: %d",
-              dynamic_id, ret);
-          return ret;
-        }
-      }
+  struct uds_registration_t* reg =
+      uds_dynamic_registration_lookup(inst, dynamic_id);
+  if (reg == NULL) {
+    return -ENOENT;  // Registration not found
+  }
 
-      /* Remove from list and free */
-      bool removed =
-          sys_slist_find_and_remove(&inst->dynamic_registrations, &reg->node);
-      __ASSERT(removed, "node not found during remove (should not happen)");
-      k_free(reg);
-      return 0;
+  /* Call custom unregister function if provided */
+  if (reg->unregister_registration_fn) {
+    int ret = reg->unregister_registration_fn(reg);
+    if (ret < 0) {
+      LOG_ERR("Custom unregister function failed for registration ID %u: %d",
+              dynamic_id, ret);
+      return ret;
     }
   }
 
-  return -ENOENT;  // Registration not found
+#ifdef CONFIG_UDS_DATA_IDENTIFIER_CACHE
+  if (reg->type == UDS_REGISTRATION_TYPE__DATA_IDENTIFIER &&
+      reg->data_identifier.cache) {
+    uds_data_identifier_cache_stop(reg->data_identifier.cache);
+  }
+#endif  // CONFIG_UDS_DATA_IDENTIFIER_CACHE
+
+  /* Remove from list, invalidate the ID and free */
+  size_t slot = uds_dynamic_registration_slot(reg);
+  sys_dlist_remove(&reg->node);
+  reg->dynamic_registration_id = 0;
+  uds_dynamic_registration_generation[slot] =
+      uds_dynamic_registration_generation[slot] < UDS_DYNAMIC_MAX_GENERATION
+          ? uds_dynamic_registration_generation[slot] + 1
+          : 0;
+  k_mem_slab_free(&uds_dynamic_registration_slab, reg);
+  return 0;
 }
 
 #endif  //  CONFIG_UDS_USE_DYNAMIC_REGISTRATION
@@ -252,8 +684,11 @@ int uds_init(struct uds_instance_t* inst,
   inst->user_context = user_context;
   inst->can_dev = can_dev;
 
+  uds_build_index();
+
 #ifdef CONFIG_UDS_USE_DYNAMIC_REGISTRATION
-  sys_slist_init(&inst->dynamic_registrations);
+  uds_dynamic_registration_pool_init();
+  sys_dlist_init(&inst->dynamic_registrations);
   inst->register_event_handler = uds_register_event_handler;
   inst->unregister_event_handler = uds_unregister_event_handler;
 #endif  //  CONFIG_UDS_USE_DYNAMIC_REGISTRATION
@@ -270,6 +705,19 @@ int uds_init(struct uds_instance_t* inst,
     return ret;
   }
 
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+  uds_periodic_data_ids_init(inst);
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
+
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+  uds_response_on_event_init(inst);
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
+
+#if defined(CONFIG_UDS_PERIODIC_DATA_IDS) || \
+    defined(CONFIG_UDS_RESPONSE_ON_EVENT)
+  inst->iso14229.request_hook = uds_request_hook;
+#endif
+
   return 0;
 }
 
@@ -12,6 +12,19 @@
 #include <ardep/uds.h>
 #include <iso14229.h>
 
+/**
+ * @brief Function to get the index key of a registration, e.g. its data
+ *        identifier
+ */
+typedef uint32_t (*uds_get_registration_key_fn)(
+    const struct uds_registration_t* const reg);
+
+/**
+ * @brief Function to get the index key an event is addressed to, e.g. the
+ *        requested data identifier
+ */
+typedef uint32_t (*uds_get_event_key_fn)(const void* arg);
+
 /**
  * @brief Associated events with other data required to handle them
  */
@@ -21,8 +34,152 @@ struct uds_event_handler_data {
   uds_get_action_fn get_action;
   UDSErr_t default_nrc;
   enum uds_registration_type_t registration_type;
+  /**
+   * @brief Optional key of a registration, only registrations whose key
+   *        matches the key of the event are checked. Set both key functions
+   *        or none.
+   */
+  uds_get_registration_key_fn get_registration_key;
+  /**
+   * @brief Optional key of an event, see @ref get_registration_key
+   */
+  uds_get_event_key_fn get_event_key;
 };
 
+#ifdef CONFIG_UDS_DATA_IDENTIFIER_CACHE
+
+/**
+ * @brief Read action of data identifiers with a cache
+ *
+ * Serves the cached bytes or runs the read action of the registration and
+ * caches the bytes it copies.
+ */
+UDSErr_t uds_data_identifier_cache_read(struct uds_context* const context,
+                                        bool* consume_event);
+
+/**
+ * @brief Write action of data identifiers with a cache
+ *
+ * Runs the write action of the registration and invalidates the cache.
+ */
+UDSErr_t uds_data_identifier_cache_write(struct uds_context* const context,
+                                         bool* consume_event);
+
+/**
+ * @brief I/O control action of data identifiers with a cache
+ *
+ * Runs the I/O control action of the registration and invalidates the cache.
+ */
+UDSErr_t uds_data_identifier_cache_io_control(
+    struct uds_context* const context, bool* consume_event);
+
+/**
+ * @brief Stop the background refresh of a cache
+ */
+void uds_data_identifier_cache_stop(struct uds_data_identifier_cache* cache);
+
+#endif  // CONFIG_UDS_DATA_IDENTIFIER_CACHE
+
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+
+/**
+ * @brief Service identifier of ReadDataByPeriodicIdentifier
+ */
+#define UDS_SID_READ_DATA_BY_PERIODIC_IDENTIFIER 0x2A
+
+/**
+ * @brief Initialize the periodic scheduler of an instance
+ */
+void uds_periodic_data_ids_init(struct uds_instance_t* inst);
+
+/**
+ * @brief Handle a ReadDataByPeriodicIdentifier request
+ *
+ * Called by the request hook of the instance, the request bypasses the
+ * iso14229 server.
+ */
+void uds_periodic_data_ids_request(struct uds_instance_t* inst,
+                                   const uint8_t* data,
+                                   uint16_t len,
+                                   bool functional);
+
+/**
+ * @brief Stop all periodic data identifiers after a session change
+ *
+ * Must be called with the event callback mutex held.
+ */
+void uds_periodic_data_ids_on_session_change(struct uds_instance_t* inst);
+
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
+
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+
+/**
+ * @brief Service identifier of ResponseOnEvent
+ */
+#define UDS_SID_RESPONSE_ON_EVENT 0x86
+
+/**
+ * @brief Request injected to send the final response of an event window
+ *
+ * The positive response SID of ResponseOnEvent, so no tester request is
+ * mistaken for it.
+ */
+#define UDS_RESPONSE_ON_EVENT_FINAL_RESPONSE_MARKER 0xC6
+
+/**
+ * @brief Initialize the ResponseOnEvent engine of an instance
+ */
+void uds_response_on_event_init(struct uds_instance_t* inst);
+
+/**
+ * @brief Handle a ResponseOnEvent request
+ *
+ * Called by the request hook of the instance, the request bypasses the
+ * iso14229 server.
+ */
+void uds_response_on_event_request(struct uds_instance_t* inst,
+                                   const uint8_t* data,
+                                   uint16_t len,
+                                   bool functional);
+
+/**
+ * @brief Send the final response of an event whose window ended
+ *
+ * Called by the request hook of the instance for the injected
+ * UDS_RESPONSE_ON_EVENT_FINAL_RESPONSE_MARKER.
+ *
+ * @return false if no marker was injected, the server rejects the request
+ */
+bool uds_response_on_event_final_response(struct uds_instance_t* inst);
+
+/**
+ * @brief Stop all events after a session change
+ *
+ * Must be called with the event callback mutex held.
+ */
+void uds_response_on_event_on_session_change(struct uds_instance_t* inst);
+
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
+
+/**
+ * @brief Find the handler data of an event
+ *
+ * @returns NULL if the event is not supported
+ */
+const struct uds_event_handler_data* uds_find_event_handler(UDSEvent_t event);
+
+/**
+ * @brief Apply the actions of all registrations matching an event
+ *
+ * Unlike @ref uds_event_callback() this takes the handler data resolved with
+ * @ref uds_find_event_handler(), so callers can resolve it once.
+ */
+UDSErr_t uds_handle_event(struct uds_instance_t* instance,
+                          UDSEvent_t event,
+                          void* arg,
+                          const struct uds_event_handler_data* handler);
+
 #ifdef CONFIG_UDS_USE_DYNAMIC_REGISTRATION
 
 /**
@@ -10,18 +10,32 @@ LOG_MODULE_DECLARE(uds, CONFIG_UDS_LOG_LEVEL);
 
 #include "uds.h"
 
+#include <errno.h>
 #include <string.h>
 
 #include <zephyr/device.h>
 #include <zephyr/drivers/flash.h>
 #include <zephyr/fs/fs.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 #include <zephyr/sys/util.h>
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+#include <zephyr/retention/retention.h>
+#include <zephyr/sys/crc.h>
+#endif
 
 #include <ardep/uds.h>
 #include <iso14229.h>
 #ifdef CONFIG_UDS_FILE_TRANSFER
 #include "upload_download_file_transfer.h"
 #endif
+#ifdef CONFIG_UDS_DOWNLOAD_COMPRESSION
+#include "upload_download_heatshrink.h"
+#endif
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+#include "upload_download_digest.h"
+#endif
 
 static const struct device* const flash_controller =
     DEVICE_DT_GET_OR_NULL(DT_CHOSEN(zephyr_flash_controller));
@@ -55,6 +69,273 @@ struct upload_download_state upload_download_state = {
   .write_block_size = 0,
 };
 
+#ifdef CONFIG_UDS_DOWNLOAD_PIPELINE
+// First error of the download writer thread since the download was started
+static atomic_t download_pipeline_error;
+#endif  // CONFIG_UDS_DOWNLOAD_PIPELINE
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+// Digest of the data written since the download was started. It is updated by
+// whoever writes the data and finished when the transfer is exited.
+static struct uds_digest_ctx download_digest_ctx;
+static struct uds_download_digest download_digest;
+static bool download_digest_valid;
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+// The pages of the download range are erased by the writer thread right
+// before they are written and, while it waits for blocks, a bit ahead of the
+// written data. Pages are always erased as a whole.
+struct download_erase {
+  // Everything of the download range below this address is erased
+  uintptr_t erased_until;
+  // End of the download range
+  uintptr_t end;
+  // End of the last block handed to the flash
+  uintptr_t written_until;
+};
+
+static struct download_erase download_erase;
+K_MUTEX_DEFINE(download_erase_mutex);
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+
+#ifdef CONFIG_UDS_DOWNLOAD_COMPRESSION
+// dataFormatIdentifier of heatshrink compressed, unencrypted data
+#define DOWNLOAD_FORMAT_HEATSHRINK 0x10
+
+struct download_pipeline_block;
+
+struct download_decompression {
+  bool active;
+  struct uds_heatshrink_decoder decoder;
+  // Pipeline buffer being filled with decoded bytes
+  struct download_pipeline_block* block;
+  // Bytes of the current TransferData request that were decoded already,
+  // the request is evaluated again after a ResponsePending
+  size_t input_offset;
+};
+
+static struct download_decompression download_decompression;
+#endif  // CONFIG_UDS_DOWNLOAD_COMPRESSION
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+static const struct device* const download_journal_dev =
+    DEVICE_DT_GET(DT_CHOSEN(zephyr_uds_download_journal));
+
+// Progress of the current download. It is kept in retention, so a download
+// that was interrupted by a reset or a lost connection can be continued.
+// Only data written up to a flash write block boundary is recorded, the
+// rest of a block can not be written again without an erase.
+struct download_journal {
+  uint32_t start;
+  uint32_t end;
+  uint32_t written_until;
+  // CRC-32 of the data from start to written_until
+  uint32_t crc32;
+};
+
+// Only accessed by whoever writes the data, like the digest
+static struct download_journal download_journal;
+
+enum download_resume_check_state {
+  DOWNLOAD_RESUME_CHECK__IDLE,
+  DOWNLOAD_RESUME_CHECK__RUNNING,
+  DOWNLOAD_RESUME_CHECK__DONE,
+};
+
+// Check of the data of an interrupted download, done by the writer thread
+// while RequestDownload answers with ResponsePending
+struct download_resume_check {
+  atomic_t state;
+  // Range of the RequestDownload
+  uintptr_t start;
+  uintptr_t end;
+  // Whether the download continues the interrupted one
+  bool resume;
+};
+
+static struct download_resume_check download_resume_check;
+
+static void download_pipeline_request_resume_check(void);
+
+static void download_journal_store(void) {
+  int rc = retention_write(download_journal_dev, 0,
+                           (const uint8_t*)&download_journal,
+                           sizeof(download_journal));
+  if (rc != 0) {
+    LOG_WRN("Failed to store the download journal: %d", rc);
+  }
+}
+
+static int download_journal_load(struct download_journal* journal) {
+  if (retention_is_valid(download_journal_dev) != 1) {
+    return -ENODATA;
+  }
+
+  return retention_read(download_journal_dev, 0, (uint8_t*)journal,
+                        sizeof(*journal));
+}
+
+static void download_journal_start(uintptr_t start, uintptr_t end) {
+  download_journal = (struct download_journal){
+    .start = start,
+    .end = end,
+    .written_until = start,
+    .crc32 = 0,
+  };
+  download_journal_store();
+}
+
+// Records data that was written at address
+static void download_journal_commit(uintptr_t address,
+                                    const uint8_t* data,
+                                    size_t len,
+                                    size_t write_block_size) {
+  if (address != download_journal.written_until ||
+      (address + len) % write_block_size != 0) {
+    return;
+  }
+
+  download_journal.crc32 = crc32_ieee_update(download_journal.crc32, data, len);
+  download_journal.written_until = address + len;
+  download_journal_store();
+}
+
+static void download_journal_clear(void) {
+  int rc = retention_clear(download_journal_dev);
+  if (rc != 0) {
+    LOG_WRN("Failed to clear the download journal: %d", rc);
+  }
+}
+
+// Checks whether a download of [address, end) continues the download in the
+// journal
+static bool download_journal_continues(const struct download_journal* journal,
+                                       uintptr_t address,
+                                       uintptr_t end) {
+  return journal->written_until == address && journal->end == end &&
+         journal->written_until != journal->start;
+}
+
+// Checks whether a download of [address, end) continues the download in the
+// journal and verifies the data that was written so far. The digest is
+// started and fed with that data.
+static bool download_journal_resume(uintptr_t address, uintptr_t end) {
+  struct download_journal journal;
+  if (download_journal_load(&journal) != 0 ||
+      !download_journal_continues(&journal, address, end)) {
+    return false;
+  }
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+  if (uds_digest_init(&download_digest_ctx) != 0) {
+    return false;
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
+  uint8_t buf[128];
+  uint32_t crc = 0;
+  for (uintptr_t pos = journal.start; pos < journal.written_until;
+       pos += sizeof(buf)) {
+    size_t len = MIN(sizeof(buf), journal.written_until - pos);
+
+    if (flash_read(flash_controller, pos, buf, len) != 0) {
+      return false;
+    }
+    crc = crc32_ieee_update(crc, buf, len);
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+    uds_digest_update(&download_digest_ctx, buf, len);
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+  }
+
+  if (crc != journal.crc32) {
+    LOG_WRN("Data of the interrupted download does not match its journal");
+    return false;
+  }
+
+  download_journal = journal;
+  return true;
+}
+
+// Verifies the data of the interrupted download, called by the writer thread
+static void download_resume_check_run(void) {
+  struct download_resume_check* check = &download_resume_check;
+
+  check->resume = download_journal_resume(check->start, check->end);
+  atomic_set(&check->state, DOWNLOAD_RESUME_CHECK__DONE);
+}
+
+// Checks whether a download of [start, end) continues the download in the
+// journal. Reading back the data written so far takes too long for a
+// response, so the writer thread verifies it. Returns false until it is done.
+static bool download_resume_check_finished(uintptr_t start,
+                                           uintptr_t end,
+                                           bool* resume) {
+  struct download_resume_check* check = &download_resume_check;
+
+  if (atomic_get(&check->state) == DOWNLOAD_RESUME_CHECK__RUNNING) {
+    return false;
+  }
+
+  // The result of a check whose request was not evaluated again is dropped
+  if (atomic_cas(&check->state, DOWNLOAD_RESUME_CHECK__DONE,
+                 DOWNLOAD_RESUME_CHECK__IDLE) &&
+      check->start == start && check->end == end) {
+    *resume = check->resume;
+    return true;
+  }
+
+  struct download_journal journal;
+  if (download_journal_load(&journal) != 0 ||
+      !download_journal_continues(&journal, start, end)) {
+    *resume = false;
+    return true;
+  }
+
+  check->start = start;
+  check->end = end;
+  atomic_set(&check->state, DOWNLOAD_RESUME_CHECK__RUNNING);
+  download_pipeline_request_resume_check();
+
+  return false;
+}
+
+int uds_download_get_resume_point(
+    struct uds_download_resume_point* resume_point) {
+  struct download_journal journal;
+  int rc = download_journal_load(&journal);
+  if (rc != 0) {
+    return rc;
+  }
+
+  if (journal.written_until == journal.start) {
+    return -ENODATA;
+  }
+
+  resume_point->address = FLASH_BASE_ADDRESS + journal.written_until;
+  resume_point->size = journal.end - journal.written_until;
+  return 0;
+}
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+// Pages are erased as a whole, so a download range has to start and end at a
+// page boundary. Otherwise the data around it would be erased as well.
+static bool download_erase_range_is_aligned(uintptr_t start, uintptr_t end) {
+  struct flash_pages_info page;
+  if (flash_get_page_info_by_offs(flash_controller, start, &page) != 0 ||
+      (uintptr_t)page.start_offset != start) {
+    return false;
+  }
+
+  if (flash_get_page_info_by_offs(flash_controller, end - 1, &page) != 0) {
+    return false;
+  }
+
+  return (uintptr_t)page.start_offset + page.size == end;
+}
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+
 // Note that when downloading, the flash has to be erased in another way before
 // (e.g. using a routine)
 static UDSErr_t start_download(const struct uds_context* const context) {
@@ -90,8 +371,15 @@ static UDSErr_t start_download(const struct uds_context* const context) {
     return UDS_NRC_RequestOutOfRange;
   }
 
+  bool compressed = false;
+#ifdef CONFIG_UDS_DOWNLOAD_COMPRESSION
+  compressed = args->dataFormatIdentifier == DOWNLOAD_FORMAT_HEATSHRINK;
+#endif
+
   // only support plain data (it is the only format defined in the standard)
-  if (args->dataFormatIdentifier != 0x00) {
+  // and heatshrink compressed data. The size is the size of the decompressed
+  // data.
+  if (args->dataFormatIdentifier != 0x00 && !compressed) {
     return UDS_NRC_RequestOutOfRange;
   }
 
@@ -112,6 +400,94 @@ static UDSErr_t start_download(const struct uds_context* const context) {
     return UDS_NRC_UploadDownloadNotAccepted;
   }
 
+#ifdef CONFIG_UDS_DOWNLOAD_PIPELINE
+  atomic_set(&download_pipeline_error, 0);
+
+  // maxNumberOfBlockLength includes 2 request bytes
+  args->maxNumberOfBlockLength =
+      MIN(CONFIG_UDS_DOWNLOAD_PIPELINE_BLOCK_SIZE + UDS_0X36_REQ_BASE_LEN,
+          args->maxNumberOfBlockLength);
+#endif  // CONFIG_UDS_DOWNLOAD_PIPELINE
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+  bool resume = false;
+  if (!download_resume_check_finished(
+          upload_download_state.start_address,
+          upload_download_state.start_address +
+              upload_download_state.total_size,
+          &resume)) {
+    // The request is evaluated again until the check is done
+    return UDS_NRC_RequestCorrectlyReceived_ResponsePending;
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+  download_digest_valid = false;
+  bool digest_started = false;
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+  // The check fed the digest with the data written so far
+  digest_started = resume;
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+  if (!digest_started && uds_digest_init(&download_digest_ctx) != 0) {
+    LOG_ERR("Failed to start the download digest");
+    return UDS_NRC_UploadDownloadNotAccepted;
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+  uintptr_t erase_start = upload_download_state.start_address;
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+  // A resumed download continues in the page the interrupted one stopped in
+  if (resume) {
+    erase_start = download_journal.start;
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+  if (!download_erase_range_is_aligned(
+          erase_start, upload_download_state.start_address +
+                           upload_download_state.total_size)) {
+    LOG_WRN("Download range does not cover whole flash pages");
+    return UDS_NRC_RequestOutOfRange;
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+  if (resume) {
+    LOG_INF("Resuming the download of 0x%08x-0x%08x",
+            download_journal.start, download_journal.end);
+  } else {
+    download_journal_start(
+        upload_download_state.start_address,
+        upload_download_state.start_address + upload_download_state.total_size);
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+  k_mutex_lock(&download_erase_mutex, K_FOREVER);
+  download_erase.erased_until = upload_download_state.start_address;
+  download_erase.written_until = upload_download_state.start_address;
+  download_erase.end =
+      upload_download_state.start_address + upload_download_state.total_size;
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+  // The page the interrupted download stopped in was erased before it was
+  // written to, erasing it again would lose the data written so far
+  struct flash_pages_info page;
+  if (resume &&
+      flash_get_page_info_by_offs(flash_controller,
+                                  upload_download_state.start_address - 1,
+                                  &page) == 0) {
+    download_erase.erased_until = page.start_offset + page.size;
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+  k_mutex_unlock(&download_erase_mutex);
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+
+#ifdef CONFIG_UDS_DOWNLOAD_COMPRESSION
+  download_decompression.active = compressed;
+  download_decompression.block = NULL;
+  download_decompression.input_offset = 0;
+  uds_heatshrink_decoder_reset(&download_decompression.decoder);
+#endif  // CONFIG_UDS_DOWNLOAD_COMPRESSION
+
   upload_download_state.state = UDS_UPDOWN__DOWNLOAD_IN_PROGRESS;
 
   return UDS_OK;
@@ -163,35 +539,28 @@ static UDSErr_t start_upload(const struct uds_context* const context) {
   return UDS_OK;
 }
 
-static UDSErr_t continue_download(const struct uds_context* const context) {
-  UDSTransferDataArgs_t* args = (UDSTransferDataArgs_t*)context->arg;
-
-  if (args->len == 0 || upload_download_state.current_address + args->len >
-                            upload_download_state.start_address +
-                                upload_download_state.total_size) {
-    return UDS_NRC_RequestOutOfRange;
-  }
-
-  LOG_DBG("Writing to flash at addr 0x%08lx, size %u",
-          upload_download_state.current_address, args->len);
+// Programs len bytes at address. Flash can only be written to in blocks of
+// write_block_size, so the trailing bytes are padded with 0xFF.
+static int download_write(uintptr_t address,
+                          const uint8_t* data,
+                          size_t len,
+                          size_t write_block_size) {
+  LOG_DBG("Writing to flash at addr 0x%08lx, size %zu", address, len);
 
-  // Flash can only be written to in blocks of write_block_size, first we
-  // calculate the number of bytes that would overflow this block size.
+  // First we calculate the number of bytes that would overflow the block size.
   // Then we write all full blocks first, and if there are remaining bytes, we
   // create a temporary buffer to write the last block with padding (0xFF).
-  const size_t overflow_size =
-      args->len % upload_download_state.write_block_size;
-  const size_t first_write = args->len - overflow_size;
+  const size_t overflow_size = len % write_block_size;
+  const size_t first_write = len - overflow_size;
 
   int rc;
   if (first_write > 0) {
-    rc = flash_write(flash_controller, upload_download_state.current_address,
-                     args->data, first_write);
+    rc = flash_write(flash_controller, address, data, first_write);
 
     if (rc != 0) {
-      LOG_ERR("Flash write failed at addr 0x%08lx, size %u, err %d",
-              upload_download_state.current_address, first_write, rc);
-      return UDS_NRC_GeneralProgrammingFailure;
+      LOG_ERR("Flash write failed at addr 0x%08lx, size %zu, err %d", address,
+              first_write, rc);
+      return rc;
     }
   }
 
@@ -199,30 +568,384 @@ static UDSErr_t continue_download(const struct uds_context* const context) {
     // need to write remaining bytes
     uint8_t last_bytes
         [MAXIMUM_FLASH_WRITE_BLOCK_SIZE];  // todo: maybe use
-                                           // upload_download_state.write_block_size
-                                           // as size
-    memset(last_bytes, 0xFF, upload_download_state.write_block_size);
-    memcpy(last_bytes, &args->data[first_write], args->len - first_write);
-
-    rc = flash_write(flash_controller,
-                     upload_download_state.current_address + first_write,
-                     last_bytes, upload_download_state.write_block_size);
+                                           // write_block_size as size
+    memset(last_bytes, 0xFF, write_block_size);
+    memcpy(last_bytes, &data[first_write], len - first_write);
+
+    rc = flash_write(flash_controller, address + first_write, last_bytes,
+                     write_block_size);
     if (rc != 0) {
-      LOG_ERR("Flash write failed at addr 0x%08lx, size %u, err %d",
-              upload_download_state.current_address + first_write,
-              upload_download_state.write_block_size, rc);
-      return UDS_NRC_GeneralProgrammingFailure;
+      LOG_ERR("Flash write failed at addr 0x%08lx, size %zu, err %d",
+              address + first_write, write_block_size, rc);
+      return rc;
     }
   }
 
   LOG_DBG("Write finished");
 
+  return 0;
+}
+
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+// Erases the page at erased_until, must be called with the mutex held
+static int download_erase_next_page(void) {
+  struct flash_pages_info info;
+  int rc = flash_get_page_info_by_offs(flash_controller,
+                                       download_erase.erased_until, &info);
+  if (rc == 0) {
+    rc = flash_erase(flash_controller, info.start_offset, info.size);
+  }
+
+  if (rc != 0) {
+    LOG_ERR("Flash erase failed at addr 0x%08lx, err %d",
+            download_erase.erased_until, rc);
+    return rc;
+  }
+
+  download_erase.erased_until = info.start_offset + info.size;
+
+  return 0;
+}
+
+// Erases the download range up to end before it is written
+static int download_erase_until(uintptr_t end) {
+  int rc = 0;
+
+  k_mutex_lock(&download_erase_mutex, K_FOREVER);
+
+  download_erase.written_until = MAX(download_erase.written_until, end);
+  end = MIN(end, download_erase.end);
+  while (rc == 0 && download_erase.erased_until < end) {
+    rc = download_erase_next_page();
+  }
+
+  k_mutex_unlock(&download_erase_mutex);
+
+  return rc;
+}
+
+// Erases one page ahead of the written data. Returns false when there is
+// nothing to erase.
+static bool download_erase_ahead(void) {
+  bool erased = false;
+
+  k_mutex_lock(&download_erase_mutex, K_FOREVER);
+
+  if (download_erase.erased_until < download_erase.end &&
+      download_erase.erased_until < download_erase.written_until +
+                                        CONFIG_UDS_DOWNLOAD_ERASE_AHEAD_SIZE) {
+    // A failure is reported when the page is about to be written
+    erased = download_erase_next_page() == 0;
+  }
+
+  k_mutex_unlock(&download_erase_mutex);
+
+  return erased;
+}
+
+// Stops erasing ahead once the download is finished
+static void download_erase_stop(void) {
+  k_mutex_lock(&download_erase_mutex, K_FOREVER);
+  download_erase.end = download_erase.erased_until;
+  k_mutex_unlock(&download_erase_mutex);
+}
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+
+#ifdef CONFIG_UDS_DOWNLOAD_PIPELINE
+/*
+ * Downloaded blocks are copied into one of the pipeline buffers and
+ * programmed by the writer thread, so the UDS thread keeps serving the bus
+ * while the flash is busy. Buffers circulate between the free and the
+ * pending queue; the download is drained when all buffers are free again.
+ */
+struct download_pipeline_block {
+  uintptr_t address;
+  size_t len;
+  size_t write_block_size;
+  uint8_t data[CONFIG_UDS_DOWNLOAD_PIPELINE_BLOCK_SIZE];
+};
+
+static struct download_pipeline_block
+    download_pipeline_blocks[CONFIG_UDS_DOWNLOAD_PIPELINE_BUFFERS];
+
+K_MSGQ_DEFINE(download_pipeline_free,
+              sizeof(struct download_pipeline_block*),
+              CONFIG_UDS_DOWNLOAD_PIPELINE_BUFFERS,
+              sizeof(void*));
+K_MSGQ_DEFINE(download_pipeline_pending,
+              sizeof(struct download_pipeline_block*),
+              CONFIG_UDS_DOWNLOAD_PIPELINE_BUFFERS,
+              sizeof(void*));
+
+// Signalled by the writer thread whenever the pipeline is drained
+static K_MUTEX_DEFINE(download_pipeline_mutex);
+static K_CONDVAR_DEFINE(download_pipeline_drained_condvar);
+
+static bool download_pipeline_drained(void);
+
+static void download_pipeline_thread(void* p1, void* p2, void* p3) {
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  while (true) {
+    struct download_pipeline_block* block;
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+    // Erase ahead while no block is waiting
+    while (k_msgq_get(&download_pipeline_pending, &block, K_NO_WAIT) != 0) {
+      if (!download_erase_ahead()) {
+        k_msgq_get(&download_pipeline_pending, &block, K_FOREVER);
+        break;
+      }
+    }
+#else
+    k_msgq_get(&download_pipeline_pending, &block, K_FOREVER);
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+    if (block == NULL) {
+      download_resume_check_run();
+      continue;
+    }
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+
+    // Blocks after a failed write are dropped, the download is failed anyway
+    if (atomic_get(&download_pipeline_error) == 0) {
+      int rc = 0;
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+      rc = download_erase_until(block->address + block->len);
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+      if (rc == 0) {
+        rc = download_write(block->address, block->data, block->len,
+                            block->write_block_size);
+      }
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+      if (rc == 0) {
+        uds_digest_update(&download_digest_ctx, block->data, block->len);
+      }
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+      if (rc == 0) {
+        download_journal_commit(block->address, block->data, block->len,
+                                block->write_block_size);
+      }
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+      if (rc != 0) {
+        atomic_cas(&download_pipeline_error, 0, rc);
+      }
+    }
+
+    k_msgq_put(&download_pipeline_free, &block, K_NO_WAIT);
+
+    k_mutex_lock(&download_pipeline_mutex, K_FOREVER);
+    if (download_pipeline_drained()) {
+      k_condvar_broadcast(&download_pipeline_drained_condvar);
+    }
+    k_mutex_unlock(&download_pipeline_mutex);
+  }
+}
+
+K_THREAD_DEFINE(download_pipeline_thread_id,
+                CONFIG_UDS_DOWNLOAD_PIPELINE_STACK_SIZE,
+                download_pipeline_thread,
+                NULL,
+                NULL,
+                NULL,
+                CONFIG_UDS_DOWNLOAD_PIPELINE_PRIORITY,
+                0,
+                0);
+
+static int download_pipeline_init(void) {
+  for (size_t i = 0; i < ARRAY_SIZE(download_pipeline_blocks); i++) {
+    struct download_pipeline_block* block = &download_pipeline_blocks[i];
+    k_msgq_put(&download_pipeline_free, &block, K_NO_WAIT);
+  }
+
+  return 0;
+}
+
+SYS_INIT(download_pipeline_init, POST_KERNEL, 0);
+
+static bool download_pipeline_drained(void) {
+  return k_msgq_num_used_get(&download_pipeline_free) ==
+         CONFIG_UDS_DOWNLOAD_PIPELINE_BUFFERS;
+}
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+// A NULL block asks the writer thread to check the journal. The pipeline is
+// drained when a download is requested, so there is room for it.
+static void download_pipeline_request_resume_check(void) {
+  struct download_pipeline_block* block = NULL;
+  k_msgq_put(&download_pipeline_pending, &block, K_NO_WAIT);
+}
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+
+int uds_download_wait_drained(k_timeout_t timeout) {
+  k_timepoint_t end = sys_timepoint_calc(timeout);
+  int ret = 0;
+
+  k_mutex_lock(&download_pipeline_mutex, K_FOREVER);
+  while (!download_pipeline_drained() && ret == 0) {
+    ret = k_condvar_wait(&download_pipeline_drained_condvar,
+                         &download_pipeline_mutex,
+                         sys_timepoint_timeout(end));
+  }
+  k_mutex_unlock(&download_pipeline_mutex);
+
+  return ret == 0 ? 0 : -EAGAIN;
+}
+#endif  // CONFIG_UDS_DOWNLOAD_PIPELINE
+
+#ifdef CONFIG_UDS_DOWNLOAD_COMPRESSION
+// Decodes the TransferData payload straight into pipeline buffers, so only
+// the window of the decoder is needed on top of the buffers
+static UDSErr_t continue_compressed_download(
+    const UDSTransferDataArgs_t* args) {
+  struct download_decompression* dec = &download_decompression;
+  const uintptr_t end_address =
+      upload_download_state.start_address + upload_download_state.total_size;
+
+  while (true) {
+    if (dec->block == NULL) {
+      if (k_msgq_get(&download_pipeline_free, &dec->block, K_NO_WAIT) != 0) {
+        // All buffers are being programmed, the request is evaluated again
+        return UDS_NRC_RequestCorrectlyReceived_ResponsePending;
+      }
+
+      dec->block->address = upload_download_state.current_address;
+      dec->block->len = 0;
+      dec->block->write_block_size = upload_download_state.write_block_size;
+    }
+
+    struct download_pipeline_block* block = dec->block;
+    size_t decoded;
+    dec->input_offset += uds_heatshrink_decode(
+        &dec->decoder, &args->data[dec->input_offset],
+        args->len - dec->input_offset, &block->data[block->len],
+        sizeof(block->data) - block->len, &decoded);
+    block->len += decoded;
+    upload_download_state.current_address += decoded;
+
+    if (upload_download_state.current_address > end_address) {
+      LOG_WRN("Decompressed data exceeds the requested download size");
+      // Nothing beyond the requested range is written
+      block->len -= upload_download_state.current_address - end_address;
+      upload_download_state.current_address = end_address;
+      dec->input_offset = 0;
+      return UDS_NRC_RequestOutOfRange;
+    }
+
+    if (block->len < sizeof(block->data)) {
+      // The whole payload is decoded
+      break;
+    }
+
+    k_msgq_put(&download_pipeline_pending, &dec->block, K_NO_WAIT);
+    dec->block = NULL;
+  }
+
+  dec->input_offset = 0;
+
+  return UDS_OK;
+}
+
+// Hands the partially filled buffer to the writer thread
+static void download_decompression_flush(void) {
+  struct download_decompression* dec = &download_decompression;
+
+  if (dec->block == NULL) {
+    return;
+  }
+
+  if (dec->block->len > 0) {
+    k_msgq_put(&download_pipeline_pending, &dec->block, K_NO_WAIT);
+  } else {
+    k_msgq_put(&download_pipeline_free, &dec->block, K_NO_WAIT);
+  }
+  dec->block = NULL;
+}
+#endif  // CONFIG_UDS_DOWNLOAD_COMPRESSION
+
+static UDSErr_t continue_download(const struct uds_context* const context) {
+  UDSTransferDataArgs_t* args = (UDSTransferDataArgs_t*)context->arg;
+
+#ifdef CONFIG_UDS_DOWNLOAD_COMPRESSION
+  // The decompressed size is checked while decoding
+  if (download_decompression.active) {
+    if (args->len == 0) {
+      return UDS_NRC_RequestOutOfRange;
+    }
+    if (atomic_get(&download_pipeline_error) != 0) {
+      return UDS_NRC_GeneralProgrammingFailure;
+    }
+
+    return continue_compressed_download(args);
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_COMPRESSION
+
+  if (args->len == 0 || upload_download_state.current_address + args->len >
+                            upload_download_state.start_address +
+                                upload_download_state.total_size) {
+    return UDS_NRC_RequestOutOfRange;
+  }
+
+#ifdef CONFIG_UDS_DOWNLOAD_PIPELINE
+  if (atomic_get(&download_pipeline_error) != 0) {
+    return UDS_NRC_GeneralProgrammingFailure;
+  }
+
+  if (args->len <= CONFIG_UDS_DOWNLOAD_PIPELINE_BLOCK_SIZE) {
+    struct download_pipeline_block* block;
+    if (k_msgq_get(&download_pipeline_free, &block, K_NO_WAIT) != 0) {
+      // All buffers are being programmed, the request is evaluated again
+      return UDS_NRC_RequestCorrectlyReceived_ResponsePending;
+    }
+
+    block->address = upload_download_state.current_address;
+    block->len = args->len;
+    block->write_block_size = upload_download_state.write_block_size;
+    memcpy(block->data, args->data, args->len);
+    k_msgq_put(&download_pipeline_pending, &block, K_NO_WAIT);
+
+    upload_download_state.current_address += args->len;
+
+    return UDS_OK;
+  }
+
+  // Blocks larger than the buffers are written in order after the pending ones
+  if (!download_pipeline_drained()) {
+    return UDS_NRC_RequestCorrectlyReceived_ResponsePending;
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_PIPELINE
+
+  int rc = 0;
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+  rc = download_erase_until(upload_download_state.current_address + args->len);
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+  if (rc == 0) {
+    rc = download_write(upload_download_state.current_address, args->data,
+                        args->len, upload_download_state.write_block_size);
+  }
+  if (rc != 0) {
+    return UDS_NRC_GeneralProgrammingFailure;
+  }
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+  uds_digest_update(&download_digest_ctx, args->data, args->len);
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+  download_journal_commit(upload_download_state.current_address, args->data,
+                          args->len, upload_download_state.write_block_size);
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+
   upload_download_state.current_address += args->len;
 
   return UDS_OK;
 }
 
-static uint8_t upload_buffer[CONFIG_UDS_UPLOAD_MAX_PAYLOAD_SIZE];
+#ifndef CONFIG_UDS_UPLOAD_XIP
+static uint8_t upload_buffer[CONFIG_UDS_UPLOAD_READ_CHUNK_SIZE];
+#endif
 
 static UDSErr_t continue_upload(const struct uds_context* const context) {
   if (upload_download_state.state != UDS_UPDOWN__UPLOAD_IN_PROGRESS) {
@@ -242,29 +965,110 @@ static UDSErr_t continue_upload(const struct uds_context* const context) {
                                     upload_download_state.total_size -
                                     upload_download_state.current_address));
 
-  int ret = flash_read(flash_controller, upload_download_state.current_address,
-                       upload_buffer, len_to_copy);
-
-  if (ret != 0) {
-    return UDS_NRC_GeneralProgrammingFailure;
-  }
-
   if (args->copyResponse == NULL) {
     return UDS_ERR_MISUSE;
   }
 
-  args->copyResponse(context->server, upload_buffer, len_to_copy);
+#ifdef CONFIG_UDS_UPLOAD_XIP
+  // The flash is memory-mapped, so it is copied into the response directly
+  uint8_t ret = args->copyResponse(
+      context->server,
+      (const void*)(FLASH_BASE_ADDRESS + upload_download_state.current_address),
+      len_to_copy);
+  if (ret != UDS_PositiveResponse) {
+    return ret;
+  }
+#else
+  // The response is assembled from chunks, each copy appends to it
+  for (size_t offset = 0; offset < len_to_copy;
+       offset += sizeof(upload_buffer)) {
+    size_t chunk_len = MIN(sizeof(upload_buffer), len_to_copy - offset);
+
+    int rc = flash_read(flash_controller,
+                        upload_download_state.current_address + offset,
+                        upload_buffer, chunk_len);
+    if (rc != 0) {
+      return UDS_NRC_GeneralProgrammingFailure;
+    }
+
+    uint8_t ret = args->copyResponse(context->server, upload_buffer, chunk_len);
+    if (ret != UDS_PositiveResponse) {
+      return ret;
+    }
+  }
+#endif  // CONFIG_UDS_UPLOAD_XIP
 
   upload_download_state.current_address += len_to_copy;
 
   return UDS_OK;
 }
 
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+// Finishes the digest, it is only reported if all writes succeeded
+static void download_digest_finish(bool valid) {
+  int rc = uds_digest_final(&download_digest_ctx, &download_digest);
+  if (rc != 0) {
+    LOG_ERR("Failed to finish the download digest: %d", rc);
+  }
+  download_digest_valid = valid && rc == 0;
+}
+
+int uds_download_get_digest(struct uds_download_digest* digest) {
+  if (!download_digest_valid) {
+    return -ENODATA;
+  }
+
+  *digest = download_digest;
+  return 0;
+}
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
 static UDSErr_t uds_upload_download_reset() {
   if (upload_download_state.state == UDS_UPDOWN__IDLE) {
     return UDS_NRC_RequestSequenceError;
   }
 
+#ifdef CONFIG_UDS_DOWNLOAD_PIPELINE
+  if (upload_download_state.state == UDS_UPDOWN__DOWNLOAD_IN_PROGRESS) {
+#ifdef CONFIG_UDS_DOWNLOAD_COMPRESSION
+    download_decompression_flush();
+#endif  // CONFIG_UDS_DOWNLOAD_COMPRESSION
+
+    if (!download_pipeline_drained()) {
+      // The request is evaluated again until all blocks are written
+      return UDS_NRC_RequestCorrectlyReceived_ResponsePending;
+    }
+
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+    download_erase_stop();
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+
+    upload_download_state.state = UDS_UPDOWN__IDLE;
+    upload_download_state.start_address = 0;
+    upload_download_state.current_address = 0;
+    upload_download_state.total_size = 0;
+
+    int rc = (int)atomic_get(&download_pipeline_error);
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+    download_digest_finish(rc == 0);
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
+    if (rc != 0) {
+      LOG_ERR("Download failed, first flash write error: %d", rc);
+      return UDS_NRC_GeneralProgrammingFailure;
+    }
+
+    return UDS_OK;
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_PIPELINE
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+  if (upload_download_state.state == UDS_UPDOWN__DOWNLOAD_IN_PROGRESS) {
+    download_digest_finish(true);
+  }
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
   upload_download_state.state = UDS_UPDOWN__IDLE;
   upload_download_state.start_address = 0;
   upload_download_state.current_address = 0;
@@ -302,8 +1106,10 @@ static UDSErr_t uds_action_upload_download(struct uds_context* context,
     case UDS_EVT_RequestUpload:
     case UDS_EVT_RequestFileTransfer: {
       int err = transfer_exit(context);
-      // only return status on non-expected errors
-      if (err != UDS_OK && err != UDS_NRC_RequestSequenceError) {
+      // only return status on non-expected errors, a failed download that was
+      // never exited does not prevent a new transfer
+      if (err != UDS_OK && err != UDS_NRC_RequestSequenceError &&
+          err != UDS_NRC_GeneralProgrammingFailure) {
         return err;
       }
     }
@@ -344,8 +1150,21 @@ static UDSErr_t uds_action_upload_download(struct uds_context* context,
 
       return UDS_NRC_RequestSequenceError;
 
-    case UDS_EVT_RequestTransferExit:
+    case UDS_EVT_RequestTransferExit: {
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+      bool download =
+          upload_download_state.state == UDS_UPDOWN__DOWNLOAD_IN_PROGRESS;
+      UDSErr_t ret = transfer_exit(context);
+      // A download that was exited does not have to be resumed, a failed one
+      // can still be resumed from the last successful write
+      if (download && ret == UDS_OK) {
+        download_journal_clear();
+      }
+      return ret;
+#else
       return transfer_exit(context);
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+    }
 
     default:
       return UDS_ERR_MISUSE;
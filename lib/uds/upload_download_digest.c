@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "upload_download_digest.h"
+
+#include <errno.h>
+
+#include <zephyr/sys/crc.h>
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST_CRC_HW
+#include <zephyr/drivers/crc.h>
+
+static const struct device* const crc_dev =
+    DEVICE_DT_GET(DT_CHOSEN(zephyr_crc));
+
+static struct crc_ctx crc_hw_ctx;
+#endif
+
+int uds_digest_init(struct uds_digest_ctx* ctx) {
+  ctx->crc32 = 0;
+  ctx->size = 0;
+
+  if (psa_crypto_init() != PSA_SUCCESS) {
+    return -EIO;
+  }
+
+  // The hash of an unfinished download may still be running
+  psa_hash_abort(&ctx->sha256);
+  if (psa_hash_setup(&ctx->sha256, PSA_ALG_SHA_256) != PSA_SUCCESS) {
+    return -EIO;
+  }
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST_CRC_HW
+  crc_hw_ctx = (struct crc_ctx){
+    .type = CRC32_IEEE,
+    .polynomial = CRC32_IEEE_POLY,
+    .seed = CRC32_IEEE_INIT_VAL,
+    .reversed = CRC_FLAG_REVERSE_INPUT | CRC_FLAG_REVERSE_OUTPUT,
+  };
+  return crc_begin(crc_dev, &crc_hw_ctx);
+#else
+  return 0;
+#endif
+}
+
+void uds_digest_update(struct uds_digest_ctx* ctx,
+                       const uint8_t* data,
+                       size_t len) {
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST_CRC_HW
+  crc_update(crc_dev, &crc_hw_ctx, data, len);
+#else
+  ctx->crc32 = crc32_ieee_update(ctx->crc32, data, len);
+#endif
+  // A failure is reported when the hash is finished
+  (void)psa_hash_update(&ctx->sha256, data, len);
+  ctx->size += len;
+}
+
+int uds_digest_final(struct uds_digest_ctx* ctx,
+                     struct uds_download_digest* digest) {
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST_CRC_HW
+  crc_finish(crc_dev, &crc_hw_ctx);
+  ctx->crc32 = crc_hw_ctx.result;
+#endif
+
+  digest->size = ctx->size;
+  digest->crc32 = ctx->crc32;
+
+  size_t len;
+  if (psa_hash_finish(&ctx->sha256, digest->sha256, sizeof(digest->sha256),
+                      &len) != PSA_SUCCESS) {
+    return -EIO;
+  }
+
+  return 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef UDS_UPLOAD_DOWNLOAD_DIGEST_H
+#define UDS_UPLOAD_DOWNLOAD_DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ardep/uds.h>
+#include <psa/crypto.h>
+
+/**
+ * @brief Digest of a download that is computed while the data is written
+ */
+struct uds_digest_ctx {
+  uint32_t crc32;
+  psa_hash_operation_t sha256;
+  uint32_t size;
+};
+
+int uds_digest_init(struct uds_digest_ctx* ctx);
+void uds_digest_update(struct uds_digest_ctx* ctx,
+                       const uint8_t* data,
+                       size_t len);
+int uds_digest_final(struct uds_digest_ctx* ctx,
+                     struct uds_download_digest* digest);
+
+#endif  // UDS_UPLOAD_DOWNLOAD_DIGEST_H
@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "upload_download_heatshrink.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * The stream is a sequence of bits, MSB first. A 1 bit is followed by an
+ * 8 bit literal. A 0 bit is followed by a back reference: W bits of
+ * offset - 1 and L bits of length - 1. The last byte is padded with 0 bits,
+ * which never form a complete back reference.
+ */
+
+#define WINDOW_MASK ((1 << UDS_HEATSHRINK_WINDOW_BITS) - 1)
+#define LOOKAHEAD_MASK ((1 << UDS_HEATSHRINK_LOOKAHEAD_BITS) - 1)
+#define BACKREF_BITS \
+  (UDS_HEATSHRINK_WINDOW_BITS + UDS_HEATSHRINK_LOOKAHEAD_BITS)
+
+void uds_heatshrink_decoder_reset(struct uds_heatshrink_decoder* dec) {
+  // References before the start of the stream read zeros
+  memset(dec, 0, sizeof(*dec));
+  dec->state = UDS_HEATSHRINK__TAG;
+}
+
+static void emit(struct uds_heatshrink_decoder* dec,
+                 uint8_t c,
+                 uint8_t* out,
+                 size_t* out_len) {
+  out[(*out_len)++] = c;
+  dec->window[dec->head & WINDOW_MASK] = c;
+  dec->head++;
+}
+
+size_t uds_heatshrink_decode(struct uds_heatshrink_decoder* dec,
+                             const uint8_t* in,
+                             size_t in_len,
+                             uint8_t* out,
+                             size_t out_size,
+                             size_t* out_len) {
+  size_t consumed = 0;
+  *out_len = 0;
+
+  while (true) {
+    if (dec->copy_remaining > 0) {
+      if (*out_len == out_size) {
+        break;
+      }
+
+      emit(dec, dec->window[(dec->head - dec->copy_offset) & WINDOW_MASK], out,
+           out_len);
+      dec->copy_remaining--;
+      continue;
+    }
+
+    uint8_t needed = 1;
+    if (dec->state == UDS_HEATSHRINK__LITERAL) {
+      needed = 8;
+    } else if (dec->state == UDS_HEATSHRINK__BACKREF) {
+      needed = BACKREF_BITS;
+    }
+
+    if (dec->bit_count < needed) {
+      if (consumed == in_len) {
+        break;
+      }
+      dec->bits = (dec->bits << 8) | in[consumed++];
+      dec->bit_count += 8;
+      continue;
+    }
+
+    if (dec->state == UDS_HEATSHRINK__LITERAL && *out_len == out_size) {
+      break;
+    }
+
+    uint32_t value =
+        (dec->bits >> (dec->bit_count - needed)) & ((1U << needed) - 1);
+    dec->bit_count -= needed;
+
+    switch (dec->state) {
+      case UDS_HEATSHRINK__TAG:
+        dec->state = value ? UDS_HEATSHRINK__LITERAL : UDS_HEATSHRINK__BACKREF;
+        break;
+
+      case UDS_HEATSHRINK__LITERAL:
+        emit(dec, (uint8_t)value, out, out_len);
+        dec->state = UDS_HEATSHRINK__TAG;
+        break;
+
+      case UDS_HEATSHRINK__BACKREF:
+        dec->copy_offset = (value >> UDS_HEATSHRINK_LOOKAHEAD_BITS) + 1;
+        dec->copy_remaining = (value & LOOKAHEAD_MASK) + 1;
+        dec->state = UDS_HEATSHRINK__TAG;
+        break;
+    }
+  }
+
+  return consumed;
+}
@@ -0,0 +1,61 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef UDS_UPLOAD_DOWNLOAD_HEATSHRINK_H
+#define UDS_UPLOAD_DOWNLOAD_HEATSHRINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bits of the back reference offset, the window has 2^W bytes
+#define UDS_HEATSHRINK_WINDOW_BITS 8
+// Bits of the back reference length
+#define UDS_HEATSHRINK_LOOKAHEAD_BITS 4
+
+enum uds_heatshrink_state {
+  UDS_HEATSHRINK__TAG,
+  UDS_HEATSHRINK__LITERAL,
+  UDS_HEATSHRINK__BACKREF,
+};
+
+/**
+ * @brief Streaming decoder for the heatshrink format
+ *
+ * The input may be split at any bit, the decoder keeps its state between
+ * calls. It only needs the window of the last 2^W decoded bytes.
+ */
+struct uds_heatshrink_decoder {
+  uint8_t window[1 << UDS_HEATSHRINK_WINDOW_BITS];
+  uint16_t head;
+  uint32_t bits;
+  uint8_t bit_count;
+  enum uds_heatshrink_state state;
+  uint16_t copy_offset;
+  uint16_t copy_remaining;
+};
+
+void uds_heatshrink_decoder_reset(struct uds_heatshrink_decoder* dec);
+
+/**
+ * @brief Decodes input until it is consumed or the output is full
+ *
+ * @param dec the decoder
+ * @param in the compressed input
+ * @param in_len length of @p in
+ * @param out buffer for the decoded bytes
+ * @param out_size size of @p out
+ * @param out_len number of decoded bytes
+ * @return number of consumed input bytes
+ */
+size_t uds_heatshrink_decode(struct uds_heatshrink_decoder* dec,
+                             const uint8_t* in,
+                             size_t in_len,
+                             uint8_t* out,
+                             size_t out_size,
+                             size_t* out_len);
+
+#endif  // UDS_UPLOAD_DOWNLOAD_HEATSHRINK_H
@@ -13,6 +13,10 @@ LOG_MODULE_REGISTER(isotp, CONFIG_MODULE_ISO14229_EXTERNAL_LOG_LEVEL);
 
 #include <iso14229.h>
 
+#ifdef CONFIG_ISO14229
+#include <ardep/iso14229.h>
+#endif
+
 void isotp_user_debug(const char* fmt, ...) {
 #if CONFIG_ISO14229_LIB_LOG_LEVEL >= LOG_LEVEL_DEBUG
   va_list args;
@@ -32,9 +36,16 @@ int isotp_user_send_can(const uint32_t arbitration_id,
   frame.dlc = size;
   memcpy(frame.data, data, size);
   frame.flags = 0;
-  const struct device* can_dev = arg;
   LOG_DBG("CAN TX: %03x [%d] %02x ...", frame.id, frame.dlc, frame.data[0]);
+
+#ifdef CONFIG_ISO14229
+  // The ardep glue passes the transmit queue of the instance, which sends the
+  // frame in the background
+  int ret = iso14229_zephyr_tx_enqueue(arg, &frame);
+#else
+  const struct device* can_dev = arg;
   int ret = can_send(can_dev, &frame, K_FOREVER, NULL, &frame);
+#endif
 
   if (ret != 0) {
     return ISOTP_RET_ERROR;
@@ -43,6 +54,17 @@ int isotp_user_send_can(const uint32_t arbitration_id,
   return ISOTP_RET_OK;
 }
 
-uint32_t isotp_user_get_us(void) { return k_uptime_get_32() * 1000; }
+/*
+ * Microsecond time base for ISO-TP timers (STmin, N_Bs, N_Cr). The 64-bit
+ * counter is truncated to 32 bit, isotp-c compares timestamps as signed
+ * differences, so the wrap every ~71 minutes is harmless.
+ */
+uint32_t isotp_user_get_us(void) {
+#ifdef CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+  return (uint32_t)k_cyc_to_us_floor64(k_cycle_get_64());
+#else
+  return (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+#endif
+}
 
 uint32_t UDSMillis() { return k_uptime_get_32(); }
@@ -1,6 +1,7 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
+#include <ardep/can_demux.h>
 #include <ardep/uds.h>
 
 LOG_MODULE_REGISTER(controller, LOG_LEVEL_INF);
@@ -49,8 +50,9 @@ static void controller_routine(struct k_work *work) {
   };
 
   LOG_INF("Adding filter for controller routine");
-  int filter_id = can_add_rx_filter(can_dev, controller_routine_rx,
-                                    &controller_received_frame, &rx_filter);
+  int filter_id =
+      can_demux_add_rx_filter(can_dev, controller_routine_rx,
+                              &controller_received_frame, &rx_filter);
 
   struct can_frame initial_frame = {
     .id = CONTROLLER_CAN_SEND_ADDR,
@@ -73,7 +75,7 @@ static void controller_routine(struct k_work *work) {
 
   ret = k_sem_take(&controller_receive_sem, K_MSEC(CONTROLLER_CAN_TIMEOUT_MS));
 
-  can_remove_rx_filter(can_dev, filter_id);
+  can_demux_remove_rx_filter(can_dev, filter_id);
 
   k_mutex_lock(&controller_routine_data_mutex, K_FOREVER);
   if (ret != 0) {
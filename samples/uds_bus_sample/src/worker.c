@@ -2,6 +2,7 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/byteorder.h>
 
+#include <ardep/can_demux.h>
 #include <ardep/uds.h>
 
 LOG_MODULE_REGISTER(worker, LOG_LEVEL_INF);
@@ -109,7 +110,7 @@ static UDSErr_t w_data_by_id_action(struct uds_context *const context,
 
       // deregister previous filter if it exists
       if (receive_can_filter_id != -1) {
-        can_remove_rx_filter(can_dev, receive_can_filter_id);
+        can_demux_remove_rx_filter(can_dev, receive_can_filter_id);
       }
 
       // register a new filter with set address
@@ -119,7 +120,7 @@ static UDSErr_t w_data_by_id_action(struct uds_context *const context,
         .mask = CAN_STD_ID_MASK,
       };
       receive_can_filter_id =
-          can_add_rx_filter(can_dev, can_rx_cb, NULL, &filter);
+          can_demux_add_rx_filter(can_dev, can_rx_cb, NULL, &filter);
       LOG_INF("Registered CAN RX filter for ID 0x%03X", can_receive_addr);
 
       if (receive_can_filter_id < 0) {
@@ -13,6 +13,90 @@ from udsoncan.services import DiagnosticSessionControl, ECUReset
 import isotp
 from intelhex import IntelHex
 import struct
+import zlib
+
+# Compression method nibble of the dataFormatIdentifier for heatshrink
+HEATSHRINK_COMPRESSION_METHOD = 0x1
+HEATSHRINK_WINDOW_BITS = 8
+HEATSHRINK_LOOKAHEAD_BITS = 4
+
+# Routine of the firmware loader that reports a CRC-32 per flash sector
+SECTOR_HASH_ROUTINE_ID = 0x0203
+# Routine of the firmware loader that reports where an interrupted download
+# can be continued
+RESUME_POINT_ROUTINE_ID = 0x0204
+
+
+def heatshrink_compress(data: bytes) -> bytes:
+    """Compresses data into the heatshrink format understood by the firmware loader
+
+    A 1 bit is followed by an 8 bit literal, a 0 bit by a back reference of
+    WINDOW_BITS offset - 1 and LOOKAHEAD_BITS length - 1, MSB first.
+    """
+    window = 1 << HEATSHRINK_WINDOW_BITS
+    max_length = 1 << HEATSHRINK_LOOKAHEAD_BITS
+    # a back reference of 2 bytes is already shorter than 2 literals
+    min_length = 2
+
+    out = bytearray()
+    bits = 0
+    bit_count = 0
+
+    def put(value: int, count: int):
+        nonlocal bits, bit_count
+        bits = (bits << count) | value
+        bit_count += count
+        while bit_count >= 8:
+            bit_count -= 8
+            out.append((bits >> bit_count) & 0xFF)
+        bits &= (1 << bit_count) - 1
+
+    # positions of every 2 byte prefix, most recent last
+    candidates: dict[bytes, list[int]] = {}
+
+    def remember(position: int):
+        if position + min_length <= len(data):
+            candidates.setdefault(data[position : position + min_length], []).append(position)
+
+    pos = 0
+    while pos < len(data):
+        best_length = 0
+        best_offset = 0
+        for candidate in reversed(candidates.get(data[pos : pos + min_length], [])):
+            if pos - candidate > window:
+                break
+            length = 0
+            while (
+                length < max_length
+                and pos + length < len(data)
+                and data[candidate + length] == data[pos + length]
+            ):
+                length += 1
+            if length > best_length:
+                best_length = length
+                best_offset = pos - candidate
+                if length == max_length:
+                    break
+
+        if best_length >= min_length:
+            put(0, 1)
+            put(best_offset - 1, HEATSHRINK_WINDOW_BITS)
+            put(best_length - 1, HEATSHRINK_LOOKAHEAD_BITS)
+            step = best_length
+        else:
+            put(1, 1)
+            put(data[pos], 8)
+            step = 1
+
+        for position in range(pos, pos + step):
+            remember(position)
+        pos += step
+
+    if bit_count > 0:
+        put(0, 8 - bit_count)
+
+    return bytes(out)
+
 
 class ArdepUDSRunner(ZephyrBinaryRunner):
     """Runner for ardep board using UDS for flashing"""
@@ -22,9 +106,12 @@ class ArdepUDSRunner(ZephyrBinaryRunner):
     uds_target_address: str
     gearshift: int | None
     block_size: int
+    compress: bool
+    incremental: bool
+    resume: bool
     hex_file: IntelHex | None
 
-    def __init__(self, cfg, can_interface, uds_source_address, uds_target_address, gearshift, block_size):
+    def __init__(self, cfg, can_interface, uds_source_address, uds_target_address, gearshift, block_size, compress, incremental, resume):
         super().__init__(cfg)
         self.hex_file = IntelHex(cfg.hex_file) if cfg.hex_file else None
         self.can_interface = can_interface
@@ -32,6 +119,9 @@ class ArdepUDSRunner(ZephyrBinaryRunner):
         self.uds_target_address = uds_target_address
         self.gearshift = gearshift
         self.block_size = block_size
+        self.compress = compress
+        self.incremental = incremental
+        self.resume = resume
 
     @classmethod
     def name(cls):
@@ -72,6 +162,22 @@ class ArdepUDSRunner(ZephyrBinaryRunner):
             type=int,
             default=512,
         )
+        parser.add_argument(
+            "-c",
+            "--compress",
+            help="Compress the firmware with heatshrink before the transfer, requires a firmware loader built with CONFIG_UDS_DOWNLOAD_COMPRESSION",
+            action="store_true",
+        )
+        parser.add_argument(
+            "--incremental",
+            help="Only download the flash sectors that differ from the firmware on the device, requires a firmware loader built with CONFIG_UDS_DOWNLOAD_ERASE_AHEAD",
+            action="store_true",
+        )
+        parser.add_argument(
+            "--resume",
+            help="Continue an interrupted download of the same firmware instead of starting over, requires a firmware loader built with CONFIG_UDS_DOWNLOAD_RESUME",
+            action="store_true",
+        )
 
     @classmethod
     def do_create(cls, cfg, args):
@@ -82,18 +188,35 @@ class ArdepUDSRunner(ZephyrBinaryRunner):
             uds_target_address=args.uds_target_id,
             gearshift=args.gearshift,
             block_size=args.block_size,
+            compress=args.compress,
+            incremental=args.incremental,
+            resume=args.resume,
         )
 
-    def read_and_split_firmware_into_blocks(self):
+    def read_firmware(self):
         base_address = self.hex_file.addresses()[0]
         firmware_data = bytes(self.hex_file.tobinarray(base_address))
 
+        return firmware_data, base_address
+
+    def split_firmware_into_blocks(self, firmware_data: bytes):
+        memory_size = len(firmware_data)
+
+        if self.compress:
+            compressed = heatshrink_compress(firmware_data)
+            print(f"Compressed firmware from {len(firmware_data)} to {len(compressed)} bytes")
+            firmware_data = compressed
+        elif not self.incremental:
+            memory_size = (len(firmware_data) + self.block_size - 1) // self.block_size * self.block_size
+        # incremental segments keep their size, a rounded up range would erase
+        # the unchanged sector after them
+
         blocks = [
             firmware_data[i : i + self.block_size]
             for i in range(0, len(firmware_data), self.block_size)
         ]
 
-        return blocks, base_address
+        return blocks, memory_size
 
     def get_isotp_address(self) -> isotp.Address:
         source_id = 0x7E0 + self.gearshift if self.gearshift is not None else int(self.uds_source_address, 0)
@@ -127,31 +250,119 @@ class ArdepUDSRunner(ZephyrBinaryRunner):
         print("Erasing slot0 ...")
         client.start_routine(0xFF00) # Erase slot0 routine
 
-        time.sleep(3)
-
-        for _ in range(5):
+        # Firmware loaders that erase during the download complete the routine
+        # right away, others take a few seconds
+        for _ in range(10):
+            time.sleep(0.5)
             try:
-                client.tester_present()
+                response = client.get_routine_result(0xFF00)
                 break
+            except udsoncan.exceptions.NegativeResponseException as e:
+                # The routine is still running
+                if e.response.code != udsoncan.Response.Code.RequestSequenceError:
+                    raise
             except udsoncan.exceptions.TimeoutException:
                 pass
-            time.sleep(1)
+        else:
+            response = client.get_routine_result(0xFF00)
 
-        response = client.get_routine_result(0xFF00)
         result = struct.unpack(">I", response.service_data.routine_status_record)[0]
         if result != 0:
             raise RuntimeError(f"Erase slot0 routine failed with code 0x{result:08X}")
 
         print("Slot0 erased successfully.")
 
-    def upload_firmware(self, client: Client, blocks, base_address):
+    def read_sector_hashes(self, client: Client, address: int, size: int):
+        """Reads the CRC-32 of each flash sector of the range from the device
+
+        The device reports a limited number of sectors of the same size at a
+        time, so the rest of the range is requested until it is covered.
+        Returns a list of (address, size, crc) of the sectors.
+        """
+        end = address + size
+        sectors: list[tuple[int, int, int]] = []
+
+        while address < end:
+            # The device answers with ResponsePending while it hashes
+            response = client.start_routine(SECTOR_HASH_ROUTINE_ID, data=struct.pack(">II", address, end - address))
+            record = response.service_data.routine_status_record
+            first_sector, sector_size = struct.unpack(">II", record[:8])
+            crcs = struct.unpack(f">{(len(record) - 8) // 4}I", record[8:])
+            if not crcs:
+                raise RuntimeError("Sector hash routine reported no sectors")
+
+            for i, crc in enumerate(crcs):
+                sectors.append((first_sector + i * sector_size, sector_size, crc))
+            address = first_sector + len(crcs) * sector_size
+
+        return sectors
+
+    def round_up_to_sector(self, client: Client, address: int, size: int):
+        """Returns the memory size of a download at address that ends at the end of its last sector
+
+        Firmware loaders that erase during the download only accept ranges of whole sectors.
+        """
+        last_sector, sector_size, _ = self.read_sector_hashes(client, address + size - 1, 1)[0]
+        return last_sector + sector_size - address
+
+    def find_changed_segments(self, client: Client, firmware_data: bytes, base_address: int):
+        """Returns (address, data) of the runs of sectors that have to be downloaded"""
+        print("Reading sector hashes...")
+        sectors = self.read_sector_hashes(client, base_address, len(firmware_data))
+
+        if sectors[0][0] != base_address:
+            print("Firmware does not start at a sector boundary, downloading all of it")
+            return [(base_address, firmware_data)]
+
+        segments = []
+        for address, sector_size, crc in sectors:
+            offset = address - base_address
+            sector = firmware_data[offset : offset + sector_size]
+            # the download erases the sector, so the rest of it reads as 0xFF
+            if zlib.crc32(sector.ljust(sector_size, b"\xff")) == crc:
+                continue
+
+            if segments and segments[-1][0] + len(segments[-1][1]) == address:
+                segments[-1] = (segments[-1][0], segments[-1][1] + sector)
+            else:
+                segments.append((address, sector))
+
+        changed = sum(len(data) for _, data in segments)
+        print(f"{changed} of {len(firmware_data)} bytes in {len(segments)} segments differ")
+
+        return segments
+
+    def find_resume_point(self, client: Client, firmware_data: bytes, base_address: int):
+        """Returns address and memory size of the rest of an interrupted download of this firmware"""
+        try:
+            response = client.start_routine(RESUME_POINT_ROUTINE_ID)
+        except udsoncan.exceptions.NegativeResponseException:
+            print("No interrupted download to resume")
+            return None
+
+        address, size = struct.unpack(">II", response.service_data.routine_status_record)
+        end = base_address + len(firmware_data)
+        # the memory size of the interrupted download may have been rounded up
+        if not base_address < address < end or address + size < end:
+            print("The interrupted download was not of this firmware, starting over")
+            return None
+
+        print(f"Resuming the download at 0x{address:08X}, {size} bytes left")
+        return address, size
+
+    def upload_firmware(self, client: Client, blocks, base_address, memory_size):
         print("Starting firmware transfer...")
 
         block_count = len(blocks)
 
         print(f"Requesting download of {block_count} blocks starting at address 0x{base_address:08X}...")
-        address = udsoncan.MemoryLocation(memorysize=block_count * self.block_size, address=base_address, address_format=32)
-        client.request_download(memory_location=address)
+        # the memory size is the size of the uncompressed firmware
+        address = udsoncan.MemoryLocation(memorysize=memory_size, address=base_address, address_format=32)
+        dfi = udsoncan.DataFormatIdentifier(
+            compression=HEATSHRINK_COMPRESSION_METHOD if self.compress else 0,
+            encryption=0,
+        )
+        client.request_download(memory_location=address, dfi=dfi)
 
         for i in range(block_count):
             print(f"Transferring block {i + 1}/{block_count}...")
@@ -167,14 +378,34 @@ class ArdepUDSRunner(ZephyrBinaryRunner):
             print("No hex file provided, please check that you are building a hex file")
             exit(1)
 
-        blocks, base_address = self.read_and_split_firmware_into_blocks()
+        firmware_data, base_address = self.read_firmware()
 
         with self.create_client() as client:
             self.test_connection(client)
             self.switch_to_programming_session(client)
 
-            self.erase_slot0(client)
-            self.upload_firmware(client, blocks, base_address)
+            resume_point = None
+            if self.resume:
+                resume_point = self.find_resume_point(client, firmware_data, base_address)
+
+            if resume_point is not None:
+                # The request has to cover exactly the rest of the interrupted
+                # download, so the device continues it
+                address, memory_size = resume_point
+                blocks, _ = self.split_firmware_into_blocks(firmware_data[address - base_address :])
+                self.upload_firmware(client, blocks, address, memory_size)
+            else:
+                if self.incremental:
+                    # Each download only erases the sectors it writes
+                    segments = self.find_changed_segments(client, firmware_data, base_address)
+                else:
+                    self.erase_slot0(client)
+                    segments = [(base_address, firmware_data)]
+
+                for address, data in segments:
+                    blocks, memory_size = self.split_firmware_into_blocks(data)
+                    memory_size = self.round_up_to_sector(client, address, memory_size)
+                    self.upload_firmware(client, blocks, address, memory_size)
 
             client.ecu_reset(ECUReset.ResetType.hardReset)
 
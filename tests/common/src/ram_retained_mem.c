@@ -0,0 +1,90 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT vnd_ram_retained_mem
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/retained_mem.h>
+
+struct ram_retained_mem_config {
+  uint8_t *buf;
+  size_t size;
+};
+
+static bool ram_retained_mem_in_bounds(const struct device *dev,
+                                       off_t offset,
+                                       size_t size) {
+  const struct ram_retained_mem_config *config = dev->config;
+
+  return offset >= 0 && (size_t)offset <= config->size &&
+         size <= config->size - (size_t)offset;
+}
+
+static ssize_t ram_retained_mem_size(const struct device *dev) {
+  const struct ram_retained_mem_config *config = dev->config;
+
+  return (ssize_t)config->size;
+}
+
+static int ram_retained_mem_read(const struct device *dev,
+                                 off_t offset,
+                                 uint8_t *buffer,
+                                 size_t size) {
+  const struct ram_retained_mem_config *config = dev->config;
+
+  if (!ram_retained_mem_in_bounds(dev, offset, size)) {
+    return -EINVAL;
+  }
+
+  memcpy(buffer, &config->buf[offset], size);
+  return 0;
+}
+
+static int ram_retained_mem_write(const struct device *dev,
+                                  off_t offset,
+                                  const uint8_t *buffer,
+                                  size_t size) {
+  const struct ram_retained_mem_config *config = dev->config;
+
+  if (!ram_retained_mem_in_bounds(dev, offset, size)) {
+    return -EINVAL;
+  }
+
+  memcpy(&config->buf[offset], buffer, size);
+  return 0;
+}
+
+static int ram_retained_mem_clear(const struct device *dev) {
+  const struct ram_retained_mem_config *config = dev->config;
+
+  memset(config->buf, 0, config->size);
+  return 0;
+}
+
+static DEVICE_API(retained_mem, ram_retained_mem_api) = {
+  .size = ram_retained_mem_size,
+  .read = ram_retained_mem_read,
+  .write = ram_retained_mem_write,
+  .clear = ram_retained_mem_clear,
+};
+
+#define RAM_RETAINED_MEM_INIT(inst)                                         \
+  static uint8_t ram_retained_mem_buf_##inst[DT_INST_PROP(inst, size)];     \
+  static const struct ram_retained_mem_config                               \
+      ram_retained_mem_config_##inst = {                                    \
+        .buf = ram_retained_mem_buf_##inst,                                 \
+        .size = DT_INST_PROP(inst, size),                                   \
+  };                                                                        \
+  DEVICE_DT_INST_DEFINE(inst, NULL, NULL, NULL,                             \
+                        &ram_retained_mem_config_##inst, POST_KERNEL,       \
+                        CONFIG_RETAINED_MEM_INIT_PRIORITY,                  \
+                        &ram_retained_mem_api);
+
+DT_INST_FOREACH_STATUS_OKAY(RAM_RETAINED_MEM_INIT);
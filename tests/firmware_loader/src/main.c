@@ -0,0 +1,69 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "routine.h"
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/ztest.h>
+
+LOG_MODULE_REGISTER(firmware_loader, CONFIG_APP_LOG_LEVEL);
+
+// Upper bound for the ResponsePending repetitions of a routine
+#define ROUTINE_MAX_REPETITIONS 1000
+
+uint8_t routine_status_record[256];
+size_t routine_status_record_len;
+
+static uint8_t copy_status_record(UDSServer_t *server,
+                                  const void *data,
+                                  uint16_t len) {
+  zassert_true(len <= sizeof(routine_status_record));
+  memcpy(routine_status_record, data, len);
+  routine_status_record_len = len;
+
+  return 0;
+}
+
+UDSErr_t routine_start(uint16_t routine_id,
+                       uint8_t *option_record,
+                       uint16_t len) {
+  UDSRoutineCtrlArgs_t args = {
+    .id = routine_id,
+    .ctrlType = UDS_ROUTINE_CONTROL__START_ROUTINE,
+    .len = len,
+    .optionRecord = option_record,
+    .copyStatusRecord = copy_status_record,
+  };
+
+  routine_status_record_len = 0;
+
+  struct iso14229_zephyr_instance *iso14229 = &uds_default_instance.iso14229;
+  return iso14229->event_callback(iso14229, UDS_EVT_RoutineCtrl, &args,
+                                  &uds_default_instance);
+}
+
+UDSErr_t routine_start_until_done(uint16_t routine_id,
+                                  uint8_t *option_record,
+                                  uint16_t len) {
+  UDSErr_t ret = UDS_NRC_RequestCorrectlyReceived_ResponsePending;
+
+  for (int i = 0; i < ROUTINE_MAX_REPETITIONS &&
+                  ret == UDS_NRC_RequestCorrectlyReceived_ResponsePending;
+       i++) {
+    if (i > 0) {
+      k_msleep(1);
+    }
+    ret = routine_start(routine_id, option_record, len);
+  }
+
+  return ret;
+}
+
+ZTEST_SUITE(firmware_loader, NULL, NULL, NULL, NULL, NULL);
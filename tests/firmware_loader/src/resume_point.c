@@ -0,0 +1,107 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "routine.h"
+
+#include <zephyr/drivers/flash.h>
+#include <zephyr/retention/retention.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+
+#define RESUME_POINT_ROUTINE_ID 0x0204
+
+#define FLASH_BASE_ADDRESS DT_REG_ADDR(DT_CHOSEN(zephyr_flash))
+#define SLOT0_ADDRESS \
+  (FLASH_BASE_ADDRESS + FIXED_PARTITION_OFFSET(slot0_partition))
+
+static const struct device *const download_journal_dev =
+    DEVICE_DT_GET(DT_CHOSEN(zephyr_uds_download_journal));
+
+// The download covers the first page of slot0, as the download erases the
+// pages of its range as a whole
+static size_t download_size(void) {
+  struct flash_pages_info page;
+  zassert_ok(
+      flash_get_page_info_by_offs(FIXED_PARTITION_DEVICE(slot0_partition),
+                                  FIXED_PARTITION_OFFSET(slot0_partition),
+                                  &page));
+  return page.size;
+}
+
+static UDSErr_t send_event(UDSEvent_t event, void *args) {
+  struct iso14229_zephyr_instance *iso14229 = &uds_default_instance.iso14229;
+  return iso14229->event_callback(iso14229, event, args,
+                                  &uds_default_instance);
+}
+
+static void exit_download(void) {
+  UDSErr_t ret;
+  while ((ret = send_event(UDS_EVT_RequestTransferExit, NULL)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    zassert_ok(uds_download_wait_drained(K_SECONDS(1)));
+  }
+  zassert_equal(ret, UDS_OK);
+}
+
+// Downloads the first len bytes of a download to slot0 and leaves the
+// download unfinished
+static void interrupt_download(size_t len) {
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)SLOT0_ADDRESS,
+    .size = download_size(),
+    .dataFormatIdentifier = 0x00,
+  };
+  zassert_equal(send_event(UDS_EVT_RequestDownload, &download_args), UDS_OK);
+
+  uint8_t data[32];
+  zassert_true(len <= sizeof(data));
+  for (size_t i = 0; i < len; i++) {
+    data[i] = (uint8_t)i;
+  }
+
+  UDSTransferDataArgs_t transfer_args = {
+    .data = data,
+    .len = len,
+  };
+  zassert_equal(send_event(UDS_EVT_TransferData, &transfer_args), UDS_OK);
+  zassert_ok(uds_download_wait_drained(K_SECONDS(1)));
+}
+
+ZTEST(firmware_loader, test_resume_point_reports_remaining_range) {
+  zassert_ok(retention_clear(download_journal_dev));
+
+  interrupt_download(24);
+
+  UDSErr_t ret = routine_start(RESUME_POINT_ROUTINE_ID, NULL, 0);
+  zassert_equal(ret, UDS_OK);
+  zassert_equal(routine_status_record_len, 8);
+  zassert_equal(sys_get_be32(&routine_status_record[0]), SLOT0_ADDRESS + 24);
+  zassert_equal(sys_get_be32(&routine_status_record[4]),
+                download_size() - 24);
+
+  exit_download();
+}
+
+ZTEST(firmware_loader, test_resume_point_without_interrupted_download) {
+  zassert_ok(retention_clear(download_journal_dev));
+
+  UDSErr_t ret = routine_start(RESUME_POINT_ROUTINE_ID, NULL, 0);
+  zassert_equal(ret, UDS_NRC_RequestSequenceError);
+  zassert_equal(routine_status_record_len, 0);
+
+  // An exited download does not have to be resumed
+  interrupt_download(24);
+  exit_download();
+
+  ret = routine_start(RESUME_POINT_ROUTINE_ID, NULL, 0);
+  zassert_equal(ret, UDS_NRC_RequestSequenceError);
+}
+
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
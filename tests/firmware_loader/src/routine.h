@@ -0,0 +1,38 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_TESTS_FIRMWARE_LOADER_SRC_ROUTINE_H_
+#define APP_TESTS_FIRMWARE_LOADER_SRC_ROUTINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ardep/uds.h>
+#include <iso14229.h>
+
+/**
+ * Status record of the last positive response
+ */
+extern uint8_t routine_status_record[];
+extern size_t routine_status_record_len;
+
+/**
+ * Start a routine of the default instance once
+ */
+UDSErr_t routine_start(uint16_t routine_id,
+                       uint8_t *option_record,
+                       uint16_t len);
+
+/**
+ * Start a routine of the default instance and repeat the request while the
+ * server answers with ResponsePending, like the UDS thread does
+ */
+UDSErr_t routine_start_until_done(uint16_t routine_id,
+                                  uint8_t *option_record,
+                                  uint16_t len);
+
+#endif  // APP_TESTS_FIRMWARE_LOADER_SRC_ROUTINE_H_
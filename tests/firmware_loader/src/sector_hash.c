@@ -0,0 +1,149 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "routine.h"
+
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/ztest.h>
+
+#define SECTOR_HASH_ROUTINE_ID 0x0203
+
+#define FLASH_BASE_ADDRESS DT_REG_ADDR(DT_CHOSEN(zephyr_flash))
+#define SLOT0_OFFSET FIXED_PARTITION_OFFSET(slot0_partition)
+#define SLOT0_SIZE FIXED_PARTITION_SIZE(slot0_partition)
+
+// Sectors of slot0 used by the tests
+#define TEST_SECTORS 6
+
+static const struct device *const flash_dev =
+    FIXED_PARTITION_DEVICE(slot0_partition);
+
+static uint32_t sector_size;
+
+// Erases the test sectors and writes a pattern into the second one, so the
+// sectors do not all have the same hash
+static void prepare_sectors(void) {
+  struct flash_pages_info page;
+  zassert_ok(flash_get_page_info_by_offs(flash_dev, SLOT0_OFFSET, &page));
+  zassert_equal(page.start_offset, SLOT0_OFFSET);
+  sector_size = page.size;
+  zassert_true(TEST_SECTORS * sector_size <= SLOT0_SIZE);
+
+  zassert_ok(flash_erase(flash_dev, SLOT0_OFFSET, TEST_SECTORS * sector_size));
+
+  uint8_t pattern[64];
+  for (size_t i = 0; i < sizeof(pattern); i++) {
+    pattern[i] = (uint8_t)(i * 7);
+  }
+  zassert_ok(flash_write(flash_dev, SLOT0_OFFSET + sector_size + 16, pattern,
+                         sizeof(pattern)));
+}
+
+static uint32_t expected_sector_crc(uint32_t offset) {
+  uint8_t buf[256];
+  uint32_t crc = 0;
+
+  for (uint32_t pos = 0; pos < sector_size; pos += sizeof(buf)) {
+    size_t len = MIN(sizeof(buf), sector_size - pos);
+    zassert_ok(flash_read(flash_dev, offset + pos, buf, len));
+    crc = crc32_ieee_update(crc, buf, len);
+  }
+
+  return crc;
+}
+
+static UDSErr_t sector_hash(uint32_t address, uint32_t size) {
+  uint8_t option_record[8];
+  sys_put_be32(address, &option_record[0]);
+  sys_put_be32(size, &option_record[4]);
+
+  return routine_start_until_done(SECTOR_HASH_ROUTINE_ID, option_record,
+                                  sizeof(option_record));
+}
+
+// Checks a status record of count sectors starting with the given one
+static void assert_sector_hashes(size_t first_sector, size_t count) {
+  const uint32_t first_offset = SLOT0_OFFSET + first_sector * sector_size;
+
+  zassert_equal(routine_status_record_len, 8 + 4 * count);
+  zassert_equal(sys_get_be32(&routine_status_record[0]),
+                FLASH_BASE_ADDRESS + first_offset);
+  zassert_equal(sys_get_be32(&routine_status_record[4]), sector_size);
+
+  for (size_t i = 0; i < count; i++) {
+    zassert_equal(sys_get_be32(&routine_status_record[8 + 4 * i]),
+                  expected_sector_crc(first_offset + i * sector_size),
+                  "Wrong CRC-32 of sector %zu", first_sector + i);
+  }
+}
+
+ZTEST(firmware_loader, test_sector_hash_multi_sector_range) {
+  prepare_sectors();
+
+  // From the middle of the first to the middle of the third sector
+  uint8_t option_record[8];
+  sys_put_be32(FLASH_BASE_ADDRESS + SLOT0_OFFSET + sector_size / 2,
+               &option_record[0]);
+  sys_put_be32(2 * sector_size, &option_record[4]);
+
+  // Hashed in the background
+  zassert_equal(routine_start(SECTOR_HASH_ROUTINE_ID, option_record,
+                              sizeof(option_record)),
+                UDS_NRC_RequestCorrectlyReceived_ResponsePending);
+  zassert_equal(routine_status_record_len, 0);
+
+  zassert_equal(routine_start_until_done(SECTOR_HASH_ROUTINE_ID, option_record,
+                                         sizeof(option_record)),
+                UDS_PositiveResponse);
+  assert_sector_hashes(0, 3);
+
+  // The written pattern changes the hash of the second sector only
+  zassert_equal(sys_get_be32(&routine_status_record[8]),
+                sys_get_be32(&routine_status_record[16]));
+  zassert_not_equal(sys_get_be32(&routine_status_record[8]),
+                    sys_get_be32(&routine_status_record[12]));
+}
+
+ZTEST(firmware_loader, test_sector_hash_reports_limited_sectors) {
+  prepare_sectors();
+
+  BUILD_ASSERT(CONFIG_FIRMWARE_LOADER_SECTOR_HASH_MAX_SECTORS < TEST_SECTORS);
+  const size_t max_sectors = CONFIG_FIRMWARE_LOADER_SECTOR_HASH_MAX_SECTORS;
+
+  zassert_equal(sector_hash(FLASH_BASE_ADDRESS + SLOT0_OFFSET,
+                            TEST_SECTORS * sector_size),
+                UDS_PositiveResponse);
+  assert_sector_hashes(0, max_sectors);
+
+  // The tester requests the rest of the range
+  zassert_equal(
+      sector_hash(FLASH_BASE_ADDRESS + SLOT0_OFFSET + max_sectors * sector_size,
+                  (TEST_SECTORS - max_sectors) * sector_size),
+      UDS_PositiveResponse);
+  assert_sector_hashes(max_sectors, TEST_SECTORS - max_sectors);
+}
+
+ZTEST(firmware_loader, test_sector_hash_rejects_ranges_outside_slot0) {
+  zassert_equal(sector_hash(FLASH_BASE_ADDRESS + SLOT0_OFFSET - 1, 2),
+                UDS_NRC_RequestOutOfRange);
+  zassert_equal(sector_hash(FLASH_BASE_ADDRESS + SLOT0_OFFSET, 0),
+                UDS_NRC_RequestOutOfRange);
+  zassert_equal(
+      sector_hash(FLASH_BASE_ADDRESS + SLOT0_OFFSET, SLOT0_SIZE + 1),
+      UDS_NRC_RequestOutOfRange);
+}
+
+ZTEST(firmware_loader, test_sector_hash_rejects_wrong_option_record) {
+  uint8_t option_record[4] = {0};
+
+  zassert_equal(routine_start(SECTOR_HASH_ROUTINE_ID, option_record,
+                              sizeof(option_record)),
+                UDS_NRC_IncorrectMessageLengthOrInvalidFormat);
+}
@@ -0,0 +1,294 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/drivers/can.h>
+#include <zephyr/drivers/can/can_fake.h>
+#include <zephyr/fff.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <ardep/can_demux.h>
+
+DEFINE_FFF_GLOBALS;
+
+#define MAX_HW_FILTERS 8
+#define THREAD_STACK_SIZE 2048
+
+static const struct device *can_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_canbus));
+
+// Hardware filters installed in the fake driver
+static struct {
+  bool installed;
+  can_rx_callback_t callback;
+  void *user_data;
+  struct can_filter filter;
+} hw_filters[MAX_HW_FILTERS];
+
+static int received[4];
+static int subscribers[4];
+
+static int add_rx_filter_fake(const struct device *dev,
+                              can_rx_callback_t callback,
+                              void *user_data,
+                              const struct can_filter *filter) {
+  for (int i = 0; i < MAX_HW_FILTERS; i++) {
+    if (!hw_filters[i].installed) {
+      hw_filters[i].installed = true;
+      hw_filters[i].callback = callback;
+      hw_filters[i].user_data = user_data;
+      hw_filters[i].filter = *filter;
+      return i;
+    }
+  }
+
+  return -ENOSPC;
+}
+
+static void remove_rx_filter_fake(const struct device *dev, int filter_id) {
+  zassert_true(hw_filters[filter_id].installed);
+  hw_filters[filter_id].installed = false;
+}
+
+static int installed_hw_filters(void) {
+  int count = 0;
+  for (int i = 0; i < MAX_HW_FILTERS; i++) {
+    count += hw_filters[i].installed;
+  }
+  return count;
+}
+
+// Passes a frame to all hardware filters it matches, like the driver
+static void receive(uint32_t id, uint8_t flags) {
+  struct can_frame frame = {
+    .id = id,
+    .flags = flags,
+  };
+
+  for (int i = 0; i < MAX_HW_FILTERS; i++) {
+    if (hw_filters[i].installed &&
+        can_frame_matches_filter(&frame, &hw_filters[i].filter)) {
+      hw_filters[i].callback(can_dev, &frame, hw_filters[i].user_data);
+    }
+  }
+}
+
+static void rx_cb(const struct device *dev,
+                  struct can_frame *frame,
+                  void *user_data) {
+  int *count = user_data;
+  (*count)++;
+}
+
+static int subscribe(int index, uint32_t id, uint32_t mask, uint8_t flags) {
+  const struct can_filter filter = {
+    .id = id,
+    .mask = mask,
+    .flags = flags,
+  };
+
+  subscribers[index] =
+      can_demux_add_rx_filter(can_dev, rx_cb, &received[index], &filter);
+  return subscribers[index];
+}
+
+static void before(void *fixture) {
+  ARG_UNUSED(fixture);
+
+  RESET_FAKE(fake_can_add_rx_filter);
+  RESET_FAKE(fake_can_remove_rx_filter);
+  fake_can_add_rx_filter_fake.custom_fake = add_rx_filter_fake;
+  fake_can_remove_rx_filter_fake.custom_fake = remove_rx_filter_fake;
+
+  memset(received, 0, sizeof(received));
+  for (size_t i = 0; i < ARRAY_SIZE(subscribers); i++) {
+    subscribers[i] = -1;
+  }
+}
+
+static void after(void *fixture) {
+  ARG_UNUSED(fixture);
+
+  for (size_t i = 0; i < ARRAY_SIZE(subscribers); i++) {
+    if (subscribers[i] >= 0) {
+      can_demux_remove_rx_filter(can_dev, subscribers[i]);
+    }
+  }
+
+  zassert_equal(installed_hw_filters(), 0);
+}
+
+ZTEST(lib_can_demux, test_exact_ids_are_dispatched) {
+  zassert_true(subscribe(0, 0x100, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_true(subscribe(1, 0x200, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_equal(installed_hw_filters(), 2);
+
+  receive(0x100, 0);
+  receive(0x200, 0);
+  receive(0x200, 0);
+  receive(0x300, 0);
+
+  zassert_equal(received[0], 1);
+  zassert_equal(received[1], 2);
+}
+
+ZTEST(lib_can_demux, test_filters_are_merged_into_the_budget) {
+  zassert_true(subscribe(0, 0x100, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_true(subscribe(1, 0x101, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_true(subscribe(2, 0x102, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_true(subscribe(3, 0x400, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_equal(installed_hw_filters(), 2);
+
+  receive(0x100, 0);
+  receive(0x101, 0);
+  receive(0x102, 0);
+  receive(0x103, 0);
+  receive(0x400, 0);
+
+  zassert_equal(received[0], 1);
+  zassert_equal(received[1], 1);
+  zassert_equal(received[2], 1);
+  zassert_equal(received[3], 1);
+}
+
+ZTEST(lib_can_demux, test_covered_filter_shares_the_hw_filter) {
+  zassert_true(subscribe(0, 0x100, 0x700, 0) >= 0);
+  zassert_true(subscribe(1, 0x123, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_equal(installed_hw_filters(), 1);
+
+  receive(0x123, 0);
+  receive(0x155, 0);
+  receive(0x200, 0);
+
+  zassert_equal(received[0], 2);
+  zassert_equal(received[1], 1);
+}
+
+ZTEST(lib_can_demux, test_extended_ids_are_kept_apart) {
+  zassert_true(subscribe(0, 0x100, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_true(subscribe(1, 0x100, CAN_EXT_ID_MASK, CAN_FILTER_IDE) >= 0);
+  zassert_equal(installed_hw_filters(), 2);
+
+  receive(0x100, CAN_FRAME_IDE);
+
+  zassert_equal(received[0], 0);
+  zassert_equal(received[1], 1);
+}
+
+ZTEST(lib_can_demux, test_removed_filter_is_not_dispatched) {
+  zassert_true(subscribe(0, 0x100, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_true(subscribe(1, 0x180, CAN_STD_ID_MASK, 0) >= 0);
+  zassert_true(subscribe(2, 0x7FF, CAN_STD_ID_MASK, 0) >= 0);
+
+  can_demux_remove_rx_filter(can_dev, subscribers[1]);
+  subscribers[1] = -1;
+  zassert_equal(installed_hw_filters(), 2);
+
+  receive(0x100, 0);
+  receive(0x180, 0);
+  receive(0x7FF, 0);
+
+  zassert_equal(received[0], 1);
+  zassert_equal(received[1], 0);
+  zassert_equal(received[2], 1);
+}
+
+ZTEST(lib_can_demux, test_failed_hw_filter_keeps_the_old_filters) {
+  zassert_true(subscribe(0, 0x100, CAN_STD_ID_MASK, 0) >= 0);
+
+  fake_can_add_rx_filter_fake.custom_fake = NULL;
+  fake_can_add_rx_filter_fake.return_val = -EIO;
+  zassert_equal(subscribe(1, 0x200, CAN_STD_ID_MASK, 0), -EIO);
+  fake_can_add_rx_filter_fake.custom_fake = add_rx_filter_fake;
+
+  receive(0x100, 0);
+  receive(0x200, 0);
+
+  zassert_equal(received[0], 1);
+  zassert_equal(received[1], 0);
+  zassert_equal(installed_hw_filters(), 1);
+}
+
+static K_SEM_DEFINE(dispatch_unblocked, 0, 1);
+static atomic_t remove_done;
+
+K_THREAD_STACK_DEFINE(receiver_stack, THREAD_STACK_SIZE);
+K_THREAD_STACK_DEFINE(remover_stack, THREAD_STACK_SIZE);
+static struct k_thread receiver_thread;
+static struct k_thread remover_thread;
+
+static void blocking_rx_cb(const struct device *dev,
+                           struct can_frame *frame,
+                           void *user_data) {
+  rx_cb(dev, frame, user_data);
+  k_sem_take(&dispatch_unblocked, K_FOREVER);
+}
+
+static void blocked_receiver(void *p1, void *p2, void *p3) {
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  receive(0x100, 0);
+}
+
+static void remover(void *p1, void *p2, void *p3) {
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  can_demux_remove_rx_filter(can_dev, subscribers[1]);
+  subscribers[1] = -1;
+  atomic_set(&remove_done, 1);
+}
+
+ZTEST(lib_can_demux, test_remove_waits_for_dispatched_frame) {
+  const struct can_filter filter = {
+    .id = 0x100,
+    .mask = CAN_STD_ID_MASK,
+  };
+
+  subscribers[0] = can_demux_add_rx_filter(can_dev, blocking_rx_cb,
+                                           &received[0], &filter);
+  zassert_true(subscribers[0] >= 0);
+  zassert_true(subscribe(1, 0x200, CAN_STD_ID_MASK, 0) >= 0);
+  atomic_set(&remove_done, 0);
+  k_sem_reset(&dispatch_unblocked);
+
+  const int priority = k_thread_priority_get(k_current_get());
+  k_thread_create(&receiver_thread, receiver_stack, THREAD_STACK_SIZE,
+                  blocked_receiver, NULL, NULL, NULL, priority, 0, K_NO_WAIT);
+  k_msleep(1);
+  zassert_equal(received[0], 1);
+
+  k_thread_create(&remover_thread, remover_stack, THREAD_STACK_SIZE, remover,
+                  NULL, NULL, NULL, priority, 0, K_NO_WAIT);
+  k_msleep(10);
+  zassert_false(atomic_get(&remove_done));
+
+  k_sem_give(&dispatch_unblocked);
+  zassert_ok(k_thread_join(&remover_thread, K_SECONDS(1)));
+  zassert_ok(k_thread_join(&receiver_thread, K_SECONDS(1)));
+  zassert_true(atomic_get(&remove_done));
+  zassert_equal(installed_hw_filters(), 1);
+}
+
+ZTEST(lib_can_demux, test_changes_without_readers_do_not_sleep) {
+  const int64_t start = k_uptime_ticks();
+
+  for (int i = 0; i < 10; i++) {
+    zassert_true(subscribe(0, 0x100, CAN_STD_ID_MASK, 0) >= 0);
+    can_demux_remove_rx_filter(can_dev, subscribers[0]);
+    subscribers[0] = -1;
+  }
+
+  // Nothing waits for a tick, so no time passes on native_sim
+  zassert_true(k_uptime_ticks() - start < 10);
+}
+
+ZTEST_SUITE(lib_can_demux, NULL, NULL, before, after, NULL);
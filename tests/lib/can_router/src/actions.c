@@ -0,0 +1,238 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "router.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+static const struct can_router_action_t rewrite_action = {
+  .id_rewrite =
+      {
+        .mask = 0x0F0,
+        .value = 0x050,
+        .offset = 0x100,
+      },
+};
+
+static const struct can_router_entry_t rewrite_routes[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0, .mask = 0, .flags = 0},
+    .action = &rewrite_action,
+  },
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0, .mask = 0, .flags = CAN_FILTER_IDE},
+    .action = &rewrite_action,
+  },
+};
+
+static const struct can_router_byte_transform transforms[] = {
+  {.index = 0, .and_mask = 0xF0, .xor_mask = 0x01},
+  {.index = 2, .and_mask = 0x0F, .xor_mask = 0x00},
+};
+
+static const struct can_router_action_t transform_action = {
+  .transforms = transforms,
+  .transform_count = ARRAY_SIZE(transforms),
+};
+
+static const struct can_router_entry_t transform_route[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0, .mask = 0, .flags = 0},
+    .action = &transform_action,
+  },
+};
+
+static const struct can_router_action_t rate_limit_action = {
+  .rate_limit =
+      {
+        .interval_us = 10000,
+        .burst = 2,
+      },
+};
+
+static const struct can_router_action_t fast_rate_limit_action = {
+  .rate_limit =
+      {
+        .interval_us = 250,
+        .burst = 1,
+      },
+};
+
+static const struct can_router_entry_t rate_limit_routes[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0x100, .mask = CAN_STD_ID_MASK, .flags = 0},
+    .action = &rate_limit_action,
+  },
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0x200, .mask = CAN_STD_ID_MASK, .flags = 0},
+    .action = &fast_rate_limit_action,
+  },
+};
+
+static const struct device **const fan_out[] = {&buses[BUS_FAN_OUT]};
+
+static const struct can_router_action_t fan_out_action = {
+  .id_rewrite = {.offset = 1},
+  .fan_out = fan_out,
+  .fan_out_count = ARRAY_SIZE(fan_out),
+};
+
+static const struct can_router_entry_t fan_out_routes[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0x100, .mask = CAN_STD_ID_MASK, .flags = 0},
+    .action = &fan_out_action,
+  },
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0x200, .mask = CAN_STD_ID_MASK, .flags = 0},
+  },
+};
+
+static void assert_route_stats(int index,
+                               uint32_t matched,
+                               uint32_t routed,
+                               uint32_t translated,
+                               uint32_t throttled) {
+  struct can_router_route_stats stats;
+
+  zassert_ok(can_router_get_route_stats(index, &stats));
+  zassert_equal(stats.matched, matched);
+  zassert_equal(stats.routed, routed);
+  zassert_equal(stats.translated, translated);
+  zassert_equal(stats.throttled, throttled);
+}
+
+ZTEST(lib_can_router, test_action_id_rewrite) {
+  zassert_ok(can_router_replace(rewrite_routes, ARRAY_SIZE(rewrite_routes)));
+
+  receive_id(0x123, 0);
+  // Truncated to a standard ID after the offset
+  receive_id(0x7A5, 0);
+  // Truncated to an extended ID after the offset
+  receive_id(0x1FFFFF23, CAN_FRAME_IDE);
+
+  zassert_equal(sent_count(BUS_DEST), 3);
+  zassert_equal(sent_frame(BUS_DEST, 0)->id, 0x253);
+  zassert_equal(sent_frame(BUS_DEST, 1)->id, 0x055);
+  zassert_equal(sent_frame(BUS_DEST, 2)->id, 0x053);
+  zassert_true((sent_frame(BUS_DEST, 2)->flags & CAN_FRAME_IDE) != 0);
+
+  assert_route_stats(0, 2, 2, 2, 0);
+  assert_route_stats(1, 1, 1, 1, 0);
+}
+
+ZTEST(lib_can_router, test_action_byte_transforms) {
+  zassert_ok(can_router_replace(transform_route, ARRAY_SIZE(transform_route)));
+
+  const struct can_frame frame = {
+    .id = 0x100,
+    .dlc = 4,
+    .data = {0x12, 0x34, 0x56, 0x78},
+  };
+  receive_frame(&frame);
+
+  // Not changed by the first transform, too short for the second one
+  const struct can_frame short_frame = {
+    .id = 0x101,
+    .dlc = 1,
+    .data = {0x31, 0x55, 0x55},
+  };
+  receive_frame(&short_frame);
+
+  zassert_equal(sent_count(BUS_DEST), 2);
+  const uint8_t expected[] = {0x11, 0x34, 0x06, 0x78};
+  zassert_mem_equal(sent_frame(BUS_DEST, 0)->data, expected,
+                    sizeof(expected));
+  zassert_equal(sent_frame(BUS_DEST, 1)->data[0], 0x31);
+  zassert_equal(sent_frame(BUS_DEST, 1)->data[2], 0x55);
+
+  assert_route_stats(0, 2, 2, 1, 0);
+}
+
+ZTEST(lib_can_router, test_action_rate_limit) {
+  zassert_ok(
+      can_router_replace(rate_limit_routes, ARRAY_SIZE(rate_limit_routes)));
+
+  // The burst passes, then one frame per interval
+  for (int i = 0; i < 3; i++) {
+    receive_id(0x100, 0);
+  }
+  zassert_equal(sent_count(BUS_DEST), 2);
+
+  k_msleep(12);
+  receive_id(0x100, 0);
+  receive_id(0x100, 0);
+  zassert_equal(sent_count(BUS_DEST), 3);
+
+  // Tokens are not saved up beyond the burst
+  k_msleep(50);
+  for (int i = 0; i < 3; i++) {
+    receive_id(0x100, 0);
+  }
+  zassert_equal(sent_count(BUS_DEST), 5);
+
+  assert_route_stats(0, 8, 5, 0, 3);
+}
+
+#ifdef CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+ZTEST(lib_can_router, test_action_rate_limit_below_a_tick) {
+  BUILD_ASSERT(250 < USEC_PER_SEC / CONFIG_SYS_CLOCK_TICKS_PER_SEC);
+
+  zassert_ok(
+      can_router_replace(rate_limit_routes, ARRAY_SIZE(rate_limit_routes)));
+
+  receive_id(0x200, 0);
+  receive_id(0x200, 0);
+  zassert_equal(sent_count(BUS_DEST), 1);
+
+  // A frame every 300 us is below the rate, even within a single tick
+  for (int i = 0; i < 3; i++) {
+    k_busy_wait(300);
+    receive_id(0x200, 0);
+  }
+  zassert_equal(sent_count(BUS_DEST), 4);
+
+  assert_route_stats(1, 5, 4, 0, 1);
+}
+#endif  // CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+
+ZTEST(lib_can_router, test_action_fan_out) {
+  zassert_ok(can_router_replace(fan_out_routes, ARRAY_SIZE(fan_out_routes)));
+
+  receive_id(0x100, 0);
+  receive_id(0x200, 0);
+
+  // The translated frame goes to both destinations
+  zassert_equal(sent_count(BUS_DEST), 2);
+  zassert_equal(sent_frame(BUS_DEST, 0)->id, 0x101);
+  zassert_equal(sent_frame(BUS_DEST, 1)->id, 0x200);
+  zassert_equal(sent_count(BUS_FAN_OUT), 1);
+  zassert_equal(sent_frame(BUS_FAN_OUT, 0)->id, 0x101);
+
+  // Routed counts frames, not destinations
+  assert_route_stats(0, 1, 1, 1, 0);
+  assert_route_stats(1, 1, 1, 0, 0);
+
+  // Only installed routes have statistics
+  struct can_router_route_stats stats;
+  zassert_equal(can_router_get_route_stats(2, &stats), -ENOENT);
+  zassert_equal(can_router_get_route_stats(-1, &stats), -ENOENT);
+}
@@ -0,0 +1,220 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "router.h"
+
+#include <string.h>
+
+#include <zephyr/drivers/can/can_fake.h>
+#include <zephyr/fff.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+DEFINE_FFF_GLOBALS;
+
+#define MAX_RX_FILTERS 16
+#define MAX_SENT_FRAMES 32
+
+const struct device *buses[BUS_COUNT] = {
+  DEVICE_DT_GET(DT_NODELABEL(can_fake0)),
+  DEVICE_DT_GET(DT_NODELABEL(can_fake1)),
+  DEVICE_DT_GET(DT_NODELABEL(can_fake2)),
+  DEVICE_DT_GET(DT_NODELABEL(can_fake3)),
+};
+
+// RX filters installed in the fake drivers
+static struct {
+  bool installed;
+  const struct device *dev;
+  can_rx_callback_t callback;
+  void *user_data;
+  struct can_filter filter;
+} rx_filters[MAX_RX_FILTERS];
+
+// Number of RX filters the fake drivers accept
+static int rx_filter_limit;
+
+static K_SEM_DEFINE(tx_unblocked, 0, 1);
+
+static struct {
+  enum tx_mode mode;
+  struct can_frame frames[MAX_SENT_FRAMES];
+  size_t count;
+  // Completion of the frame in the mailbox in TX_HOLD mode
+  can_tx_callback_t held_callback;
+  void *held_user_data;
+} tx[BUS_COUNT];
+
+static enum bus bus_of(const struct device *dev) {
+  for (int i = 0; i < BUS_COUNT; i++) {
+    if (buses[i] == dev) {
+      return i;
+    }
+  }
+
+  zassert_unreachable("Unknown CAN device %s", dev->name);
+  return BUS_COUNT;
+}
+
+static int add_rx_filter_fake(const struct device *dev,
+                              can_rx_callback_t callback,
+                              void *user_data,
+                              const struct can_filter *filter) {
+  if (installed_filters() >= rx_filter_limit) {
+    return -ENOSPC;
+  }
+
+  for (int i = 0; i < MAX_RX_FILTERS; i++) {
+    if (!rx_filters[i].installed) {
+      rx_filters[i].installed = true;
+      rx_filters[i].dev = dev;
+      rx_filters[i].callback = callback;
+      rx_filters[i].user_data = user_data;
+      rx_filters[i].filter = *filter;
+      return i;
+    }
+  }
+
+  return -ENOSPC;
+}
+
+static void remove_rx_filter_fake(const struct device *dev, int filter_id) {
+  zassert_true(rx_filters[filter_id].installed);
+  zassert_equal(rx_filters[filter_id].dev, dev);
+  rx_filters[filter_id].installed = false;
+}
+
+static int send_fake(const struct device *dev,
+                     const struct can_frame *frame,
+                     k_timeout_t timeout,
+                     can_tx_callback_t callback,
+                     void *user_data) {
+  const enum bus bus = bus_of(dev);
+
+  if (tx[bus].mode == TX_BUSY) {
+    return -EAGAIN;
+  }
+
+  zassert_is_null(tx[bus].held_callback, "Two frames in flight on bus %d",
+                  bus);
+  zassert_true(tx[bus].count < MAX_SENT_FRAMES);
+  tx[bus].frames[tx[bus].count++] = *frame;
+
+  if (tx[bus].mode == TX_HOLD) {
+    tx[bus].held_callback = callback;
+    tx[bus].held_user_data = user_data;
+    return 0;
+  }
+
+  if (tx[bus].mode == TX_BLOCK) {
+    k_sem_take(&tx_unblocked, K_FOREVER);
+  }
+  callback(dev, 0, user_data);
+
+  return 0;
+}
+
+void set_tx_mode(enum bus bus, enum tx_mode mode) {
+  tx[bus].mode = mode;
+}
+
+void complete_tx(enum bus bus, int error) {
+  can_tx_callback_t callback = tx[bus].held_callback;
+
+  zassert_not_null(callback, "No frame in flight on bus %d", bus);
+  tx[bus].held_callback = NULL;
+  callback(buses[bus], error, tx[bus].held_user_data);
+}
+
+void unblock_tx(void) {
+  k_sem_give(&tx_unblocked);
+}
+
+void set_rx_filter_limit(int limit) {
+  rx_filter_limit = limit;
+}
+
+void receive_frame(const struct can_frame *frame) {
+  // The callbacks get a copy, like from the driver's RX buffer
+  for (int i = 0; i < MAX_RX_FILTERS; i++) {
+    struct can_frame rx_frame = *frame;
+
+    if (rx_filters[i].installed && rx_filters[i].dev == buses[BUS_SOURCE] &&
+        can_frame_matches_filter(&rx_frame, &rx_filters[i].filter)) {
+      rx_filters[i].callback(rx_filters[i].dev, &rx_frame,
+                             rx_filters[i].user_data);
+    }
+  }
+}
+
+void receive_id(uint32_t id, uint8_t flags) {
+  struct can_frame frame = {
+    .id = id,
+    .flags = flags,
+    .dlc = 1,
+    .data = {(uint8_t)id},
+  };
+
+  receive_frame(&frame);
+}
+
+size_t sent_count(enum bus bus) {
+  return tx[bus].count;
+}
+
+const struct can_frame *sent_frame(enum bus bus, size_t index) {
+  zassert_true(index < tx[bus].count, "Only %zu frames sent on bus %d",
+               tx[bus].count, bus);
+  return &tx[bus].frames[index];
+}
+
+int installed_filters(void) {
+  int count = 0;
+  for (int i = 0; i < MAX_RX_FILTERS; i++) {
+    // Filters of other users of the fake driver, like UDS, are left out
+    for (int j = 0; j < BUS_COUNT; j++) {
+      count += rx_filters[i].installed && rx_filters[i].dev == buses[j];
+    }
+  }
+  return count;
+}
+
+static void before(void *fixture) {
+  ARG_UNUSED(fixture);
+
+  RESET_FAKE(fake_can_add_rx_filter);
+  RESET_FAKE(fake_can_remove_rx_filter);
+  RESET_FAKE(fake_can_send);
+  fake_can_add_rx_filter_fake.custom_fake = add_rx_filter_fake;
+  fake_can_remove_rx_filter_fake.custom_fake = remove_rx_filter_fake;
+  fake_can_send_fake.custom_fake = send_fake;
+  rx_filter_limit = MAX_RX_FILTERS;
+
+  for (int i = 0; i < BUS_COUNT; i++) {
+    tx[i].mode = TX_COMPLETE;
+    tx[i].count = 0;
+  }
+}
+
+static void after(void *fixture) {
+  ARG_UNUSED(fixture);
+
+  zassert_ok(can_router_replace(NULL, 0));
+  zassert_equal(installed_filters(), 0);
+
+  // Sends the frames left in the queues, so the next test starts with empty
+  // ones
+  for (int i = 0; i < BUS_COUNT; i++) {
+    tx[i].mode = TX_COMPLETE;
+    if (tx[i].held_callback != NULL) {
+      complete_tx(i, 0);
+    }
+  }
+  k_sleep(K_TICKS(2));
+}
+
+ZTEST_SUITE(lib_can_router, NULL, NULL, before, after, NULL);
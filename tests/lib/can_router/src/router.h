@@ -0,0 +1,80 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_TESTS_LIB_CAN_ROUTER_SRC_ROUTER_H_
+#define APP_TESTS_LIB_CAN_ROUTER_SRC_ROUTER_H_
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+
+#include <ardep/can_router.h>
+
+/*
+ * Fake CAN buses. Frames are only received on BUS_SOURCE. BUS_STATS is the
+ * destination of the statistics test only, so its statistics start at 0.
+ */
+enum bus {
+  BUS_SOURCE,
+  BUS_DEST,
+  BUS_FAN_OUT,
+  BUS_STATS,
+  BUS_COUNT,
+};
+
+extern const struct device *buses[BUS_COUNT];
+
+/**
+ * How the fake driver of a bus handles frames handed to it
+ */
+enum tx_mode {
+  /** Sent right away, the completion callback is called from can_send() */
+  TX_COMPLETE,
+  /** Sent, but completed only by complete_tx() */
+  TX_HOLD,
+  /** Rejected with -EAGAIN, like with all mailboxes busy */
+  TX_BUSY,
+  /** can_send() waits for unblock_tx(), must be called from a thread */
+  TX_BLOCK,
+};
+
+void set_tx_mode(enum bus bus, enum tx_mode mode);
+
+/**
+ * Complete the frame held in the mailbox of @p bus with @p error
+ */
+void complete_tx(enum bus bus, int error);
+
+/**
+ * Let a can_send() waiting in TX_BLOCK mode return
+ */
+void unblock_tx(void);
+
+/**
+ * Make the fake drivers reject RX filters once @p limit of them are installed
+ */
+void set_rx_filter_limit(int limit);
+
+/**
+ * Pass a frame to the RX filters of BUS_SOURCE it matches, like the driver
+ */
+void receive_frame(const struct can_frame *frame);
+
+void receive_id(uint32_t id, uint8_t flags);
+
+/**
+ * Number of frames the fake driver of @p bus accepted since the test started
+ */
+size_t sent_count(enum bus bus);
+
+const struct can_frame *sent_frame(enum bus bus, size_t index);
+
+/**
+ * Number of RX filters the router installed
+ */
+int installed_filters(void);
+
+#endif  // APP_TESTS_LIB_CAN_ROUTER_SRC_ROUTER_H_
@@ -0,0 +1,302 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "router.h"
+
+#include <limits.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#define TRAFFIC_FRAMES 24
+#define THREAD_STACK_SIZE 2048
+
+static int broken_can_init(const struct device *dev) {
+  ARG_UNUSED(dev);
+  return -EIO;
+}
+
+// A device whose initialization failed, so it is not ready
+DEVICE_DEFINE(broken_can,
+              "broken_can",
+              broken_can_init,
+              NULL,
+              NULL,
+              NULL,
+              POST_KERNEL,
+              CONFIG_KERNEL_INIT_PRIORITY_DEVICE,
+              NULL);
+
+static const struct device *broken_bus = DEVICE_GET(broken_can);
+
+K_THREAD_STACK_DEFINE(receiver_stack, THREAD_STACK_SIZE);
+K_THREAD_STACK_DEFINE(replacer_stack, THREAD_STACK_SIZE);
+static struct k_thread receiver_thread;
+static struct k_thread replacer_thread;
+
+static const struct can_router_entry_t table_a[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0, .mask = 0, .flags = 0},
+  },
+};
+
+static const struct can_router_entry_t table_b[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_FAN_OUT],
+    .filter = {.id = 0, .mask = 0, .flags = 0},
+  },
+};
+
+static const struct can_router_entry_t table_exact_id[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0x100, .mask = CAN_STD_ID_MASK, .flags = 0},
+  },
+};
+
+// None of them is covered by the filter of table_exact_id, so each one needs
+// a hardware filter of its own
+static const struct can_router_entry_t table_exact_ids[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_FAN_OUT],
+    .filter = {.id = 0x200, .mask = CAN_STD_ID_MASK, .flags = 0},
+  },
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_FAN_OUT],
+    .filter = {.id = 0x300, .mask = CAN_STD_ID_MASK, .flags = 0},
+  },
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_FAN_OUT],
+    .filter = {.id = 0x400, .mask = CAN_STD_ID_MASK, .flags = 0},
+  },
+};
+
+static void start_thread(struct k_thread *thread,
+                         k_thread_stack_t *stack,
+                         k_thread_entry_t entry) {
+  k_thread_create(thread, stack, THREAD_STACK_SIZE, entry, NULL, NULL, NULL,
+                  k_thread_priority_get(k_current_get()), 0, K_NO_WAIT);
+}
+
+ZTEST(lib_can_router, test_table_validation_failures) {
+  static const struct can_router_entry_t missing_device[] = {
+    {.from = NULL, .to = &buses[BUS_DEST]},
+  };
+  static const struct can_router_entry_t not_ready[] = {
+    {.from = &buses[BUS_SOURCE], .to = &broken_bus},
+  };
+
+  static const struct can_router_action_t missing_transforms = {
+    .transform_count = 1,
+  };
+  static const struct can_router_action_t missing_fan_out = {
+    .fan_out_count = 1,
+  };
+  static const struct device **const fan_out_not_ready_buses[] = {
+    &broken_bus,
+  };
+  static const struct can_router_action_t fan_out_not_ready = {
+    .fan_out = fan_out_not_ready_buses,
+    .fan_out_count = ARRAY_SIZE(fan_out_not_ready_buses),
+  };
+  static const struct device **const fan_out_buses[] = {
+    &buses[BUS_FAN_OUT],
+    &buses[BUS_STATS],
+    &buses[BUS_FAN_OUT],
+  };
+  BUILD_ASSERT(ARRAY_SIZE(fan_out_buses) > CONFIG_CAN_ROUTER_MAX_FAN_OUT);
+  static const struct can_router_action_t too_many_fan_out = {
+    .fan_out = fan_out_buses,
+    .fan_out_count = ARRAY_SIZE(fan_out_buses),
+  };
+  static const struct can_router_entry_t bad_actions[] = {
+    {.from = &buses[BUS_SOURCE],
+     .to = &buses[BUS_DEST],
+     .action = &missing_transforms},
+    {.from = &buses[BUS_SOURCE],
+     .to = &buses[BUS_DEST],
+     .action = &missing_fan_out},
+    {.from = &buses[BUS_SOURCE],
+     .to = &buses[BUS_DEST],
+     .action = &fan_out_not_ready},
+    {.from = &buses[BUS_SOURCE],
+     .to = &buses[BUS_DEST],
+     .action = &too_many_fan_out},
+  };
+
+  // One destination more than there are queues
+  static const struct can_router_entry_t too_many_destinations[] = {
+    {.from = &buses[BUS_SOURCE], .to = &buses[BUS_DEST]},
+    {.from = &buses[BUS_SOURCE], .to = &buses[BUS_FAN_OUT]},
+    {.from = &buses[BUS_SOURCE], .to = &buses[BUS_STATS]},
+    {.from = &buses[BUS_SOURCE], .to = &buses[BUS_SOURCE]},
+  };
+  BUILD_ASSERT(ARRAY_SIZE(too_many_destinations) >
+               CONFIG_CAN_ROUTER_MAX_DESTINATIONS);
+
+  static struct can_router_entry_t too_many_routes
+      [CONFIG_CAN_ROUTER_MAX_ROUTES + 1];
+  for (size_t i = 0; i < ARRAY_SIZE(too_many_routes); i++) {
+    too_many_routes[i] = table_a[0];
+  }
+
+  zassert_ok(can_router_replace(table_a, ARRAY_SIZE(table_a)));
+
+  zassert_equal(can_router_validate(NULL, 1), -EINVAL);
+  zassert_equal(can_router_validate(table_a, -1), -EINVAL);
+  zassert_equal(can_router_validate(missing_device, 1), -EINVAL);
+  zassert_equal(can_router_validate(not_ready, 1), -ENODEV);
+  zassert_equal(can_router_validate(&bad_actions[0], 1), -EINVAL);
+  zassert_equal(can_router_validate(&bad_actions[1], 1), -EINVAL);
+  zassert_equal(can_router_validate(&bad_actions[2], 1), -ENODEV);
+  zassert_equal(can_router_validate(&bad_actions[3], 1), -ENOMEM);
+  zassert_equal(can_router_validate(too_many_destinations,
+                                    ARRAY_SIZE(too_many_destinations)),
+                -ENOMEM);
+  zassert_equal(can_router_validate(too_many_routes,
+                                    ARRAY_SIZE(too_many_routes)),
+                -ENOMEM);
+  zassert_ok(can_router_validate(too_many_routes,
+                                 ARRAY_SIZE(too_many_routes) - 1));
+
+  // Invalid tables are neither installed nor registered on top
+  zassert_equal(can_router_replace(not_ready, 1), -ENODEV);
+  zassert_equal(can_router_replace(too_many_destinations,
+                                   ARRAY_SIZE(too_many_destinations)),
+                -ENOMEM);
+  zassert_equal(can_router_register(too_many_routes,
+                                    ARRAY_SIZE(too_many_routes) - 1),
+                -ENOMEM);
+  zassert_equal(installed_filters(), 1);
+
+  receive_id(0x100, 0);
+  zassert_equal(sent_count(BUS_DEST), 1);
+  zassert_equal(sent_count(BUS_SOURCE), 0);
+}
+
+static void traffic(void *p1, void *p2, void *p3) {
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  for (uint32_t i = 0; i < TRAFFIC_FRAMES; i++) {
+    receive_id(0x100 + i, 0);
+    k_yield();
+  }
+}
+
+ZTEST(lib_can_router, test_table_swap_under_traffic) {
+  zassert_ok(can_router_replace(table_a, ARRAY_SIZE(table_a)));
+
+  start_thread(&receiver_thread, receiver_stack, traffic);
+  for (int i = 0; i < TRAFFIC_FRAMES; i++) {
+    zassert_ok(can_router_replace(i % 2 == 0 ? table_b : table_a, 1));
+    k_yield();
+  }
+  zassert_ok(k_thread_join(&receiver_thread, K_SECONDS(1)));
+
+  // Every frame was routed by exactly one of the tables
+  zassert_equal(sent_count(BUS_DEST) + sent_count(BUS_FAN_OUT),
+                TRAFFIC_FRAMES);
+  zassert_true(sent_count(BUS_DEST) > 0);
+  zassert_true(sent_count(BUS_FAN_OUT) > 0);
+
+  bool routed[TRAFFIC_FRAMES] = {false};
+  const enum bus destinations[] = {BUS_DEST, BUS_FAN_OUT};
+  for (size_t i = 0; i < ARRAY_SIZE(destinations); i++) {
+    for (size_t j = 0; j < sent_count(destinations[i]); j++) {
+      const uint32_t frame = sent_frame(destinations[i], j)->id - 0x100;
+      zassert_true(frame < TRAFFIC_FRAMES);
+      zassert_false(routed[frame], "Frame %u routed twice", frame);
+      routed[frame] = true;
+    }
+  }
+}
+
+static int replace_result;
+static atomic_t replace_done;
+
+static void blocked_receiver(void *p1, void *p2, void *p3) {
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  receive_id(0x100, 0);
+}
+
+static void replacer(void *p1, void *p2, void *p3) {
+  ARG_UNUSED(p1);
+  ARG_UNUSED(p2);
+  ARG_UNUSED(p3);
+
+  replace_result = can_router_replace(table_b, ARRAY_SIZE(table_b));
+  atomic_set(&replace_done, 1);
+}
+
+ZTEST(lib_can_router, test_table_replace_waits_for_routed_frame) {
+  zassert_ok(can_router_replace(table_a, ARRAY_SIZE(table_a)));
+  atomic_set(&replace_done, 0);
+
+  // The frame is routed by table_a until can_send() returns
+  set_tx_mode(BUS_DEST, TX_BLOCK);
+  start_thread(&receiver_thread, receiver_stack, blocked_receiver);
+  k_msleep(1);
+  zassert_equal(sent_count(BUS_DEST), 1);
+
+  start_thread(&replacer_thread, replacer_stack, replacer);
+  k_msleep(10);
+  zassert_false(atomic_get(&replace_done));
+
+  // table_b is active already
+  receive_id(0x101, 0);
+  zassert_equal(sent_count(BUS_FAN_OUT), 1);
+
+  unblock_tx();
+  zassert_ok(k_thread_join(&replacer_thread, K_SECONDS(1)));
+  zassert_ok(k_thread_join(&receiver_thread, K_SECONDS(1)));
+  zassert_true(atomic_get(&replace_done));
+  zassert_ok(replace_result);
+}
+
+ZTEST(lib_can_router, test_table_rollback_when_filter_fails) {
+  zassert_ok(can_router_replace(table_exact_id, ARRAY_SIZE(table_exact_id)));
+  zassert_equal(installed_filters(), 1);
+
+  // The second filter of the new table can not be installed
+  set_rx_filter_limit(2);
+  zassert_equal(
+      can_router_replace(table_exact_ids, ARRAY_SIZE(table_exact_ids)),
+      -ENOSPC);
+  zassert_equal(installed_filters(), 1);
+
+  receive_id(0x100, 0);
+  receive_id(0x200, 0);
+  zassert_equal(sent_count(BUS_DEST), 1);
+  zassert_equal(sent_count(BUS_FAN_OUT), 0);
+
+  struct can_router_route_stats stats;
+  zassert_ok(can_router_get_route_stats(0, &stats));
+  zassert_equal(stats.matched, 1);
+  zassert_equal(can_router_get_route_stats(1, &stats), -ENOENT);
+
+  // Both tables can be used again
+  set_rx_filter_limit(INT_MAX);
+  zassert_ok(can_router_replace(table_exact_ids, ARRAY_SIZE(table_exact_ids)));
+  zassert_equal(installed_filters(), 3);
+
+  receive_id(0x100, 0);
+  receive_id(0x200, 0);
+  zassert_equal(sent_count(BUS_DEST), 1);
+  zassert_equal(sent_count(BUS_FAN_OUT), 1);
+}
@@ -0,0 +1,188 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "router.h"
+
+#include <zephyr/drivers/can/can_fake.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+// The expected frames below are for queues of 4 frames
+BUILD_ASSERT(CONFIG_CAN_ROUTER_TX_QUEUE_SIZE == 4);
+
+// Routes all standard and extended frames to BUS_DEST
+static const struct can_router_entry_t dest_routes[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0, .mask = 0, .flags = 0},
+  },
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_DEST],
+    .filter = {.id = 0, .mask = 0, .flags = CAN_FILTER_IDE},
+  },
+};
+
+static const struct can_router_entry_t stats_route[] = {
+  {
+    .from = &buses[BUS_SOURCE],
+    .to = &buses[BUS_STATS],
+    .filter = {.id = 0, .mask = 0, .flags = 0},
+  },
+};
+
+static void assert_sent_ids(enum bus bus, const uint32_t *ids, size_t count) {
+  zassert_equal(sent_count(bus), count, "Sent %zu frames instead of %zu",
+                sent_count(bus), count);
+  for (size_t i = 0; i < count; i++) {
+    zassert_equal(sent_frame(bus, i)->id, ids[i],
+                  "Frame %zu is %x instead of %x", i, sent_frame(bus, i)->id,
+                  ids[i]);
+  }
+}
+
+static uint32_t dest_dropped(void) {
+  struct can_router_stats stats;
+  zassert_ok(can_router_get_stats(buses[BUS_DEST], &stats));
+  return stats.dropped;
+}
+
+ZTEST(lib_can_router, test_tx_queue_keeps_order_while_mailboxes_busy) {
+  zassert_ok(can_router_replace(dest_routes, ARRAY_SIZE(dest_routes)));
+
+  set_tx_mode(BUS_DEST, TX_BUSY);
+  receive_id(0x101, 0);
+  receive_id(0x102, 0);
+  receive_id(0x103, 0);
+  zassert_true(fake_can_send_fake.call_count >= 3);
+  zassert_equal(sent_count(BUS_DEST), 0);
+
+  // The mailboxes are free again, the frames are sent on the next tick
+  set_tx_mode(BUS_DEST, TX_COMPLETE);
+  zassert_equal(sent_count(BUS_DEST), 0);
+  k_sleep(K_TICKS(2));
+
+  const uint32_t expected[] = {0x101, 0x102, 0x103};
+  assert_sent_ids(BUS_DEST, expected, ARRAY_SIZE(expected));
+}
+
+#ifdef CONFIG_CAN_ROUTER_OVERFLOW_DROP_OLDEST
+ZTEST(lib_can_router, test_tx_queue_overflow_drops_oldest) {
+  zassert_ok(can_router_replace(dest_routes, ARRAY_SIZE(dest_routes)));
+  const uint32_t dropped = dest_dropped();
+
+  // 0x100 is in flight, 0x101 to 0x104 fill the queue
+  set_tx_mode(BUS_DEST, TX_HOLD);
+  for (uint32_t id = 0x100; id <= 0x105; id++) {
+    receive_id(id, 0);
+  }
+  zassert_equal(dest_dropped(), dropped + 1);
+
+  set_tx_mode(BUS_DEST, TX_COMPLETE);
+  complete_tx(BUS_DEST, 0);
+
+  const uint32_t expected[] = {0x100, 0x102, 0x103, 0x104, 0x105};
+  assert_sent_ids(BUS_DEST, expected, ARRAY_SIZE(expected));
+}
+#endif  // CONFIG_CAN_ROUTER_OVERFLOW_DROP_OLDEST
+
+#ifdef CONFIG_CAN_ROUTER_OVERFLOW_DROP_NEWEST
+ZTEST(lib_can_router, test_tx_queue_overflow_drops_newest) {
+  zassert_ok(can_router_replace(dest_routes, ARRAY_SIZE(dest_routes)));
+  const uint32_t dropped = dest_dropped();
+
+  // 0x100 is in flight, 0x101 to 0x104 fill the queue
+  set_tx_mode(BUS_DEST, TX_HOLD);
+  for (uint32_t id = 0x100; id <= 0x105; id++) {
+    receive_id(id, 0);
+  }
+  zassert_equal(dest_dropped(), dropped + 1);
+
+  set_tx_mode(BUS_DEST, TX_COMPLETE);
+  complete_tx(BUS_DEST, 0);
+
+  const uint32_t expected[] = {0x100, 0x101, 0x102, 0x103, 0x104};
+  assert_sent_ids(BUS_DEST, expected, ARRAY_SIZE(expected));
+}
+#endif  // CONFIG_CAN_ROUTER_OVERFLOW_DROP_NEWEST
+
+#ifdef CONFIG_CAN_ROUTER_OVERFLOW_PRIORITY
+ZTEST(lib_can_router, test_tx_queue_overflow_drops_lowest_priority) {
+  zassert_ok(can_router_replace(dest_routes, ARRAY_SIZE(dest_routes)));
+  const uint32_t dropped = dest_dropped();
+
+  set_tx_mode(BUS_DEST, TX_HOLD);
+  receive_id(0x050, 0);
+
+  // The extended frame loses against the standard one with the same base ID
+  receive_id(0x100 << 18, CAN_FRAME_IDE);
+  receive_id(0x100, 0);
+  receive_id(0x080, 0);
+  receive_id(0x090, 0);
+  receive_id(0x0A0, 0);
+
+  // Loses against all queued frames
+  receive_id(0x7FF, 0);
+
+  // Wins against 0x100 by its base ID
+  receive_id((0x010 << 18) | 0x3FFFF, CAN_FRAME_IDE);
+
+  zassert_equal(dest_dropped(), dropped + 3);
+
+  set_tx_mode(BUS_DEST, TX_COMPLETE);
+  complete_tx(BUS_DEST, 0);
+
+  const uint32_t expected[] = {
+    0x050, 0x080, 0x090, 0x0A0, (0x010 << 18) | 0x3FFFF,
+  };
+  assert_sent_ids(BUS_DEST, expected, ARRAY_SIZE(expected));
+  zassert_true((sent_frame(BUS_DEST, 4)->flags & CAN_FRAME_IDE) != 0);
+}
+#endif  // CONFIG_CAN_ROUTER_OVERFLOW_PRIORITY
+
+ZTEST(lib_can_router, test_tx_queue_stats) {
+  struct can_router_stats stats;
+
+  // Nothing is routed to the source
+  zassert_equal(can_router_get_stats(buses[BUS_SOURCE], &stats), -ENOENT);
+
+  zassert_ok(can_router_replace(stats_route, ARRAY_SIZE(stats_route)));
+
+  set_tx_mode(BUS_STATS, TX_HOLD);
+  receive_id(0x100, 0);
+  receive_id(0x101, 0);
+  receive_id(0x102, 0);
+  k_msleep(20);
+
+  complete_tx(BUS_STATS, 0);
+  complete_tx(BUS_STATS, -EIO);
+  complete_tx(BUS_STATS, 0);
+
+  zassert_ok(can_router_get_stats(buses[BUS_STATS], &stats));
+  zassert_equal(stats.sent, 2);
+  zassert_equal(stats.errors, 1);
+  zassert_equal(stats.dropped, 0);
+  zassert_equal(stats.high_water, 2);
+  zassert_true(stats.latency_max_us >= 20000);
+  zassert_true(stats.latency_avg_us >= 20000);
+
+  // One in flight, a full queue and one more
+  for (uint32_t id = 0x103; id <= 0x108; id++) {
+    receive_id(id, 0);
+  }
+  set_tx_mode(BUS_STATS, TX_COMPLETE);
+  complete_tx(BUS_STATS, 0);
+
+  zassert_ok(can_router_get_stats(buses[BUS_STATS], &stats));
+  zassert_equal(stats.sent, 7);
+  zassert_equal(stats.errors, 1);
+  zassert_equal(stats.dropped, 1);
+  zassert_equal(stats.high_water, CONFIG_CAN_ROUTER_TX_QUEUE_SIZE);
+  zassert_true(stats.latency_max_us >= 20000);
+  zassert_true(stats.latency_avg_us < stats.latency_max_us);
+}
@@ -0,0 +1,132 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "router.h"
+
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/ztest.h>
+
+#ifdef CONFIG_CAN_ROUTER_UDS
+
+#include <ardep/uds.h>
+#include <iso14229.h>
+
+#define RECORD_SIZE 11
+
+static UDSErr_t write_route_table(const uint8_t *data, uint16_t len) {
+  struct iso14229_zephyr_instance *iso14229 = &uds_default_instance.iso14229;
+  UDSWDBIArgs_t args = {
+    .dataId = CAN_ROUTER_UDS_ROUTE_TABLE_DATA_ID,
+    .data = data,
+    .len = len,
+  };
+
+  return iso14229->event_callback(iso14229, UDS_EVT_WriteDataByIdentifier,
+                                  &args, &uds_default_instance);
+}
+
+static void set_session(uint8_t session) {
+  uds_default_instance.iso14229.server.sessionType = session;
+}
+
+// Bus indices match the can-router-bus<N> aliases of the overlay
+static void put_record(uint8_t *record,
+                       uint8_t from,
+                       uint8_t to,
+                       uint8_t flags,
+                       uint32_t id,
+                       uint32_t mask) {
+  record[0] = from;
+  record[1] = to;
+  record[2] = flags;
+  sys_put_be32(id, &record[3]);
+  sys_put_be32(mask, &record[7]);
+}
+
+ZTEST(lib_can_router, test_uds_route_table_records) {
+  uint8_t table[2 * RECORD_SIZE];
+  put_record(&table[0], BUS_SOURCE, BUS_DEST, 0, 0x100, CAN_STD_ID_MASK);
+  put_record(&table[RECORD_SIZE], BUS_SOURCE, BUS_FAN_OUT, CAN_FILTER_IDE,
+             0x12345, CAN_EXT_ID_MASK);
+
+  set_session(UDS_DIAG_SESSION__EXTENDED);
+  zassert_equal(write_route_table(table, sizeof(table)),
+                UDS_PositiveResponse);
+  zassert_equal(installed_filters(), 2);
+
+  receive_id(0x100, 0);
+  receive_id(0x101, 0);
+  receive_id(0x12345, CAN_FRAME_IDE);
+  receive_id(0x100, CAN_FRAME_IDE);
+
+  zassert_equal(sent_count(BUS_DEST), 1);
+  zassert_equal(sent_frame(BUS_DEST, 0)->id, 0x100);
+  zassert_false(sent_frame(BUS_DEST, 0)->flags & CAN_FRAME_IDE);
+  zassert_equal(sent_count(BUS_FAN_OUT), 1);
+  zassert_equal(sent_frame(BUS_FAN_OUT, 0)->id, 0x12345);
+  zassert_true(sent_frame(BUS_FAN_OUT, 0)->flags & CAN_FRAME_IDE);
+
+  // The routes are numbered by their record
+  struct can_router_route_stats stats;
+  zassert_ok(can_router_get_route_stats(1, &stats));
+  zassert_equal(stats.matched, 1);
+  zassert_equal(stats.routed, 1);
+  zassert_equal(can_router_get_route_stats(2, &stats), -ENOENT);
+
+  set_session(UDS_DIAG_SESSION__DEFAULT);
+}
+
+ZTEST(lib_can_router, test_uds_route_table_rejected) {
+  uint8_t table[RECORD_SIZE];
+  put_record(table, BUS_SOURCE, BUS_DEST, 0, 0x100, CAN_STD_ID_MASK);
+
+  // Not in the default session
+  set_session(UDS_DIAG_SESSION__DEFAULT);
+  zassert_equal(write_route_table(table, sizeof(table)),
+                UDS_NRC_ConditionsNotCorrect);
+  zassert_equal(installed_filters(), 0);
+
+  set_session(UDS_DIAG_SESSION__EXTENDED);
+  zassert_equal(write_route_table(table, sizeof(table)),
+                UDS_PositiveResponse);
+
+  // Not a whole number of records
+  zassert_equal(write_route_table(table, sizeof(table) - 1),
+                UDS_NRC_IncorrectMessageLengthOrInvalidFormat);
+
+  // Buses without an alias
+  uint8_t unknown_bus[RECORD_SIZE];
+  put_record(unknown_bus, BUS_SOURCE, 5, 0, 0x200, CAN_STD_ID_MASK);
+  zassert_equal(write_route_table(unknown_bus, sizeof(unknown_bus)),
+                UDS_NRC_RequestOutOfRange);
+  put_record(unknown_bus, 0xFF, BUS_DEST, 0, 0x200, CAN_STD_ID_MASK);
+  zassert_equal(write_route_table(unknown_bus, sizeof(unknown_bus)),
+                UDS_NRC_RequestOutOfRange);
+
+  // More routes than the router takes
+  static uint8_t too_many[(CONFIG_CAN_ROUTER_MAX_ROUTES + 1) * RECORD_SIZE];
+  for (size_t i = 0; i < CONFIG_CAN_ROUTER_MAX_ROUTES + 1; i++) {
+    put_record(&too_many[i * RECORD_SIZE], BUS_SOURCE, BUS_FAN_OUT, 0,
+               0x200 + i, CAN_STD_ID_MASK);
+  }
+  zassert_equal(write_route_table(too_many, sizeof(too_many)),
+                UDS_NRC_RequestOutOfRange);
+
+  // The table written first is still installed
+  zassert_equal(installed_filters(), 1);
+  receive_id(0x100, 0);
+  zassert_equal(sent_count(BUS_DEST), 1);
+  zassert_equal(sent_count(BUS_FAN_OUT), 0);
+
+  // An empty table removes all routes
+  zassert_equal(write_route_table(NULL, 0), UDS_PositiveResponse);
+  zassert_equal(installed_filters(), 0);
+
+  set_session(UDS_DIAG_SESSION__DEFAULT);
+}
+
+#endif  // CONFIG_CAN_ROUTER_UDS
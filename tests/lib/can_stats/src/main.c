@@ -0,0 +1,234 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/drivers/can.h>
+#include <zephyr/drivers/can/can_fake.h>
+#include <zephyr/fff.h>
+#include <zephyr/ztest.h>
+
+#include <ardep/can_demux.h>
+#include <ardep/can_stats.h>
+
+DEFINE_FFF_GLOBALS;
+
+#define WINDOW_MS CONFIG_CAN_STATS_WINDOW_MS
+
+static const struct device *can_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_canbus));
+
+// RX filters added by the statistics module, one for standard and one for
+// extended IDs
+static can_rx_callback_t rx_callbacks[2];
+static void *rx_user_data[2];
+static int rx_filter_count;
+
+static enum can_state state;
+static struct can_bus_err_cnt err_cnt;
+
+static struct can_stats_id id_stats[8];
+static size_t id_count;
+
+static int add_rx_filter_fake(const struct device *dev,
+                              can_rx_callback_t callback,
+                              void *user_data,
+                              const struct can_filter *filter) {
+  const int index = (filter->flags & CAN_FILTER_IDE) != 0 ? 1 : 0;
+
+  rx_callbacks[index] = callback;
+  rx_user_data[index] = user_data;
+  return rx_filter_count++;
+}
+
+static int get_state_fake(const struct device *dev,
+                          enum can_state *out_state,
+                          struct can_bus_err_cnt *out_err_cnt) {
+  *out_state = state;
+  *out_err_cnt = err_cnt;
+  return 0;
+}
+
+static void receive(uint32_t id, uint8_t flags, uint8_t dlc) {
+  struct can_frame frame = {
+    .id = id,
+    .flags = flags,
+    .dlc = dlc,
+  };
+
+  const int index = (flags & CAN_FRAME_IDE) != 0 ? 1 : 0;
+  rx_callbacks[index](can_dev, &frame, rx_user_data[index]);
+}
+
+static void collect_id(const struct can_stats_id *stats, void *user_data) {
+  ARG_UNUSED(user_data);
+
+  zassert_true(id_count < ARRAY_SIZE(id_stats));
+  id_stats[id_count++] = *stats;
+}
+
+static const struct can_stats_id *find_id(uint32_t id, bool extended) {
+  id_count = 0;
+  zassert_ok(can_stats_foreach_id(can_dev, collect_id, NULL));
+
+  for (size_t i = 0; i < id_count; i++) {
+    if (id_stats[i].id == id && id_stats[i].extended == extended) {
+      return &id_stats[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void count_rx_cb(const struct device *dev,
+                        struct can_frame *frame,
+                        void *user_data) {
+  int *count = user_data;
+  (*count)++;
+}
+
+static void *setup(void) {
+  fake_can_add_rx_filter_fake.custom_fake = add_rx_filter_fake;
+  fake_can_get_state_fake.custom_fake = get_state_fake;
+
+  zassert_ok(can_stats_enable(can_dev, 500000, 0));
+  zassert_equal(rx_filter_count, 2);
+
+  return NULL;
+}
+
+static void before(void *fixture) {
+  ARG_UNUSED(fixture);
+
+  state = CAN_STATE_ERROR_ACTIVE;
+  err_cnt = (struct can_bus_err_cnt){0};
+  // Let a window sample the error counters
+  k_msleep(WINDOW_MS + WINDOW_MS / 2);
+
+  zassert_ok(can_stats_reset(can_dev));
+}
+
+ZTEST(lib_can_stats, test_frames_are_counted_per_id) {
+  const struct can_frame tx_frame = {
+    .id = 0x200,
+    .dlc = 8,
+  };
+
+  receive(0x100, 0, 8);
+  receive(0x100, 0, 8);
+  receive(0x100, CAN_FRAME_IDE, 8);
+  can_stats_record_tx(can_dev, &tx_frame);
+
+  const struct can_stats_id *stats = find_id(0x100, false);
+  zassert_not_null(stats);
+  zassert_equal(stats->rx_count, 2);
+  zassert_equal(stats->tx_count, 0);
+
+  stats = find_id(0x100, true);
+  zassert_not_null(stats);
+  zassert_equal(stats->rx_count, 1);
+
+  stats = find_id(0x200, false);
+  zassert_not_null(stats);
+  zassert_equal(stats->tx_count, 1);
+
+  struct can_stats_bus bus;
+  zassert_ok(can_stats_get_bus(can_dev, &bus));
+  zassert_equal(bus.rx_frames, 3);
+  zassert_equal(bus.tx_frames, 1);
+}
+
+ZTEST(lib_can_stats, test_interval_is_measured) {
+  for (int i = 0; i < 5; i++) {
+    receive(0x100, 0, 8);
+    k_msleep(10);
+  }
+
+  const struct can_stats_id *stats = find_id(0x100, false);
+  zassert_not_null(stats);
+  // Sleeping can take up to a tick longer
+  zassert_within(stats->interval_avg_us, 10500, 1000);
+  zassert_within(stats->interval_min_us, 10500, 1000);
+  zassert_within(stats->interval_max_us, 10500, 1000);
+}
+
+ZTEST(lib_can_stats, test_bus_load_uses_worst_case_frame_length) {
+  // 135 bits at 500 kbit/s take 270 us, 37 frames about 10 ms
+  for (int i = 0; i < 37; i++) {
+    receive(0x100, 0, 8);
+  }
+
+  k_msleep(2 * WINDOW_MS);
+
+  struct can_stats_bus bus;
+  zassert_ok(can_stats_get_bus(can_dev, &bus));
+  zassert_equal(bus.load_peak_permille, 99);
+  zassert_equal(bus.load_permille, 0);
+}
+
+ZTEST(lib_can_stats, test_full_table_counts_untracked_frames) {
+  // Three quarters of the 8 slots are used
+  for (uint32_t id = 1; id <= 10; id++) {
+    receive(id, 0, 0);
+  }
+
+  struct can_stats_bus bus;
+  zassert_ok(can_stats_get_bus(can_dev, &bus));
+  zassert_equal(bus.rx_frames, 10);
+  zassert_equal(bus.untracked_frames, 4);
+
+  zassert_not_null(find_id(1, false));
+  zassert_equal(id_count, 6);
+}
+
+ZTEST(lib_can_stats, test_error_counters_are_sampled) {
+  state = CAN_STATE_ERROR_PASSIVE;
+  err_cnt.tx_err_cnt = 128;
+  err_cnt.rx_err_cnt = 5;
+  k_msleep(WINDOW_MS + WINDOW_MS / 2);
+
+  struct can_stats_bus bus;
+  zassert_ok(can_stats_get_bus(can_dev, &bus));
+  zassert_equal(bus.state, CAN_STATE_ERROR_PASSIVE);
+  zassert_equal(bus.tx_err_cnt, 128);
+  zassert_equal(bus.tx_err_trend, 128);
+  zassert_equal(bus.rx_err_cnt, 5);
+  zassert_equal(bus.error_passive_count, 1);
+
+  k_msleep(WINDOW_MS);
+
+  zassert_ok(can_stats_get_bus(can_dev, &bus));
+  zassert_equal(bus.tx_err_trend, 0);
+  zassert_equal(bus.error_passive_count, 1);
+}
+
+ZTEST(lib_can_stats, test_unmonitored_device_is_rejected) {
+  struct can_stats_bus bus;
+
+  zassert_equal(can_stats_get_bus(NULL, &bus), -ENOENT);
+  zassert_equal(can_stats_reset(NULL), -ENOENT);
+}
+
+ZTEST(lib_can_stats, test_filters_are_shared_through_demux) {
+  const struct can_filter filter = {
+    .id = 0x123,
+    .mask = CAN_STD_ID_MASK,
+  };
+  int received = 0;
+
+  int filter_id = can_demux_add_rx_filter(can_dev, count_rx_cb, &received,
+                                          &filter);
+  zassert_true(filter_id >= 0);
+
+  // Covered by the filter for all standard IDs, so no hardware filter is
+  // added and neither one hides the frames from the other
+  zassert_equal(rx_filter_count, 2);
+  receive(0x123, 0, 1);
+  zassert_equal(received, 1);
+  zassert_not_null(find_id(0x123, false));
+
+  can_demux_remove_rx_filter(can_dev, filter_id);
+}
+
+ZTEST_SUITE(lib_can_stats, NULL, setup, before, NULL, NULL);
@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fixture.h"
+#include "zephyr/ztest_assert.h"
+
+#include <zephyr/fff.h>
+#include <zephyr/ztest.h>
+
+// Include UDS minimal library headers
+#include <ardep/iso14229.h>
+#include <iso14229.h>
+
+static struct can_frame flow_control_frames[4];
+static uint32_t flow_control_count;
+
+static int can_send_flow_control_fake(const struct device *dev,
+                                      const struct can_frame *frame,
+                                      k_timeout_t timeout,
+                                      can_tx_callback_t callback,
+                                      void *user_data) {
+  if ((frame->data[0] & 0xF0) == 0x30 &&
+      flow_control_count < ARRAY_SIZE(flow_control_frames)) {
+    flow_control_frames[flow_control_count++] = *frame;
+  }
+
+  if (callback) {
+    callback(dev, 0, user_data);
+  }
+
+  return 0;
+}
+
+ZTEST_F(lib_iso14229, test_can_rx_ring_fits_block_size) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  flow_control_count = 0;
+  fake_can_send_fake.custom_fake = can_send_flow_control_fake;
+
+  uint8_t first_frame[] = {
+    0x10,  // PCI_HB (first frame, upper nibble)
+    0xC8,  // PCI_LB (200 bytes of data total)
+    0x2E,  // WDBI   (Write Data by Identifier)
+    0x01,  // DID_HB (Identifier High Byte)
+    0x02,  // DID_LB (Identifier Low Byte)
+    0x00,  // DREC_DATA_1
+    0x00,  // DREC_DATA_2
+    0x00,  // DREC_DATA_3
+  };
+  receive_phys_can_frame_array(fixture, first_frame);
+  tick_thread(instance);
+
+  zassert_equal(flow_control_count, 1);
+  zassert_equal(flow_control_frames[0].data[0], 0x30);
+  uint8_t block_size = flow_control_frames[0].data[1];
+  zassert_equal(block_size, ISO_TP_DEFAULT_BLOCK_SIZE);
+  zassert_true(block_size < CONFIG_ISO14229_PHYS_RX_RING_SIZE);
+
+  // A whole block arrives before the event loop runs again
+  uint8_t consecutive_frame[8] = {0};
+  for (uint8_t i = 0; i < block_size; i++) {
+    consecutive_frame[0] = 0x20 | ((i + 1) & 0x0F);
+    receive_phys_can_frame_array(fixture, consecutive_frame);
+  }
+
+  zassert_equal(instance->can_phys_rx.high_water, block_size);
+  zassert_equal(instance->can_phys_rx.dropped, 0);
+
+  // Processing the block releases all slots and requests the next one
+  tick_thread(instance);
+  zassert_equal(flow_control_count, 2);
+  zassert_equal(flow_control_frames[1].data[0], 0x30);
+  zassert_equal(atomic_get(&instance->can_phys_rx.head),
+                atomic_get(&instance->can_phys_rx.tail));
+}
+
+ZTEST_F(lib_iso14229, test_can_rx_ring_overflow) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  // Consecutive frames without an ongoing reception are ignored by ISO-TP
+  uint8_t consecutive_frame[] = {0x21, 0, 0, 0, 0, 0, 0, 0};
+  for (int i = 0; i < CONFIG_ISO14229_PHYS_RX_RING_SIZE; i++) {
+    receive_phys_can_frame_array(fixture, consecutive_frame);
+  }
+
+  zassert_equal(instance->can_phys_rx.high_water,
+                CONFIG_ISO14229_PHYS_RX_RING_SIZE);
+  zassert_equal(instance->can_phys_rx.dropped, 0);
+
+  receive_phys_can_frame_array(fixture, consecutive_frame);
+  zassert_equal(instance->can_phys_rx.dropped, 1);
+
+  // Draining the ring makes room again, the high water mark is kept
+  tick_thread(instance);
+  receive_phys_can_frame_array(fixture, consecutive_frame);
+  zassert_equal(instance->can_phys_rx.dropped, 1);
+  zassert_equal(instance->can_phys_rx.high_water,
+                CONFIG_ISO14229_PHYS_RX_RING_SIZE);
+  tick_thread(instance);
+}
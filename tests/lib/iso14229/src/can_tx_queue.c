@@ -0,0 +1,139 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fixture.h"
+#include "zephyr/ztest_assert.h"
+
+#include <zephyr/fff.h>
+#include <zephyr/ztest.h>
+
+// Include UDS minimal library headers
+#include <ardep/iso14229.h>
+#include <iso14229.h>
+
+static const uint16_t tx_queue_data_id = 0x0C0D;
+// First frame carries 3 bytes of the record, the rest needs 8 consecutive
+// frames
+static uint8_t tx_queue_data[3 + 8 * 7];
+
+static struct can_frame stalled_frames[12];
+static uint32_t stalled_frame_count;
+static can_tx_callback_t pending_callback;
+static void *pending_user_data;
+
+// Fake CAN send that never completes on its own, simulating a busy bus
+static int can_send_stalled_fake(const struct device *dev,
+                                 const struct can_frame *frame,
+                                 k_timeout_t timeout,
+                                 can_tx_callback_t callback,
+                                 void *user_data) {
+  zassert_true(K_TIMEOUT_EQ(timeout, K_NO_WAIT), "CAN TX must not block");
+  zassert_is_null(pending_callback, "Only one frame may be in flight");
+
+  if (stalled_frame_count < ARRAY_SIZE(stalled_frames)) {
+    stalled_frames[stalled_frame_count] = *frame;
+  }
+  stalled_frame_count++;
+
+  pending_callback = callback;
+  pending_user_data = user_data;
+  return 0;
+}
+
+static void complete_pending_frame(const struct device *dev) {
+  can_tx_callback_t callback = pending_callback;
+
+  zassert_not_null(callback);
+  pending_callback = NULL;
+  callback(dev, 0, pending_user_data);
+}
+
+static UDSErr_t test_can_tx_queue_uds_callback(
+    struct iso14229_zephyr_instance *inst,
+    UDSEvent_t event,
+    void *arg,
+    void *user_context) {
+  if (event == UDS_EVT_ReadDataByIdent) {
+    UDSRDBIArgs_t *args = arg;
+    if (args->dataId == tx_queue_data_id) {
+      return args->copy(&inst->server, tx_queue_data, sizeof(tx_queue_data));
+    }
+  }
+
+  return UDS_OK;
+}
+
+ZTEST_F(lib_iso14229, test_can_tx_queue_does_not_block_on_busy_bus) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  stalled_frame_count = 0;
+  pending_callback = NULL;
+  fake_can_send_fake.custom_fake = can_send_stalled_fake;
+  test_uds_callback_fake.custom_fake = test_can_tx_queue_uds_callback;
+
+  uint8_t request_data[] = {
+    0x03,                            // PCI    (single frame, 3 bytes of data)
+    0x22,                            // RDBI   (Read Data by Identifier)
+    (tx_queue_data_id >> 8) & 0xFF,  // DID_HB (Identifier High Byte)
+    tx_queue_data_id & 0xFF,         // DID_LB (Identifier Low Byte)
+  };
+  receive_phys_can_frame_array(fixture, request_data);
+  advance_time_and_tick_thread(instance);
+  tick_thread(instance);
+
+  // First frame is in flight, the transmission never completes
+  zassert_equal(stalled_frame_count, 1);
+  complete_pending_frame(fixture->can_dev);
+
+  uint8_t control_flow_frame[] = {
+    0x30,  // PCI         (control flow frame, continue to send)
+    0x00,  // CTL_FCBS    (Block Size 0 == send all)
+    0x00,  // CTL_FCSTMIN (Separator time minimum (0ms))
+  };
+  receive_phys_can_frame_array(fixture, control_flow_frame);
+
+  // The event loop keeps queueing consecutive frames while the bus is busy
+  for (int i = 0; i < 10; i++) {
+    tick_thread(instance);
+  }
+  zassert_equal(stalled_frame_count, 2);
+
+  // Every completion hands the next frame to the driver, in order
+  while (pending_callback != NULL) {
+    complete_pending_frame(fixture->can_dev);
+  }
+
+  zassert_equal(stalled_frame_count, 9);
+  for (uint32_t i = 1; i < 9; i++) {
+    zassert_equal(stalled_frames[i].data[0], 0x20 + i,
+                  "Consecutive frame %u out of order", i);
+  }
+  zassert_equal(instance->tx.overflows, 0);
+  zassert_equal(instance->tx.errors, 0);
+}
+
+ZTEST_F(lib_iso14229, test_can_tx_queue_overflow) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+  struct can_frame frame = {
+    .id = fixture->cfg.target_addr,
+    .dlc = 1,
+  };
+
+  stalled_frame_count = 0;
+  pending_callback = NULL;
+  fake_can_send_fake.custom_fake = can_send_stalled_fake;
+
+  for (int i = 0; i < CONFIG_ISO14229_TX_QUEUE_SIZE; i++) {
+    zassert_ok(iso14229_zephyr_tx_enqueue(&instance->tx, &frame));
+  }
+  zassert_equal(iso14229_zephyr_tx_enqueue(&instance->tx, &frame), -ENOBUFS);
+  zassert_equal(instance->tx.overflows, 1);
+
+  // Draining one frame makes room again
+  complete_pending_frame(fixture->can_dev);
+  zassert_ok(iso14229_zephyr_tx_enqueue(&instance->tx, &frame));
+}
@@ -0,0 +1,191 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fixture.h"
+#include "zephyr/ztest_assert.h"
+
+#include <zephyr/fff.h>
+#include <zephyr/ztest.h>
+
+// Include UDS minimal library headers
+#include <ardep/iso14229.h>
+#include <iso14229.h>
+
+#ifdef CONFIG_ISO14229_EXECUTOR
+
+#define EXECUTOR_INSTANCES 16
+#define EXECUTOR_RX_ID_BASE 0x600
+#define EXECUTOR_TX_ID_BASE 0x680
+#define EXECUTOR_ROUNDS 10
+
+static struct iso14229_zephyr_instance executor_instances[EXECUTOR_INSTANCES];
+static can_rx_callback_t executor_rx_callbacks[EXECUTOR_INSTANCES];
+static void *executor_rx_user_data[EXECUTOR_INSTANCES];
+static atomic_t executor_responses[EXECUTOR_INSTANCES];
+
+static int executor_rx_filter_fake(const struct device *dev,
+                                   can_rx_callback_t callback,
+                                   void *user_data,
+                                   const struct can_filter *filter) {
+  uint32_t index = filter->id - EXECUTOR_RX_ID_BASE;
+
+  if (index >= EXECUTOR_INSTANCES) {
+    return -EINVAL;
+  }
+
+  executor_rx_callbacks[index] = callback;
+  executor_rx_user_data[index] = user_data;
+  return index;
+}
+
+static int executor_can_send_fake(const struct device *dev,
+                                  const struct can_frame *frame,
+                                  k_timeout_t timeout,
+                                  can_tx_callback_t callback,
+                                  void *user_data) {
+  uint32_t index = frame->id - EXECUTOR_TX_ID_BASE;
+
+  // Positive TesterPresent response
+  if (index < EXECUTOR_INSTANCES && frame->data[1] == 0x7E) {
+    atomic_inc(&executor_responses[index]);
+  }
+
+  if (callback) {
+    callback(dev, 0, user_data);
+  }
+
+  return 0;
+}
+
+static void executor_send_tester_present(const struct device *dev,
+                                         uint32_t index) {
+  struct can_frame frame = {
+    .id = EXECUTOR_RX_ID_BASE + index,
+    .dlc = 3,
+    .data = {
+      0x02,  // PCI (single frame, 2 bytes of data)
+      0x3E,  // SID (TesterPresent)
+      0x00,  // SF  (zeroSubFunction)
+    },
+  };
+
+  executor_rx_callbacks[index](dev, &frame, executor_rx_user_data[index]);
+}
+
+static bool executor_all_responded(atomic_val_t count) {
+  for (int i = 0; i < EXECUTOR_INSTANCES; i++) {
+    if (atomic_get(&executor_responses[i]) < count) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+ZTEST_F(lib_iso14229, test_executor_serves_many_instances) {
+  fake_can_add_rx_filter_fake.custom_fake = executor_rx_filter_fake;
+  fake_can_send_fake.custom_fake = executor_can_send_fake;
+
+  for (int i = 0; i < EXECUTOR_INSTANCES; i++) {
+    const UDSISOTpCConfig_t cfg = {
+      .source_addr = EXECUTOR_RX_ID_BASE + i,
+      .target_addr = EXECUTOR_TX_ID_BASE + i,
+      .source_addr_func = UDS_TP_NOOP_ADDR,
+      .target_addr_func = UDS_TP_NOOP_ADDR,
+    };
+
+    atomic_set(&executor_responses[i], 0);
+    zassert_ok(iso14229_zephyr_init(&executor_instances[i], &cfg,
+                                    fixture->can_dev, NULL));
+    executor_instances[i].set_callback(&executor_instances[i],
+                                       test_uds_callback);
+    zassert_ok(executor_instances[i].thread_start(&executor_instances[i]));
+  }
+
+  for (int round = 1; round <= EXECUTOR_ROUNDS; round++) {
+    // All instances receive a request at the same time
+    for (int i = 0; i < EXECUTOR_INSTANCES; i++) {
+      executor_send_tester_present(fixture->can_dev, i);
+    }
+
+    for (int i = 0; i < 1000 && !executor_all_responded(round); i++) {
+      k_msleep(1);
+    }
+    zassert_true(executor_all_responded(round),
+                 "Not all instances responded in round %d", round);
+  }
+
+  atomic_val_t wakeups = 0;
+  for (int i = 0; i < EXECUTOR_INSTANCES; i++) {
+    zassert_ok(executor_instances[i].thread_stop(&executor_instances[i]));
+    zassert_equal(atomic_get(&executor_responses[i]), EXECUTOR_ROUNDS);
+    wakeups += atomic_get(&executor_instances[i].thread_wakeups);
+  }
+
+  TC_PRINT("%d instances served by %d executor thread(s), %zu bytes per "
+           "instance, %ld event loop runs\n",
+           EXECUTOR_INSTANCES, CONFIG_ISO14229_EXECUTOR_THREADS,
+           sizeof(struct iso14229_zephyr_instance), (long)wakeups);
+
+  // Stopped instances are no longer run
+  for (int i = 0; i < EXECUTOR_INSTANCES; i++) {
+    executor_send_tester_present(fixture->can_dev, i);
+  }
+  k_msleep(10);
+  zassert_true(!executor_all_responded(EXECUTOR_ROUNDS + 1));
+}
+
+static K_SEM_DEFINE(executor_callback_entered, 0, 1);
+static K_SEM_DEFINE(executor_callback_release, 0, 1);
+static atomic_t executor_callback_done;
+
+// Blocks the executor thread running the instance until released
+static UDSErr_t executor_blocking_uds_callback(
+    struct iso14229_zephyr_instance *inst,
+    UDSEvent_t event,
+    void *arg,
+    void *user_context) {
+  if (event == UDS_EVT_ReadDataByIdent) {
+    k_sem_give(&executor_callback_entered);
+    k_sem_take(&executor_callback_release, K_FOREVER);
+    atomic_set(&executor_callback_done, 1);
+  }
+
+  return UDS_OK;
+}
+
+static void executor_release_work_handler(struct k_work *work) {
+  k_sem_give(&executor_callback_release);
+}
+
+static K_WORK_DELAYABLE_DEFINE(executor_release_work,
+                               executor_release_work_handler);
+
+ZTEST_F(lib_iso14229, test_executor_stop_waits_for_running_instance) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  atomic_set(&executor_callback_done, 0);
+  test_uds_callback_fake.custom_fake = executor_blocking_uds_callback;
+  zassert_ok(instance->thread_start(instance));
+
+  uint8_t request_data[] = {
+    0x03,  // PCI    (single frame, 3 bytes of data)
+    0x22,  // RDBI   (Read Data by Identifier)
+    0x12,  // DID_HB (Identifier High Byte)
+    0x34,  // DID_LB (Identifier Low Byte)
+  };
+  receive_phys_can_frame_array(fixture, request_data);
+  zassert_ok(k_sem_take(&executor_callback_entered, K_MSEC(1000)));
+
+  k_work_schedule(&executor_release_work, K_MSEC(5));
+  zassert_ok(instance->thread_stop(instance));
+
+  // Stopping returned only after the executor thread left the instance
+  zassert_equal(atomic_get(&executor_callback_done), 1);
+}
+
+#endif  // CONFIG_ISO14229_EXECUTOR
@@ -97,28 +97,20 @@ void assert_send_phy_can_frame(const struct lib_iso14229_fixture *fixture,
   zassert_mem_equal(actual_frame.data, expected_frame.data, data_len);
 }
 
-// Actual definition in zephyr/drivers/can/can_common.c
-// Re-defined here for proper injection fake can send command
-struct can_tx_default_cb_ctx {
-  struct k_sem done;
-  int status;
-};
-
-// Fake CAN send to set the return code and
-// unlock the semaphore AND capture the frame data
+// Fake CAN send to report the transmission as completed
+// AND capture the frame data
 static int can_send_t_fake_impl(const struct device *dev,
                                 const struct can_frame *frame,
                                 k_timeout_t timeout,
                                 can_tx_callback_t callback,
                                 void *user_data) {
-  struct can_tx_default_cb_ctx *ctx = user_data;
-
   // Capture the frame data
   send_can_frames[send_can_frame_count] = *frame;
   send_can_frame_count++;
 
-  k_sem_give(&ctx->done);
-  ctx->status = 0;  // Success
+  if (callback) {
+    callback(dev, 0, user_data);  // Success
+  }
   return 0;
 }
 
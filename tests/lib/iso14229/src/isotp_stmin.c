@@ -0,0 +1,118 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fixture.h"
+#include "zephyr/ztest_assert.h"
+
+#include <zephyr/fff.h>
+#include <zephyr/ztest.h>
+
+// Include UDS minimal library headers
+#include <ardep/iso14229.h>
+#include <iso14229.h>
+
+#ifdef CONFIG_ISO14229_THREAD
+
+static const uint16_t stmin_data_id = 0x0A0B;
+// First frame carries 3 bytes of the record, the rest needs 8 consecutive
+// frames
+static uint8_t stmin_data[3 + 8 * 7];
+
+static uint32_t frame_timestamps_us[12];
+static uint32_t frame_count;
+
+static int can_send_timestamp_fake(const struct device *dev,
+                                   const struct can_frame *frame,
+                                   k_timeout_t timeout,
+                                   can_tx_callback_t callback,
+                                   void *user_data) {
+  if (frame_count < ARRAY_SIZE(frame_timestamps_us)) {
+    frame_timestamps_us[frame_count] = isotp_user_get_us();
+  }
+  frame_count++;
+
+  if (callback) {
+    callback(dev, 0, user_data);
+  }
+
+  return 0;
+}
+
+static UDSErr_t test_isotp_stmin_uds_callback(
+    struct iso14229_zephyr_instance *inst,
+    UDSEvent_t event,
+    void *arg,
+    void *user_context) {
+  if (event == UDS_EVT_ReadDataByIdent) {
+    UDSRDBIArgs_t *args = arg;
+    if (args->dataId == stmin_data_id) {
+      return args->copy(&inst->server, stmin_data, sizeof(stmin_data));
+    }
+  }
+
+  return UDS_OK;
+}
+
+static void wait_for_frames(uint32_t count) {
+  for (int i = 0; i < 1000 && frame_count < count; i++) {
+    k_msleep(1);
+  }
+  zassert_true(frame_count >= count, "Only %u of %u frames sent", frame_count,
+               count);
+}
+
+ZTEST_F(lib_iso14229, test_isotp_sub_millisecond_stmin) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+  const uint32_t stmin_us = 500;
+
+  frame_count = 0;
+  fake_can_send_fake.custom_fake = can_send_timestamp_fake;
+  test_uds_callback_fake.custom_fake = test_isotp_stmin_uds_callback;
+
+  zassert_ok(instance->thread_start(instance));
+
+  uint8_t request_data[] = {
+    0x03,                         // PCI    (single frame, 3 bytes of data)
+    0x22,                         // RDBI   (Read Data by Identifier)
+    (stmin_data_id >> 8) & 0xFF,  // DID_HB (Identifier High Byte)
+    stmin_data_id & 0xFF,         // DID_LB (Identifier Low Byte)
+  };
+  receive_phys_can_frame_array(fixture, request_data);
+  wait_for_frames(1);
+
+  uint8_t control_flow_frame[] = {
+    0x30,  // PCI         (control flow frame, continue to send)
+    0x00,  // CTL_FCBS    (Block Size 0 == send all)
+    0xF5,  // CTL_FCSTMIN (Separator time minimum (500us))
+  };
+  receive_phys_can_frame_array(fixture, control_flow_frame);
+  wait_for_frames(9);
+
+  zassert_ok(instance->thread_stop(instance));
+
+  uint32_t min_gap_us = UINT32_MAX;
+  uint32_t max_gap_us = 0;
+  for (uint32_t i = 2; i < 9; i++) {
+    uint32_t gap_us = frame_timestamps_us[i] - frame_timestamps_us[i - 1];
+    min_gap_us = MIN(min_gap_us, gap_us);
+    max_gap_us = MAX(max_gap_us, gap_us);
+  }
+
+  TC_PRINT("Consecutive frame gaps for STmin %u us: min %u us, max %u us\n",
+           stmin_us, min_gap_us, max_gap_us);
+
+  zassert_true(min_gap_us >= stmin_us);
+#if defined(CONFIG_ISO14229_THREAD_WAIT_EVENT) && \
+    CONFIG_ISO14229_BUSY_WAIT_MAX_US >= 500
+  zassert_true(max_gap_us < stmin_us + 100);
+#elif defined(CONFIG_ISO14229_THREAD_WAIT_EVENT)
+  // The remainder below one tick is slept as a whole tick
+  zassert_true(max_gap_us <= 2 * k_ticks_to_us_ceil32(1) + 100);
+#endif
+}
+
+#endif  // CONFIG_ISO14229_THREAD
@@ -0,0 +1,148 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fixture.h"
+#include "zephyr/ztest_assert.h"
+
+#include <string.h>
+
+#include <zephyr/fff.h>
+#include <zephyr/ztest.h>
+
+// Include UDS minimal library headers
+#include <ardep/iso14229.h>
+#include <iso14229.h>
+
+static uint32_t request_hook_calls;
+static uint8_t request_hook_data[16];
+static uint16_t request_hook_len;
+
+// Takes ReadDataByPeriodicIdentifier requests and answers them positively
+static bool test_request_hook(struct iso14229_zephyr_instance *inst,
+                              const uint8_t *data,
+                              uint16_t len,
+                              bool functional) {
+  request_hook_calls++;
+
+  if (data[0] != 0x2A) {
+    return false;
+  }
+
+  memcpy(request_hook_data, data, MIN(len, sizeof(request_hook_data)));
+  request_hook_len = len;
+
+  const uint8_t response[] = {0x6A};
+  zassert_ok(iso14229_zephyr_send_response(inst, response, sizeof(response)));
+  return true;
+}
+
+static UDSErr_t test_request_hook_callback(
+    struct iso14229_zephyr_instance *inst,
+    UDSEvent_t event,
+    void *arg,
+    void *user_context) {
+  return UDS_PositiveResponse;
+}
+
+ZTEST_F(lib_iso14229, test_request_hook_handles_request) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  request_hook_calls = 0;
+  instance->request_hook = test_request_hook;
+  test_uds_callback_fake.custom_fake = test_request_hook_callback;
+
+  uint8_t request_data[] = {
+    0x04,  // PCI  (single frame, 4 bytes of data)
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    0x03,  // TM   (sendAtFastRate)
+    0x01,  // PDID
+    0x02,  // PDID
+  };
+
+  receive_phys_can_frame_array(fixture, request_data);
+  tick_thread(instance);
+
+  zassert_equal(request_hook_calls, 1);
+  zassert_equal(request_hook_len, 4);
+  zassert_mem_equal(request_hook_data, &request_data[1], 4);
+
+  // The server never saw the request
+  zassert_equal(test_uds_callback_fake.call_count, 0);
+
+  uint8_t response_data[] = {
+    0x01,  // PCI  (single frame, 1 byte of data)
+    0x6A,  // SID  (ReadDataByPeriodicIdentifier)
+  };
+  assert_send_phy_can_frame_array(fixture, 0, response_data);
+}
+
+ZTEST_F(lib_iso14229, test_request_hook_gets_segmented_request) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  request_hook_calls = 0;
+  instance->request_hook = test_request_hook;
+  test_uds_callback_fake.custom_fake = test_request_hook_callback;
+
+  uint8_t first_frame[] = {
+    0x10,  // PCI_HB (first frame, upper nibble)
+    0x0A,  // PCI_LB (10 bytes of data total)
+    0x2A,  // SID    (ReadDataByPeriodicIdentifier)
+    0x03,  // TM     (sendAtFastRate)
+    0x01,  // PDID
+    0x02,  // PDID
+    0x03,  // PDID
+    0x04,  // PDID
+  };
+  receive_phys_can_frame_array(fixture, first_frame);
+  tick_thread(instance);
+
+  // Only complete requests reach the hook
+  zassert_equal(request_hook_calls, 0);
+
+  uint8_t consecutive_frame[] = {
+    0x21,  // PCI  (consecutive frame, sequence number 1)
+    0x05,  // PDID
+    0x06,  // PDID
+    0x07,  // PDID
+    0x08,  // PDID
+  };
+  receive_phys_can_frame_array(fixture, consecutive_frame);
+  tick_thread(instance);
+
+  zassert_equal(request_hook_calls, 1);
+  zassert_equal(request_hook_len, 10);
+  zassert_mem_equal(request_hook_data, &first_frame[2], 6);
+  zassert_mem_equal(&request_hook_data[6], &consecutive_frame[1], 4);
+  zassert_equal(test_uds_callback_fake.call_count, 0);
+}
+
+ZTEST_F(lib_iso14229, test_request_hook_passes_other_requests) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  request_hook_calls = 0;
+  instance->request_hook = test_request_hook;
+  test_uds_callback_fake.custom_fake = test_request_hook_callback;
+
+  uint8_t request_data[] = {
+    0x02,  // PCI (single frame, 2 bytes of data)
+    0x3E,  // SID (TesterPresent)
+    0x00,  // SF  (zeroSubFunction)
+  };
+
+  receive_phys_can_frame_array(fixture, request_data);
+  advance_time_and_tick_thread(instance);
+  tick_thread(instance);
+
+  zassert_equal(request_hook_calls, 1);
+
+  uint8_t response_data[] = {
+    0x02,  // PCI (single frame, 2 bytes of data)
+    0x7E,  // SID (TesterPresent)
+    0x00,  // SF  (zeroSubFunction)
+  };
+  assert_send_phy_can_frame_array(fixture, 0, response_data);
+}
@@ -0,0 +1,234 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fixture.h"
+#include "zephyr/ztest_assert.h"
+
+#include <zephyr/fff.h>
+#include <zephyr/ztest.h>
+
+// Include UDS minimal library headers
+#include <ardep/iso14229.h>
+#include <iso14229.h>
+
+#ifdef CONFIG_ISO14229_THREAD
+
+static UDSErr_t test_thread_session_callback(
+    struct iso14229_zephyr_instance *inst,
+    UDSEvent_t event,
+    void *arg,
+    void *user_context) {
+  if (event == UDS_EVT_SessionTimeout) {
+    session_timeout_event_fired = true;
+  }
+
+  return UDS_PositiveResponse;
+}
+
+static struct can_frame first_frame;
+static uint32_t first_frame_sent_us;
+
+static int can_send_timestamp_fake(const struct device *dev,
+                                   const struct can_frame *frame,
+                                   k_timeout_t timeout,
+                                   can_tx_callback_t callback,
+                                   void *user_data) {
+  if (fake_can_send_fake.call_count == 1) {
+    first_frame_sent_us = isotp_user_get_us();
+    first_frame = *frame;
+  }
+
+  if (callback) {
+    callback(dev, 0, user_data);
+  }
+
+  return 0;
+}
+
+static const uint16_t busy_bus_data_id = 0x0C0E;
+// More consecutive frames than fit into the transmit queue
+static uint8_t busy_bus_data[256];
+#define BUSY_BUS_FRAMES (1 + DIV_ROUND_UP(3 + sizeof(busy_bus_data) - 6, 7))
+
+static bool bus_busy;
+static uint32_t busy_bus_sent_count;
+static uint32_t last_frame_sent_us;
+
+// Fake CAN send that finds all mailboxes taken while the bus is busy
+static int can_send_busy_fake(const struct device *dev,
+                              const struct can_frame *frame,
+                              k_timeout_t timeout,
+                              can_tx_callback_t callback,
+                              void *user_data) {
+  if (bus_busy) {
+    return -EAGAIN;
+  }
+
+  busy_bus_sent_count++;
+  last_frame_sent_us = isotp_user_get_us();
+  callback(dev, 0, user_data);
+
+  return 0;
+}
+
+static UDSErr_t test_thread_busy_bus_callback(
+    struct iso14229_zephyr_instance *inst,
+    UDSEvent_t event,
+    void *arg,
+    void *user_context) {
+  if (event == UDS_EVT_ReadDataByIdent) {
+    UDSRDBIArgs_t *args = arg;
+    if (args->dataId == busy_bus_data_id) {
+      return args->copy(&inst->server, busy_bus_data, sizeof(busy_bus_data));
+    }
+  }
+
+  return UDS_OK;
+}
+
+/**
+ * Waits until the server sent @p count CAN frames
+ */
+static void wait_for_sent_frames(uint32_t count) {
+  for (int i = 0; i < 1000 && fake_can_send_fake.call_count < count; i++) {
+    k_msleep(1);
+  }
+  zassert_true(fake_can_send_fake.call_count >= count,
+               "No response from the server thread");
+}
+
+ZTEST_F(lib_iso14229, test_thread_idle_wakeups) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  zassert_ok(instance->thread_start(instance));
+  k_msleep(10);
+
+  atomic_val_t before = atomic_get(&instance->thread_wakeups);
+  k_msleep(1000);
+  atomic_val_t wakeups = atomic_get(&instance->thread_wakeups) - before;
+
+  zassert_ok(instance->thread_stop(instance));
+
+  TC_PRINT("Idle thread wakeups per second: %ld\n", (long)wakeups);
+
+#ifdef CONFIG_ISO14229_THREAD_WAIT_EVENT
+  zassert_true(wakeups <= 1000 / CONFIG_ISO14229_THREAD_MAX_WAIT_MS + 1);
+#else
+  zassert_true(wakeups >= USEC_PER_SEC / CONFIG_ISO14229_THREAD_SLEEP_US / 2);
+#endif
+}
+
+ZTEST_F(lib_iso14229, test_thread_response_latency) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  zassert_ok(instance->thread_start(instance));
+  k_msleep(10);
+
+  uint8_t request_data[] = {
+    0x02,  // PCI (single frame, 2 bytes of data)
+    0x3E,  // SID (TesterPresent)
+    0x00,  // SF  (zeroSubFunction)
+  };
+  uint8_t response_data[] = {
+    0x02,  // PCI (single frame, 2 bytes of data)
+    0x7E,  // SID (positive response to 0x3E)
+    0x00,  // SF  (zeroSubFunction)
+  };
+
+  fake_can_send_fake.custom_fake = can_send_timestamp_fake;
+
+  uint32_t request_us = isotp_user_get_us();
+  receive_phys_can_frame_array(fixture, request_data);
+  wait_for_sent_frames(1);
+
+  zassert_ok(instance->thread_stop(instance));
+
+  uint32_t latency_us = first_frame_sent_us - request_us;
+
+  TC_PRINT("TesterPresent response latency: %u us\n", latency_us);
+
+  zassert_mem_equal(first_frame.data, response_data, sizeof(response_data));
+
+#ifdef CONFIG_ISO14229_THREAD_WAIT_EVENT
+  zassert_true(latency_us < USEC_PER_MSEC);
+#endif
+}
+
+ZTEST_F(lib_iso14229, test_thread_session_timeout_without_traffic) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  test_uds_callback_fake.custom_fake = test_thread_session_callback;
+
+  zassert_ok(instance->thread_start(instance));
+
+  uint8_t request_data[] = {
+    0x02,  // PCI (single frame, 2 bytes of data)
+    0x10,  // SID (DiagnosticSessionControl)
+    0x02,  // DS  (Programming Session)
+  };
+  receive_phys_can_frame_array(fixture, request_data);
+  wait_for_sent_frames(1);
+
+  // No further frames, the S3 deadline alone has to wake up the thread
+  k_msleep(instance->server.s3_ms + 200);
+
+  zassert_ok(instance->thread_stop(instance));
+  zassert_true(session_timeout_event_fired);
+}
+
+ZTEST_F(lib_iso14229, test_thread_retries_full_queue_on_busy_bus) {
+  struct iso14229_zephyr_instance *instance = &fixture->instance;
+
+  bus_busy = true;
+  busy_bus_sent_count = 0;
+  fake_can_send_fake.custom_fake = can_send_busy_fake;
+  test_uds_callback_fake.custom_fake = test_thread_busy_bus_callback;
+
+  zassert_ok(instance->thread_start(instance));
+  k_msleep(10);
+
+  uint8_t request_data[] = {
+    0x03,                            // PCI    (single frame, 3 bytes of data)
+    0x22,                            // RDBI   (Read Data by Identifier)
+    (busy_bus_data_id >> 8) & 0xFF,  // DID_HB (Identifier High Byte)
+    busy_bus_data_id & 0xFF,         // DID_LB (Identifier Low Byte)
+  };
+  receive_phys_can_frame_array(fixture, request_data);
+  k_msleep(10);
+
+  uint8_t control_flow_frame[] = {
+    0x30,  // PCI         (control flow frame, continue to send)
+    0x00,  // CTL_FCBS    (Block Size 0 == send all)
+    0x00,  // CTL_FCSTMIN (Separator time minimum (0ms))
+  };
+  receive_phys_can_frame_array(fixture, control_flow_frame);
+  k_msleep(20);
+
+  // The queue filled up while no frame was in flight
+  zassert_equal(busy_bus_sent_count, 0);
+  zassert_true(instance->tx.space_wanted);
+
+  uint32_t bus_free_us = isotp_user_get_us();
+  bus_busy = false;
+  for (int i = 0; i < 1000 && busy_bus_sent_count < BUSY_BUS_FRAMES; i++) {
+    k_msleep(1);
+  }
+
+  zassert_ok(instance->thread_stop(instance));
+  zassert_equal(busy_bus_sent_count, BUSY_BUS_FRAMES);
+
+  uint32_t drain_us = last_frame_sent_us - bus_free_us;
+
+  TC_PRINT("Queue drained %u us after the bus got free\n", drain_us);
+
+#ifdef CONFIG_ISO14229_THREAD_WAIT_EVENT
+  // Retried on the next tick, not after CONFIG_ISO14229_THREAD_MAX_WAIT_MS
+  zassert_true(drain_us < 10 * USEC_PER_MSEC);
+#endif
+}
+
+#endif  // CONFIG_ISO14229_THREAD
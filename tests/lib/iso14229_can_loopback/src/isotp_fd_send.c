@@ -0,0 +1,273 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/ztest.h>
+
+#include "tester.h"
+
+#ifdef CONFIG_ISO14229_CAN_FD
+
+// Slightly above the N_Bs and N_Cr timeouts of 1000 ms
+#define TIMEOUT_EXPIRED K_MSEC(1100)
+
+// Payload bytes of a first frame and a consecutive frame
+#define FF_PAYLOAD (TESTER_DL - 2)
+#define CF_PAYLOAD (TESTER_DL - 1)
+
+static uint8_t response[3 + 512];
+
+static void request_record(uint16_t len) {
+  uint8_t request[] = {
+    0x03,                               // PCI    (single frame, 3 bytes)
+    0x22,                               // RDBI   (Read Data by Identifier)
+    TEST_RECORD_DATA_ID(len) >> 8,      // DID_HB (Identifier High Byte)
+    TEST_RECORD_DATA_ID(len) & 0xFF,    // DID_LB (Identifier Low Byte)
+  };
+
+  tester_send_frame(request, sizeof(request));
+}
+
+static void check_record_response(uint16_t len) {
+  zassert_equal(response[0], 0x62, "Expected positive RDBI response");
+  zassert_equal(response[1], TEST_RECORD_DATA_ID(len) >> 8);
+  zassert_equal(response[2], TEST_RECORD_DATA_ID(len) & 0xFF);
+  for (size_t i = 0; i < len; i++) {
+    zassert_equal(response[3 + i], test_record_byte(i),
+                  "Wrong record byte %zu", i);
+  }
+}
+
+static void send_flow_control(uint8_t flow_status,
+                              uint8_t block_size,
+                              uint8_t st_min) {
+  uint8_t flow_control[] = {
+    0x30 | flow_status,  // PCI      (flow control frame)
+    block_size,          // CTL_FCBS (Block Size)
+    st_min,              // CTL_FCSTMIN (Separator time minimum)
+  };
+
+  tester_send_frame(flow_control, sizeof(flow_control));
+}
+
+// Receives the first frame of a response of 3 + record_len bytes
+static void receive_first_frame(uint16_t record_len) {
+  const size_t len = 3 + record_len;
+  struct can_frame frame;
+
+  tester_receive_frame(&frame);
+  zassert_equal(can_dlc_to_bytes(frame.dlc), TESTER_DL);
+  zassert_equal(frame.data[0], 0x10 | (len >> 8), "Expected first frame");
+  zassert_equal(frame.data[1], len & 0xFF);
+  memcpy(response, &frame.data[2], FF_PAYLOAD);
+}
+
+// Receives the consecutive frames up to the end of a response of
+// 3 + record_len bytes, with sequence numbers starting at sn, and returns the
+// time the last one was sent
+static uint32_t receive_consecutive_frames(uint16_t record_len,
+                                           size_t *offset,
+                                           uint8_t *sn,
+                                           size_t count,
+                                           uint32_t min_gap_us) {
+  const size_t len = 3 + record_len;
+  struct can_frame frame;
+  uint32_t last_us = 0;
+
+  for (size_t i = 0; i < count && *offset < len; i++) {
+    const uint32_t sent_us = tester_receive_frame(&frame);
+    zassert_equal(frame.data[0], 0x20 | *sn, "Expected consecutive frame %u",
+                  *sn);
+    if (i > 0) {
+      zassert_true(sent_us - last_us >= min_gap_us,
+                   "Consecutive frames %u us apart, STmin is %u us",
+                   sent_us - last_us, min_gap_us);
+    }
+
+    const size_t copy_len = MIN(len - *offset, CF_PAYLOAD);
+    memcpy(&response[*offset], &frame.data[1], copy_len);
+    *offset += copy_len;
+    *sn = (*sn + 1) & 0x0F;
+    last_us = sent_us;
+  }
+
+  return last_us;
+}
+
+ZTEST(lib_iso14229_can_loopback, test_fd_single_frame_responses) {
+  // 7 bytes still use the classic layout, 8 to 62 bytes the escape sequence
+  const uint16_t record_lens[] = {4, 5, 30, TESTER_DL - 2 - 3};
+  struct can_frame frame;
+
+  tester_purge();
+
+  for (size_t i = 0; i < ARRAY_SIZE(record_lens); i++) {
+    const uint16_t len = 3 + record_lens[i];
+
+    request_record(record_lens[i]);
+    tester_receive_frame(&frame);
+    zassert_true((frame.flags & CAN_FRAME_FDF) != 0);
+
+    if (len <= 7) {
+      zassert_equal(frame.data[0], len);
+      memcpy(response, &frame.data[1], len);
+    } else {
+      zassert_equal(frame.data[0], 0x00, "Expected escaped single frame");
+      zassert_equal(frame.data[1], len);
+      zassert_true(can_dlc_to_bytes(frame.dlc) >= len + 2);
+      memcpy(response, &frame.data[2], len);
+    }
+    check_record_response(record_lens[i]);
+  }
+
+  // One byte more needs a first frame
+  request_record(TESTER_DL - 2 - 3 + 1);
+  receive_first_frame(TESTER_DL - 2 - 3 + 1);
+  send_flow_control(0, 0, 0);
+  size_t offset = FF_PAYLOAD;
+  uint8_t sn = 1;
+  receive_consecutive_frames(TESTER_DL - 2 - 3 + 1, &offset, &sn, 1, 0);
+  check_record_response(TESTER_DL - 2 - 3 + 1);
+}
+
+ZTEST(lib_iso14229_can_loopback, test_fd_segmented_response_flow_control) {
+  // First frame and 6 consecutive frames
+  const uint16_t record_len = 400;
+  size_t offset = FF_PAYLOAD;
+  uint8_t sn = 1;
+
+  tester_purge();
+  request_record(record_len);
+  receive_first_frame(record_len);
+
+  // Nothing is sent before the flow control
+  tester_expect_no_frame(K_MSEC(50));
+
+  // A block of 2 frames 5 ms apart
+  send_flow_control(0, 2, 0x05);
+  receive_consecutive_frames(record_len, &offset, &sn, 2, 5000);
+  zassert_equal(sn, 3);
+  tester_expect_no_frame(K_MSEC(50));
+
+  // The rest 500 us apart without further flow control
+  send_flow_control(0, 0, 0xF5);
+  receive_consecutive_frames(record_len, &offset, &sn, SIZE_MAX, 500);
+  zassert_equal(offset, 3 + record_len);
+  zassert_equal(sn, 7);
+  tester_expect_no_frame(K_MSEC(50));
+
+  check_record_response(record_len);
+}
+
+ZTEST(lib_iso14229_can_loopback, test_fd_flow_control_wait) {
+  const uint16_t record_len = 200;
+  size_t offset = FF_PAYLOAD;
+  uint8_t sn = 1;
+
+  tester_purge();
+  request_record(record_len);
+  receive_first_frame(record_len);
+
+  // Every WAIT restarts N_Bs, together they exceed it
+  send_flow_control(1, 0, 0);
+  tester_expect_no_frame(K_MSEC(600));
+  send_flow_control(1, 0, 0);
+  tester_expect_no_frame(K_MSEC(600));
+
+  send_flow_control(0, 0, 0);
+  receive_consecutive_frames(record_len, &offset, &sn, SIZE_MAX, 0);
+  zassert_equal(offset, 3 + record_len);
+  check_record_response(record_len);
+}
+
+ZTEST(lib_iso14229_can_loopback, test_fd_flow_control_overflow) {
+  struct can_frame frame;
+
+  tester_purge();
+  request_record(200);
+  receive_first_frame(200);
+
+  send_flow_control(2, 0, 0);
+  tester_expect_no_frame(K_MSEC(100));
+
+  // The next request is answered
+  request_record(4);
+  tester_receive_frame(&frame);
+  zassert_equal(frame.data[0], 7);
+}
+
+ZTEST(lib_iso14229_can_loopback, test_fd_n_bs_timeout) {
+  struct can_frame frame;
+
+  tester_purge();
+  request_record(200);
+  receive_first_frame(200);
+
+  tester_expect_no_frame(TIMEOUT_EXPIRED);
+
+  // The transfer was aborted, a late flow control is ignored
+  send_flow_control(0, 0, 0);
+  tester_expect_no_frame(K_MSEC(100));
+
+  request_record(4);
+  tester_receive_frame(&frame);
+  zassert_equal(frame.data[0], 7);
+}
+
+ZTEST(lib_iso14229_can_loopback, test_fd_n_cr_timeout) {
+  const size_t len = 103;
+  uint8_t buf[TESTER_DL];
+  struct can_frame frame;
+
+  tester_purge();
+
+  // First frame of a WriteDataByIdentifier request
+  buf[0] = 0x10 | (len >> 8);
+  buf[1] = len & 0xFF;
+  buf[2] = 0x2E;
+  buf[3] = 0xF1;
+  buf[4] = 0xA0;
+  memset(&buf[5], 0x55, sizeof(buf) - 5);
+  tester_send_frame(buf, sizeof(buf));
+
+  tester_receive_frame(&frame);
+  zassert_equal(frame.data[0], 0x30, "Expected flow control CTS");
+
+  // The consecutive frame arrives after N_Cr and is ignored
+  k_sleep(TIMEOUT_EXPIRED);
+  buf[0] = 0x21;
+  tester_send_frame(buf, len - FF_PAYLOAD + 1);
+  tester_expect_no_frame(K_MSEC(200));
+
+  request_record(4);
+  tester_receive_frame(&frame);
+  zassert_equal(frame.data[0], 7);
+}
+
+ZTEST(lib_iso14229_can_loopback, test_fd_first_frame_too_long_is_rejected) {
+  uint8_t buf[TESTER_DL];
+  struct can_frame frame;
+
+  tester_purge();
+
+  // Escaped first frame of 5000 bytes, more than the server can take
+  memset(buf, 0x55, sizeof(buf));
+  buf[0] = 0x10;
+  buf[1] = 0x00;
+  buf[2] = 0x00;
+  buf[3] = 0x00;
+  buf[4] = 5000 >> 8;
+  buf[5] = 5000 & 0xFF;
+  tester_send_frame(buf, sizeof(buf));
+
+  tester_receive_frame(&frame);
+  zassert_equal(frame.data[0], 0x32, "Expected flow control OVFLW");
+  tester_expect_no_frame(K_MSEC(50));
+}
+
+#endif  // CONFIG_ISO14229_CAN_FD
@@ -0,0 +1,242 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <ardep/iso14229.h>
+#include <iso14229.h>
+
+#include "tester.h"
+
+/*
+ * Benchmark for a firmware download sized request (WriteDataByIdentifier
+ * with 4000 bytes of data) over the can_loopback driver. Run once with the
+ * classic CAN and once with the CAN FD transport to compare the number of
+ * frames on the bus.
+ */
+
+#define BENCHMARK_DATA_ID 0xF1A0
+#define BENCHMARK_DATA_LEN 4000
+
+const struct device *can_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_canbus));
+
+static struct iso14229_zephyr_instance server;
+
+struct tester_frame {
+  struct can_frame frame;
+  uint32_t timestamp_us;
+};
+
+K_MSGQ_DEFINE(server_tx_msgq, sizeof(struct tester_frame), 32, 4);
+
+static atomic_t request_frames;
+static atomic_t request_bytes;
+static uint8_t request[3 + BENCHMARK_DATA_LEN];
+static bool request_data_valid;
+
+static uint8_t test_record[TEST_RECORD_MAX_LEN];
+
+static UDSErr_t server_callback(struct iso14229_zephyr_instance *inst,
+                                UDSEvent_t event,
+                                void *arg,
+                                void *user_context) {
+  if (event == UDS_EVT_ReadDataByIdent) {
+    UDSRDBIArgs_t *args = arg;
+    if (args->dataId < TEST_RECORD_DATA_ID(0) ||
+        args->dataId > TEST_RECORD_DATA_ID(TEST_RECORD_MAX_LEN)) {
+      return UDS_NRC_RequestOutOfRange;
+    }
+    return args->copy(&inst->server, test_record,
+                      args->dataId - TEST_RECORD_DATA_ID(0));
+  }
+
+  if (event == UDS_EVT_WriteDataByIdent) {
+    UDSWDBIArgs_t *args = arg;
+    request_data_valid = args->dataId == BENCHMARK_DATA_ID &&
+                         args->len == BENCHMARK_DATA_LEN &&
+                         memcmp(args->data, &request[3], args->len) == 0;
+    return UDS_PositiveResponse;
+  }
+
+  return UDS_NRC_ServiceNotSupported;
+}
+
+static void server_tx_cb(const struct device *dev,
+                         struct can_frame *frame,
+                         void *user_data) {
+  const struct tester_frame received = {
+    .frame = *frame,
+    .timestamp_us = isotp_user_get_us(),
+  };
+
+  k_msgq_put(&server_tx_msgq, &received, K_NO_WAIT);
+}
+
+static void request_counter_cb(const struct device *dev,
+                               struct can_frame *frame,
+                               void *user_data) {
+  atomic_inc(&request_frames);
+  atomic_add(&request_bytes, can_dlc_to_bytes(frame->dlc));
+}
+
+void tester_send_frame(uint8_t *data, uint8_t len) {
+  struct can_frame frame = {
+    .id = SERVER_RX_ID,
+    .flags = TESTER_FLAGS,
+    .dlc = can_bytes_to_dlc(len),
+  };
+  memcpy(frame.data, data, len);
+  memset(&frame.data[len], 0xCC, can_dlc_to_bytes(frame.dlc) - len);
+
+  zassert_ok(can_send(can_dev, &frame, K_MSEC(100), NULL, NULL));
+}
+
+uint32_t tester_receive_frame(struct can_frame *frame) {
+  struct tester_frame received;
+
+  zassert_ok(k_msgq_get(&server_tx_msgq, &received, K_SECONDS(2)),
+             "No frame from the server");
+  *frame = received.frame;
+  return received.timestamp_us;
+}
+
+void tester_expect_no_frame(k_timeout_t timeout) {
+  struct tester_frame received;
+
+  zassert_equal(k_msgq_get(&server_tx_msgq, &received, timeout), -EAGAIN,
+                "Unexpected frame 0x%02x from the server",
+                received.frame.data[0]);
+}
+
+void tester_purge(void) {
+  k_msgq_purge(&server_tx_msgq);
+}
+
+// Minimal ISO-TP sender for messages that need segmentation
+static void tester_send_segmented(const uint8_t *msg, size_t len) {
+  uint8_t buf[TESTER_DL];
+  struct can_frame flow_control;
+
+  buf[0] = 0x10 | (len >> 8);
+  buf[1] = len & 0xFF;
+  size_t offset = TESTER_DL - 2;
+  memcpy(&buf[2], msg, offset);
+  tester_send_frame(buf, TESTER_DL);
+
+  uint8_t sn = 1;
+  uint32_t block_remain = 0;
+  bool unlimited_block = false;
+
+  while (offset < len) {
+    if (!unlimited_block && block_remain == 0) {
+      tester_receive_frame(&flow_control);
+      zassert_equal(flow_control.data[0], 0x30, "Expected flow control CTS");
+      block_remain = flow_control.data[1];
+      unlimited_block = block_remain == 0;
+    }
+
+    size_t copy_len = MIN(len - offset, TESTER_DL - 1);
+    buf[0] = 0x20 | sn;
+    memcpy(&buf[1], &msg[offset], copy_len);
+    tester_send_frame(buf, copy_len + 1);
+
+    offset += copy_len;
+    sn = (sn + 1) & 0x0F;
+    block_remain--;
+  }
+}
+
+static uint32_t expected_frame_count(size_t len) {
+  const size_t first_frame_payload = TESTER_DL - 2;
+  const size_t consecutive_frame_payload = TESTER_DL - 1;
+
+  return 1 + DIV_ROUND_UP(len - first_frame_payload, consecutive_frame_payload);
+}
+
+ZTEST(lib_iso14229_can_loopback, test_benchmark_download_request) {
+  struct can_frame response;
+
+  request[0] = 0x2E;  // WDBI (Write Data by Identifier)
+  request[1] = BENCHMARK_DATA_ID >> 8;
+  request[2] = BENCHMARK_DATA_ID & 0xFF;
+  for (size_t i = 0; i < BENCHMARK_DATA_LEN; i++) {
+    request[3 + i] = (uint8_t)(i * 7);
+  }
+
+  tester_purge();
+  atomic_set(&request_frames, 0);
+  atomic_set(&request_bytes, 0);
+  request_data_valid = false;
+
+  int64_t start = k_uptime_ticks();
+  tester_send_segmented(request, sizeof(request));
+  tester_receive_frame(&response);
+  int64_t duration_us = k_ticks_to_us_floor64(k_uptime_ticks() - start);
+
+  zassert_equal(response.data[1], 0x6E, "Expected positive WDBI response");
+  zassert_true(request_data_valid);
+
+  uint32_t frames = atomic_get(&request_frames);
+  uint32_t bus_bytes = atomic_get(&request_bytes);
+
+  TC_PRINT("%s: %zu byte request in %u frames (%u bus bytes, %zu payload "
+           "bytes per frame), %lld us\n",
+           TESTER_MODE_STR, sizeof(request), frames, bus_bytes,
+           sizeof(request) / frames, duration_us);
+
+  zassert_equal(frames, expected_frame_count(sizeof(request)));
+}
+
+static void *can_loopback_setup(void) {
+  const struct can_filter server_tx_filter = {
+    .id = SERVER_TX_ID,
+    .mask = CAN_STD_ID_MASK,
+  };
+  const struct can_filter request_filter = {
+    .id = SERVER_RX_ID,
+    .mask = CAN_STD_ID_MASK,
+  };
+  const UDSISOTpCConfig_t cfg = {
+    .source_addr = SERVER_RX_ID,
+    .target_addr = SERVER_TX_ID,
+    .source_addr_func = SERVER_FUNC_ID,
+    .target_addr_func = UDS_TP_NOOP_ADDR,
+  };
+
+  for (size_t i = 0; i < ARRAY_SIZE(test_record); i++) {
+    test_record[i] = test_record_byte(i);
+  }
+
+  zassert_true(device_is_ready(can_dev));
+  zassert_ok(can_set_mode(can_dev, IS_ENABLED(CONFIG_ISO14229_CAN_FD)
+                                       ? CAN_MODE_FD
+                                       : CAN_MODE_NORMAL));
+
+  zassert_true(can_add_rx_filter(can_dev, server_tx_cb, NULL,
+                                 &server_tx_filter) >= 0);
+  zassert_true(can_add_rx_filter(can_dev, request_counter_cb, NULL,
+                                 &request_filter) >= 0);
+
+  zassert_ok(iso14229_zephyr_init(&server, &cfg, can_dev, NULL));
+  server.set_callback(&server, server_callback);
+
+  zassert_ok(can_start(can_dev));
+  zassert_ok(server.thread_start(&server));
+
+  return NULL;
+}
+
+ZTEST_SUITE(lib_iso14229_can_loopback,
+            NULL,
+            can_loopback_setup,
+            NULL,
+            NULL,
+            NULL);
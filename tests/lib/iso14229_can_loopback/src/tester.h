@@ -0,0 +1,67 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef APP_TESTS_LIB_ISO14229_CAN_LOOPBACK_SRC_TESTER_H_
+#define APP_TESTS_LIB_ISO14229_CAN_LOOPBACK_SRC_TESTER_H_
+
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+
+#include <ardep/iso14229.h>
+#include <iso14229.h>
+
+#define SERVER_RX_ID 0x7E8
+#define SERVER_TX_ID 0x7E0
+#define SERVER_FUNC_ID 0x7DF
+
+#ifdef CONFIG_ISO14229_CAN_FD
+#define TESTER_DL 64
+#define TESTER_FLAGS (CAN_FRAME_FDF | CAN_FRAME_BRS)
+#define TESTER_MODE_STR "CAN FD"
+#else
+#define TESTER_DL 8
+#define TESTER_FLAGS 0
+#define TESTER_MODE_STR "classic CAN"
+#endif
+
+/**
+ * Reading this data identifier returns @p len bytes of test_record_byte()
+ */
+#define TEST_RECORD_DATA_ID(len) (0xE000 + (len))
+#define TEST_RECORD_MAX_LEN 0x0FFF
+
+static inline uint8_t test_record_byte(size_t index) {
+  return (uint8_t)(index * 3 + 1);
+}
+
+extern const struct device *can_dev;
+
+/**
+ * Send a frame to the server, padded to the next valid data length
+ */
+void tester_send_frame(uint8_t *data, uint8_t len);
+
+/**
+ * Receive the next frame sent by the server
+ *
+ * @param frame Received frame
+ *
+ * @returns Time the frame was sent, as returned by isotp_user_get_us()
+ */
+uint32_t tester_receive_frame(struct can_frame *frame);
+
+/**
+ * Check that the server sends no frame within @p timeout
+ */
+void tester_expect_no_frame(k_timeout_t timeout);
+
+/**
+ * Drop all frames sent by the server that were not received yet
+ */
+void tester_purge(void);
+
+#endif  // APP_TESTS_LIB_ISO14229_CAN_LOOPBACK_SRC_TESTER_H_
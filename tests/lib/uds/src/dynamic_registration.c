@@ -218,4 +218,57 @@ ZTEST_F(lib_uds, test_unregistering_non_existing_registration) {
   zassert_equal(ret, -ENOENT);
 }
 
+ZTEST_F(lib_uds, test_dynamic_registration_pool_exhausted) {
+  struct uds_instance_t *instance = fixture->instance;
+  uint32_t ids[CONFIG_UDS_DYNAMIC_REGISTRATION_POOL_SIZE];
+
+  struct uds_registration_t reg = {
+    .type = UDS_REGISTRATION_TYPE__DATA_IDENTIFIER,
+    .data_identifier.data_id = UDS_DYNAMIC_DATA_ID_2,
+  };
+
+  for (int i = 0; i < ARRAY_SIZE(ids); i++) {
+    zassert_ok(instance->register_event_handler(instance, reg, &ids[i], NULL));
+  }
+
+  uint32_t id;
+  zassert_equal(instance->register_event_handler(instance, reg, &id, NULL),
+                -ENOMEM);
+
+  // Unregistering makes room again
+  zassert_ok(instance->unregister_event_handler(instance, ids[0]));
+  zassert_ok(instance->register_event_handler(instance, reg, &ids[0], NULL));
+}
+
+ZTEST_F(lib_uds, test_dynamic_registration_stale_id) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  struct uds_registration_t reg = {
+    .type = UDS_REGISTRATION_TYPE__DATA_IDENTIFIER,
+    .data_identifier.data_id = UDS_DYNAMIC_DATA_ID_2,
+  };
+
+  uint32_t first_id;
+  zassert_ok(instance->register_event_handler(instance, reg, &first_id, NULL));
+  zassert_ok(instance->unregister_event_handler(instance, first_id));
+
+  // Churn through the pool, every registration gets a new ID
+  uint32_t id = first_id;
+  for (int i = 0; i < 1000; i++) {
+    uint32_t new_id;
+    zassert_ok(instance->register_event_handler(instance, reg, &new_id, NULL));
+    zassert_not_equal(new_id, id);
+    zassert_not_equal(new_id, first_id);
+    zassert_ok(instance->unregister_event_handler(instance, new_id));
+    id = new_id;
+  }
+
+  zassert_ok(instance->register_event_handler(instance, reg, &id, NULL));
+
+  // IDs of unregistered handlers stay invalid, even if their slot is reused
+  zassert_equal(instance->unregister_event_handler(instance, first_id),
+                -ENOENT);
+  zassert_ok(instance->unregister_event_handler(instance, id));
+}
+
 #endif  // CONFIG_UDS_USE_DYNAMIC_REGISTRATION
@@ -332,16 +332,26 @@ static void uds_after(void *f) {
 
   fs_unmount(&fixture_fs_mount);
 
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+  uds_periodic_data_ids_stop(fixture->instance);
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
+
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+  uds_response_on_event_clear(fixture->instance);
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
+
 #ifdef CONFIG_UDS_USE_DYNAMIC_REGISTRATION
   struct uds_registration_t *reg;
   struct uds_registration_t *temp;
 
-  SYS_SLIST_FOR_EACH_CONTAINER_SAFE (&fixture->instance->dynamic_registrations,
+  // Return all registrations to the pool for the next test
+  SYS_DLIST_FOR_EACH_CONTAINER_SAFE (&fixture->instance->dynamic_registrations,
                                      reg, temp, node) {
-    k_free(reg);
+    fixture->instance->unregister_event_handler(fixture->instance,
+                                                reg->dynamic_registration_id);
   }
 
-  sys_slist_init(&fixture->instance->dynamic_registrations);
+  sys_dlist_init(&fixture->instance->dynamic_registrations);
 #endif
 }
 
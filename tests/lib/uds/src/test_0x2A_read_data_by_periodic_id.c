@@ -0,0 +1,354 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ardep/uds.h"
+#include "fixture.h"
+#include "iso14229.h"
+#include "zephyr/ztest_assert.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#ifdef CONFIG_UDS_PERIODIC_DATA_IDS
+
+#define PERIODIC_CAN_ID 0x6E8
+#define RESPONSE_CAN_ID 0x7E0
+
+#define MAX_SENT_FRAMES 64
+
+extern struct uds_instance_t fixture_uds_instance;
+
+static struct can_frame sent_frames[MAX_SENT_FRAMES];
+static int64_t sent_at[MAX_SENT_FRAMES];
+static size_t sent_count;
+
+static uint16_t periodic_counter;
+static uint8_t periodic_long_data[8];
+
+static int periodic_can_send_fake(const struct device *dev,
+                                  const struct can_frame *frame,
+                                  k_timeout_t timeout,
+                                  can_tx_callback_t callback,
+                                  void *user_data) {
+  if (sent_count < MAX_SENT_FRAMES) {
+    sent_frames[sent_count] = *frame;
+    sent_at[sent_count] = k_uptime_get();
+    sent_count++;
+  }
+
+  if (callback) {
+    callback(dev, 0, user_data);
+  }
+
+  return 0;
+}
+
+static UDSErr_t periodic_read_check(const struct uds_context *const context,
+                                    bool *apply_action) {
+  *apply_action = true;
+  return UDS_OK;
+}
+
+static UDSErr_t periodic_read_counter(struct uds_context *const context,
+                                      bool *consume_event) {
+  UDSRDBIArgs_t *args = context->arg;
+  uint8_t data[] = {periodic_counter >> 8, periodic_counter & 0xFF};
+
+  periodic_counter++;
+  *consume_event = true;
+  return args->copy(context->server, data, sizeof(data));
+}
+
+static UDSErr_t periodic_read_long(struct uds_context *const context,
+                                   bool *consume_event) {
+  UDSRDBIArgs_t *args = context->arg;
+
+  *consume_event = true;
+  return args->copy(context->server, periodic_long_data,
+                    sizeof(periodic_long_data));
+}
+
+UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(&fixture_uds_instance,
+                                        0xF201,
+                                        NULL,
+                                        periodic_read_check,
+                                        periodic_read_counter,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL)
+
+// Does not fit into a periodic message
+UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(&fixture_uds_instance,
+                                        0xF202,
+                                        NULL,
+                                        periodic_read_check,
+                                        periodic_read_long,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL)
+
+UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(&fixture_uds_instance,
+                                        0xF203,
+                                        NULL,
+                                        periodic_read_check,
+                                        periodic_read_counter,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL)
+
+UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(&fixture_uds_instance,
+                                        0xF204,
+                                        NULL,
+                                        periodic_read_check,
+                                        periodic_read_counter,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL)
+
+static UDSErr_t periodic_session_check(const struct uds_context *const context,
+                                       bool *apply_action) {
+  *apply_action = true;
+  return UDS_OK;
+}
+
+static UDSErr_t periodic_session_action(struct uds_context *const context,
+                                        bool *consume_event) {
+  *consume_event = true;
+  return UDS_PositiveResponse;
+}
+
+static void periodic_setup(struct uds_instance_t *instance,
+                           enum uds_diagnostic_session session) {
+  RESET_FAKE(fake_can_send);
+  fake_can_send_fake.custom_fake = periodic_can_send_fake;
+
+  sent_count = 0;
+  periodic_counter = 0;
+
+  instance->iso14229.server.sessionType = session;
+  zassert_ok(uds_set_periodic_can_id(instance, PERIODIC_CAN_ID));
+}
+
+static void periodic_request(struct uds_instance_t *instance,
+                             const uint8_t *request,
+                             uint16_t len) {
+  zassert_true(instance->iso14229.request_hook(&instance->iso14229, request,
+                                               len, false));
+}
+
+#define periodic_request_array(instance, request_array) \
+  periodic_request(instance, request_array, ARRAY_SIZE(request_array))
+
+static void assert_response(size_t frame_index,
+                            const uint8_t *data,
+                            uint8_t len) {
+  zassert_true(frame_index < sent_count);
+  zassert_equal(sent_frames[frame_index].id, RESPONSE_CAN_ID);
+  zassert_equal(sent_frames[frame_index].dlc, len);
+  zassert_mem_equal(sent_frames[frame_index].data, data, len);
+}
+
+#define assert_response_array(frame_index, data_array) \
+  assert_response(frame_index, data_array, ARRAY_SIZE(data_array))
+
+static size_t count_periodic_frames(void) {
+  size_t count = 0;
+
+  for (size_t i = 0; i < sent_count; i++) {
+    if (sent_frames[i].id == PERIODIC_CAN_ID) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+ZTEST_F(lib_uds, test_0x2A_not_supported_in_default_session) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  periodic_setup(instance, UDS_DIAG_SESSION__DEFAULT);
+
+  uint8_t request[] = {
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_FAST_RATE,
+    0x01,  // PDID (0xF201)
+  };
+  periodic_request_array(instance, request);
+
+  uint8_t response[] = {
+    0x03,  // PCI (single frame, 3 bytes of data)
+    0x7F,  // Negative response
+    0x2A,  // SID (ReadDataByPeriodicIdentifier)
+    UDS_NRC_ServiceNotSupportedInActiveSession,
+  };
+  assert_response_array(0, response);
+
+  k_msleep(2 * CONFIG_UDS_PERIODIC_FAST_RATE_MS);
+  zassert_equal(count_periodic_frames(), 0);
+}
+
+ZTEST_F(lib_uds, test_0x2A_sends_without_drift) {
+  struct uds_instance_t *instance = fixture->instance;
+  const uint32_t period_ms = CONFIG_UDS_PERIODIC_FAST_RATE_MS;
+
+  periodic_setup(instance, UDS_DIAG_SESSION__EXTENDED);
+
+  uint8_t request[] = {
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_FAST_RATE,
+    0x01,  // PDID (0xF201)
+  };
+  periodic_request_array(instance, request);
+
+  k_msleep(5 * period_ms + period_ms / 2);
+
+  // The response precedes the first periodic message
+  uint8_t response[] = {
+    0x01,  // PCI (single frame, 1 byte of data)
+    0x6A,  // SID (ReadDataByPeriodicIdentifier)
+  };
+  assert_response_array(0, response);
+
+  zassert_equal(count_periodic_frames(), 6);
+  for (size_t i = 1; i < sent_count; i++) {
+    // Periodic data identifier followed by the counter
+    uint8_t message[] = {0x01, 0x00, (uint8_t)i};
+    zassert_equal(sent_frames[i].id, PERIODIC_CAN_ID);
+    zassert_equal(sent_frames[i].dlc, sizeof(message));
+    zassert_mem_equal(sent_frames[i].data, message, sizeof(message));
+
+    // Deadlines advance by the period and do not accumulate delays
+    zassert_within(sent_at[i] - sent_at[1], (i - 1) * period_ms, 1,
+                   "Message %zu sent at %lld ms", i, sent_at[i] - sent_at[1]);
+  }
+
+  uint8_t stop_request[] = {
+    0x2A,  // SID (ReadDataByPeriodicIdentifier)
+    UDS_PERIODIC_TRANSMISSION_MODE__STOP_SENDING,
+  };
+  periodic_request_array(instance, stop_request);
+  assert_response_array(sent_count - 1, response);
+
+  size_t sent_before = sent_count;
+  k_msleep(2 * period_ms);
+  zassert_equal(sent_count, sent_before);
+}
+
+ZTEST_F(lib_uds, test_0x2A_stops_on_session_timeout) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  periodic_setup(instance, UDS_DIAG_SESSION__EXTENDED);
+
+  uint8_t request[] = {
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_FAST_RATE,
+    0x01,  // PDID (0xF201)
+  };
+  periodic_request_array(instance, request);
+
+  k_msleep(CONFIG_UDS_PERIODIC_FAST_RATE_MS / 2);
+  zassert_equal(count_periodic_frames(), 1);
+
+  receive_event(instance, UDS_EVT_SessionTimeout, NULL);
+
+  k_msleep(2 * CONFIG_UDS_PERIODIC_FAST_RATE_MS);
+  zassert_equal(count_periodic_frames(), 1);
+}
+
+ZTEST_F(lib_uds, test_0x2A_stops_on_session_change) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  periodic_setup(instance, UDS_DIAG_SESSION__EXTENDED);
+
+  uint8_t request[] = {
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_FAST_RATE,
+    0x01,  // PDID (0xF201)
+  };
+  periodic_request_array(instance, request);
+
+  k_msleep(CONFIG_UDS_PERIODIC_FAST_RATE_MS / 2);
+  zassert_equal(count_periodic_frames(), 1);
+
+  data_id_check_fn_fake.custom_fake = periodic_session_check;
+  data_id_action_fn_fake.custom_fake = periodic_session_action;
+
+  UDSDiagSessCtrlArgs_t args = {
+    .type = UDS_DIAG_SESSION__PROGRAMMING,
+  };
+  zassert_ok(receive_event(instance, UDS_EVT_DiagSessCtrl, &args));
+
+  k_msleep(2 * CONFIG_UDS_PERIODIC_FAST_RATE_MS);
+  zassert_equal(count_periodic_frames(), 1);
+}
+
+ZTEST_F(lib_uds, test_0x2A_rejects_unsupported_data_ids) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  periodic_setup(instance, UDS_DIAG_SESSION__EXTENDED);
+
+  uint8_t nrc_response[] = {
+    0x03,  // PCI (single frame, 3 bytes of data)
+    0x7F,  // Negative response
+    0x2A,  // SID (ReadDataByPeriodicIdentifier)
+    UDS_NRC_RequestOutOfRange,
+  };
+
+  // Not registered
+  uint8_t unknown_request[] = {
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_SLOW_RATE,
+    0x01,  // PDID (0xF201)
+    0x10,  // PDID (0xF210)
+  };
+  periodic_request_array(instance, unknown_request);
+  assert_response_array(0, nrc_response);
+
+  // More than 7 bytes of data
+  uint8_t long_request[] = {
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_SLOW_RATE,
+    0x02,  // PDID (0xF202)
+  };
+  periodic_request_array(instance, long_request);
+  assert_response_array(1, nrc_response);
+
+  // More than CONFIG_UDS_PERIODIC_DATA_IDS_MAX data identifiers
+  uint8_t too_many_request[] = {
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    UDS_PERIODIC_TRANSMISSION_MODE__SEND_AT_SLOW_RATE,
+    0x01,  // PDID (0xF201)
+    0x03,  // PDID (0xF203)
+    0x04,  // PDID (0xF204)
+  };
+  BUILD_ASSERT(CONFIG_UDS_PERIODIC_DATA_IDS_MAX < 3);
+  periodic_request_array(instance, too_many_request);
+  assert_response_array(2, nrc_response);
+
+  // Invalid transmission mode
+  uint8_t mode_request[] = {
+    0x2A,  // SID  (ReadDataByPeriodicIdentifier)
+    0x05,  // TM   (reserved)
+    0x01,  // PDID (0xF201)
+  };
+  periodic_request_array(instance, mode_request);
+  assert_response_array(3, nrc_response);
+
+  // Nothing was scheduled
+  k_msleep(2 * CONFIG_UDS_PERIODIC_FAST_RATE_MS);
+  zassert_equal(count_periodic_frames(), 0);
+}
+
+#endif  // CONFIG_UDS_PERIODIC_DATA_IDS
@@ -49,10 +49,10 @@ UDSErr_t custom_action_for_0x2C_dynamically_define_data(
 }
 
 void assert_dynamic_data_registration_with_id(
-    sys_slist_t *dynamic_registrations, uint16_t id, bool should_be_found) {
+    sys_dlist_t *dynamic_registrations, uint16_t id, bool should_be_found) {
   bool registration_found = false;
   struct uds_registration_t *registration;
-  SYS_SLIST_FOR_EACH_CONTAINER (dynamic_registrations, registration, node) {
+  SYS_DLIST_FOR_EACH_CONTAINER (dynamic_registrations, registration, node) {
     if (registration->type == UDS_REGISTRATION_TYPE__DATA_IDENTIFIER &&
         registration->data_identifier.data_id == id) {
       registration_found = true;
@@ -385,3 +385,60 @@ ZTEST_F(lib_uds, test_0x2C_dynamically_define_data_ids__mixed_data) {
   assert_dynamic_data_registration_with_id(&instance->dynamic_registrations,
                                            0xFEDC, false);
 }
+
+ZTEST_F(lib_uds,
+        test_0x2C_dynamically_define_data_ids__reads_each_source_once) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  data_id_check_fn_fake.custom_fake =
+      custom_check_for_0x2C_dynamically_define_data;
+  data_id_action_fn_fake.custom_fake =
+      custom_action_for_0x2C_dynamically_define_data;
+
+  UDSDDDIArgs_t args = {
+    .type = 0x01,  // define by data id
+    .allDataIds = false,
+    .dynamicDataId = 0xFEDC,
+    .subFuncArgs.defineById.sourceDataId = data_id_r,
+    .subFuncArgs.defineById.position = 0,
+    .subFuncArgs.defineById.size = 1,
+  };
+
+  int ret = receive_event(instance, UDS_EVT_DynamicDefineDataId, &args);
+  zassert_ok(ret);
+
+  args.subFuncArgs.defineById.position = 2;
+  args.subFuncArgs.defineById.size = 2;
+  ret = receive_event(instance, UDS_EVT_DynamicDefineDataId, &args);
+  zassert_ok(ret);
+
+  args.subFuncArgs.defineById.position = 1;
+  args.subFuncArgs.defineById.size = 1;
+  ret = receive_event(instance, UDS_EVT_DynamicDefineDataId, &args);
+  zassert_ok(ret);
+
+  UDSRDBIArgs_t read_arg = {
+    .dataId = 0xFEDC,
+    .copy = copy,
+  };
+
+  uint32_t action_calls = data_id_action_fn_fake.call_count;
+
+  ret = receive_event(instance, UDS_EVT_ReadDataByIdent, &read_arg);
+  zassert_ok(ret);
+
+  // Three slices of the same source only read the source once
+  zassert_equal(data_id_action_fn_fake.call_count, action_calls + 1);
+
+  uint8_t expected_data[] = {0x11, 0x33, 0x44, 0x22};
+  assert_copy_data(expected_data, sizeof(expected_data));
+
+  UDSDDDIArgs_t remove_args = {
+    .type = 0x03,  // clear dynamic data id
+    .allDataIds = false,
+    .dynamicDataId = 0xFEDC,
+  };
+
+  ret = receive_event(instance, UDS_EVT_DynamicDefineDataId, &remove_args);
+  zassert_ok(ret);
+}
@@ -15,6 +15,7 @@
 
 #include <zephyr/drivers/flash.h>
 #include <zephyr/fs/fs.h>
+#include <zephyr/retention/retention.h>
 #include <zephyr/ztest.h>
 
 #define FLASH_BASE_ADDRESS DT_REG_ADDR(DT_CHOSEN(zephyr_flash_controller))
@@ -29,6 +30,25 @@ const struct device *const flash_controller =
 
 #define UDS_TEST_FS_MOUNT_POINT "/lfs"
 
+// Waits until the download writer thread programmed the pending blocks
+static void wait_for_download_writes(void) {
+#ifdef CONFIG_UDS_DOWNLOAD_PIPELINE
+  zassert_ok(uds_download_wait_drained(K_SECONDS(1)));
+#endif  // CONFIG_UDS_DOWNLOAD_PIPELINE
+}
+
+// Sends TransferData again while the server answers with ResponsePending,
+// like the UDS thread does
+static int transfer_data(struct uds_instance_t *instance,
+                         UDSTransferDataArgs_t *args) {
+  int ret;
+  while ((ret = receive_event(instance, UDS_EVT_TransferData, args)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    wait_for_download_writes();
+  }
+  return ret;
+}
+
 ZTEST_F(lib_uds,
         test_0x34_0x38_upload_download_request_download_fail_on_size_0) {
   struct uds_instance_t *instance = fixture->instance;
@@ -117,6 +137,8 @@ ZTEST_F(lib_uds, test_0x34_0x38_upload_download_transfer_data) {
   ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args_1);
   zassert_equal(ret, UDS_OK);
 
+  wait_for_download_writes();
+
   uint8_t buf[4];
   ret =
       flash_read(flash_controller, STORAGE_PARTITION_OFFSET, buf, sizeof(buf));
@@ -131,6 +153,8 @@ ZTEST_F(lib_uds, test_0x34_0x38_upload_download_transfer_data) {
   ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args_2);
   zassert_equal(ret, UDS_OK);
 
+  wait_for_download_writes();
+
   ret = flash_read(flash_controller, STORAGE_PARTITION_OFFSET + 4, buf,
                    sizeof(buf));
   zassert_equal(ret, 0);
@@ -163,6 +187,8 @@ ZTEST_F(lib_uds, test_0x34_0x38_upload_download_transfer_data_7_bytes) {
   ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args_1);
   zassert_equal(ret, UDS_OK);
 
+  wait_for_download_writes();
+
   uint8_t buf[4];
   ret =
       flash_read(flash_controller, STORAGE_PARTITION_OFFSET, buf, sizeof(buf));
@@ -177,6 +203,8 @@ ZTEST_F(lib_uds, test_0x34_0x38_upload_download_transfer_data_7_bytes) {
   ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args_2);
   zassert_equal(ret, UDS_OK);
 
+  wait_for_download_writes();
+
   ret = flash_read(flash_controller, STORAGE_PARTITION_OFFSET + 4, buf,
                    sizeof(buf));
   zassert_equal(ret, 0);
@@ -226,12 +254,14 @@ ZTEST_F(lib_uds,
       .len = chunk_len,
     };
 
-    ret = receive_event(instance, UDS_EVT_TransferData, &transfer_chunk);
+    ret = transfer_data(instance, &transfer_chunk);
     zassert_equal(ret, UDS_OK);
 
     bytes_sent += chunk_len;
   }
 
+  wait_for_download_writes();
+
   uint8_t last_written_byte;
   ret =
       flash_read(flash_controller, STORAGE_PARTITION_OFFSET + download_size - 1,
@@ -255,6 +285,564 @@ ZTEST_F(lib_uds,
   zassert_equal(guard_after, guard_before);
 }
 
+#ifdef CONFIG_UDS_DOWNLOAD_PIPELINE
+ZTEST_F(lib_uds, test_0x34_0x38_upload_download_transfer_data_pipelined) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  clear_storage_partition();
+
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)STORAGE_BASE_ADDRESS,
+    .size = STORAGE_PARTITION_SIZE,
+    .dataFormatIdentifier = 0x00,
+    .maxNumberOfBlockLength = 4095,
+  };
+
+  int ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_OK);
+  zassert_equal(download_args.maxNumberOfBlockLength,
+                CONFIG_UDS_DOWNLOAD_PIPELINE_BLOCK_SIZE + 2);
+
+  uint8_t block[16];
+  UDSTransferDataArgs_t transfer_args = {
+    .data = block,
+    .len = sizeof(block),
+  };
+
+  // The writer thread does not run before the test thread sleeps, so every
+  // buffer is taken after this
+  for (size_t i = 0; i < CONFIG_UDS_DOWNLOAD_PIPELINE_BUFFERS; i++) {
+    memset(block, (uint8_t)i, sizeof(block));
+    ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args);
+    zassert_equal(ret, UDS_OK);
+  }
+
+  memset(block, 0xA5, sizeof(block));
+  ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args);
+  zassert_equal(ret, UDS_NRC_RequestCorrectlyReceived_ResponsePending);
+
+  wait_for_download_writes();
+
+  ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args);
+  zassert_equal(ret, UDS_OK);
+
+  // Exit waits for the last block to be programmed
+  ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL);
+  zassert_equal(ret, UDS_NRC_RequestCorrectlyReceived_ResponsePending);
+
+  wait_for_download_writes();
+
+  ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL);
+  zassert_equal(ret, UDS_OK);
+
+  uint8_t buf[sizeof(block)];
+  uint8_t expected[sizeof(block)];
+  for (size_t i = 0; i <= CONFIG_UDS_DOWNLOAD_PIPELINE_BUFFERS; i++) {
+    ret = flash_read(flash_controller,
+                     STORAGE_PARTITION_OFFSET + i * sizeof(block), buf,
+                     sizeof(buf));
+    zassert_equal(ret, 0);
+
+    memset(expected,
+           i < CONFIG_UDS_DOWNLOAD_PIPELINE_BUFFERS ? (uint8_t)i : 0xA5,
+           sizeof(expected));
+    zassert_mem_equal(buf, expected, sizeof(expected));
+  }
+}
+#endif  // CONFIG_UDS_DOWNLOAD_PIPELINE
+
+#ifdef CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+ZTEST_F(lib_uds, test_0x34_0x38_upload_download_erase_ahead) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  fill_storage_with_test_pattern();
+
+  struct flash_pages_info page;
+  int ret = flash_get_page_info_by_offs(flash_controller,
+                                        STORAGE_PARTITION_OFFSET, &page);
+  zassert_equal(ret, 0);
+
+  // The download covers the first two pages
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)STORAGE_BASE_ADDRESS,
+    .size = 2 * page.size,
+    .dataFormatIdentifier = 0x00,
+  };
+  zassert_true(STORAGE_PARTITION_SIZE >= 3 * page.size);
+
+  ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_OK);
+
+  // Programming over the test pattern only works on erased pages
+  const uint8_t data[] = {0xDE, 0xAD, 0xBE, 0xEF};
+  UDSTransferDataArgs_t transfer_args = {
+    .data = data,
+    .len = sizeof(data),
+  };
+  ret = transfer_data(instance, &transfer_args);
+  zassert_equal(ret, UDS_OK);
+
+  while ((ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    wait_for_download_writes();
+  }
+  zassert_equal(ret, UDS_OK);
+
+  uint8_t buf[sizeof(data)];
+  ret =
+      flash_read(flash_controller, STORAGE_PARTITION_OFFSET, buf, sizeof(buf));
+  zassert_equal(ret, 0);
+  zassert_mem_equal(buf, data, sizeof(data));
+
+  // The rest of the download range was erased ahead
+  uint8_t erased;
+  ret = flash_read(flash_controller, STORAGE_PARTITION_OFFSET + page.size,
+                   &erased, sizeof(erased));
+  zassert_equal(ret, 0);
+  zassert_equal(erased, 0xFF);
+
+  // Pages outside of the download range are kept
+  uint8_t kept;
+  ret = flash_read(flash_controller, STORAGE_PARTITION_OFFSET + 2 * page.size,
+                   &kept, sizeof(kept));
+  zassert_equal(ret, 0);
+  zassert_equal(kept, (uint8_t)(2 * page.size));
+}
+
+ZTEST_F(lib_uds, test_0x34_0x38_upload_download_erase_ahead_unaligned) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  fill_storage_with_test_pattern();
+
+  struct flash_pages_info page;
+  int ret = flash_get_page_info_by_offs(flash_controller,
+                                        STORAGE_PARTITION_OFFSET, &page);
+  zassert_equal(ret, 0);
+  zassert_true(STORAGE_PARTITION_SIZE >= 2 * page.size);
+
+  // Ends in the middle of the second page
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)STORAGE_BASE_ADDRESS,
+    .size = page.size + 1,
+    .dataFormatIdentifier = 0x00,
+  };
+  ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_NRC_RequestOutOfRange);
+
+  // Starts in the middle of the first page
+  download_args.addr = (void *)(STORAGE_BASE_ADDRESS + 1);
+  download_args.size = page.size - 1;
+  ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_NRC_RequestOutOfRange);
+
+  // Nothing was erased
+  uint8_t kept;
+  ret = flash_read(flash_controller, STORAGE_PARTITION_OFFSET, &kept,
+                   sizeof(kept));
+  zassert_equal(ret, 0);
+  zassert_equal(kept, 0);
+}
+#endif  // CONFIG_UDS_DOWNLOAD_ERASE_AHEAD
+
+#ifdef CONFIG_UDS_DOWNLOAD_DIGEST
+ZTEST_F(lib_uds, test_0x34_0x38_upload_download_digest) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  clear_storage_partition();
+
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)STORAGE_BASE_ADDRESS,
+    .size = 4,
+    .dataFormatIdentifier = 0x00,
+  };
+
+  int ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_OK);
+
+  const uint8_t data[] = {0xDE, 0xAD, 0xBE, 0xEF};
+  UDSTransferDataArgs_t transfer_args = {
+    .data = data,
+    .len = sizeof(data),
+  };
+  ret = transfer_data(instance, &transfer_args);
+  zassert_equal(ret, UDS_OK);
+
+  struct uds_download_digest digest;
+  ret = uds_download_get_digest(&digest);
+  zassert_equal(ret, -ENODATA);
+
+  while ((ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    wait_for_download_writes();
+  }
+  zassert_equal(ret, UDS_OK);
+
+  const uint8_t expected_sha256[] = {
+    0x5F, 0x78, 0xC3, 0x32, 0x74, 0xE4, 0x3F, 0xA9, 0xDE, 0x56, 0x59,
+    0x26, 0x5C, 0x1D, 0x91, 0x7E, 0x25, 0xC0, 0x37, 0x22, 0xDC, 0xB0,
+    0xB8, 0xD2, 0x7D, 0xB8, 0xD5, 0xFE, 0xAA, 0x81, 0x39, 0x53,
+  };
+
+  ret = uds_download_get_digest(&digest);
+  zassert_equal(ret, 0);
+  zassert_equal(digest.size, sizeof(data));
+  zassert_equal(digest.crc32, 0x7C9CA35A);
+  zassert_mem_equal(digest.sha256, expected_sha256, sizeof(expected_sha256));
+
+  // A new download invalidates the digest of the last one
+  ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_OK);
+
+  ret = uds_download_get_digest(&digest);
+  zassert_equal(ret, -ENODATA);
+
+  while ((ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    wait_for_download_writes();
+  }
+  zassert_equal(ret, UDS_OK);
+}
+#endif  // CONFIG_UDS_DOWNLOAD_DIGEST
+
+#ifdef CONFIG_UDS_DOWNLOAD_COMPRESSION
+// heatshrink stream of 0x00..0x0F four times followed by "ARDEP ARDEP ARDEP"
+static const uint8_t heatshrink_data[] = {
+  0x80, 0x40, 0x60, 0x50, 0x38, 0x24, 0x16, 0x0D, 0x07, 0x84, 0x42,
+  0x61, 0x50, 0xB8, 0x64, 0x36, 0x1D, 0x0F, 0x07, 0xF8, 0x3F, 0xC1,
+  0xFF, 0x41, 0xA9, 0x51, 0x28, 0xB5, 0x09, 0x00, 0x16, 0x80,
+};
+
+static size_t heatshrink_plain_data(uint8_t *buf) {
+  size_t len = 0;
+  for (size_t i = 0; i < 4 * 16; i++) {
+    buf[len++] = i % 16;
+  }
+  memcpy(&buf[len], "ARDEP ARDEP ARDEP", 17);
+  return len + 17;
+}
+
+ZTEST_F(lib_uds, test_0x34_0x38_upload_download_transfer_data_compressed) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  clear_storage_partition();
+
+  uint8_t expected[81];
+  zassert_equal(heatshrink_plain_data(expected), sizeof(expected));
+
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)STORAGE_BASE_ADDRESS,
+    .size = sizeof(expected),
+    .dataFormatIdentifier = 0x10,  // heatshrink, not encrypted
+  };
+
+  int ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_OK);
+
+  // The stream is split in the middle of a back reference
+  UDSTransferDataArgs_t transfer_args_1 = {
+    .data = heatshrink_data,
+    .len = 13,
+  };
+  ret = transfer_data(instance, &transfer_args_1);
+  zassert_equal(ret, UDS_OK);
+
+  UDSTransferDataArgs_t transfer_args_2 = {
+    .data = &heatshrink_data[13],
+    .len = sizeof(heatshrink_data) - 13,
+  };
+  ret = transfer_data(instance, &transfer_args_2);
+  zassert_equal(ret, UDS_OK);
+
+  while ((ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    wait_for_download_writes();
+  }
+  zassert_equal(ret, UDS_OK);
+
+  uint8_t buf[sizeof(expected)];
+  ret =
+      flash_read(flash_controller, STORAGE_PARTITION_OFFSET, buf, sizeof(buf));
+  zassert_equal(ret, 0);
+  zassert_mem_equal(buf, expected, sizeof(expected));
+}
+
+ZTEST_F(lib_uds,
+        test_0x34_0x38_upload_download_transfer_data_compressed_overflow) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  clear_storage_partition();
+
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)STORAGE_BASE_ADDRESS,
+    .size = 80,  // one byte less than the decompressed data
+    .dataFormatIdentifier = 0x10,
+  };
+
+  int ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_OK);
+
+  UDSTransferDataArgs_t transfer_args = {
+    .data = heatshrink_data,
+    .len = sizeof(heatshrink_data),
+  };
+  ret = transfer_data(instance, &transfer_args);
+  zassert_equal(ret, UDS_NRC_RequestOutOfRange);
+
+  while ((ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    wait_for_download_writes();
+  }
+  zassert_equal(ret, UDS_OK);
+
+  // Nothing is written beyond the requested range
+  uint8_t guard;
+  ret = flash_read(flash_controller, STORAGE_PARTITION_OFFSET + 80, &guard,
+                   sizeof(guard));
+  zassert_equal(ret, 0);
+  zassert_equal(guard, 0xFF);
+}
+#endif  // CONFIG_UDS_DOWNLOAD_COMPRESSION
+
+#ifdef CONFIG_UDS_DOWNLOAD_RESUME
+static const struct device *const download_journal_dev =
+    DEVICE_DT_GET(DT_CHOSEN(zephyr_uds_download_journal));
+
+// The journal reports addresses relative to the flash the download goes to
+#define RESUME_BASE_ADDRESS \
+  (DT_REG_ADDR(DT_CHOSEN(zephyr_flash)) + STORAGE_PARTITION_OFFSET)
+// Data transferred by the tests, at the start of the download range
+#define RESUME_DOWNLOAD_SIZE 64
+
+static uint8_t resume_test_byte(size_t index) {
+  return (uint8_t)(index * 5 + 3);
+}
+
+// The download range is the first page of the storage partition, as the
+// pages of the range are erased as a whole
+static size_t resume_range_size(void) {
+  struct flash_pages_info page;
+  zassert_ok(flash_get_page_info_by_offs(flash_controller,
+                                         STORAGE_PARTITION_OFFSET, &page));
+  zassert_true(page.size >= RESUME_DOWNLOAD_SIZE);
+  zassert_true(STORAGE_PARTITION_SIZE >= 2 * page.size);
+  return page.size;
+}
+
+static int request_resume_range(struct uds_instance_t *instance,
+                                size_t offset,
+                                size_t size) {
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)(RESUME_BASE_ADDRESS + offset),
+    .size = size,
+    .dataFormatIdentifier = 0x00,
+  };
+
+  // Evaluated again while the writer thread verifies the data written so far
+  int ret;
+  while ((ret = receive_event(instance, UDS_EVT_RequestDownload,
+                              &download_args)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    k_sleep(K_MSEC(1));
+  }
+  return ret;
+}
+
+// Requests the download range from offset to its end
+static void request_resume_download(struct uds_instance_t *instance,
+                                    size_t offset) {
+  int ret =
+      request_resume_range(instance, offset, resume_range_size() - offset);
+  zassert_equal(ret, UDS_OK);
+}
+
+// Transfers the test data from offset to offset + len and waits until it is
+// written, so the journal is up to date
+static void transfer_resume_data(struct uds_instance_t *instance,
+                                 size_t offset,
+                                 size_t len) {
+  uint8_t data[RESUME_DOWNLOAD_SIZE];
+  for (size_t i = 0; i < len; i++) {
+    data[i] = resume_test_byte(offset + i);
+  }
+
+  UDSTransferDataArgs_t transfer_args = {
+    .data = data,
+    .len = len,
+  };
+  int ret = transfer_data(instance, &transfer_args);
+  zassert_equal(ret, UDS_OK);
+
+  wait_for_download_writes();
+}
+
+static void exit_download(struct uds_instance_t *instance) {
+  int ret;
+  while ((ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL)) ==
+         UDS_NRC_RequestCorrectlyReceived_ResponsePending) {
+    wait_for_download_writes();
+  }
+  zassert_equal(ret, UDS_OK);
+}
+
+static void assert_resume_point(size_t offset) {
+  struct uds_download_resume_point resume_point;
+  zassert_ok(uds_download_get_resume_point(&resume_point));
+  zassert_equal(resume_point.address, RESUME_BASE_ADDRESS + offset);
+  zassert_equal(resume_point.size, resume_range_size() - offset);
+}
+
+static void assert_no_resume_point(void) {
+  struct uds_download_resume_point resume_point;
+  zassert_equal(uds_download_get_resume_point(&resume_point), -ENODATA);
+}
+
+ZTEST_F(lib_uds, test_0x34_0x38_download_resume_journal_advances) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  zassert_ok(retention_clear(download_journal_dev));
+  zassert_equal(flash_get_write_block_size(flash_controller), 4);
+
+  request_resume_download(instance, 0);
+
+  // Nothing was written yet
+  assert_no_resume_point();
+
+  transfer_resume_data(instance, 0, 16);
+  assert_resume_point(16);
+
+  transfer_resume_data(instance, 16, 16);
+  assert_resume_point(32);
+
+  // The rest of a write block can not be written again, the data is not
+  // recorded until the end of the block
+  transfer_resume_data(instance, 32, 3);
+  assert_resume_point(32);
+
+  exit_download(instance);
+}
+
+ZTEST_F(lib_uds, test_0x34_0x38_download_resume_remaining_range) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  zassert_ok(retention_clear(download_journal_dev));
+
+  request_resume_download(instance, 0);
+  transfer_resume_data(instance, 0, 32);
+
+  // The connection is lost, the tester continues with the rest
+  request_resume_download(instance, 32);
+  assert_resume_point(32);
+
+  transfer_resume_data(instance, 32, RESUME_DOWNLOAD_SIZE - 32);
+  exit_download(instance);
+
+  // The page was not erased again, the data of both parts is in the flash
+  uint8_t buf[RESUME_DOWNLOAD_SIZE];
+  int ret =
+      flash_read(flash_controller, STORAGE_PARTITION_OFFSET, buf, sizeof(buf));
+  zassert_equal(ret, 0);
+  for (size_t i = 0; i < sizeof(buf); i++) {
+    zassert_equal(buf[i], resume_test_byte(i), "Wrong byte %zu", i);
+  }
+}
+
+ZTEST_F(lib_uds, test_0x34_0x38_download_resume_verified_in_background) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  zassert_ok(retention_clear(download_journal_dev));
+
+  request_resume_download(instance, 0);
+  transfer_resume_data(instance, 0, 32);
+
+  // The data written so far is read back by the writer thread, the request
+  // is answered with ResponsePending first
+  UDSRequestDownloadArgs_t download_args = {
+    .addr = (void *)(RESUME_BASE_ADDRESS + 32),
+    .size = resume_range_size() - 32,
+    .dataFormatIdentifier = 0x00,
+  };
+  int ret = receive_event(instance, UDS_EVT_RequestDownload, &download_args);
+  zassert_equal(ret, UDS_NRC_RequestCorrectlyReceived_ResponsePending);
+
+  request_resume_download(instance, 32);
+  assert_resume_point(32);
+
+  exit_download(instance);
+}
+
+ZTEST_F(lib_uds, test_0x34_0x38_download_resume_other_range_starts_over) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  zassert_ok(retention_clear(download_journal_dev));
+
+  request_resume_download(instance, 0);
+  transfer_resume_data(instance, 0, 32);
+
+  // Does not end where the interrupted download ends. It is not resumed and
+  // can not be started in the middle of a page either.
+  int ret = request_resume_range(instance, 32, 2 * resume_range_size() - 32);
+  zassert_equal(ret, UDS_NRC_RequestOutOfRange);
+  assert_resume_point(32);
+
+  // Does not start where the interrupted download stopped
+  ret = request_resume_range(instance, 16, resume_range_size() - 16);
+  zassert_equal(ret, UDS_NRC_RequestOutOfRange);
+  assert_resume_point(32);
+
+  // A download of another range starts over
+  ret = request_resume_range(instance, 0, 2 * resume_range_size());
+  zassert_equal(ret, UDS_OK);
+  assert_no_resume_point();
+
+  exit_download(instance);
+}
+
+ZTEST_F(lib_uds, test_0x34_0x38_download_resume_rejects_crc_mismatch) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  zassert_ok(retention_clear(download_journal_dev));
+
+  request_resume_download(instance, 0);
+  transfer_resume_data(instance, 0, 32);
+
+  // The data written so far is lost
+  struct flash_pages_info page;
+  zassert_ok(flash_get_page_info_by_offs(flash_controller,
+                                         STORAGE_PARTITION_OFFSET, &page));
+  zassert_ok(flash_erase(flash_controller, page.start_offset, page.size));
+
+  // The download is not resumed and can not start in the middle of a page
+  int ret = request_resume_range(instance, 32, resume_range_size() - 32);
+  zassert_equal(ret, UDS_NRC_RequestOutOfRange);
+
+  // It is downloaded again from the start
+  request_resume_download(instance, 0);
+  assert_no_resume_point();
+
+  exit_download(instance);
+}
+
+ZTEST_F(lib_uds, test_0x34_0x38_download_resume_cleared_on_transfer_exit) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  zassert_ok(retention_clear(download_journal_dev));
+
+  request_resume_download(instance, 0);
+  transfer_resume_data(instance, 0, 32);
+  assert_resume_point(32);
+
+  exit_download(instance);
+
+  assert_no_resume_point();
+  zassert_equal(retention_is_valid(download_journal_dev), 0);
+
+  // The rest of the completed download is not resumed
+  int ret = request_resume_range(instance, 32, resume_range_size() - 32);
+  zassert_equal(ret, UDS_NRC_RequestOutOfRange);
+  assert_no_resume_point();
+}
+#endif  // CONFIG_UDS_DOWNLOAD_RESUME
+
 ZTEST_F(lib_uds, test_0x34_0x38_upload_download_request_upload_fail_on_size_0) {
   struct uds_instance_t *instance = fixture->instance;
 
@@ -366,6 +954,53 @@ ZTEST_F(lib_uds,
   zassert_equal(ret, UDS_OK);
 }
 
+ZTEST_F(lib_uds, test_0x34_0x38_upload_download_request_upload_large_blocks) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  int cleanup = receive_event(instance, UDS_EVT_RequestTransferExit, NULL);
+  zassert_true(cleanup == UDS_OK || cleanup == UDS_NRC_RequestSequenceError);
+
+  fill_storage_with_test_pattern();
+
+  // More than one read chunk, the response is assembled from several copies
+  uint8_t expected[300];
+  const size_t upload_size = sizeof(expected);
+  zassert_true(STORAGE_PARTITION_SIZE >= upload_size);
+
+  UDSRequestUploadArgs_t upload_args = {
+    .addr = (void *)STORAGE_PARTITION_OFFSET,
+    .size = upload_size,
+    .dataFormatIdentifier = 0x00,
+    .maxNumberOfBlockLength = 1024,
+  };
+
+  int ret = receive_event(instance, UDS_EVT_RequestUpload, &upload_args);
+  zassert_equal(ret, UDS_OK);
+  zassert_equal(upload_args.maxNumberOfBlockLength, 1024);
+
+  uint8_t buffer[4];
+  UDSTransferDataArgs_t transfer_args = {
+    .data = buffer,
+    .len = sizeof(buffer),
+    .maxRespLen = 1022,
+    .copyResponse = copy,
+  };
+
+  ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args);
+  zassert_equal(ret, UDS_OK);
+
+  for (size_t i = 0; i < sizeof(expected); i++) {
+    expected[i] = (uint8_t)i;
+  }
+  assert_copy_data(expected, sizeof(expected));
+
+  ret = receive_event(instance, UDS_EVT_TransferData, &transfer_args);
+  zassert_equal(ret, UDS_NRC_RequestSequenceError);
+
+  ret = receive_event(instance, UDS_EVT_RequestTransferExit, NULL);
+  zassert_equal(ret, UDS_OK);
+}
+
 ZTEST_F(lib_uds, test_0x34_0x38_upload_download_transfer_exit_success) {
   struct uds_instance_t *instance = fixture->instance;
 
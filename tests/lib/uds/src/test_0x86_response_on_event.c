@@ -0,0 +1,554 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ardep/uds.h"
+#include "fixture.h"
+#include "iso14229.h"
+#include "zephyr/ztest_assert.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#ifdef CONFIG_UDS_RESPONSE_ON_EVENT
+
+#define RESPONSE_CAN_ID 0x7E0
+
+#define MAX_SENT_FRAMES 16
+
+// A few passes of the change detection
+#define ROE_SETTLE_MS (3 * CONFIG_UDS_RESPONSE_ON_EVENT_INTERVAL_MS)
+
+extern struct uds_instance_t fixture_uds_instance;
+
+static struct can_frame sent_frames[MAX_SENT_FRAMES];
+static size_t sent_count;
+
+static uint16_t roe_value;
+static uint8_t roe_dtc_status;
+static uint8_t roe_dtc_mask;
+
+static int roe_can_send_fake(const struct device *dev,
+                             const struct can_frame *frame,
+                             k_timeout_t timeout,
+                             can_tx_callback_t callback,
+                             void *user_data) {
+  if (sent_count < MAX_SENT_FRAMES) {
+    sent_frames[sent_count++] = *frame;
+  }
+
+  if (callback) {
+    callback(dev, 0, user_data);
+  }
+
+  return 0;
+}
+
+static UDSErr_t roe_check(const struct uds_context *const context,
+                          bool *apply_action) {
+  *apply_action = true;
+  return UDS_OK;
+}
+
+static UDSErr_t roe_read_value(struct uds_context *const context,
+                               bool *consume_event) {
+  UDSRDBIArgs_t *args = context->arg;
+  uint8_t data[] = {roe_value >> 8, roe_value & 0xFF};
+
+  *consume_event = true;
+  return args->copy(context->server, data, sizeof(data));
+}
+
+UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(&fixture_uds_instance,
+                                        0x0120,
+                                        NULL,
+                                        roe_check,
+                                        roe_read_value,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL,
+                                        NULL)
+
+// Answers reportDTCByStatusMask with one DTC and the session change with a
+// positive response
+static UDSErr_t roe_fixture_action(struct uds_context *const context,
+                                   bool *consume_event) {
+  *consume_event = true;
+
+  if (context->event != UDS_EVT_ReadDTCInformation) {
+    return UDS_PositiveResponse;
+  }
+
+  UDSRDTCIArgs_t *args = context->arg;
+  const uint8_t availability_mask = 0xFF;
+  const uint8_t dtc[] = {0x0A, 0x9B, 0x17};
+
+  zassert_equal(args->type, UDS_READ_DTC_INFO_SUBFUNC__DTC_BY_STATUS_MASK);
+  roe_dtc_mask = args->subFuncArgs.numOfDTCByStatusMaskArgs.mask;
+
+  args->copy(context->server, &availability_mask, sizeof(availability_mask));
+  args->copy(context->server, dtc, sizeof(dtc));
+  return args->copy(context->server, &roe_dtc_status, sizeof(roe_dtc_status));
+}
+
+static void roe_setup(void) {
+  RESET_FAKE(fake_can_send);
+  fake_can_send_fake.custom_fake = roe_can_send_fake;
+
+  data_id_check_fn_fake.custom_fake = roe_check;
+  data_id_action_fn_fake.custom_fake = roe_fixture_action;
+
+  sent_count = 0;
+  roe_value = 0;
+  roe_dtc_status = 0;
+  roe_dtc_mask = 0;
+}
+
+static void roe_request(struct uds_instance_t *instance,
+                        const uint8_t *request,
+                        uint16_t len) {
+  zassert_true(instance->iso14229.request_hook(&instance->iso14229, request,
+                                               len, false));
+}
+
+#define roe_request_array(instance, request_array) \
+  roe_request(instance, request_array, ARRAY_SIZE(request_array))
+
+static void assert_response(size_t frame_index,
+                            const uint8_t *data,
+                            uint8_t len) {
+  zassert_true(frame_index < sent_count);
+  zassert_equal(sent_frames[frame_index].id, RESPONSE_CAN_ID);
+  zassert_equal(sent_frames[frame_index].dlc, len);
+  zassert_mem_equal(sent_frames[frame_index].data, data, len);
+}
+
+#define assert_response_array(frame_index, data_array) \
+  assert_response(frame_index, data_array, ARRAY_SIZE(data_array))
+
+// Takes the oldest request injected into the instance, the UDS thread is not
+// running in these tests
+static bool pop_injected_frame(struct uds_instance_t *instance,
+                               struct can_frame *frame) {
+  struct iso14229_zephyr_rx_ring *ring = &instance->iso14229.can_phys_rx;
+  const uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+
+  if (tail == (uint32_t)atomic_get(&ring->head)) {
+    return false;
+  }
+
+  *frame = ring->slots[tail];
+  atomic_set(&ring->tail, (tail + 1) % ring->num_slots);
+  return true;
+}
+
+static size_t count_injected_frames(struct uds_instance_t *instance) {
+  struct can_frame frame;
+  size_t count = 0;
+
+  while (pop_injected_frame(instance, &frame)) {
+    count++;
+  }
+
+  return count;
+}
+
+static size_t set_value_and_count(struct uds_instance_t *instance,
+                                  uint16_t value) {
+  roe_value = value;
+  k_msleep(ROE_SETTLE_MS);
+  return count_injected_frames(instance);
+}
+
+ZTEST_F(lib_uds, test_0x86_set_up_response) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  roe_setup();
+
+  uint8_t request[] = {
+    0x86,        // SID  (ResponseOnEvent)
+    0x03,        // SF   (onChangeOfDataIdentifier)
+    0x02,        // EWT  (infiniteTimeToResponse)
+    0x01, 0x20,  // DID
+    0x22,        // STRT (ReadDataByIdentifier)
+    0x01, 0x20,  // DID
+  };
+  roe_request_array(instance, request);
+
+  uint8_t response[] = {
+    0x10, 0x09,  // PCI  (first frame, 9 bytes of data)
+    0xC6,        // SID  (ResponseOnEvent)
+    0x03,        // SF   (onChangeOfDataIdentifier)
+    0x00,        // NOIE
+    0x02,        // EWT  (infiniteTimeToResponse)
+    0x01, 0x20,  // DID
+  };
+  assert_response_array(0, response);
+}
+
+ZTEST_F(lib_uds, test_0x86_on_change_of_data_identifier) {
+  struct uds_instance_t *instance = fixture->instance;
+  struct can_frame frame;
+
+  roe_setup();
+  count_injected_frames(instance);
+
+  uint8_t set_up[] = {
+    0x86,        // SID  (ResponseOnEvent)
+    0x83,        // SF   (onChangeOfDataIdentifier, suppress response)
+    0x02,        // EWT  (infiniteTimeToResponse)
+    0x01, 0x20,  // DID
+    0x22,        // STRT (ReadDataByIdentifier)
+    0x01, 0x20,  // DID
+  };
+  roe_request_array(instance, set_up);
+  zassert_equal(sent_count, 0);
+
+  uint8_t start[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x05,  // SF  (startResponseOnEvent)
+    0x02,  // EWT (infiniteTimeToResponse)
+  };
+  roe_request_array(instance, start);
+
+  uint8_t start_response[] = {
+    0x04,  // PCI  (single frame, 4 bytes of data)
+    0xC6,  // SID  (ResponseOnEvent)
+    0x05,  // SF   (startResponseOnEvent)
+    0x00,  // NOIE
+    0x02,  // EWT  (infiniteTimeToResponse)
+  };
+  assert_response_array(0, start_response);
+
+  // The first sample is the reference, nothing changed yet
+  zassert_equal(set_value_and_count(instance, 0), 0);
+
+  roe_value = 0x1234;
+  k_msleep(ROE_SETTLE_MS);
+
+  zassert_true(pop_injected_frame(instance, &frame));
+  uint8_t injected[] = {
+    0x03,        // PCI  (single frame, 3 bytes of data)
+    0x22,        // SID  (ReadDataByIdentifier)
+    0x01, 0x20,  // DID
+  };
+  zassert_equal(frame.dlc, sizeof(injected));
+  zassert_mem_equal(frame.data, injected, sizeof(injected));
+
+  // Identified once per change
+  zassert_false(pop_injected_frame(instance, &frame));
+  zassert_equal(set_value_and_count(instance, 0x1234), 0);
+}
+
+ZTEST_F(lib_uds, test_0x86_on_comparison_of_values) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  roe_setup();
+  count_injected_frames(instance);
+  roe_value = 50;
+
+  uint8_t set_up[] = {
+    0x86,                    // SID  (ResponseOnEvent)
+    0x87,                    // SF   (onComparisonOfValues, suppress response)
+    0x02,                    // EWT  (infiniteTimeToResponse)
+    0x01, 0x20,              // DID
+    0x02,                    // comparison logic (>)
+    0x00, 0x00, 0x00, 0x64,  // comparison value (100)
+    0x0A,                    // hysteresis (10 %)
+    0x40, 0x00,              // localization (unsigned, 16 bit at offset 0)
+    0x22,                    // STRT (ReadDataByIdentifier)
+    0x01, 0x20,              // DID
+  };
+  roe_request_array(instance, set_up);
+
+  uint8_t start[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x85,  // SF  (startResponseOnEvent, suppress response)
+  };
+  roe_request_array(instance, start);
+  zassert_equal(sent_count, 0);
+
+  zassert_equal(set_value_and_count(instance, 50), 0);
+  zassert_equal(set_value_and_count(instance, 120), 1);
+  zassert_equal(set_value_and_count(instance, 105), 0);
+
+  // Not below the hysteresis band of 90 to 100
+  zassert_equal(set_value_and_count(instance, 95), 0);
+  zassert_equal(set_value_and_count(instance, 120), 0);
+
+  zassert_equal(set_value_and_count(instance, 80), 0);
+  zassert_equal(set_value_and_count(instance, 120), 1);
+}
+
+ZTEST_F(lib_uds, test_0x86_on_dtc_status_change) {
+  struct uds_instance_t *instance = fixture->instance;
+  struct can_frame frame;
+
+  roe_setup();
+  count_injected_frames(instance);
+
+  uint8_t set_up[] = {
+    0x86,  // SID  (ResponseOnEvent)
+    0x81,  // SF   (onDTCStatusChange, suppress response)
+    0x02,  // EWT  (infiniteTimeToResponse)
+    0x01,  // DTCStatusMask (testFailed)
+    0x19,  // STRT (ReadDTCInformation)
+    0x02,  // SF   (reportDTCByStatusMask)
+    0x01,  // DTCStatusMask (testFailed)
+  };
+  roe_request_array(instance, set_up);
+
+  uint8_t start[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x85,  // SF  (startResponseOnEvent, suppress response)
+  };
+  roe_request_array(instance, start);
+
+  k_msleep(ROE_SETTLE_MS);
+  zassert_equal(count_injected_frames(instance), 0);
+
+  // Status bits outside of the mask are ignored
+  roe_dtc_status = 0x08;
+  k_msleep(ROE_SETTLE_MS);
+  zassert_equal(count_injected_frames(instance), 0);
+
+  roe_dtc_status = 0x09;
+  k_msleep(ROE_SETTLE_MS);
+
+  zassert_true(pop_injected_frame(instance, &frame));
+  uint8_t injected[] = {
+    0x03,  // PCI  (single frame, 3 bytes of data)
+    0x19,  // SID  (ReadDTCInformation)
+    0x02,  // SF   (reportDTCByStatusMask)
+    0x01,  // DTCStatusMask (testFailed)
+  };
+  zassert_equal(frame.dlc, sizeof(injected));
+  zassert_mem_equal(frame.data, injected, sizeof(injected));
+  zassert_false(pop_injected_frame(instance, &frame));
+}
+
+ZTEST_F(lib_uds, test_0x86_on_dtc_status_change_reads_by_mask) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  roe_setup();
+
+  uint8_t set_up[] = {
+    0x86,  // SID  (ResponseOnEvent)
+    0x81,  // SF   (onDTCStatusChange, suppress response)
+    0x02,  // EWT  (infiniteTimeToResponse)
+    0x09,  // DTCStatusMask (testFailed, confirmedDTC)
+    0x19,  // STRT (ReadDTCInformation)
+    0x02,  // SF   (reportDTCByStatusMask)
+    0x09,  // DTCStatusMask (testFailed, confirmedDTC)
+  };
+  roe_request_array(instance, set_up);
+  zassert_equal(roe_dtc_mask, 0);
+
+  uint8_t start[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x85,  // SF  (startResponseOnEvent, suppress response)
+  };
+  roe_request_array(instance, start);
+
+  // The sample passes the DTCStatusMask of the event to the action
+  k_msleep(ROE_SETTLE_MS);
+  zassert_equal(roe_dtc_mask, 0x09);
+}
+
+ZTEST_F(lib_uds, test_0x86_event_window_ends) {
+  struct uds_instance_t *instance = fixture->instance;
+  struct can_frame frame;
+
+  roe_setup();
+  count_injected_frames(instance);
+
+  uint8_t set_up[] = {
+    0x86,        // SID  (ResponseOnEvent)
+    0x83,        // SF   (onChangeOfDataIdentifier, suppress response)
+    0x03,        // EWT  (short window)
+    0x01, 0x20,  // DID
+    0x22,        // STRT (ReadDataByIdentifier)
+    0x01, 0x20,  // DID
+  };
+  roe_request_array(instance, set_up);
+
+  uint8_t start[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x85,  // SF  (startResponseOnEvent, suppress response)
+  };
+  roe_request_array(instance, start);
+
+  // Identified once within the window
+  k_msleep(CONFIG_UDS_RESPONSE_ON_EVENT_INTERVAL_MS);
+  roe_value = 0x1234;
+  k_msleep(2 * CONFIG_UDS_RESPONSE_ON_EVENT_INTERVAL_MS);
+  zassert_equal(count_injected_frames(instance), 1);
+
+  k_msleep(CONFIG_UDS_RESPONSE_ON_EVENT_SHORT_WINDOW_MS);
+  roe_value = 0x5678;
+  k_msleep(ROE_SETTLE_MS);
+
+  // Only the marker of the final response is injected
+  zassert_true(pop_injected_frame(instance, &frame));
+  uint8_t marker[] = {
+    0x01,  // PCI (single frame, 1 byte of data)
+    0xC6,  // final response marker
+  };
+  zassert_equal(frame.dlc, sizeof(marker));
+  zassert_mem_equal(frame.data, marker, sizeof(marker));
+  zassert_false(pop_injected_frame(instance, &frame));
+
+  uint8_t report[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x04,  // SF  (reportActivatedEvents)
+  };
+  roe_request_array(instance, report);
+
+  uint8_t report_response[] = {
+    0x03,  // PCI  (single frame, 3 bytes of data)
+    0xC6,  // SID  (ResponseOnEvent)
+    0x04,  // SF   (reportActivatedEvents)
+    0x00,  // NOAE
+  };
+  assert_response_array(0, report_response);
+
+  roe_request(instance, &marker[1], 1);
+
+  uint8_t final_response[] = {
+    0x10, 0x09,  // PCI  (first frame, 9 bytes of data)
+    0xC6,        // SID  (ResponseOnEvent)
+    0x03,        // SF   (onChangeOfDataIdentifier)
+    0x01,        // NOIE
+    0x03,        // EWT  (short window)
+    0x01, 0x20,  // DID
+  };
+  assert_response_array(1, final_response);
+
+  // Sent once, a repeated marker is left to the server
+  zassert_false(instance->iso14229.request_hook(&instance->iso14229,
+                                                &marker[1], 1, false));
+  k_msleep(ROE_SETTLE_MS);
+  zassert_equal(count_injected_frames(instance), 0);
+}
+
+ZTEST_F(lib_uds, test_0x86_stops_on_session_change) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  roe_setup();
+  count_injected_frames(instance);
+
+  uint8_t set_up[] = {
+    0x86,        // SID  (ResponseOnEvent)
+    0x83,        // SF   (onChangeOfDataIdentifier, suppress response)
+    0x02,        // EWT  (infiniteTimeToResponse)
+    0x01, 0x20,  // DID
+    0x22,        // STRT (ReadDataByIdentifier)
+    0x01, 0x20,  // DID
+  };
+  roe_request_array(instance, set_up);
+
+  uint8_t start[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x85,  // SF  (startResponseOnEvent, suppress response)
+  };
+  roe_request_array(instance, start);
+  k_msleep(ROE_SETTLE_MS);
+
+  UDSDiagSessCtrlArgs_t args = {
+    .type = UDS_DIAG_SESSION__EXTENDED,
+  };
+  zassert_ok(receive_event(instance, UDS_EVT_DiagSessCtrl, &args));
+
+  zassert_equal(set_value_and_count(instance, 0x1234), 0);
+
+  // The events are still set up and can be started again
+  roe_request_array(instance, start);
+  k_msleep(ROE_SETTLE_MS);
+  zassert_equal(set_value_and_count(instance, 0x4321), 1);
+}
+
+ZTEST_F(lib_uds, test_0x86_rejects_invalid_requests) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  roe_setup();
+
+  uint8_t start[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x05,  // SF  (startResponseOnEvent)
+  };
+  roe_request_array(instance, start);
+
+  uint8_t sequence_error[] = {
+    0x03,  // PCI (single frame, 3 bytes of data)
+    0x7F,  // negative response
+    0x86,  // SID (ResponseOnEvent)
+    0x24,  // NRC (requestSequenceError)
+  };
+  assert_response_array(0, sequence_error);
+
+  uint8_t unsupported_window[] = {
+    0x86,        // SID  (ResponseOnEvent)
+    0x03,        // SF   (onChangeOfDataIdentifier)
+    0x09,        // EWT  (not supported)
+    0x01, 0x20,  // DID
+    0x22,        // STRT (ReadDataByIdentifier)
+    0x01, 0x20,  // DID
+  };
+  roe_request_array(instance, unsupported_window);
+
+  uint8_t out_of_range[] = {
+    0x03,  // PCI (single frame, 3 bytes of data)
+    0x7F,  // negative response
+    0x86,  // SID (ResponseOnEvent)
+    0x31,  // NRC (requestOutOfRange)
+  };
+  assert_response_array(1, out_of_range);
+
+  uint8_t unknown_data_id[] = {
+    0x86,        // SID  (ResponseOnEvent)
+    0x03,        // SF   (onChangeOfDataIdentifier)
+    0x02,        // EWT  (infiniteTimeToResponse)
+    0xFE, 0xFE,  // DID  (not registered)
+    0x22,        // STRT (ReadDataByIdentifier)
+    0xFE, 0xFE,  // DID
+  };
+  roe_request_array(instance, unknown_data_id);
+  assert_response_array(2, out_of_range);
+
+  uint8_t unsupported_event[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x02,  // SF  (onTimerInterrupt)
+    0x02,  // EWT (infiniteTimeToResponse)
+  };
+  roe_request_array(instance, unsupported_event);
+
+  uint8_t sub_function_not_supported[] = {
+    0x03,  // PCI (single frame, 3 bytes of data)
+    0x7F,  // negative response
+    0x86,  // SID (ResponseOnEvent)
+    0x12,  // NRC (subFunctionNotSupported)
+  };
+  assert_response_array(3, sub_function_not_supported);
+
+  uint8_t too_short[] = {
+    0x86,  // SID (ResponseOnEvent)
+    0x03,  // SF  (onChangeOfDataIdentifier)
+    0x02,  // EWT (infiniteTimeToResponse)
+    0x01,  // DID (incomplete)
+  };
+  roe_request_array(instance, too_short);
+
+  uint8_t incorrect_length[] = {
+    0x03,  // PCI (single frame, 3 bytes of data)
+    0x7F,  // negative response
+    0x86,  // SID (ResponseOnEvent)
+    0x13,  // NRC (incorrectMessageLengthOrInvalidFormat)
+  };
+  assert_response_array(4, incorrect_length);
+}
+
+#endif  // CONFIG_UDS_RESPONSE_ON_EVENT
@@ -0,0 +1,215 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fixture.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#ifdef CONFIG_UDS_DATA_IDENTIFIER_CACHE
+
+#define CACHED_DATA_ID 0x0100
+#define REFRESHED_DATA_ID 0x0101
+
+#define CACHE_MAX_AGE_MS 20
+#define CACHE_REFRESH_MS 10
+
+extern struct uds_instance_t fixture_uds_instance;
+
+static uint8_t cached_value;
+static uint32_t cached_reads;
+static uint32_t cached_writes;
+
+static UDSErr_t cached_check(const struct uds_context *const context,
+                             bool *apply_action) {
+  *apply_action = true;
+  return UDS_OK;
+}
+
+static UDSErr_t cached_read(struct uds_context *const context,
+                            bool *consume_event) {
+  UDSRDBIArgs_t *args = context->arg;
+
+  cached_reads++;
+  *consume_event = true;
+  return args->copy(context->server, &cached_value, sizeof(cached_value));
+}
+
+static UDSErr_t cached_write(struct uds_context *const context,
+                             bool *consume_event) {
+  UDSWDBIArgs_t *args = context->arg;
+
+  cached_writes++;
+  cached_value = args->data[0];
+  *consume_event = true;
+  return UDS_OK;
+}
+
+UDS_DATA_IDENTIFIER_CACHE_DEFINE(cached_data_id_cache,
+                                 sizeof(cached_value),
+                                 CACHE_MAX_AGE_MS,
+                                 0)
+
+UDS_REGISTER_CACHED_DATA_BY_IDENTIFIER_HANDLER(&fixture_uds_instance,
+                                               CACHED_DATA_ID,
+                                               NULL,
+                                               &cached_data_id_cache,
+                                               // read
+                                               cached_check,
+                                               cached_read,
+                                               // write
+                                               cached_check,
+                                               cached_write,
+                                               // io control
+                                               NULL,
+                                               NULL,
+                                               NULL)
+
+UDS_DATA_IDENTIFIER_CACHE_DEFINE(refreshed_data_id_cache,
+                                 sizeof(cached_value),
+                                 0,
+                                 CACHE_REFRESH_MS)
+
+UDS_REGISTER_CACHED_DATA_BY_IDENTIFIER_HANDLER(&fixture_uds_instance,
+                                               REFRESHED_DATA_ID,
+                                               NULL,
+                                               &refreshed_data_id_cache,
+                                               // read
+                                               cached_check,
+                                               cached_read,
+                                               // write
+                                               NULL,
+                                               NULL,
+                                               // io control
+                                               NULL,
+                                               NULL,
+                                               NULL)
+
+static void reset_cache_test(void) {
+  cached_value = 0x42;
+  cached_reads = 0;
+  cached_writes = 0;
+
+  uds_data_identifier_cache_invalidate(&cached_data_id_cache);
+  uds_data_identifier_cache_invalidate(&refreshed_data_id_cache);
+}
+
+static UDSErr_t read_data_id(struct uds_instance_t *instance,
+                             uint16_t data_id) {
+  UDSRDBIArgs_t arg = {
+    .dataId = data_id,
+    .copy = copy,
+  };
+
+  return receive_event(instance, UDS_EVT_ReadDataByIdent, &arg);
+}
+
+ZTEST_F(lib_uds, test_data_identifier_cache_serves_cached_bytes) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  reset_cache_test();
+
+  zassert_ok(read_data_id(instance, CACHED_DATA_ID));
+  zassert_equal(cached_reads, 1);
+
+  // The source changes, but the cached value is served
+  cached_value = 0x43;
+  zassert_ok(read_data_id(instance, CACHED_DATA_ID));
+  zassert_equal(cached_reads, 1);
+
+  uint8_t expected[] = {0x42, 0x42};
+  assert_copy_data(expected, sizeof(expected));
+}
+
+ZTEST_F(lib_uds, test_data_identifier_cache_expires) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  reset_cache_test();
+
+  zassert_ok(read_data_id(instance, CACHED_DATA_ID));
+  cached_value = 0x43;
+
+  k_msleep(CACHE_MAX_AGE_MS + 1);
+
+  zassert_ok(read_data_id(instance, CACHED_DATA_ID));
+  zassert_equal(cached_reads, 2);
+
+  uint8_t expected[] = {0x42, 0x43};
+  assert_copy_data(expected, sizeof(expected));
+}
+
+ZTEST_F(lib_uds, test_data_identifier_cache_invalidated_by_write) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  reset_cache_test();
+
+  zassert_ok(read_data_id(instance, CACHED_DATA_ID));
+
+  uint8_t data[] = {0x44};
+  UDSWDBIArgs_t arg = {
+    .dataId = CACHED_DATA_ID,
+    .data = data,
+    .len = sizeof(data),
+  };
+  zassert_ok(receive_event(instance, UDS_EVT_WriteDataByIdent, &arg));
+  zassert_equal(cached_writes, 1);
+
+  zassert_ok(read_data_id(instance, CACHED_DATA_ID));
+  zassert_equal(cached_reads, 2);
+
+  uint8_t expected[] = {0x42, 0x44};
+  assert_copy_data(expected, sizeof(expected));
+}
+
+ZTEST_F(lib_uds, test_data_identifier_cache_refreshes_while_read) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  reset_cache_test();
+
+  // The first read fills the cache and starts the background refresh
+  zassert_ok(read_data_id(instance, REFRESHED_DATA_ID));
+  zassert_equal(cached_reads, 1);
+
+  cached_value = 0x43;
+  k_msleep(CACHE_REFRESH_MS + CACHE_REFRESH_MS / 2);
+  zassert_equal(cached_reads, 2, "Cache was not refreshed");
+
+  // Served from the refreshed cache
+  zassert_ok(read_data_id(instance, REFRESHED_DATA_ID));
+  zassert_equal(cached_reads, 2);
+
+  uint8_t expected[] = {0x42, 0x43};
+  assert_copy_data(expected, sizeof(expected));
+
+  // Refreshing stops once the data identifier is not read anymore
+  k_msleep(4 * CACHE_REFRESH_MS);
+  zassert_equal(cached_reads, 3);
+}
+
+ZTEST_F(lib_uds, test_data_identifier_cache_refresh_waits_for_server) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  reset_cache_test();
+
+  zassert_ok(read_data_id(instance, REFRESHED_DATA_ID));
+  zassert_equal(cached_reads, 1);
+
+  // No read action runs while the server handles an event
+  k_mutex_lock(&instance->iso14229.event_callback_mutex, K_FOREVER);
+  k_msleep(CACHE_REFRESH_MS + CACHE_REFRESH_MS / 2);
+  zassert_equal(cached_reads, 1, "Cache refreshed while the server was busy");
+  k_mutex_unlock(&instance->iso14229.event_callback_mutex);
+
+  // The refresh was deferred by one period
+  k_msleep(CACHE_REFRESH_MS);
+  zassert_equal(cached_reads, 2, "Deferred refresh did not run");
+
+  k_msleep(2 * CACHE_REFRESH_MS);
+  zassert_equal(cached_reads, 2);
+}
+
+#endif  // CONFIG_UDS_DATA_IDENTIFIER_CACHE
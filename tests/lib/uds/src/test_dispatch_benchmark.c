@@ -0,0 +1,161 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "fixture.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+/*
+ * Benchmark for the dispatch cost of an event depending on the position of
+ * the matching registration. BENCHMARK_DATA_IDS additional data identifiers
+ * are registered, the dispatch cost must not grow with the position. The
+ * lib.uds.benchmark_small scenario runs it with fewer registrations.
+ *
+ * The cycle counter of native_sim does not advance while the CPU is busy, so
+ * the timing is only checked on real hardware. On every platform exactly one
+ * registration is checked and applied per dispatch.
+ */
+
+// Registered in blocks of 10 data identifiers, set by CMakeLists.txt
+#ifndef BENCHMARK_DATA_ID_BLOCKS
+#define BENCHMARK_DATA_ID_BLOCKS 10
+#endif
+
+BUILD_ASSERT(BENCHMARK_DATA_ID_BLOCKS >= 1 && BENCHMARK_DATA_ID_BLOCKS <= 10);
+
+#define BENCHMARK_DATA_IDS (10 * BENCHMARK_DATA_ID_BLOCKS)
+#define BENCHMARK_BATCHES 5
+#define BENCHMARK_ITERATIONS 200
+
+// Data identifier of the registration with the given index
+#define BENCHMARK_DATA_ID_AT(i) \
+  (0xB000 | (((i) / 10) << 8) | (((i) % 10) << 4))
+
+extern struct uds_instance_t fixture_uds_instance;
+
+static uint32_t benchmark_checks;
+static uint32_t benchmark_reads;
+static uint16_t benchmark_last_data_id;
+
+static UDSErr_t benchmark_read_check(const struct uds_context *const context,
+                                     bool *apply_action) {
+  benchmark_checks++;
+  *apply_action = true;
+  return UDS_OK;
+}
+
+static UDSErr_t benchmark_read(struct uds_context *const context,
+                               bool *consume_event) {
+  benchmark_reads++;
+  benchmark_last_data_id = context->registration->data_identifier.data_id;
+  *consume_event = true;
+  return UDS_OK;
+}
+
+#define BENCHMARK_REGISTER_DATA_ID(b, a)                                    \
+  UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(                                  \
+      &fixture_uds_instance, BENCHMARK_DATA_ID_AT(10 * (a) + (b)), NULL,    \
+      benchmark_read_check, benchmark_read, NULL, NULL, NULL, NULL, NULL)
+
+#define BENCHMARK_REGISTER_DATA_IDS(a, _)                                   \
+  FOR_EACH_FIXED_ARG(BENCHMARK_REGISTER_DATA_ID, (), a, 0, 1, 2, 3, 4, 5, \
+                     6, 7, 8, 9)
+
+// Registers the data identifiers 0xB000, 0xB010, ... up to 0xB990
+LISTIFY(BENCHMARK_DATA_ID_BLOCKS, BENCHMARK_REGISTER_DATA_IDS, ())
+
+static const uint16_t benchmark_probes[] = {
+  BENCHMARK_DATA_ID_AT(0),
+  BENCHMARK_DATA_ID_AT(BENCHMARK_DATA_IDS / 4),
+  BENCHMARK_DATA_ID_AT(BENCHMARK_DATA_IDS / 2),
+  BENCHMARK_DATA_ID_AT(3 * BENCHMARK_DATA_IDS / 4),
+  BENCHMARK_DATA_ID_AT(BENCHMARK_DATA_IDS - 1),
+};
+
+// Fastest batch in nanoseconds per dispatch
+static uint32_t benchmark_dispatch(struct uds_instance_t *instance,
+                                   uint16_t data_id,
+                                   UDSErr_t expected) {
+  uint32_t best_cycles = UINT32_MAX;
+
+  UDSRDBIArgs_t arg = {
+    .dataId = data_id,
+    .copy = copy,
+  };
+
+  for (int batch = 0; batch < BENCHMARK_BATCHES; batch++) {
+    uint32_t start = k_cycle_get_32();
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+      zassert_equal(receive_event(instance, UDS_EVT_ReadDataByIdent, &arg),
+                    expected);
+    }
+    best_cycles = MIN(best_cycles, k_cycle_get_32() - start);
+  }
+
+  return (uint32_t)(k_cyc_to_ns_floor64(best_cycles) / BENCHMARK_ITERATIONS);
+}
+
+ZTEST_F(lib_uds, test_dispatch_benchmark) {
+  struct uds_instance_t *instance = fixture->instance;
+  uint32_t probe_ns[ARRAY_SIZE(benchmark_probes)];
+
+  benchmark_checks = 0;
+  benchmark_reads = 0;
+
+  for (int i = 0; i < ARRAY_SIZE(benchmark_probes); i++) {
+    probe_ns[i] =
+        benchmark_dispatch(instance, benchmark_probes[i], UDS_PositiveResponse);
+    zassert_equal(benchmark_last_data_id, benchmark_probes[i]);
+
+    TC_PRINT("read of data identifier 0x%04X: %u ns per dispatch\n",
+             benchmark_probes[i], probe_ns[i]);
+  }
+
+  // Only the matching registration was checked and applied, none of the
+  // other benchmark registrations and none of the fixture
+  const uint32_t dispatches =
+      ARRAY_SIZE(benchmark_probes) * BENCHMARK_BATCHES * BENCHMARK_ITERATIONS;
+  zassert_equal(benchmark_checks, dispatches);
+  zassert_equal(benchmark_reads, dispatches);
+  zassert_equal(data_id_check_fn_fake.call_count, 0);
+
+  uint32_t unknown_ns =
+      benchmark_dispatch(instance, 0xBFFF, UDS_NRC_RequestOutOfRange);
+  TC_PRINT("read of unknown data identifier: %u ns per dispatch\n",
+           unknown_ns);
+
+  // No registration is checked for an unknown data identifier
+  zassert_equal(benchmark_checks, dispatches);
+
+  TC_PRINT("%d additional registrations, %zu bytes per registration\n",
+           BENCHMARK_DATA_IDS, sizeof(struct uds_registration_t));
+
+  if (!IS_ENABLED(CONFIG_ARCH_POSIX)) {
+    // The last registration is found as fast as the first one
+    zassert_true(probe_ns[ARRAY_SIZE(probe_ns) - 1] <= 2 * probe_ns[0] + 1000,
+                 "Dispatch cost grows with the number of registrations");
+  }
+}
+
+// Registered with expressions, in no particular order in ROM, and looked up
+// through the index sorted by uds_init()
+ZTEST_F(lib_uds, test_data_identifier_expressions) {
+  struct uds_instance_t *instance = fixture->instance;
+
+  for (int i = BENCHMARK_DATA_IDS - 1; i >= 0; i--) {
+    UDSRDBIArgs_t arg = {
+      .dataId = BENCHMARK_DATA_ID_AT(i),
+      .copy = copy,
+    };
+
+    zassert_equal(receive_event(instance, UDS_EVT_ReadDataByIdent, &arg),
+                  UDS_PositiveResponse);
+    zassert_equal(benchmark_last_data_id, BENCHMARK_DATA_ID_AT(i));
+  }
+}
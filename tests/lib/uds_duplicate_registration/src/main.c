@@ -0,0 +1,128 @@
+/*
+ * SPDX-FileCopyrightText: Copyright (C) Frickly Systems GmbH
+ * SPDX-FileCopyrightText: Copyright (C) MBition GmbH
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <zephyr/device.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <ardep/uds.h>
+
+#define DATA_ID_BASE 0x0100
+
+static struct uds_instance_t uds_instance;
+static struct uds_instance_t other_uds_instance;
+
+static const UDSISOTpCConfig_t cfg = {
+  // Hardware Addresses
+  .source_addr = 0x7E8,  // Can ID Server (us)
+  .target_addr = 0x7E0,  // Can ID Client (them)
+
+  // Functional Addresses
+  .source_addr_func = 0x7DF,             // ID Server (us)
+  .target_addr_func = UDS_TP_NOOP_ADDR,  // ID Client (them)
+};
+
+enum registration {
+  REG_INSTANCE,
+  REG_OTHER_INSTANCE,
+  REG_DUPLICATE_PASSES_ON,
+  REG_DUPLICATE,
+  REG_LOWERCASE,
+};
+
+// Registrations whose read action ran, in the order they ran
+static enum registration reads[4];
+static size_t read_count;
+
+static UDSErr_t read_check(const struct uds_context *const context,
+                           bool *apply_action) {
+  *apply_action = true;
+  return UDS_OK;
+}
+
+static UDSErr_t read(struct uds_context *const context, bool *consume_event) {
+  const enum registration reg =
+      POINTER_TO_UINT(context->registration->data_identifier.user_context);
+
+  zassert_true(read_count < ARRAY_SIZE(reads));
+  reads[read_count++] = reg;
+
+  // One of the duplicated registrations passes the event on
+  *consume_event = reg != REG_DUPLICATE_PASSES_ON;
+  return UDS_PositiveResponse;
+}
+
+#define REGISTER_DATA_ID(_instance, _data_id, _reg)                       \
+  UDS_REGISTER_DATA_BY_IDENTIFIER_HANDLER(_instance, _data_id, NULL,      \
+                                          read_check, read, NULL, NULL,   \
+                                          NULL, NULL, UINT_TO_POINTER(_reg))
+
+// The same identifier for different instances
+REGISTER_DATA_ID(&uds_instance, 0x0001, REG_INSTANCE)
+REGISTER_DATA_ID(&other_uds_instance, 0x0001, REG_OTHER_INSTANCE)
+
+// Registered twice for the same instance, once as an expression
+REGISTER_DATA_ID(&uds_instance, 0x0102, REG_DUPLICATE_PASSES_ON)
+REGISTER_DATA_ID(&uds_instance, (DATA_ID_BASE + 2), REG_DUPLICATE)
+
+// Spelled differently than the identifier that is read
+REGISTER_DATA_ID(&uds_instance, 0xf1a0, REG_LOWERCASE)
+
+static uint8_t copy(UDSServer_t *server, const void *data, uint16_t len) {
+  return UDS_PositiveResponse;
+}
+
+static UDSErr_t read_data_id(struct uds_instance_t *instance,
+                             uint16_t data_id) {
+  UDSRDBIArgs_t args = {
+    .dataId = data_id,
+    .copy = copy,
+  };
+
+  read_count = 0;
+  return instance->iso14229.event_callback(
+      &instance->iso14229, UDS_EVT_ReadDataByIdent, &args, instance);
+}
+
+static void *setup(void) {
+  const struct device *can_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_canbus));
+
+  zassert_ok(uds_init(&uds_instance, &cfg, can_dev, NULL));
+  zassert_ok(uds_init(&other_uds_instance, &cfg, can_dev, NULL));
+
+  return NULL;
+}
+
+ZTEST(lib_uds_duplicate_registration, test_same_data_id_per_instance) {
+  zassert_equal(read_data_id(&uds_instance, 0x0001), UDS_PositiveResponse);
+  zassert_equal(read_count, 1);
+  zassert_equal(reads[0], REG_INSTANCE);
+
+  zassert_equal(read_data_id(&other_uds_instance, 0x0001),
+                UDS_PositiveResponse);
+  zassert_equal(read_count, 1);
+  zassert_equal(reads[0], REG_OTHER_INSTANCE);
+}
+
+ZTEST(lib_uds_duplicate_registration, test_duplicate_data_id_in_turn) {
+  zassert_equal(read_data_id(&uds_instance, 0x0102), UDS_PositiveResponse);
+  zassert_true(read_count >= 1 && read_count <= 2);
+  zassert_equal(reads[read_count - 1], REG_DUPLICATE);
+
+  // Not registered for the other instance
+  zassert_equal(read_data_id(&other_uds_instance, 0x0102),
+                UDS_NRC_RequestOutOfRange);
+  zassert_equal(read_count, 0);
+}
+
+ZTEST(lib_uds_duplicate_registration, test_lowercase_data_id) {
+  zassert_equal(read_data_id(&uds_instance, 0xF1A0), UDS_PositiveResponse);
+  zassert_equal(read_count, 1);
+  zassert_equal(reads[0], REG_LOWERCASE);
+}
+
+ZTEST_SUITE(lib_uds_duplicate_registration, NULL, setup, NULL, NULL, NULL);